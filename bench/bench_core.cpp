@@ -0,0 +1,393 @@
+// micro-benchmarks of the core library, prints json to stdout
+
+#include <parser.hpp>
+#include <program.hpp>
+#include <mesh.hpp>
+#include <domain.hpp>
+#include <implicit.hpp>
+#include <contour.hpp>
+#include <normal_packing.hpp>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef PLOTTER3D_BUILD_TYPE
+#define PLOTTER3D_BUILD_TYPE ""
+#endif
+
+// ------------------------------------------------------------
+// harness
+// ------------------------------------------------------------
+
+// every benchmark runs its body at least once and then repeats it
+// until `min_time` seconds have passed. the reported cost is the
+// fastest run divided by the number of points the body processes,
+// which is the least noisy figure on a shared machine.
+
+struct result {
+  std::string name;
+  long long points;
+  int iterations;
+  double ns_per_point;
+  double points_per_second;
+};
+
+static double min_time = 0.5;
+static std::vector<result> results;
+static const char* filter = nullptr;
+
+// keeps the compiler from removing work whose result is not used
+static volatile double sink;
+
+static void run(const std::string& name, long long points, const std::function<void()>& body) {
+  if (filter && name.find(filter) == std::string::npos)
+    return;
+
+  using clock = std::chrono::steady_clock;
+  double best = INFINITY, total = 0.0;
+  int iterations = 0;
+  while (iterations == 0 || total < min_time) {
+    auto begin = clock::now();
+    body();
+    double elapsed = std::chrono::duration<double>(clock::now() - begin).count();
+    best = std::min(best, elapsed);
+    total += elapsed;
+    iterations++;
+  }
+
+  result r;
+  r.name = name;
+  r.points = points;
+  r.iterations = iterations;
+  r.ns_per_point = best * 1e9 / points;
+  r.points_per_second = points / best;
+  results.push_back(r);
+  std::fprintf(stderr, "%-40s %10.2f ns/point %14.0f points/s\n", name.c_str(), r.ns_per_point, r.points_per_second);
+}
+
+static void print_json(FILE* out) {
+  char date[32];
+  std::time_t now = std::time(nullptr);
+  std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", std::localtime(&now));
+
+  std::fprintf(out, "{\n");
+  std::fprintf(out, "  \"context\": {\n");
+  std::fprintf(out, "    \"date\": \"%s\",\n", date);
+  std::fprintf(out, "    \"threads\": %u,\n", std::thread::hardware_concurrency());
+  std::fprintf(out, "    \"build_type\": \"%s\",\n", PLOTTER3D_BUILD_TYPE);
+  std::fprintf(out, "    \"min_time\": %g\n", min_time);
+  std::fprintf(out, "  },\n");
+  std::fprintf(out, "  \"benchmarks\": [\n");
+  for (size_t i = 0; i < results.size(); i++) {
+    const result& r = results[i];
+    std::fprintf(out, "    {\"name\": \"%s\", \"points\": %lld, \"iterations\": %d, "
+		 "\"ns_per_point\": %.4f, \"points_per_second\": %.1f}%s\n",
+		 r.name.c_str(), r.points, r.iterations, r.ns_per_point, r.points_per_second,
+		 i + 1 < results.size() ? "," : "");
+  }
+  std::fprintf(out, "  ]\n");
+  std::fprintf(out, "}\n");
+}
+
+// ------------------------------------------------------------
+// corpus
+// ------------------------------------------------------------
+
+// representative functions, from a single operation to the longer
+// expressions typed in the gui. the names are used in the json.
+
+struct expression {
+  const char* name;
+  const char* text;
+};
+
+static const expression corpus[] = {
+  {"plane",    "x+y"},
+  {"paraboloid", "x^2+y^2"},
+  {"ripple",   "sin(sqrt(x^2+y^2))"},
+  {"saddle",   "x*y/(1+x^2+y^2)"},
+  {"gaussian", "exp(-(x^2+y^2)/4)*cos(x)*cos(y)"},
+  {"mixed",    "sin(x)*cos(y)+ln(1+x^2)-arctan(y/2)+sqrt(4+x*y)"},
+};
+
+// parametric surfaces, compiled into one program with three results
+static const expression parametric_corpus[] = {
+  {"sphere",   "cos(u)*sin(v/2), sin(u)*sin(v/2), cos(v/2)"},
+  {"torus",    "(2+cos(v))*cos(u), (2+cos(v))*sin(u), sin(v)"},
+};
+
+// implicit surfaces F(x, y, z) = 0 over the cube of the grid
+static const expression implicit_corpus[] = {
+  {"sphere",   "x^2+y^2+z^2-16"},
+  {"gyroid",   "sin(x)*cos(y)+sin(y)*cos(z)+sin(z)*cos(x)"},
+};
+
+// ------------------------------------------------------------
+// benchmarks
+// ------------------------------------------------------------
+
+static void bench_parser(const expression& e) {
+
+  // the interpreter parses the string again for every point. it is
+  // slow enough that a fixed 128^2 sample gives a stable figure.
+
+  const int n = 128;
+  std::string text = e.text;
+  run(std::string("parser/eval_expr/") + e.name, (long long)n * n, [&]() {
+    parser p;
+    double sum = 0.0;
+    for (int i = 0; i < n; i++)
+      for (int j = 0; j < n; j++) {
+	p.set_xy(-5.0 + i * 10.0 / n, -5.0 + j * 10.0 / n);
+	sum += p.eval_expr(text.data());
+      }
+    sink = sum;
+  });
+}
+
+static void bench_program(const expression& e) {
+
+  // the compiled program, one point at a time and in batches
+
+  const int n = 512;
+  program prog;
+  parser().compile(e.text, prog);
+
+  run(std::string("program/eval/") + e.name, (long long)n * n, [&]() {
+    double sum = 0.0;
+    for (int i = 0; i < n; i++)
+      for (int j = 0; j < n; j++)
+	sum += prog.eval(-5.0 + i * 10.0 / n, -5.0 + j * 10.0 / n);
+    sink = sum;
+  });
+
+  std::vector<double> xs(n), ys(n), zs(n);
+  for (int j = 0; j < n; j++)
+    ys[j] = -5.0 + j * 10.0 / n;
+  run(std::string("program/eval_batch/") + e.name, (long long)n * n, [&]() {
+    double sum = 0.0;
+    for (int i = 0; i < n; i++) {
+      std::fill(xs.begin(), xs.end(), -5.0 + i * 10.0 / n);
+      prog.eval_batch(xs.data(), ys.data(), 0.0, zs.data(), n);
+      sum += zs[0];
+    }
+    sink = sum;
+  });
+}
+
+static void bench_grid(const expression& e, int n, bool normals) {
+
+  // the full pipeline used by the gui: every thread, every vertex
+
+  program prog;
+  parser().compile(e.text, prog);
+
+  grid g;
+  g.size = 10.0f;
+  g.vertices_per_axis = n;
+  g.normals = normals;
+  std::vector<float> vertices((size_t)n * n * floats_per_vertex);
+
+  std::string name = std::string(normals ? "grid_normals/" : "grid/") + e.name + "/" + std::to_string(n);
+  run(name, (long long)n * n, [&]() {
+    height_range range = evaluate_grid(prog, g, vertices);
+    sink = range.max;
+  });
+}
+
+static void bench_implicit(const expression& e, int n) {
+
+  // sampling, triangulation and normals of an n^3 lattice. the
+  // points are the samples, not the vertices of the mesh.
+
+  program prog;
+  parser().compile(e.text, prog);
+
+  grid g;
+  g.size = 10.0f;
+  g.vertices_per_axis = n;
+  g.normals = true;
+  std::vector<float> vertices;
+  std::vector<unsigned int> indices;
+
+  run("implicit/" + std::string(e.name) + "/" + std::to_string(n), (long long)n * n * n, [&]() {
+    height_range range = extract_implicit(prog, g, vertices, indices);
+    sink = range.max;
+  });
+}
+
+static void bench_contours(const expression& e, int n, int levels) {
+
+  // segments and polylines of `levels` contours over an evaluated grid
+
+  program prog;
+  parser().compile(e.text, prog);
+
+  grid g;
+  g.size = 20.0f;
+  g.vertices_per_axis = n;
+  std::vector<float> vertices((size_t)n * n * floats_per_vertex);
+  height_range range = evaluate_grid(prog, g, vertices);
+  std::vector<float> heights = contour_levels(range.min, range.max, levels);
+  contour_lines lines;
+
+  std::string name = "contours/" + std::string(e.name) + "/" + std::to_string(levels) + "/" + std::to_string(n);
+  run(name, (long long)n * n, [&]() {
+    extract_contours(vertices.data(), n, n, heights, lines);
+    sink = lines.indices.size();
+  });
+}
+
+static void bench_compact(const char* name, const char* text, int n) {
+
+  // the triangles kept around the poles and holes of a grid
+
+  program prog;
+  parser().compile(text, prog);
+
+  grid g;
+  g.size = 20.0f;
+  g.vertices_per_axis = n;
+  std::vector<float> vertices((size_t)n * n * floats_per_vertex);
+  evaluate_grid(prog, g, vertices);
+  std::vector<unsigned int> indices;
+
+  run("compact/" + std::string(name) + "/" + std::to_string(n), (long long)n * n, [&]() {
+    grid_compact_indices(prog, g, vertices.data(), indices);
+    sink = indices.size();
+  });
+}
+
+static void bench_domain(const char* name, const char* text, int n) {
+
+  // evaluation and compaction of a grid over a domain, against the
+  // n^2 points of the whole grid
+
+  program prog;
+  parser().compile(corpus[2].text, prog);
+  domain region;
+  std::string error;
+  parse_domain(text, region, error);
+
+  grid g;
+  g.size = 10.0f;
+  g.vertices_per_axis = n;
+  if (!region.empty())
+    g.region = &region;
+  std::vector<float> vertices((size_t)g.rows() * g.columns() * floats_per_vertex);
+  std::vector<unsigned int> indices;
+
+  run("domain/" + std::string(name) + "/" + std::to_string(n), (long long)n * n, [&]() {
+    height_range range = evaluate_grid(prog, g, vertices);
+    grid_compact_indices(prog, g, vertices.data(), indices);
+    sink = range.max + indices.size();
+  });
+}
+
+static void bench_indices(int n) {
+  run("grid_indices/" + std::to_string(n), (long long)n * n, [&]() {
+    std::vector<unsigned int> ind = grid_indices(n);
+    sink = ind.back();
+  });
+}
+
+static void bench_packing(int n) {
+
+  // writing the color and the packed normal of every vertex
+
+  std::vector<float> vertices((size_t)n * n * floats_per_vertex);
+  const float rgb[3] = {1.0f, 0.5f, 0.25f};
+  run("fill_colors/" + std::to_string(n), (long long)n * n, [&]() {
+    grid_fill_colors(vertices, rgb);
+    sink = vertices[3];
+  });
+
+  std::vector<float> dzdx(n), dzdy(n);
+  for (int i = 0; i < n; i++) {
+    dzdx[i] = std::cos(i * 0.01f);
+    dzdy[i] = std::sin(i * 0.01f);
+  }
+  run("pack_normal/" + std::to_string(n), (long long)n * n, [&]() {
+    for (int i = 0; i < n; i++)
+      for (int j = 0; j < n; j++) {
+	uint32_t normal = pack_normal(-dzdx[i], 1.0f, -dzdy[j]);
+	std::memcpy(&vertices[((size_t)i * n + j) * floats_per_vertex + 6], &normal, sizeof(normal));
+      }
+    sink = vertices[6];
+  });
+}
+
+int main(int argc, char** argv) {
+
+  std::vector<int> sizes = {64, 512, 2048};
+  const char* output = nullptr;
+
+  for (int i = 1; i < argc; i++) {
+    if (std::strcmp(argv[i], "--min-time") == 0 && i + 1 < argc)
+      min_time = std::atof(argv[++i]);
+    else if (std::strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+      filter = argv[++i];
+    else if (std::strcmp(argv[i], "--out") == 0 && i + 1 < argc)
+      output = argv[++i];
+    else if (std::strcmp(argv[i], "--sizes") == 0 && i + 1 < argc) {
+      sizes.clear();
+      for (char* s = std::strtok(argv[++i], ","); s; s = std::strtok(nullptr, ","))
+	sizes.push_back(std::max(2, std::atoi(s)));
+    } else {
+      std::fprintf(stderr, "usage: %s [--min-time seconds] [--filter substring] [--sizes 64,512,2048] [--out file.json]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  for (const expression& e : corpus)
+    bench_parser(e);
+  for (const expression& e : corpus)
+    bench_program(e);
+  for (int n : sizes)
+    for (const expression& e : corpus)
+      bench_grid(e, n, false);
+  for (int n : sizes)
+    bench_grid(corpus[2], n, true);
+  for (int n : sizes)
+    for (const expression& e : parametric_corpus) {
+      bench_grid(e, n, false);
+      bench_grid(e, n, true);
+    }
+  // the lattice is cubic, the grid sizes would not fit in memory
+  for (int n : {64, 256})
+    for (const expression& e : implicit_corpus)
+      bench_implicit(e, n);
+  for (int n : sizes)
+    for (int levels : {10, 50})
+      bench_contours(corpus[2], n, levels);
+  for (int n : sizes) {
+    bench_compact("clean", corpus[2].text, n);
+    bench_compact("pole", "1/x", n);
+    bench_compact("hole", "sqrt(16-x^2-y^2)", n);
+  }
+  for (int n : sizes) {
+    bench_domain("square", "", n);
+    bench_domain("strip", "0 < y < 1", n);
+    bench_domain("disc", "x^2 + y^2 < 4", n);
+  }
+  for (int n : sizes)
+    bench_indices(n);
+  for (int n : sizes)
+    bench_packing(n);
+
+  FILE* out = output ? std::fopen(output, "w") : stdout;
+  if (!out) {
+    std::fprintf(stderr, "cannot write %s\n", output);
+    return 1;
+  }
+  print_json(out);
+  if (out != stdout)
+    std::fclose(out);
+  return 0;
+}
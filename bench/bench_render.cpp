@@ -0,0 +1,505 @@
+// offscreen rendering benchmark, prints json to stdout
+//
+// draws a scene of surfaces with SceneRenderer, the same draw path as
+// CanvasGL::render, into a framebuffer object of a surfaceless egl
+// context. works with software rasterizers (llvmpipe) and without a
+// display.
+//
+// --tiles draws a tile pyramid (see plotter3d-cli --tiles) instead of
+// the functions, loading its tiles while the camera moves. --points
+// draws a point cloud the same way, see point_cloud.hpp. --implicit
+// draws implicit surfaces, extracted again every frame when animated.
+// --contours n draws n contour levels over the surfaces, --contour-map
+// draws them alone from above. --singular draws functions with poles
+// and holes, whose triangles are compacted every evaluation. --domain
+// restricts the functions to a rectangle and a mask, see domain.hpp.
+// --trace saves the evaluate, upload and draw stages of every frame
+// for chrome://tracing or Perfetto, see trace.hpp.
+
+#include <glad/glad.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <scene_renderer.hpp>
+#include <parser.hpp>
+#include <mesh.hpp>
+#include <implicit.hpp>
+#include <contour.hpp>
+#include <tiled_surface.hpp>
+#include <point_layer.hpp>
+#include <trace.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+// ------------------------------------------------------------
+// context
+// ------------------------------------------------------------
+
+// prefers the mesa surfaceless platform, then the default display.
+// no surface is created in either case, the frames are drawn into a
+// framebuffer object.
+
+static bool create_context() {
+  EGLDisplay display = EGL_NO_DISPLAY;
+
+  auto get_platform_display = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+  if (get_platform_display)
+    display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+  EGLint major, minor;
+  if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)) {
+    display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)) {
+      std::fprintf(stderr, "cannot initialize egl\n");
+      return false;
+    }
+  }
+
+  if (!eglBindAPI(EGL_OPENGL_API)) {
+    std::fprintf(stderr, "egl has no desktop opengl\n");
+    return false;
+  }
+
+  const EGLint attributes[] = {
+    EGL_CONTEXT_MAJOR_VERSION, 3,
+    EGL_CONTEXT_MINOR_VERSION, 3,
+    EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+    EGL_NONE
+  };
+  EGLContext context = eglCreateContext(display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, attributes);
+  if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+    std::fprintf(stderr, "cannot create a surfaceless opengl 3.3 context (0x%x)\n", eglGetError());
+    return false;
+  }
+
+  if (!gladLoadGLLoader((GLADloadproc)eglGetProcAddress)) {
+    std::fprintf(stderr, "Failed to initialize GLAD\n");
+    return false;
+  }
+  return true;
+}
+
+static void create_framebuffer(int width, int height) {
+  GLuint fbo, color, depth;
+  glGenFramebuffers(1, &fbo);
+  glGenRenderbuffers(1, &color);
+  glGenRenderbuffers(1, &depth);
+  glBindRenderbuffer(GL_RENDERBUFFER, color);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+  glBindRenderbuffer(GL_RENDERBUFFER, depth);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+  glViewport(0, 0, width, height);
+}
+
+// ------------------------------------------------------------
+// scene
+// ------------------------------------------------------------
+
+static const char* static_functions[] = {
+  "sin(sqrt(x^2+y^2))",
+  "x*y/(1+x^2+y^2)",
+  "exp(-(x^2+y^2)/4)*cos(x)*cos(y)",
+  "sin(x)*cos(y)+ln(1+x^2)-arctan(y/2)",
+};
+
+static const char* animated_functions[] = {
+  "sin(sqrt(x^2+y^2)-t)",
+  "sin(x+t)*cos(y-t)",
+  "exp(-(x^2+y^2)/4)*cos(x*t)",
+  "x*y/(1+x^2+y^2)*cos(t)",
+};
+
+// poles and undefined regions, see grid_compact_indices
+static const char* static_singular[] = {
+  "1/x",
+  "tan(x)*cos(y)",
+  "ln(x^2+y^2)",
+  "1/(x^2+y^2-4)",
+};
+
+static const char* animated_singular[] = {
+  "1/(x-t)",
+  "tan(x+t)*cos(y)",
+  "sqrt(x*sin(t)+y)",
+  "1/(x^2+y^2-4-2*sin(t))",
+};
+
+static const char* static_implicit[] = {
+  "x^2+y^2+z^2-16",
+  "sin(x)*cos(y)+sin(y)*cos(z)+sin(z)*cos(x)",
+};
+
+// the sphere changes its size, so its buffers have to grow
+static const char* animated_implicit[] = {
+  "x^2+y^2+z^2-9-6*sin(t)",
+  "sin(x+t)*cos(y)+sin(y)*cos(z)+sin(z)*cos(x)",
+};
+
+static double percentile(const std::vector<double>& sorted, double p) {
+  // nearest rank
+  size_t rank = (size_t)std::ceil(p / 100.0 * sorted.size());
+  return sorted[std::min(sorted.size() - 1, rank == 0 ? 0 : rank - 1)];
+}
+
+int main(int argc, char** argv) {
+
+  int surfaces = 4;
+  int width = 1280, height = 720;
+  int frames = 300, warmup = 10;
+  bool animate = false;
+  bool implicit = false;
+  bool singular = false;
+  const char* output = nullptr;
+  const char* tiles_path = nullptr;
+  const char* points_path = nullptr;
+  const char* trace_path = nullptr;
+  std::string domain_text;
+  domain region;
+
+  Properties props = {};
+  props.grid_size = 10;
+  props.divisions = 200;
+  props.perspective = true;
+  props.show_axes = true;
+  props.show_mesh = false;
+  props.lighting = false;
+  props.time = 0.0;
+
+  for (int i = 1; i < argc; i++) {
+    if (std::strcmp(argv[i], "--surfaces") == 0 && i + 1 < argc)
+      surfaces = std::max(1, std::atoi(argv[++i]));
+    else if (std::strcmp(argv[i], "--divisions") == 0 && i + 1 < argc)
+      props.divisions = std::max(1, std::atoi(argv[++i]));
+    else if (std::strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+      frames = std::max(1, std::atoi(argv[++i]));
+    else if (std::strcmp(argv[i], "--size") == 0 && i + 1 < argc)
+      std::sscanf(argv[++i], "%dx%d", &width, &height);
+    else if (std::strcmp(argv[i], "--animate") == 0)
+      animate = true;
+    else if (std::strcmp(argv[i], "--lighting") == 0)
+      props.lighting = true;
+    else if (std::strcmp(argv[i], "--mesh") == 0)
+      props.show_mesh = true;
+    else if (std::strcmp(argv[i], "--implicit") == 0)
+      implicit = true;
+    else if (std::strcmp(argv[i], "--singular") == 0)
+      singular = true;
+    else if (std::strcmp(argv[i], "--contours") == 0 && i + 1 < argc)
+      props.contours = std::max(0, std::atoi(argv[++i]));
+    else if (std::strcmp(argv[i], "--contour-map") == 0)
+      props.contour_map = true;
+    else if (std::strcmp(argv[i], "--domain") == 0 && i + 1 < argc) {
+      domain_text = argv[++i];
+      std::string error;
+      if (!parse_domain(domain_text, region, error) || !domain_fits(region, props.grid_size, error)) {
+	std::fprintf(stderr, "--domain: %s\n", error.c_str());
+	return 1;
+      }
+    } else if (std::strcmp(argv[i], "--out") == 0 && i + 1 < argc)
+      output = argv[++i];
+    else if (std::strcmp(argv[i], "--tiles") == 0 && i + 1 < argc)
+      tiles_path = argv[++i];
+    else if (std::strcmp(argv[i], "--points") == 0 && i + 1 < argc)
+      points_path = argv[++i];
+    else if (std::strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+      trace_path = argv[++i];
+      trace_record(true);
+    } else {
+      std::fprintf(stderr, "usage: %s [--surfaces n] [--divisions n] [--frames n] [--size WxH]"
+		   " [--animate] [--lighting] [--mesh] [--implicit] [--singular] [--contours n] [--contour-map]"
+		   " [--domain text]"
+		   " [--tiles file.p3dt] [--points file]"
+		   " [--out file.json] [--trace file.json]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  if (!create_context())
+    return 1;
+  create_framebuffer(width, height);
+
+  std::map<unsigned int, SurfaceData> surfaces_data;
+  SceneRenderer scene(props, surfaces_data);
+  scene.init();
+
+  // the surfaces are set up the way the gui does it, one vao and one
+  // stream buffer each, sharing the index buffers of the renderer
+
+  unsigned long long bytes_uploaded = 0;
+  int vertices_per_axis = props.divisions + 1;
+
+  grid g;
+  g.size = props.grid_size;
+  g.vertices_per_axis = vertices_per_axis;
+  g.normals = props.lighting;
+  // the grid of a surface, like WindowSurfaceConfig::surface_grid
+  auto surface_grid = [&](const SurfaceData& surface) {
+    grid sg = g;
+    if (!surface.implicit && !surface.prog.parametric() && !surface.region.empty())
+      sg.region = &surface.region;
+    return sg;
+  };
+
+  for (int i = 0; i < (tiles_path || points_path ? 0 : surfaces); i++) {
+    SurfaceData& surface = surfaces_data[i];
+    int n = sizeof(static_functions) / sizeof(*static_functions);
+    surface.function = animate ? animated_functions[i % n] : static_functions[i % n];
+    if (implicit) {
+      n = sizeof(static_implicit) / sizeof(*static_implicit);
+      surface.function = animate ? animated_implicit[i % n] : static_implicit[i % n];
+    }
+    if (singular) {
+      n = sizeof(static_singular) / sizeof(*static_singular);
+      surface.function = animate ? animated_singular[i % n] : static_singular[i % n];
+    }
+    parser().compile(surface.function.c_str(), surface.prog);
+    surface.animated = surface.prog.uses(OP_T);
+    surface.implicit = surface.prog.uses(OP_Z);
+    surface.domain_text = domain_text;
+    surface.region = region;
+    surface.show = true;
+    surface.rgb = {0.2f + 0.6f * (i % 2), 0.4f, 1.0f - 0.6f * (i % 2)};
+    surface.colormap = i % COLORMAP_COUNT;
+    surface.divisions = props.divisions;
+    surface.window_surface_config = nullptr;
+    surface.rows = surface_grid(surface).rows();
+    surface.columns = surface_grid(surface).columns();
+    surface.vertices.resize((size_t)surface.rows * surface.columns * floats_per_vertex);
+
+    glGenVertexArrays(1, &surface.vao);
+    scene.create_vertex_buffer(surface);
+    grid_fill_colors(surface.vertices, surface.rgb.data());
+  }
+  if (tiles_path) {
+    std::shared_ptr<tile_pyramid> pyramid = std::make_shared<tile_pyramid>();
+    std::string error;
+    if (!pyramid->open(tiles_path, error)) {
+      std::fprintf(stderr, "%s: %s\n", tiles_path, error.c_str());
+      return 1;
+    }
+    surfaces = 1;
+    SurfaceData& surface = surfaces_data[0];
+    surface.function = tiles_path;
+    surface.source = SOURCE_DATA;
+    surface.show = true;
+    surface.rgb = {0.2f, 0.4f, 1.0f};
+    surface.colormap = COLORMAP_VIRIDIS;
+    surface.z_min = pyramid->tiles.back().min;
+    surface.z_max = pyramid->tiles.back().max;
+    surface.window_surface_config = nullptr;
+    glGenVertexArrays(1, &surface.vao);
+    surface.tiles = std::make_shared<TiledSurface>(pyramid);
+    surface.tiles->create(props.grid_size, surface.rgb.data());
+  }
+  double build_ms = 0.0;
+  if (points_path) {
+    auto begin = std::chrono::steady_clock::now();
+    std::shared_ptr<point_cloud> cloud = std::make_shared<point_cloud>();
+    std::string error;
+    if (!point_cloud_open(points_path, *cloud, error)) {
+      std::fprintf(stderr, "%s: %s\n", points_path, error.c_str());
+      return 1;
+    }
+    build_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+    surfaces = 1;
+    SurfaceData& surface = surfaces_data[0];
+    surface.function = points_path;
+    surface.source = SOURCE_POINTS;
+    surface.show = true;
+    surface.rgb = {0.2f, 0.4f, 1.0f};
+    surface.colormap = COLORMAP_VIRIDIS;
+    surface.z_min = cloud->value_min;
+    surface.z_max = cloud->value_max;
+    surface.window_surface_config = nullptr;
+    glGenVertexArrays(1, &surface.vao);
+    surface.points = std::make_shared<PointLayer>(cloud);
+    surface.points->create();
+  }
+  scene.ebo_update();
+
+  auto evaluate = [&](SurfaceData& surface) {
+    if (surface.tiles || surface.points)
+      return;
+    g.t = props.time;
+    grid sg = surface_grid(surface);
+    height_range range;
+    if (surface.implicit) {
+      range = extract_implicit(surface.prog, g, surface.vertices, surface.indices);
+      grid_fill_colors(surface.vertices, surface.rgb.data());
+    } else {
+      range = evaluate_grid(surface.prog, sg, surface.vertices);
+      // like WindowSurfaceConfig::update_indices
+      bool compacted = surface.compacted;
+      surface.compacted = grid_compact_indices(surface.prog, sg, surface.vertices.data(), surface.indices);
+      if (compacted && !surface.compacted)
+	surface.ebo = scene.grid_ebo(surface.rows, surface.columns, surface.ind_size);
+    }
+    surface.z_min = range.min;
+    surface.z_max = range.max;
+    if (props.contours > 0 && !surface.implicit) {
+      extract_contours(surface.vertices.data(), surface.rows, surface.columns,
+		       contour_levels(range.min, range.max, props.contours), surface.contours);
+      surface.contours_changed = true;
+      bytes_uploaded += (surface.contours.positions.size() + surface.contours.indices.size()) * 4;
+    }
+    bytes_uploaded += scene.upload_vertices(surface);
+  };
+
+  for (auto& pair : surfaces_data)
+    evaluate(pair.second);
+  unsigned long long bytes_initial = bytes_uploaded;
+  bytes_uploaded = 0;
+
+  // ------------------------------------------------------------
+  // scripted orbit
+  // ------------------------------------------------------------
+
+  // one full turn around the origin over the measured frames, at the
+  // distance and elevation the canvas starts with plus a slow bob.
+  // animated surfaces are evaluated and uploaded every frame, like
+  // the timer of the gui does.
+
+  using clock = std::chrono::steady_clock;
+  std::vector<double> frame_ms;
+  frame_ms.reserve(frames);
+  unsigned long long draw_calls = 0, triangles = 0, tiles = 0, points = 0;
+  double gpu_ms = 0.0, pass_gpu_ms[PASS_COUNT] = {};
+  float radius = 5.0f;
+  float aspect = (float)width / (float)height;
+  glm::mat4 projection = glm::perspective(glm::radians(60.0f), aspect, 0.05f, 5000.0f);
+  if (props.contour_map)
+    projection = glm::ortho(-5.0f * aspect, 5.0f * aspect, -5.0f, 5.0f, 0.05f, 5000.0f);
+
+  for (int frame = -warmup; frame < frames; frame++) {
+    auto begin = clock::now();
+
+    float theta = glm::radians(-90.0f) + 2.0f * (float)M_PI * frame / frames;
+    float phi = glm::radians(30.0f) * std::sin(2.0f * (float)M_PI * frame / frames);
+    glm::vec3 camera_pos(radius * std::cos(phi) * std::cos(theta),
+			 radius * std::sin(phi),
+			 radius * std::cos(phi) * std::sin(theta));
+    glm::mat4 view = glm::lookAt(camera_pos, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    // the map from below, like CanvasGL::render
+    if (props.contour_map) {
+      camera_pos = glm::vec3(0.0f, -2500.0f, 0.0f);
+      view = glm::lookAt(camera_pos, glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+    }
+
+    if (animate) {
+      props.time += 1.0 / 60.0;
+      for (auto& pair : surfaces_data)
+	if (pair.second.animated)
+	  evaluate(pair.second);
+    }
+
+    scene.draw(view, projection, camera_pos);
+    // wait for the gpu, otherwise only the submission is measured
+    glFinish();
+
+    double elapsed = std::chrono::duration<double, std::milli>(clock::now() - begin).count();
+    if (frame < 0) {
+      bytes_uploaded = 0;
+      continue;
+    }
+    frame_ms.push_back(elapsed);
+    draw_calls += scene.stats.draw_calls;
+    triangles += scene.stats.triangles;
+    tiles += scene.stats.tiles;
+    points += scene.stats.points;
+    gpu_ms += scene.stats.gpu_ms;
+    for (int pass = 0; pass < PASS_COUNT; pass++)
+      pass_gpu_ms[pass] += scene.stats.pass_gpu_ms[pass];
+  }
+
+  GLenum error = glGetError();
+
+  // ------------------------------------------------------------
+  // report
+  // ------------------------------------------------------------
+
+  std::vector<double> sorted = frame_ms;
+  std::sort(sorted.begin(), sorted.end());
+  double total = 0.0;
+  for (double ms : frame_ms)
+    total += ms;
+
+  // the chunks outlive the slices of the surfaces now in height arrays
+  const VertexPool& pool = scene.vertex_pool();
+  bool persistent = !pool.chunks.empty() && pool.chunks.front().persistent;
+  scene.destroy();
+
+  FILE* out = output ? std::fopen(output, "w") : stdout;
+  if (!out) {
+    std::fprintf(stderr, "cannot write %s\n", output);
+    return 1;
+  }
+  std::fprintf(out, "{\n");
+  std::fprintf(out, "  \"context\": {\n");
+  std::fprintf(out, "    \"renderer\": \"%s\",\n", (const char*)glGetString(GL_RENDERER));
+  std::fprintf(out, "    \"version\": \"%s\",\n", (const char*)glGetString(GL_VERSION));
+  std::fprintf(out, "    \"persistent_mapping\": %s,\n", persistent ? "true" : "false");
+  std::fprintf(out, "    \"gl_error\": %u\n", error);
+  std::fprintf(out, "  },\n");
+  std::fprintf(out, "  \"scene\": {\n");
+  std::fprintf(out, "    \"surfaces\": %d,\n", surfaces);
+  std::fprintf(out, "    \"divisions\": %d,\n", (int)props.divisions);
+  std::fprintf(out, "    \"width\": %d,\n", width);
+  std::fprintf(out, "    \"height\": %d,\n", height);
+  std::fprintf(out, "    \"frames\": %d,\n", frames);
+  std::fprintf(out, "    \"animate\": %s,\n", animate ? "true" : "false");
+  std::fprintf(out, "    \"lighting\": %s,\n", props.lighting ? "true" : "false");
+  std::fprintf(out, "    \"mesh\": %s,\n", props.show_mesh ? "true" : "false");
+  std::fprintf(out, "    \"implicit\": %s,\n", implicit ? "true" : "false");
+  std::fprintf(out, "    \"singular\": %s,\n", singular ? "true" : "false");
+  std::fprintf(out, "    \"contours\": %d,\n", props.contours);
+  std::fprintf(out, "    \"contour_map\": %s,\n", props.contour_map ? "true" : "false");
+  std::fprintf(out, "    \"domain\": \"%s\",\n", domain_text.c_str());
+  std::fprintf(out, "    \"tiles\": %s,\n", tiles_path ? "true" : "false");
+  std::fprintf(out, "    \"points\": %s\n", points_path ? "true" : "false");
+  std::fprintf(out, "  },\n");
+  std::fprintf(out, "  \"frame_ms\": {\"mean\": %.4f, \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f},\n",
+	       total / frames, percentile(sorted, 50), percentile(sorted, 95), percentile(sorted, 99), sorted.back());
+  std::fprintf(out, "  \"gpu_ms_per_frame\": %.4f,\n", gpu_ms / frames);
+  std::fprintf(out, "  \"gpu_ms_per_pass\": {");
+  for (int pass = 0; pass < PASS_COUNT; pass++)
+    std::fprintf(out, "%s\"%s\": %.4f", pass ? ", " : "", render_pass_names[pass], pass_gpu_ms[pass] / frames);
+  std::fprintf(out, "},\n");
+  std::fprintf(out, "  \"draw_calls_per_frame\": %.2f,\n", (double)draw_calls / frames);
+  std::fprintf(out, "  \"triangles_per_frame\": %.0f,\n", (double)triangles / frames);
+  if (tiles_path) {
+    const TiledSurface& tiled = *surfaces_data.begin()->second.tiles;
+    std::fprintf(out, "  \"tiles_per_frame\": %.2f,\n", (double)tiles / frames);
+    std::fprintf(out, "  \"tiles_resident\": %d,\n", tiled.resident());
+  }
+  if (points_path) {
+    const point_cloud& cloud = surfaces_data.begin()->second.points->data();
+    std::fprintf(out, "  \"points_total\": %zu,\n", cloud.count);
+    std::fprintf(out, "  \"points_nodes\": %zu,\n", cloud.nodes.size());
+    std::fprintf(out, "  \"points_build_ms\": %.1f,\n", build_ms);
+    std::fprintf(out, "  \"points_per_frame\": %.0f,\n", (double)points / frames);
+  }
+  std::fprintf(out, "  \"bytes_uploaded_initial\": %llu,\n", bytes_initial);
+  std::fprintf(out, "  \"bytes_uploaded\": %llu,\n", bytes_uploaded);
+  std::fprintf(out, "  \"bytes_uploaded_per_frame\": %.0f\n", (double)bytes_uploaded / frames);
+  std::fprintf(out, "}\n");
+  if (out != stdout)
+    std::fclose(out);
+
+  std::string trace_error;
+  if (trace_path && !trace_write(trace_path, trace_error)) {
+    std::fprintf(stderr, "%s: %s\n", trace_path, trace_error.c_str());
+    return 1;
+  }
+
+  return error == GL_NO_ERROR ? 0 : 1;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+// ------------------------------------------------------------
+// animation clock
+// ------------------------------------------------------------
+
+struct Timeline {
+  bool playing = false;
+  double speed = 1.0;
+  void advance(double& time, double seconds) const;
+};
+
+// ------------------------------------------------------------
+// per frame re-evaluation budget
+// ------------------------------------------------------------
+
+// animated surfaces are evaluated again on every tick. when the time
+// spent doing so goes over `budget_ms`, the scheduler halves their
+// resolution. it only doubles it back when the measured cost says
+// the higher level would still fit, so it does not oscillate between
+// two levels.
+
+class AnimationScheduler {
+public:
+  double budget_ms = 8.0;
+  float divisions_min = 8.0f;
+  float divisions(float divisions_full) const;
+  void record(double elapsed_ms, float divisions_full);
+  void reset() { level = 0; }
+private:
+  int level = 0;
+};
+
+// ------------------------------------------------------------
+// frame pacing
+// ------------------------------------------------------------
+
+// what a requested frame brings up to date. a camera move only draws
+// again, a scene change first runs the work deferred to the frame
+// (see CanvasGL::defer).
+enum redraw_reasons {
+  REDRAW_CAMERA = 1,
+  REDRAW_SCENE = 2
+};
+
+// changes request a frame instead of drawing one. every request made
+// before the frame starts is folded into it, and frames start at
+// most once per `interval_ms`, the refresh period of the display, so
+// a mouse reporting at 1000 Hz costs no more frames than the screen
+// shows. the counts and frame times since the last report are kept
+// for the status bar.
+
+struct FrameReport {
+  int frames = 0;
+  int requests = 0; // folded into those frames
+  double frame_ms = 0.0; // mean time spent drawing a frame
+  double frame_ms_max = 0.0;
+  double fps = 0.0;
+};
+
+class FramePacer {
+public:
+  double interval_ms = 1000.0 / 60.0;
+  // true for the first request after a frame, the caller then
+  // schedules one `delay` milliseconds from now
+  bool request(int reasons);
+  double delay(double now_ms) const;
+  int pending() const { return reasons; } // the reasons requested so far
+  // starts a frame and returns the reasons folded into it
+  int begin(double now_ms);
+  void end(double now_ms);
+  FrameReport report(double now_ms);
+private:
+  int reasons = 0;
+  double frame_start = -1e9;
+  int frames = 0, requests = 0;
+  double frame_total = 0.0, frame_max = 0.0, report_start = 0.0;
+};
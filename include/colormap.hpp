@@ -0,0 +1,26 @@
+#pragma once
+
+#include <vector>
+
+
+enum colormaps {
+  COLORMAP_SOLID = 0, // the color of the surface, no lookup
+  COLORMAP_VIRIDIS,
+  COLORMAP_TURBO,
+  COLORMAP_DIVERGING,
+  COLORMAP_COUNT
+};
+
+extern const char* colormap_names[COLORMAP_COUNT];
+
+// ------------------------------------------------------------
+// lookup tables
+// ------------------------------------------------------------
+
+// the tables are uploaded once as 1d textures. the fragment shader
+// maps the height of every fragment from [z_min, z_max] to [0, 1] and
+// samples them, so changing the colormap or its range never touches
+// the vertex buffers.
+
+void colormap_sample(int colormap, float t, float rgb[3]);
+std::vector<unsigned char> colormap_table(int colormap, int size);
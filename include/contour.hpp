@@ -0,0 +1,40 @@
+#pragma once
+
+#include <mesh.hpp>
+#include <vector>
+
+// ------------------------------------------------------------
+// contour lines
+// ------------------------------------------------------------
+
+// the lines where the height of an evaluated grid (the second float
+// of every vertex, see mesh.hpp) crosses a set of levels.
+//
+// every quad of the grid is cut into the two triangles it is drawn
+// with, and each triangle the level crosses gets one segment between
+// two of its edges (marching squares on the triangles). the lines then
+// lie on the drawn surface, and a quad whose corners alternate around
+// the level is never ambiguous. the rows of the grid are split between
+// the hardware threads.
+//
+// segments are oriented with the higher side on the same hand, so the
+// segment leaving a triangle by an edge is followed by the one at the
+// same level in the triangle across it. they are chained into
+// polylines without searching, open ones ending at the border of the
+// grid or next to a vertex that is not finite, and closed loops.
+
+// index between two polylines, drawn with GL_PRIMITIVE_RESTART
+const unsigned int contour_restart = ~0u;
+
+struct contour_lines {
+  std::vector<float> positions; // xyz per vertex, scene coordinates
+  std::vector<unsigned int> indices; // line strips ended by contour_restart
+};
+
+// `count` levels spread evenly over the inside of [min, max]
+std::vector<float> contour_levels(float min, float max, int count);
+
+// `vertices` holds rows * columns vertices of floats_per_vertex
+// floats, see grid::rows. `levels` is sorted.
+void extract_contours(const float* vertices, int rows, int columns, const std::vector<float>& levels,
+		      contour_lines& lines);
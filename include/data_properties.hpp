@@ -6,5 +6,8 @@ struct Properties {
   bool perspective;
   bool show_axes;
   bool show_mesh;
-  // bool lighting;
+  bool lighting;
+  double time; // animation clock, the `t` variable
+  int contours = 0; // contour levels drawn over every surface, see contour.hpp
+  bool contour_map = false; // only the contours, seen from above
 };
@@ -1,19 +1,76 @@
 #pragma once
 
 #include <glad/glad.h>
+#include <stream_buffer.hpp>
+#include <height_array.hpp>
+#include <program.hpp>
+#include <mesh.hpp>
+#include <domain.hpp>
+#include <mapped_file.hpp>
+#include <height_field.hpp>
+#include <tiled_surface.hpp>
+#include <point_layer.hpp>
+#include <contour.hpp>
+#include <memory>
+#include <colormap.hpp>
 #include <string>
 #include <vector>
 
 class WindowSurfaceConfig;
 
+// what the heights of a surface come from
+enum surface_sources {
+  SOURCE_FUNCTION = 0, // `function`, compiled into `prog`
+  SOURCE_DATA,         // `data`, read from the file named by `function`
+  SOURCE_POINTS        // `points`, read from the file named by `function`
+};
+
 struct SurfaceData {
   std::string function;
+  int source = SOURCE_FUNCTION;
+  program prog; // compiled `function`
+  std::string domain_text; // empty for the whole grid
+  domain region; // parsed `domain_text`, see domain.hpp
+  std::shared_ptr<height_field> data; // SOURCE_DATA
+  std::shared_ptr<TiledSurface> tiles; // drawn instead of the grid for large data
+  std::shared_ptr<PointLayer> points; // SOURCE_POINTS, drawn instead of the grid
+  bool animated = false; // `function` depends on t
+  bool implicit = false; // `function` reads z, see implicit.hpp
   bool show;
   std::vector<float> vertices;
+  // right after opening a scene cache the vertices are still in the
+  // mapped file. they are copied into `vertices` before the first
+  // change, see WindowSurfaceConfig::unmap_vertices
+  std::shared_ptr<mapped_file> mapped;
+  const float* mapped_vertices = nullptr;
+  size_t mapped_count = 0;
   std::vector<float> rgb;
+  int colormap = COLORMAP_SOLID;
+  float z_min = 0, z_max = 0; // finite height range, updated by every evaluation
+  bool range_auto = true; // otherwise the colormap spans range_min to range_max
+  float range_min = 0, range_max = 1;
   GLuint vao;
-  GLuint vbo;
-  GLuint ebo; // shared between all surfaces
+  StreamBuffer vbo; // ring buffered, see stream_buffer.hpp
+  // a height field on the grid draws from a layer of a height array
+  // instead (see height_array.hpp), `extent` holds the x of its first
+  // and last row and the z of its first and last column
+  height_layer heights;
+  float extent[4] = {};
+  GLuint ebo; // shared between all surfaces, except implicit ones
   unsigned int ind_size;
+  // the triangles of an implicit surface, which change with every
+  // evaluation, and the ebo they are uploaded to. a grid with holes or
+  // poles (`compacted`, see grid_compact_indices) draws from them too.
+  std::vector<unsigned int> indices;
+  GLuint mesh_ebo = 0;
+  bool compacted = false;
+  // contour lines of the grid, extracted with every evaluation and
+  // uploaded with the vertices when `contours_changed`
+  contour_lines contours;
+  bool contours_changed = false;
+  GLuint contour_vao = 0, contour_vbo = 0, contour_ebo = 0;
+  unsigned int contour_size = 0; // indices in contour_ebo
+  float divisions = 0; // lower than props.divisions while animating over budget
+  int rows = 0, columns = 0; // vertices of the grid, see grid::rows
   WindowSurfaceConfig* window_surface_config; // reference to respective window surface config
 };
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <program.hpp>
+#include <cmath>
+#include <string>
+#include <vector>
+
+// ------------------------------------------------------------
+// domain of a height field
+// ------------------------------------------------------------
+
+// the part of the plane a function is drawn over, written as
+// comparisons separated by commas:
+//
+//   -1 < x < 3, 0 <= y <= 2, x^2 + y^2 < 4
+//
+// a comparison between x or y and a constant sets a side of the
+// rectangle the grid covers, a side left open stays at the edge of
+// the grid square. a side set alone is kept inside the square, so
+// `x > 7` over a square of 10 leaves nothing (see domain_fits). the
+// grid keeps its resolution along the longer
+// side of the rectangle and spaces the vertices along the shorter one
+// alike, see grid::rows.
+//
+// every other comparison is a mask: the function is only evaluated at
+// the vertices where all of them hold, the others get no height and
+// the triangles around them are left out like those over holes (see
+// grid_compact_indices). masks read x and y only.
+
+// `prog` is the right side minus the left side of a comparison, with
+// `<` and `<=` turned around where needed. it holds where that is
+// above 0, or where it is not below 0 when not `strict`.
+struct mask_term {
+  program prog;
+  bool strict = true;
+};
+
+struct domain {
+  float x_min = NAN, x_max = NAN; // nan: the edge of the grid square
+  float y_min = NAN, y_max = NAN;
+  std::vector<mask_term> mask;
+  bool empty() const {
+    return std::isnan(x_min) && std::isnan(x_max) && std::isnan(y_min) && std::isnan(y_max) && mask.empty();
+  }
+};
+
+// an empty text is the whole grid. returns false with a message in
+// `error` and leaves `d` empty when the text is not a domain.
+bool parse_domain(const std::string& text, domain& d, std::string& error);
+
+// false with a message in `error` when the rectangle of `d` over a
+// grid square of `size` is empty, see grid::x_begin
+bool domain_fits(const domain& d, float size, std::string& error);
+
+// inside[k] is 1 where the mask holds at (x[k], y[k])
+void domain_mask(const domain& d, const double* x, const double* y, int count, unsigned char* inside);
+
+// the same along a row of the grid, x being the same for every point
+// and y sorted. the row is cut into blocks, and a block the interval
+// bounds of a term (see interval.hpp) put wholly inside or outside is
+// not evaluated point by point, only those along the boundary are.
+void domain_mask_row(const domain& d, double x, const double* y, int count, unsigned char* inside);
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <program.hpp>
+#include <mesh.hpp>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+
+enum export_formats {
+  EXPORT_STL = 0, // binary
+  EXPORT_PLY,     // binary little endian
+  EXPORT_OBJ,     // ascii
+  EXPORT_RAW      // float32 heights row after row, x y z triples for parametric and implicit surfaces
+};
+
+// ------------------------------------------------------------
+// buffered writer
+// ------------------------------------------------------------
+
+// collects small writes into one large buffer. formatted numbers are
+// written with std::to_chars, without allocations or locale lookups.
+
+class buffered_writer {
+public:
+  explicit buffered_writer(size_t capacity = 1 << 20);
+  ~buffered_writer();
+  bool open(const char* path);
+  bool close();
+  void write(const void* data, size_t size);
+  void write(const char* text);
+  void write(float value);
+  void write(unsigned long long value);
+  void put(char c);
+  bool seek_write(long offset, const void* data, size_t size);
+  long tell();
+  unsigned long long written() const { return bytes; }
+  bool good() const { return file && ok; }
+private:
+  FILE* file = nullptr;
+  std::vector<char> buffer;
+  size_t used = 0;
+  unsigned long long bytes = 0;
+  bool ok = true;
+  void flush();
+};
+
+// ------------------------------------------------------------
+// mesh export
+// ------------------------------------------------------------
+
+// evaluates the grid one band of rows at a time and streams the
+// triangles of each band to the file, so the memory used does not
+// depend on the number of vertices. the mesh is written z up, the
+// value of the function being z. triangles with a vertex that is not
+// finite are left out; such vertices are written as 0 in the formats
+// that index vertices.
+//
+// an implicit surface is extracted whole (see implicit.hpp) and
+// written as an indexed mesh, raw being its vertices.
+
+struct export_stats {
+  unsigned long long vertices = 0;
+  unsigned long long triangles = 0;
+  unsigned long long bytes = 0;
+};
+
+extern const char* export_format_names[];
+
+int export_format_from_name(const std::string& name); // -1 if unknown
+int export_format_from_path(const std::string& path); // by extension, EXPORT_RAW if unknown
+bool export_grid(const program& prog, const grid& g, int format, const char* path,
+		 export_stats* stats = nullptr);
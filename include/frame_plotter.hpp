@@ -5,6 +5,8 @@
 #include <data_properties.hpp>
 #include <data_surfaces.hpp>
 #include <window_surface_config.hpp>
+#include <animation.hpp>
+#include <wx/timer.h>
 #include <string>
 #include <map>
 
@@ -48,6 +50,7 @@ public:
     /* ----------- create window ----------- */
     
     WindowSurfaceConfig* window_surface_config = new WindowSurfaceConfig(this, id_new, props, surfaces_data);
+    window_surface_config->set_canvas_gl(canvas_gl);
 
     /* ----------- init map entry ----------- */
 
@@ -56,31 +59,25 @@ public:
       .show = true,
       .rgb = {1.0f, 0.0f, 0.0f},
       .ind_size = 0,
+      .divisions = props.divisions,
       .window_surface_config = window_surface_config
     };
 
     surfaces_data[id_new] = surface_new;
 
     glGenVertexArrays(1, &surfaces_data[id_new].vao);
-    glGenBuffers(1, &surfaces_data[id_new].vbo);
 
     glBindVertexArray(surfaces_data[id_new].vao);
-    glBindBuffer(GL_ARRAY_BUFFER, surfaces_data[id_new].vbo);
     
     if (canvas_gl) {
-      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, canvas_gl->EBO);
-      surfaces_data[id_new].ind_size = canvas_gl->ind_size;
+      surfaces_data[id_new].ebo = canvas_gl->grid_ebo(props.divisions + 1, props.divisions + 1,
+						      surfaces_data[id_new].ind_size);
+      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, surfaces_data[id_new].ebo);
     }
-    
-    // set location and data format
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
 
     glBindVertexArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
 
+    // creates the vbo and sets the attribute format
     window_surface_config->update_buffer_size();
     window_surface_config->vector_update_colors();
     
@@ -114,18 +111,40 @@ class FramePlotter : public wxFrame {
   wxTextCtrl* textctrl_divisions;
   wxCheckBox* checkbox_axes;
   wxCheckBox* checkbox_mesh;
-  // wxCheckBox* checkbox_lighting;
+  wxCheckBox* checkbox_lighting;
   wxComboBox* combobox_projection;
+  wxTextCtrl* textctrl_contours;
+  wxButton* button_play;
+  wxTextCtrl* textctrl_speed;
+  wxStaticText* statictext_time;
+  Timeline timeline;
+  AnimationScheduler scheduler;
+  wxTimer timer;
+  wxStopWatch stopwatch;
+  long time_last = 0;
+  // the work the handlers leave to the next frame, see CanvasGL::defer
+  enum { DEFER_SURFACES, DEFER_CONTOURS };
+  void rebuild_surfaces();
+  void animate(float divisions);
 public:
   FramePlotter(wxFrame* parent);
   void on_gridsize(wxCommandEvent& event);
   void on_divisions(wxCommandEvent& event);
   void on_projection(wxCommandEvent& event);
+  void on_contours(wxCommandEvent& event);
   void on_axes(wxCommandEvent& event);
   void on_mesh(wxCommandEvent& event);
-  // void on_lighting(wxCommandEvent& event);
+  void on_lighting(wxCommandEvent& event);
+  void on_play(wxCommandEvent& event);
+  void on_speed(wxCommandEvent& event);
+  void on_timer(wxTimerEvent& event);
   void on_menu_exit(wxCommandEvent& event);
   void on_menu_surface(wxCommandEvent& event);
+  void on_menu_open(wxCommandEvent& event);
+  void on_menu_save(wxCommandEvent& event);
+  void on_menu_overlay(wxCommandEvent& event);
+  void on_menu_record(wxCommandEvent& event);
+  void on_menu_trace(wxCommandEvent& event);
   void help(WindowSurfaceConfig& window);
 
   friend class WindowSurfaceConfig;
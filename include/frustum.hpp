@@ -0,0 +1,37 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+// ------------------------------------------------------------
+// view frustum
+// ------------------------------------------------------------
+
+// the six planes of projection * view, pointing inwards. a box is
+// outside once it lies completely behind one of them, which keeps
+// some boxes near the corners that are outside too.
+
+struct frustum {
+  glm::vec4 planes[6];
+
+  void set(const glm::mat4& view_projection) {
+    glm::mat4 m = glm::transpose(view_projection);
+    planes[0] = m[3] + m[0];
+    planes[1] = m[3] - m[0];
+    planes[2] = m[3] + m[1];
+    planes[3] = m[3] - m[1];
+    planes[4] = m[3] + m[2];
+    planes[5] = m[3] - m[2];
+  }
+
+  bool intersects(const float box_min[3], const float box_max[3]) const {
+    for (const glm::vec4& plane : planes) {
+      // the corner furthest along the normal of the plane
+      glm::vec3 p(plane.x >= 0.0f ? box_max[0] : box_min[0],
+		  plane.y >= 0.0f ? box_max[1] : box_min[1],
+		  plane.z >= 0.0f ? box_max[2] : box_min[2]);
+      if (glm::dot(glm::vec3(plane), p) + plane.w < 0.0f)
+	return false;
+    }
+    return true;
+  }
+};
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <cstddef>
+#include <vector>
+
+// ------------------------------------------------------------
+// height arrays
+// ------------------------------------------------------------
+
+// the vertices of a height field over the grid differ from those of
+// any other of the same rows and columns only by their heights and
+// normals: x follows the row, z the column, and the color is that of
+// the surface. such a surface keeps a layer of a texture array of its
+// resolution instead of a slice of the VertexPool, two 32 bit texels
+// per vertex (the height and the packed normal, see
+// normal_packing.hpp) in place of seven floats.
+//
+// every surface of an array is then one instance of a single
+// glDrawElementsInstanced over the index buffer of the resolution.
+// the vertex shader rebuilds the vertex from gl_VertexID and the
+// layer, extent, colormap and color of the instance, which come from
+// per instance attributes of the vao of the array.
+//
+// an array doubles its layers when full, copying the ones in use,
+// up to GL_MAX_ARRAY_TEXTURE_LAYERS; another array of the same
+// resolution is created past that.
+
+struct height_layer {
+  int array = -1;
+  int layer = -1;
+};
+
+class HeightArrays {
+public:
+  // per instance: the x of the first and last row, the z of the first
+  // and last column, the colormap row (-1 for the color), the height
+  // range, the layer and the rgb color
+  static const int instance_floats = 11;
+
+  struct array {
+    int rows = 0, columns = 0;
+    GLuint texture = 0;
+    int capacity = 0; // layers
+    std::vector<char> used;
+    GLuint vao = 0, instances = 0;
+    std::vector<float> instance_data; // filled by the renderer every frame
+  };
+  std::vector<array> arrays;
+
+  // reads the limits of the context, once it is current
+  void init();
+  // false when a texture cannot hold rows by columns texels, the
+  // surface stays in the vertex pool then
+  bool fits(int rows, int columns);
+  height_layer allocate(int rows, int columns);
+  void release(const height_layer& layer);
+  // `vertices` is the grid of the array, rows by columns vertices of
+  // floats_per_vertex floats. returns the bytes uploaded.
+  size_t upload(const height_layer& layer, const float* vertices);
+  void destroy();
+private:
+  GLint max_size = 0; // GL_MAX_TEXTURE_SIZE
+  GLint max_layers = 0; // GL_MAX_ARRAY_TEXTURE_LAYERS
+  std::vector<unsigned int> texels;
+  void resize(array& a, int capacity);
+};
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <mapped_file.hpp>
+#include <mesh.hpp>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+// ------------------------------------------------------------
+// measured height data
+// ------------------------------------------------------------
+
+// a rows x cols matrix of heights read from a file:
+//
+//   .npy       float32 or float64, c order. used in place.
+//   .csv .txt  one row of the matrix per line, separated by commas,
+//              semicolons or blanks. parsed by every core into
+//              `storage`; values that are not numbers become nan.
+//   other      raw float32, square, or named like `name_<cols>x<rows>`.
+//              used in place.
+//
+// binary files stay in the mapping, only the pages that are sampled
+// are read, so a file of several gigabytes opens at once.
+
+enum height_field_types {
+  HEIGHT_FLOAT32 = 0,
+  HEIGHT_FLOAT64
+};
+
+struct height_field {
+  int rows = 0;
+  int cols = 0;
+  int type = HEIGHT_FLOAT32;
+  const unsigned char* values = nullptr; // first value of the first row
+  size_t row_stride = 0; // in bytes
+  std::shared_ptr<mapped_file> file;
+  std::vector<float> storage; // parsed csv
+  // set when the file opened but not quite as expected, such as csv
+  // rows of different lengths
+  std::string warning;
+
+  double value(size_t row, size_t col) const {
+    const unsigned char* p = values + row * row_stride;
+    if (type == HEIGHT_FLOAT64) {
+      double v;
+      std::memcpy(&v, p + col * sizeof(double), sizeof(v));
+      return v;
+    }
+    float v;
+    std::memcpy(&v, p + col * sizeof(float), sizeof(v));
+    return v;
+  }
+};
+
+bool height_field_open(const char* path, height_field& field, std::string& error);
+std::string file_extension(const std::string& path); // lower case, without the dot
+
+// fills xyz (and the normals when requested) of a grid from the
+// field. every vertex takes the nearest value, so a large field is
+// decimated with a constant stride and only the rows it needs are
+// touched. returns the range of the finite heights.
+
+height_range sample_height_field(const height_field& field, const grid& g, std::vector<float>& vertices);
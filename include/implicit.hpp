@@ -0,0 +1,40 @@
+#pragma once
+
+#include <program.hpp>
+#include <mesh.hpp>
+#include <vector>
+
+// ------------------------------------------------------------
+// implicit surfaces
+// ------------------------------------------------------------
+
+// the surface F(x, y, z) = 0 of a program that reads z, over the cube
+// [-size/2, size/2]^3 of the grid cut into vertices_per_axis - 1 cells
+// per axis.
+//
+// the lattice is cut into blocks of cells first, and blocks where the
+// interval bounds of F (see interval.hpp) leave out 0 are skipped:
+// most of the cube, for a closed surface. F is sampled at the corners
+// of the other blocks, a layer of corners per task. each cell is cut
+// into six tetrahedra along its main diagonal and every tetrahedron
+// that F changes sign in gets one or two triangles (marching
+// tetrahedra). the cut is the same in every cell, so neighbouring
+// cells meet without cracks and without the ambiguous cases of
+// marching cubes.
+//
+// vertices lie on the edges of the lattice. each is created once and
+// looked up by its edge in a table over two layers of corners, so the
+// mesh is indexed and shares every vertex between its triangles. the
+// cells are split into slabs of layers that are triangulated in
+// parallel, the vertices on the plane between two slabs are welded
+// afterwards.
+//
+// cells with a corner that is not finite, or across a pole where F
+// changes sign without a zero, are left empty like the triangles of a
+// grid. the normal is the gradient of F by central
+// differences at the vertex.
+
+// writes the vertex format of mesh.hpp without colors, and triangles
+// into `indices`. returns the range of z, the vertical axis.
+height_range extract_implicit(const program& prog, const grid& g, std::vector<float>& vertices,
+			      std::vector<unsigned int>& indices);
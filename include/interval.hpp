@@ -0,0 +1,35 @@
+#pragma once
+
+// ------------------------------------------------------------
+// interval arithmetic
+// ------------------------------------------------------------
+
+// [lo, hi] holds every value an expression takes while its variables
+// range over their intervals. both bounds are rounded outwards after
+// every operation, which covers the rounding of the operation itself
+// and the error of the math library.
+//
+// `singular` is set when an operation is undefined somewhere in its
+// arguments: a division by an interval that contains 0, the root or
+// logarithm of values below 0, arcsin and arccos outside [-1, 1] and
+// tan across a pole. the bounds then cover the defined part, and are
+// infinite when that part is unbounded or empty.
+
+struct interval {
+  double lo = 0.0;
+  double hi = 0.0;
+  bool singular = false;
+
+  interval() = default;
+  interval(double value) : lo(value), hi(value) { }
+  interval(double lo, double hi) : lo(lo), hi(hi) { }
+  bool contains(double value) const { return lo <= value && value <= hi; }
+  double width() const { return hi - lo; }
+};
+
+interval interval_entire(bool singular);
+interval interval_hull(const interval& a, const interval& b);
+
+// the interval of an operation of program.hpp, with the same
+// semantics as program::apply
+interval interval_apply(int op, const interval& a, const interval& b);
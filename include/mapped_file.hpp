@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// ------------------------------------------------------------
+// read only memory mapped file
+// ------------------------------------------------------------
+
+// the pages are read by the os when they are first touched, so
+// opening a file of any size costs about the same. the mapping stays
+// valid until close() or the destructor.
+
+class mapped_file {
+public:
+  mapped_file() = default;
+  mapped_file(const mapped_file&) = delete;
+  mapped_file& operator=(const mapped_file&) = delete;
+  ~mapped_file();
+  bool open(const char* path);
+  void close();
+  const unsigned char* data() const { return bytes; }
+  size_t size() const { return length; }
+  // tells the os the range will be read soon, or only once in order
+  void will_need(size_t offset, size_t size) const;
+  void sequential() const;
+private:
+  const unsigned char* bytes = nullptr;
+  size_t length = 0;
+#ifdef _WIN32
+  void* file = nullptr;
+  void* mapping = nullptr;
+#endif
+};
+
+// xxh64 of the bytes. every bit of the input reaches every bit of the
+// result, and it is fast enough to verify a mapped file at the speed
+// the pages are read.
+uint64_t checksum64(const void* data, size_t size);
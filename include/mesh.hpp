@@ -0,0 +1,139 @@
+#pragma once
+
+#include <program.hpp>
+#include <domain.hpp>
+#include <vector>
+
+// vertex format: xyz, rgb and the octahedral normal, whose two 16 bit
+// halves are stored in the bits of the seventh float
+const int floats_per_vertex = 7;
+
+// ------------------------------------------------------------
+// grid mesh
+// ------------------------------------------------------------
+
+// a square grid of vertices_per_axis^2 vertices centered on the
+// origin. x runs along the rows, y along the columns and the value of
+// the function is stored as the second coordinate, which is the
+// vertical axis of the scene.
+//
+// a height field can be drawn over a `region` instead (see
+// domain.hpp): a rectangle of rows() by columns() vertices, with no
+// height where its mask does not hold. parametric and implicit
+// surfaces and data always cover the square, their grids have no
+// region.
+
+// a parametric surface (see program::coordinates) is evaluated over
+// u and v in [0, parametric_range], u along the rows. its z is drawn
+// along the vertical axis like the value of a height field, and
+// `size` does not apply.
+
+const double parametric_range = 6.283185307179586; // 2 pi
+
+struct grid {
+  float size;
+  // the first and last vertex lie on the edges of the grid (or of the
+  // region), the spacing is size / (vertices_per_axis - 1). with a
+  // fractional number of divisions, such as 12.5 for a surface
+  // animated over budget, that is slightly finer than size /
+  // divisions, which would stop short of the far edge and shrink the
+  // surface with every resolution the scheduler picks.
+  int vertices_per_axis;
+  double t = 0.0; // value of the `t` variable
+  bool normals = false; // pack normals into the seventh float
+  const domain* region = nullptr;
+  // vertices along x and along y. the longer side of the region has
+  // vertices_per_axis of them, the other side as many as keep the
+  // spacing.
+  int rows() const;
+  int columns() const;
+  // coordinates of the first vertex and of the last one. a side of
+  // the region set alone stays inside the square, see domain_fits.
+  float x_begin() const;
+  float x_end() const;
+  float y_begin() const;
+  float y_end() const;
+  bool masked() const { return region && !region->mask.empty(); }
+};
+
+struct height_range {
+  float min = 0.0f;
+  float max = 0.0f;
+};
+
+std::vector<unsigned int> grid_indices(int vertices_per_axis);
+std::vector<unsigned int> grid_indices(int rows, int columns);
+void grid_fill_colors(std::vector<float>& vertices, const float rgb[3]);
+
+// evaluates `prog` for every vertex and writes xyz (and the normal
+// when requested) into `vertices`, which must already hold rows() *
+// columns() vertices. the registers in `stored` are also written to
+// `stores`, and OP_LOAD reads from `loads`. both hold one value per
+// vertex. returns the range of the finite heights, the z of a
+// parametric surface. vertices outside the mask of the region are
+// never evaluated, their height is nan.
+
+height_range evaluate_grid(const program& prog, const grid& g, std::vector<float>& vertices,
+			   const std::vector<int>& stored,
+			   std::vector<std::vector<double>>& stores,
+			   const std::vector<std::vector<double>>& loads);
+height_range evaluate_grid(const program& prog, const grid& g, std::vector<float>& vertices);
+
+// packs the normal of every vertex from `gradients` (dz/dx and dz/dy
+// per vertex), or from the neighbouring heights where a gradient is
+// not finite or there are none.
+
+void grid_normals(const grid& g, std::vector<float>& vertices, const float* gradients = nullptr);
+
+// heights only, for the rows [row_begin, row_end) of the grid.
+// `heights` holds (row_end - row_begin) * columns() values.
+// the batch tools evaluate large grids a band of rows at a time and
+// never hold all of them.
+
+void evaluate_heights(const program& prog, const grid& g, int row_begin, int row_end, float* heights);
+
+// x, y and z of the vertices of the rows [row_begin, row_end), z up,
+// for height fields and parametric surfaces alike. `positions` holds
+// three floats per vertex.
+
+void evaluate_positions(const program& prog, const grid& g, int row_begin, int row_end, float* positions);
+
+// bounds of the result of `prog` over the whole grid without sampling
+// it: the rectangle of a height field (its mask is left out), u and v
+// of a parametric surface, the cube of an implicit one (see
+// interval.hpp). a box whose bounds are singular is split in four
+// (eight in the cube), at most `depth` times, which tightens the
+// bounds and tells a real singularity from the overestimation of
+// interval arithmetic. the result is singular when some box still is
+// at the finest level.
+
+interval bound_grid(const program& prog, const grid& g, int depth = 8);
+
+// the triangles of grid_indices that are worth drawing: those with
+// three finite vertices and, for a height field, those that do not
+// cross a pole or a jump of the function. a triangle is checked for
+// one when its heights span more than jump_fraction of the spread of
+// the heights, and left out when the bounds of the function over its
+// quad are singular. steep but continuous triangles stay.
+//
+// returns false and leaves `indices` empty when every triangle is
+// kept, which one interval evaluation over the whole grid often
+// tells; the shared index buffer of the resolution is drawn then. the
+// holes of a masked grid are never told that way.
+
+const float jump_fraction = 1.0f / 16.0f;
+
+// jump_fraction of the spread of a sample of the heights of a grid,
+// taken between percentiles since the values next to a pole would
+// make the range itself useless. infinity without a finite height.
+// reorders `sample`.
+
+float grid_jump(std::vector<float>& sample);
+
+// whether the bounds of a height field over the quad between rows i
+// and i + 1 and columns j and j + 1 of the grid are singular
+
+bool grid_quad_singular(const program& prog, const grid& g, int i, int j);
+
+bool grid_compact_indices(const program& prog, const grid& g, const float* vertices,
+			  std::vector<unsigned int>& indices);
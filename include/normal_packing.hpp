@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+
+// ------------------------------------------------------------
+// octahedral normal encoding
+// ------------------------------------------------------------
+
+// a unit vector is projected onto the octahedron |x|+|y|+|z| = 1 and
+// the lower half is folded over the upper one, which leaves two
+// coordinates in [-1, 1]. they are stored as two normalized 16 bit
+// integers, read by the vertex shader as a GL_SHORT vec2.
+
+inline uint32_t pack_normal(float nx, float ny, float nz) {
+  float sum = std::fabs(nx) + std::fabs(ny) + std::fabs(nz);
+  // straight up, y is the vertical axis of the scene
+  if (sum == 0.0f || !std::isfinite(sum))
+    return 32767u << 16; // (0, 1, 0)
+  float u = nx / sum;
+  float v = ny / sum;
+  if (nz < 0.0f) {
+    float u_folded = (1.0f - std::fabs(v)) * (u >= 0.0f ? 1.0f : -1.0f);
+    float v_folded = (1.0f - std::fabs(u)) * (v >= 0.0f ? 1.0f : -1.0f);
+    u = u_folded;
+    v = v_folded;
+  }
+  int16_t pu = static_cast<int16_t>(std::lround(u * 32767.0f));
+  int16_t pv = static_cast<int16_t>(std::lround(v * 32767.0f));
+  return static_cast<uint16_t>(pu) | (static_cast<uint32_t>(static_cast<uint16_t>(pv)) << 16);
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <thread>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <algorithm>
+
+// ------------------------------------------------------------
+// thread pool
+// ------------------------------------------------------------
+
+// the worker threads of the process, one per hardware thread but the
+// calling one. started on first use and joined at exit, every
+// parallel loop hands its chunks to them instead of starting threads
+// of its own.
+
+class thread_pool {
+public:
+  static thread_pool& shared();
+  int threads() const { return (int)workers.size() + 1; }
+  // calls task(i) for every i in [0, count) and returns once all of
+  // them are done. the calling thread runs tasks of its own as well,
+  // so a task may call run() again.
+  void run(int count, const std::function<void(int)>& task);
+  ~thread_pool();
+private:
+  struct job {
+    const std::function<void(int)>* task;
+    int count;
+    int next = 0;
+    int done = 0;
+  };
+  std::vector<std::thread> workers;
+  std::deque<job*> jobs; // with tasks left to start
+  std::mutex mutex;
+  std::condition_variable wake, finished;
+  bool stopping = false;
+  thread_pool();
+  int claim(job& j);
+  void complete(job& j);
+  void work();
+};
+
+// ------------------------------------------------------------
+// parallel loop
+// ------------------------------------------------------------
+
+// splits [begin, end) into one contiguous chunk per hardware thread
+// and calls fn(chunk_begin, chunk_end) for each of them on the
+// thread_pool, the calling thread included. chunks are never smaller
+// than `min_chunk`, so short loops stay on the calling thread.
+
+template <typename F>
+void parallel_for(int begin, int end, F fn, int min_chunk = 1) {
+  int count = end - begin;
+  if (count <= 0)
+    return;
+
+  thread_pool& pool = thread_pool::shared();
+  int threads = std::min(pool.threads(), (count + min_chunk - 1) / min_chunk);
+  if (threads <= 1) {
+    fn(begin, end);
+    return;
+  }
+
+  int chunk = (count + threads - 1) / threads;
+  pool.run(threads, [&](int i) {
+    int chunk_begin = begin + i * chunk;
+    int chunk_end = std::min(end, chunk_begin + chunk);
+    if (chunk_begin < chunk_end)
+      fn(chunk_begin, chunk_end);
+  });
+}
+
+// ------------------------------------------------------------
+// parallel sort
+// ------------------------------------------------------------
+
+// sorts one chunk per hardware thread, then merges neighbouring
+// chunks in rounds, the merges of a round running in parallel.
+
+template <typename It, typename Compare>
+void parallel_sort(It first, It last, Compare comp) {
+  long long count = last - first;
+  int threads = std::max(1, (int)std::thread::hardware_concurrency());
+  if (threads == 1 || count < (1 << 16)) {
+    std::sort(first, last, comp);
+    return;
+  }
+
+  std::vector<It> bounds(threads + 1);
+  for (int i = 0; i <= threads; i++)
+    bounds[i] = first + count * i / threads;
+  parallel_for(0, threads, [&](int chunk_begin, int chunk_end) {
+    for (int i = chunk_begin; i < chunk_end; i++)
+      std::sort(bounds[i], bounds[i + 1], comp);
+  });
+
+  for (int width = 1; width < threads; width *= 2) {
+    int merges = (threads + 2 * width - 1) / (2 * width);
+    parallel_for(0, merges, [&](int merge_begin, int merge_end) {
+      for (int m = merge_begin; m < merge_end; m++) {
+	int low = m * 2 * width;
+	int middle = std::min(low + width, threads);
+	int high = std::min(low + 2 * width, threads);
+	if (middle < high)
+	  std::inplace_merge(bounds[low], bounds[middle], bounds[high], comp);
+      }
+    });
+  }
+}
@@ -4,6 +4,7 @@
 #include <cctype>
 #include <cstring>
 #include <iostream>
+#include <program.hpp>
 
 
 enum types {
@@ -18,11 +19,19 @@ class parser {
 public:
   parser();
   double eval_expr(char* exp);
+  bool compile(const char* exp, program& prog);
   void set_xy(double x_val, double y_val);
+  void set_z(double z_val);
+  void set_t(double t_val);
 private:
   double x;
   double y;
-  char* expr_ptr;
+  double z;
+  double t;
+  bool failed;
+  bool parametric; // compiling x, y, z over u and v
+  program* prog;
+  const char* expr_ptr;
   char token[100];
   char token_type;
   void eval_AS(double& result);
@@ -32,7 +41,16 @@ private:
   void eval_P(double& result);
   void eval_function(double& result, const char* token);
   void atom(double& result);
+  void compile_AS(int& reg);
+  void compile_MD(int& reg);
+  void compile_E(int& reg);
+  void compile_unary(int& reg);
+  void compile_P(int& reg);
+  void compile_atom(int& reg);
+  bool parameter_name(const char* name) const;
+  int function_opcode(const char* token);
   void get_token();
+  void copy_token(char*& temp);
   bool isdelim(char c);
   void serror(int error);
 };
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <height_field.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// ------------------------------------------------------------
+// point cloud
+// ------------------------------------------------------------
+
+// points read from a file with one point per row:
+//
+//   .csv .txt  x, y, z and an optional value, parsed like height data
+//   .npy       float32 or float64 array of shape (n, 3) or (n, 4)
+//   other      raw float32 x, y, z triples
+//
+// z is drawn along the vertical axis of the scene like the value of a
+// function. the value, or the height when there is none, selects the
+// color of the colormap.
+//
+// the points are sorted along a morton curve and cut into an octree.
+// every node keeps a sample of up to `node_samples` points spread over
+// its cube, the points its ancestors did not take, and a leaf keeps
+// all that are left. drawing a node together with all of its ancestors
+// shows the cloud at the density of the node, so a renderer refines
+// where the camera is close and stops at any node.
+//
+// the points of a node are stored together, nodes in breadth first
+// order, as four 16 bit integers: the position within the cube of the
+// node and the value within [value_min, value_max].
+
+struct point_node {
+  float min[3];       // corner of the cube, scene space
+  float size;         // edge of the cube
+  uint32_t first = 0; // of its points in point_cloud::points
+  uint32_t count = 0;
+  int depth = 0;
+  int children[8];    // -1 where there is none, always after the node
+};
+
+struct point_cloud {
+  static const int node_samples = 16384;
+  std::vector<point_node> nodes; // the root first
+  std::vector<uint16_t> points;  // 4 per point
+  size_t count = 0;              // finite points
+  float min[3] = {}, max[3] = {}; // scene bounds
+  float value_min = 0.0f, value_max = 0.0f;
+  bool has_values = false;       // otherwise the value is the height
+  // average distance between the points of a node and its ancestors
+  float spacing(const point_node& node) const { return node.size / 128.0f; }
+};
+
+bool point_cloud_open(const char* path, point_cloud& cloud, std::string& error);
+
+// builds the octree from a table of at least three columns, rows with
+// a coordinate that is not finite are left out
+bool point_cloud_build(const height_field& table, point_cloud& cloud, std::string& error);
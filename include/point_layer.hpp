@@ -0,0 +1,53 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <frustum.hpp>
+#include <point_cloud.hpp>
+#include <memory>
+#include <vector>
+
+// ------------------------------------------------------------
+// point cloud layer
+// ------------------------------------------------------------
+
+// draws a point cloud as point sprites, one vertex per point. the
+// points are uploaded a few million per frame, coarse nodes first, so
+// a large cloud shows up at once and fills in.
+//
+// every frame the octree is walked from the nodes closest to the
+// camera: nodes outside the frustum are skipped, and a node is
+// refined while the distance between its points covers more than
+// `point_size` pixels, until `point_budget` points are selected. each
+// node is one draw call with its cube as a uniform.
+
+class PointLayer {
+public:
+  float point_size = 2.0f;        // in pixels
+  size_t point_budget = 4000000;  // drawn per frame
+  size_t budget = 512 << 20;      // bytes of vertex buffer
+  size_t uploads_per_frame = 4000000; // points
+  explicit PointLayer(std::shared_ptr<const point_cloud> cloud);
+  void create();
+  void destroy();
+  void update(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& camera_pos,
+	      int viewport_height);
+  // draws the nodes of the last update, `location_node` is the vec4
+  // uniform taking the cube of each node
+  unsigned long long draw(GLint location_node, int& draw_calls) const;
+  bool pending() const { return uploaded_nodes < uploadable_nodes; }
+  int selected() const { return (int)selection.size(); }
+  const point_cloud& data() const { return *cloud; }
+private:
+  std::shared_ptr<const point_cloud> cloud;
+  GLuint vao = 0, vbo = 0;
+  size_t uploaded_nodes = 0;   // the first nodes, breadth first
+  size_t uploadable_nodes = 0; // the nodes that fit into `budget`
+  std::vector<int> selection;
+  frustum view_frustum;
+  float pixels_per_unit = 0.0f;
+  bool orthographic = false;
+  glm::vec3 camera;
+  bool visible(const point_node& node) const;
+  float distance(const point_node& node) const;
+};
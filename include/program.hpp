@@ -0,0 +1,111 @@
+#pragma once
+
+#include <interval.hpp>
+#include <vector>
+#include <map>
+#include <tuple>
+#include <string>
+#include <cstdint>
+
+
+enum opcodes {
+  OP_CONST = 0,
+  OP_X,     // x of a height field, u of a parametric surface
+  OP_Y,     // y of a height field, v of a parametric surface
+  OP_Z,     // z of an implicit surface
+  OP_T,
+  OP_PARAM, // `a` is the index into program::params
+  OP_LOAD,  // `a` is the index into the loads of eval_outputs
+  OP_ADD,
+  OP_SUB,
+  OP_MUL,
+  OP_DIV,
+  OP_POW,
+  OP_NEG,
+  OP_SIN,
+  OP_COS,
+  OP_TAN,
+  OP_ASIN,
+  OP_ACOS,
+  OP_ATAN,
+  OP_RAD,
+  OP_DEG,
+  OP_SQRT,
+  OP_EXP,
+  OP_LN,
+  OP_LOG10
+};
+
+
+// one instruction per register: instruction i writes register i and
+// reads the registers `a` and `b`, which always come before it.
+
+struct instruction {
+  int op;
+  int a;
+  int b;
+  double value;
+};
+
+
+// ------------------------------------------------------------
+// compiled expression
+// ------------------------------------------------------------
+
+// produced by parser::compile. equal subexpressions are emitted only
+// once and operations on constants are folded while compiling, so
+// evaluating the program costs one pass over `code` per point.
+//
+// named parameters are read from `param_values` while evaluating, so
+// changing one never requires compiling again.
+//
+// a parametric surface is one program with three results, the
+// registers of x, y and z in `coordinates`, so subexpressions shared
+// between them (cos(u) in a sphere) are computed once per point.
+// `result` is then z.
+//
+// a program that reads z is an implicit surface F(x, y, z) = 0, see
+// implicit.hpp.
+//
+// eval_gradient() evaluates the partial derivatives with respect to x
+// and y alongside the value (forward mode automatic differentiation),
+// the values through the same kernel as eval_outputs(). split()
+// prepares a residual program that recomputes only the part of the
+// expression that depends on one parameter. eval_interval() bounds `result` over
+// a box of x, y and z, see interval.hpp.
+
+class program {
+public:
+  static constexpr int batch_size = 64;
+  std::vector<instruction> code;
+  std::vector<std::string> params;
+  std::vector<double> param_values;
+  int result = -1;
+  std::vector<int> coordinates; // x, y, z of a parametric surface, otherwise empty
+  void clear();
+  bool valid() const { return result >= 0; }
+  bool parametric() const { return coordinates.size() == 3; }
+  bool uses(int op) const;
+  int emit(int op, int a = -1, int b = -1, double value = 0.0);
+  int param_index(const std::string& name);
+  double eval(double x, double y, double t = 0.0) const;
+  void eval_batch(const double* x, const double* y, double t, double* out, int n) const;
+  void eval_outputs(const double* x, const double* y, double t, int n,
+		    const std::vector<int>& outputs, double* const* out,
+		    const double* const* loads = nullptr, const double* z = nullptr) const;
+  void eval_gradient(const double* x, const double* y, double t, int n,
+		     double* out, double* dx, double* dy) const;
+  void eval_gradient(const double* x, const double* y, double t, int n,
+		     const std::vector<int>& outputs, double* const* out,
+		     double* const* dx, double* const* dy) const;
+  interval eval_interval(const interval& x, const interval& y, double t,
+			 const interval& z = interval()) const;
+  void split(int param, program& residual, std::vector<int>& cut) const;
+  static double apply(int op, double a, double b);
+  static void derivative(int op, double a, double b, double r, double& da, double& db);
+private:
+  void eval_instruction(size_t i, double* regs, int first, int m, const double* x, const double* y,
+			double t, const double* const* loads, const double* z) const;
+  // constants by their bits, so 0 and -0 stay apart
+  std::map<std::tuple<int, int, int, uint64_t>, int> emitted;
+};
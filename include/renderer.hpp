@@ -9,17 +9,19 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <data_properties.hpp>
+#include <animation.hpp>
 #include <wx/wx.h>
 #include <wx/glcanvas.h>
+#include <functional>
 #include <string>
 #include <map>
+#include <vector>
 #include <data_surfaces.hpp>
+#include <scene_renderer.hpp>
 #include <window_surface_config.hpp>
 
 class CanvasGL : public wxGLCanvas {
   wxGLContext* m_context;
-  GLuint shader_surface, shader_mesh;
-  GLuint VAO_AXIS, VBO_AXIS;
   GLuint test;
   float fov            = 60.0f;
   float near_plane     = 0.05;
@@ -37,13 +39,38 @@ class CanvasGL : public wxGLCanvas {
   int x_current, y_current, x_last, y_last;
   Properties& props;
   std::map<unsigned int, SurfaceData>& surfaces_data;
+  SceneRenderer scene; // shaders, buffers and draw passes
+  // frames are requested and paced, see FramePacer. the timer starts
+  // a frame that was requested too soon after the previous one.
+  FramePacer pacer;
+  wxTimer timer_frame;
+  double report_last = 0.0;
+  // the performance overlay, drawn from the last report
+  bool overlay = false;
+  bool overlay_stale = false;
+  FrameReport report_latest;
+  void update_overlay();
+  // work run at the start of the next frame, at most one per owner
+  // and tag
+  struct deferred_work {
+    const void* owner;
+    int tag;
+    std::function<void()> work;
+  };
+  std::vector<deferred_work> deferred;
+  void on_timer_frame(wxTimerEvent& event);
 public:
+  std::function<void(const FrameReport&)> report_frames; // twice a second while drawing
   CanvasGL(wxPanel* parent, int* args, Properties& properties, std::map<unsigned int, SurfaceData>& surfaces_data);
   virtual ~CanvasGL();
-  GLuint EBO;
-  unsigned int ind_size;
   void init_gl(void);
   void on_size(wxSizeEvent& event);
+  void request_frame(int reasons = REDRAW_SCENE);
+  void show_overlay(bool show);
+  // counters and gpu times of the passes of the last frame
+  const RenderStats& render_stats() const { return scene.stats; }
+  void defer(const void* owner, int tag, std::function<void()> work);
+  void cancel_deferred(const void* owner);
   void render(wxPaintEvent& event);
   void on_mouse_motion(wxMouseEvent& event);
   void on_mouse_left_down(wxMouseEvent& event);
@@ -51,4 +78,9 @@ public:
   void on_mouse_right_down(wxMouseEvent& event);
   void on_mouse_right_up(wxMouseEvent& event);
   void ebo_update();
+  GLuint grid_ebo(int rows, int columns, unsigned int& count);
+  // the buffers of the surfaces, see SceneRenderer
+  void create_vertex_buffer(SurfaceData& surface);
+  size_t upload_vertices(SurfaceData& surface);
+  void release_heights(SurfaceData& surface);
 };
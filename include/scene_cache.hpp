@@ -0,0 +1,55 @@
+#pragma once
+
+#include <data_properties.hpp>
+#include <mapped_file.hpp>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// ------------------------------------------------------------
+// scene cache file
+// ------------------------------------------------------------
+
+// a session on disk: the properties, the settings of every surface
+// and its evaluated vertices, so reopening it does not evaluate
+// anything.
+//
+//   header     magic, version, offset and checksum of the table
+//   table      properties and one entry per surface
+//   vertices   one block per surface, page aligned
+//
+// the file is read through a mapping. the vertex blocks are checked
+// against their checksums (checksum64) and then handed out as
+// pointers into the mapped pages, which can be uploaded to gl without
+// another copy. writing replaces the file as a whole, so the
+// vertices of a mapping of the file itself can be saved over it.
+// numbers are stored in the byte order of the machine, little endian
+// on every platform the plotter runs on.
+
+struct cached_surface {
+  std::string function; // or the path of the data file
+  int source = 0; // surface_sources
+  float rgb[3] = {1.0f, 0.0f, 0.0f};
+  bool show = true;
+  int colormap = 0;
+  bool range_auto = true;
+  float range_min = 0, range_max = 1;
+  float z_min = 0, z_max = 0;
+  std::vector<std::pair<std::string, double>> params;
+  std::string domain; // see domain.hpp
+  int rows = 0, columns = 0; // of the grid, see grid::rows
+  // floats_per_vertex floats per vertex. points into the mapping when
+  // read, null when the block is missing or its checksum is wrong
+  const float* vertices = nullptr;
+  size_t vertices_count = 0; // in floats
+};
+
+struct scene_cache {
+  Properties props = {};
+  std::vector<cached_surface> surfaces;
+  std::shared_ptr<mapped_file> file; // keeps the vertices valid
+};
+
+bool scene_cache_write(const char* path, const Properties& props, const std::vector<cached_surface>& surfaces);
+bool scene_cache_read(const char* path, scene_cache& cache);
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <data_properties.hpp>
+#include <data_surfaces.hpp>
+#include <colormap.hpp>
+#include <vertex_pool.hpp>
+#include <height_array.hpp>
+#include <map>
+#include <utility>
+#include <vector>
+
+// the passes of SceneRenderer::draw, in the order they draw. the fill
+// pass clears the frame and pages the tiles and points in as well.
+enum render_passes {
+  PASS_FILL,
+  PASS_MESH,
+  PASS_CONTOURS,
+  PASS_POINTS,
+  PASS_AXES,
+  PASS_COUNT
+};
+
+const char* const render_pass_names[PASS_COUNT] = {"fill", "mesh", "contours", "points", "axes"};
+
+// counters of the last call to SceneRenderer::draw
+struct RenderStats {
+  int draw_calls = 0;
+  unsigned long long triangles = 0;
+  int tiles = 0; // drawn by tiled surfaces
+  unsigned long long points = 0; // drawn by point layers
+  bool pending = false; // tiles or points are still loading, draw again soon
+  // gpu time of every pass and their sum, from the timer queries of
+  // the frame two frames back. 0 for a pass that did not draw then.
+  double pass_gpu_ms[PASS_COUNT] = {};
+  double gpu_ms = 0.0;
+};
+
+// ------------------------------------------------------------
+// scene renderer
+// ------------------------------------------------------------
+
+// the gl side of the plotter: shaders, axes, colormaps, index buffers
+// and the draw passes. it does not know about windows, the caller
+// makes a context current and passes the camera, so the same code
+// draws into the wx canvas and into offscreen benchmarks.
+
+class SceneRenderer {
+  GLuint shader_surface, shader_mesh, shader_points, shader_lines, shader_overlay;
+  GLuint shader_instanced, shader_instanced_mesh; // surfaces in height arrays
+  GLuint VAO_AXIS, VBO_AXIS;
+  GLuint VAO_OVERLAY, overlay_texture;
+  int overlay_width = 0, overlay_height = 0;
+  // a timer query per pass and frame, for two frames: one set is read
+  // while the other one times the frame being drawn
+  GLuint pass_queries[2][PASS_COUNT];
+  bool pass_issued[2][PASS_COUNT] = {};
+  int frame_query = 0;
+  double pass_gpu_ms[PASS_COUNT] = {};
+  void read_pass_queries();
+  void begin_pass(int pass);
+  void end_pass(int pass);
+  GLuint colormap_textures[COLORMAP_COUNT];
+  GLuint colormap_atlas; // a row per colormap, for the pooled surfaces
+  // the grid surfaces of a chunk of the vertex pool that share an
+  // index buffer, drawn by one glMultiDrawElementsBaseVertex. kept
+  // from frame to frame with their arrays, only the first
+  // batch_count are used.
+  struct draw_batch {
+    int chunk;
+    GLuint ebo;
+    std::vector<GLsizei> counts;
+    std::vector<const void*> offsets;
+    std::vector<GLint> base_vertices;
+  };
+  std::vector<draw_batch> batches;
+  size_t batch_count = 0;
+  void collect_batches();
+  void draw_batches(GLuint shader);
+  void draw_instances(GLuint shader);
+  Properties& props;
+  std::map<unsigned int, SurfaceData>& surfaces_data;
+  std::map<std::pair<int, int>, std::pair<GLuint, unsigned int>> ebo_levels; // keyed by rows and columns
+  GLuint EBO = 0;
+  unsigned int ind_size = 0;
+  // the vertices of every grid surface, see vertex_pool.hpp, and the
+  // height fields on the grid, see height_array.hpp
+  VertexPool pool;
+  HeightArrays heights;
+public:
+  SceneRenderer(Properties& props, std::map<unsigned int, SurfaceData>& surfaces_data);
+  RenderStats stats;
+  void init();
+  // the gl objects of the renderer, with the context it was
+  // initialized in current
+  void destroy();
+  void draw(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& camera_pos);
+  // an rgba image drawn over the plot, such as the performance overlay
+  // of the gui. rows from the top.
+  void set_overlay(const unsigned char* rgba, int width, int height);
+  void draw_overlay(int x, int y);
+  void ebo_update();
+  GLuint grid_ebo(int rows, int columns, unsigned int& count);
+  VertexPool& vertex_pool() { return pool; }
+  HeightArrays& height_arrays() { return heights; }
+  void create_vertex_buffer(SurfaceData& surface, size_t size = 0);
+  void upload_indices(SurfaceData& surface, size_t size);
+  static void upload_contours(SurfaceData& surface);
+  size_t upload_vertices(SurfaceData& surface);
+};
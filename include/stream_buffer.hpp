@@ -0,0 +1,43 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <vertex_pool.hpp>
+#include <cstddef>
+
+// ------------------------------------------------------------
+// ring buffered streaming vertex buffer
+// ------------------------------------------------------------
+
+// the buffer holds `regions` copies of the vertex data back to
+// back. each upload writes the region after the one being drawn, so
+// the gpu can keep reading the old data while the cpu writes the new
+// one. draws select the current region with a base vertex.
+//
+// the ring is a slice of a chunk of the VertexPool, base vertices
+// count from the start of the chunk. a fence guards every region.
+// with ARB_buffer_storage the chunk stays persistently mapped,
+// without it each region is mapped unsynchronized once its fence has
+// passed: the chunk is shared, so it cannot be orphaned.
+
+class StreamBuffer {
+public:
+  static const int regions = 3;
+  void create(VertexPool& pool, size_t region_size);
+  void destroy();
+  void* map_region();
+  void unmap_region();
+  void fence();
+  GLint base_vertex(size_t vertex_size) const;
+  GLuint buffer() const;
+  const pool_slice& slice() const { return pooled; }
+  size_t capacity() const { return region_size; }
+  bool is_persistent() const;
+private:
+  VertexPool* pool = nullptr;
+  pool_slice pooled;
+  size_t region_size = 0;
+  int region_current = 0;
+  int region_writing = -1;
+  GLsync fences[regions] = {};
+  void wait(int region);
+};
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <height_field.hpp>
+#include <mapped_file.hpp>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// ------------------------------------------------------------
+// tile pyramid
+// ------------------------------------------------------------
+
+// a height field cut into square tiles at every level of a mip chain
+// and stored in one file next to it. level 0 holds every value of the
+// field, every level above takes every second row and column of the
+// one below, up to a level that fits into a single tile.
+//
+// a tile holds (tile_size + 1)^2 heights: its last row and column are
+// the first ones of its neighbours, so tiles of one level meet without
+// cracks. tiles on the border of the field repeat the last row and
+// column. each tile starts on a page boundary and is read with one
+// copy out of the mapping.
+//
+// every tile records its height range and its geometric error, the
+// largest distance between the tile and the full resolution field. the
+// renderer turns it into an error in pixels to pick the level to draw.
+
+struct tile_id {
+  int level = 0;
+  int row = 0; // of the tile within its level
+  int col = 0;
+  uint64_t key() const { return ((uint64_t)level << 56) | ((uint64_t)row << 28) | (uint64_t)col; }
+};
+
+struct tile_info {
+  uint64_t offset = 0; // of the heights in the file
+  float min = 0.0f;    // finite height range, min > max if there is none
+  float max = 0.0f;
+  float error = 0.0f;  // geometric error, in height units
+};
+
+struct tile_level {
+  int rows = 0, cols = 0;           // samples
+  int tile_rows = 0, tile_cols = 0; // tiles
+  size_t first = 0;                 // of its tiles in tile_pyramid::tiles
+};
+
+class tile_pyramid {
+public:
+  int tile_size = 0; // quads along a tile
+  int rows = 0, cols = 0; // of the field
+  uint64_t stamp = 0; // of the source file, see tile_source_stamp
+  std::vector<tile_level> levels;
+  std::vector<tile_info> tiles;
+  bool open(const char* path, std::string& error);
+  int top() const { return (int)levels.size() - 1; }
+  bool exists(const tile_id& id) const;
+  const tile_info& info(const tile_id& id) const;
+  // row and column of the field under sample (i, j) of a tile
+  size_t field_row(const tile_id& id, int i) const;
+  size_t field_col(const tile_id& id, int j) const;
+  // copies the heights of a tile, (tile_size + 1)^2 values row after row
+  void read(const tile_id& id, float* heights) const;
+  // scene space box of a tile, for a field drawn over a square of `size`
+  void bounds(const tile_id& id, float size, float box_min[3], float box_max[3]) const;
+private:
+  mapped_file file;
+};
+
+void tile_pyramid_levels(int rows, int cols, int tile_size, std::vector<tile_level>& levels);
+
+// size and modification time of a file, stored in the pyramid to tell
+// whether it was built from the current version of the source
+uint64_t tile_source_stamp(const char* path);
+
+// writes the pyramid of `field` to `path`. the field is read once per
+// level, a band of tiles at a time, so it may be larger than memory.
+bool tile_pyramid_build(const height_field& field, const char* path, int tile_size,
+			uint64_t stamp, std::string& error);
+
+// fills the vertices of a tile in the vertex format of mesh.hpp, with
+// the same placement as sample_height_field and packed normals
+void tile_vertices(const tile_pyramid& pyramid, const tile_id& id, float size, const float rgb[3],
+		   std::vector<float>& vertices);
+
+// ------------------------------------------------------------
+// tile loader
+// ------------------------------------------------------------
+
+// reads tiles on its own thread, so the page faults of a cold file
+// never stall a frame. the renderer replaces the queue every frame with
+// the tiles it misses, most important first, and takes the finished
+// vertices whenever it is ready to upload them.
+
+struct loaded_tile {
+  tile_id id;
+  std::vector<float> vertices;
+};
+
+class tile_loader {
+public:
+  tile_loader(std::shared_ptr<const tile_pyramid> pyramid, float size, const float rgb[3]);
+  ~tile_loader();
+  tile_loader(const tile_loader&) = delete;
+  tile_loader& operator=(const tile_loader&) = delete;
+  void request(const std::vector<tile_id>& wanted);
+  bool pop(loaded_tile& tile);
+  bool idle() const; // nothing queued, loading or waiting to be taken
+private:
+  std::shared_ptr<const tile_pyramid> pyramid;
+  float size;
+  float rgb[3];
+  mutable std::mutex mutex;
+  std::condition_variable wake;
+  std::deque<tile_id> queue;
+  std::deque<loaded_tile> done;
+  bool loading = false;
+  uint64_t loading_key = 0;
+  bool quit = false;
+  std::thread thread;
+  void run();
+};
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <frustum.hpp>
+#include <tile_pyramid.hpp>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+// ------------------------------------------------------------
+// out of core surface
+// ------------------------------------------------------------
+
+// draws a tile pyramid with a fixed pool of tile slots in one vertex
+// buffer. every frame the quadtree of tiles is walked from the top:
+// tiles outside the frustum are skipped, a tile is split while its
+// geometric error covers more than `max_pixel_error` pixels and all
+// of its visible children are resident. tiles that are missing are
+// requested from the loader thread, the parent is drawn until they
+// arrive.
+//
+// slots are recycled in least recently used order, a slot drawn by
+// the current frame is never taken. uploads are limited per frame so a
+// burst of loads never makes one frame much longer than the others.
+
+class TiledSurface {
+public:
+  float max_pixel_error = 2.0f;
+  size_t budget = 256 << 20; // bytes of vertex buffer
+  int uploads_per_frame = 8;
+  explicit TiledSurface(std::shared_ptr<const tile_pyramid> pyramid);
+  void create(float size, const float rgb[3]);
+  void destroy();
+  // selects the tiles for this frame, takes finished loads and
+  // requests the missing tiles
+  void update(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& camera_pos,
+	      int viewport_height);
+  // draws the tiles of the last update, returns the triangles
+  unsigned long long draw(int& draw_calls) const;
+  bool pending() const; // loads are still coming in
+  float grid_size() const { return size; }
+  int resident() const { return (int)keys.size(); }
+  int selected() const { return (int)selection.size(); }
+private:
+  struct slot {
+    tile_id id;
+    bool used = false;
+    unsigned long frame = 0; // last frame it was drawn or walked through
+    std::list<int>::iterator position;
+  };
+  struct wanted_tile {
+    tile_id id;
+    float error; // in pixels
+  };
+  std::shared_ptr<const tile_pyramid> pyramid;
+  std::unique_ptr<tile_loader> loader;
+  float size = 0.0f;
+  GLuint vao = 0, vbo = 0, ebo = 0;
+  GLsizei index_count = 0;
+  int vertices_per_tile = 0;
+  std::vector<slot> slots;
+  std::list<int> lru; // most recently used first
+  std::unordered_map<uint64_t, int> keys; // resident tiles
+  std::vector<int> selection;
+  std::vector<wanted_tile> wanted;
+  unsigned long frame = 0;
+  int uploads = 0; // by the last update
+  frustum view_frustum;
+  glm::vec3 camera;
+  float pixels_per_unit = 0.0f; // at distance 1, or everywhere if orthographic
+  bool orthographic = false;
+  int find(const tile_id& id) const;
+  void touch(int index);
+  bool visible(const float box_min[3], const float box_max[3]) const;
+  float screen_error(const tile_id& id, const float box_min[3], const float box_max[3]) const;
+  void walk(const tile_id& id);
+  void upload(const loaded_tile& tile);
+};
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// ------------------------------------------------------------
+// scoped timers
+// ------------------------------------------------------------
+
+// the stages of making a mesh (parse, evaluate, index, contours,
+// upload) and of drawing a frame are timed by a trace_scope on the
+// stack:
+//
+//   {
+//     trace_scope scope("evaluate");
+//     ...
+//   }
+//
+// the last time of every name is always kept, the gui shows them in
+// its overlay. that costs a clock read and a store: the lock is only
+// taken while recording, or the first time a thread ends a scope of
+// a name. while recording, every scope is kept as an event as
+// well, the oldest dropped past trace_capacity of them, and
+// trace_write saves the events in the trace event format read by
+// chrome://tracing and Perfetto, one track per thread. counters, such
+// as the gpu time of a frame, go to the trace the same way.
+//
+// names are string literals, events keep them by pointer.
+
+const size_t trace_capacity = 1 << 18;
+
+void trace_record(bool on);
+bool trace_recording();
+void trace_clear();
+
+// milliseconds the last scope named `name` took, 0 before the first
+double trace_last_ms(const char* name);
+
+// a value over time, a track of its own in the trace
+void trace_counter(const char* name, double value);
+
+// returns false with a message in `error` when the file cannot be
+// written
+bool trace_write(const char* path, std::string& error);
+
+class trace_scope {
+  const char* name;
+  double begin_us;
+public:
+  explicit trace_scope(const char* name);
+  ~trace_scope();
+  trace_scope(const trace_scope&) = delete;
+  trace_scope& operator=(const trace_scope&) = delete;
+};
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <mesh.hpp>
+#include <cstddef>
+#include <vector>
+
+// ------------------------------------------------------------
+// shared vertex pool
+// ------------------------------------------------------------
+
+// the vertices of every grid surface live in a few large buffers, the
+// chunks, instead of a buffer each. a surface owns a slice of a chunk
+// (its StreamBuffer ring, see stream_buffer.hpp), and the surfaces of
+// a chunk that use the same index buffer are drawn by one
+// glMultiDrawElementsBaseVertex through the vao of the chunk, however
+// many there are.
+//
+// slices start on blocks of block_vertices vertices. a texture buffer
+// holds the slot of the slice every block belongs to, and a second
+// one a vec4 per slot: the colormap row (-1 for the vertex colors) and
+// the height range. the vertex shader finds them from gl_VertexID,
+// which counts from the start of the chunk, so the colormap and range
+// of every surface of a draw are its own without a uniform per
+// surface.
+//
+// chunks are never moved: a new one is created when none has room,
+// each twice the size of the last up to chunk_max. a released slice
+// is only reused once the frames that drew from it are done.
+
+struct pool_slice {
+  int chunk = -1;
+  size_t offset = 0, size = 0; // bytes
+  int slot = -1;
+};
+
+class VertexPool {
+public:
+  static constexpr int block_vertices = 256;
+  static constexpr size_t vertex_size = floats_per_vertex * sizeof(float);
+  static constexpr size_t block_size = block_vertices * vertex_size;
+  static constexpr size_t chunk_min = (size_t)16 << 20;
+  static constexpr size_t chunk_max = (size_t)256 << 20;
+
+  struct chunk {
+    GLuint buffer = 0, vao = 0;
+    size_t capacity = 0;
+    bool persistent = false;
+    void* mapped = nullptr;
+    std::vector<std::pair<size_t, size_t>> free; // offset and size, sorted
+    std::vector<int> blocks; // slot of every block
+    std::vector<float> params; // 4 per slot
+    std::vector<char> slots_used;
+    GLuint blocks_buffer = 0, blocks_texture = 0;
+    GLuint params_buffer = 0, params_texture = 0;
+    bool blocks_changed = false, params_changed = false;
+  };
+  std::vector<chunk> chunks;
+
+  pool_slice allocate(size_t size);
+  void release(const pool_slice& slice);
+  void set_params(const pool_slice& slice, float colormap_row, float range_min, float range_max);
+  // uploads the tables that changed, before the chunk is drawn
+  void update_tables(int chunk);
+  void destroy();
+private:
+  struct retired_slice {
+    pool_slice slice;
+    GLsync fence;
+  };
+  std::vector<retired_slice> retired;
+  void reclaim();
+  void free_slice(const pool_slice& slice);
+  bool fit(int chunk, size_t size, pool_slice& slice);
+  int create_chunk(size_t size);
+};
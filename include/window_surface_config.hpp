@@ -3,9 +3,16 @@
 #include <wx/event.h>
 #include <wx/wx.h>
 #include <wx/clrpicker.h>
+#include <wx/slider.h>
+#include <wx/choice.h>
 #include <data_surfaces.hpp>
 #include <data_properties.hpp>
+#include <program.hpp>
+#include <mesh.hpp>
+#include <scene_cache.hpp>
 #include <map>
+#include <string>
+#include <vector>
 class CanvasGL;
 
 class WindowSurfaceConfig : public wxPanel {
@@ -15,17 +22,63 @@ class WindowSurfaceConfig : public wxPanel {
   wxTextCtrl* textctrl_function;
   wxCheckBox* checkbox_show;
   wxColourPickerCtrl* colour_picker;
+  wxButton* button_data;
+  wxButton* button_points;
   wxButton* button_remove;
+  wxChoice* choice_colormap;
+  wxCheckBox* checkbox_range_auto;
+  wxTextCtrl* textctrl_range_min;
+  wxTextCtrl* textctrl_range_max;
+  wxTextCtrl* textctrl_domain;
+  wxBoxSizer* sizer_params;
+  std::vector<wxSlider*> sliders_params;
+  std::vector<wxStaticText*> statictexts_params;
+  std::map<std::string, double> param_values; // kept while the function is edited
   CanvasGL* canvas_gl = nullptr;
+  // incremental evaluation, see program::split
+  int incremental_param = -1;
+  program residual;
+  std::vector<int> cut;
+  std::vector<std::vector<double>> cut_values;
+  // the work left to the next frame, see CanvasGL::defer. the sliders
+  // take DEFER_PARAM + their parameter.
+  enum { DEFER_EVALUATE, DEFER_PARAM };
+  void defer_evaluate();
+  void update_param_controls();
+  void update_range_controls();
+  void unmap_vertices();
+  void release_tiles();
+  void release_points();
+  grid surface_grid() const;
+  std::shared_ptr<TiledSurface> open_tiles(const std::string& path, const height_field& field);
+  void evaluate_grid(const program& prog, const std::vector<int>& stored,
+		     std::vector<std::vector<double>>& stores,
+		     const std::vector<std::vector<double>>& loads);
 public:
   WindowSurfaceConfig(wxPanel* parent, unsigned int id, Properties& props, std::map<unsigned int, SurfaceData>& surfaces_data);
   void on_checkbox(wxCommandEvent& event);
   void on_textctrl(wxCommandEvent& event);
+  void on_data(wxCommandEvent& event);
+  bool open_data(const std::string& path);
+  void on_points(wxCommandEvent& event);
+  bool open_points(const std::string& path);
   void on_color(wxColourPickerEvent& event);
   void on_remove(wxCommandEvent& event);
+  void on_slider(int param);
+  void on_colormap(wxCommandEvent& event);
+  void on_range(wxCommandEvent& event);
+  void on_domain(wxCommandEvent& event);
+  void remove();
+  void load_cached(const cached_surface& cached, std::shared_ptr<mapped_file> file);
+  cached_surface to_cached() const;
   void update_buffer_size();
+  void set_implicit(bool implicit);
+  void set_divisions(float divisions);
   void vector_update_colors();
   void vector_update_coords();
+  void vector_update_param(int param);
+  void update_indices();
+  void update_contours();
   void vector_send_to_buffer();
   void set_canvas_gl(CanvasGL* canvas_gl);
 };
@@ -0,0 +1,71 @@
+#include <animation.hpp>
+#include <algorithm>
+#include <cmath>
+
+void Timeline::advance(double& time, double seconds) const {
+  if (playing)
+    time += seconds * speed;
+}
+
+float AnimationScheduler::divisions(float divisions_full) const {
+  if (divisions_full <= divisions_min)
+    return divisions_full;
+  return std::max(divisions_min, divisions_full / std::ldexp(1.0f, level));
+}
+
+void AnimationScheduler::record(double elapsed_ms, float divisions_full) {
+
+  // the cost grows with the number of vertices, so going up one
+  // level costs about four times the current frame.
+
+  if (elapsed_ms > budget_ms) {
+    if (divisions(divisions_full) > divisions_min)
+      level++;
+  } else if (level > 0 && elapsed_ms * 4.0 < budget_ms * 0.75) {
+    level--;
+  }
+}
+
+bool FramePacer::request(int reasons) {
+  requests++;
+  bool first = this->reasons == 0;
+  this->reasons |= reasons;
+  return first;
+}
+
+double FramePacer::delay(double now_ms) const {
+  return std::max(0.0, frame_start + interval_ms - now_ms);
+}
+
+int FramePacer::begin(double now_ms) {
+  int folded = reasons;
+  reasons = 0;
+  frame_start = now_ms;
+  // the first report counts from the first frame
+  if (report_start == 0.0)
+    report_start = now_ms;
+  return folded;
+}
+
+void FramePacer::end(double now_ms) {
+  double elapsed = now_ms - frame_start;
+  frames++;
+  frame_total += elapsed;
+  frame_max = std::max(frame_max, elapsed);
+}
+
+FrameReport FramePacer::report(double now_ms) {
+  FrameReport r;
+  r.frames = frames;
+  r.requests = requests;
+  if (frames > 0) {
+    r.frame_ms = frame_total / frames;
+    r.frame_ms_max = frame_max;
+  }
+  if (now_ms > report_start)
+    r.fps = frames * 1000.0 / (now_ms - report_start);
+  frames = requests = 0;
+  frame_total = frame_max = 0.0;
+  report_start = now_ms;
+  return r;
+}
@@ -0,0 +1,88 @@
+#include <colormap.hpp>
+#include <algorithm>
+#include <cmath>
+
+const char* colormap_names[COLORMAP_COUNT] = {
+  "Solid",
+  "Viridis",
+  "Turbo",
+  "Diverging"
+};
+
+void colormap_sample(int colormap, float t, float rgb[3]) {
+
+  t = std::clamp(t, 0.0f, 1.0f);
+
+  switch (colormap) {
+
+  case COLORMAP_VIRIDIS: {
+    // polynomial fit of matplotlib's viridis
+    static const float c[7][3] = {
+      { 0.2777273272f,  0.0054073445f,  0.3340998053f},
+      { 0.1050930431f,  1.4046135299f,  1.3845901626f},
+      {-0.3308618287f,  0.2148475595f,  0.0950951630f},
+      {-4.6342304990f, -5.7991009734f, -19.332440956f},
+      { 6.2282699363f, 14.179933367f,  56.690552601f},
+      { 4.7763849977f, -13.745145378f, -65.353032633f},
+      {-5.4354558559f,  4.6458526122f,  26.312435250f}
+    };
+    for (int k = 0; k < 3; k++) {
+      float v = c[6][k];
+      for (int i = 5; i >= 0; i--)
+	v = v * t + c[i][k];
+      rgb[k] = v;
+    }
+    break;
+  }
+
+  case COLORMAP_TURBO: {
+    // polynomial approximation published with turbo
+    static const float c[6][3] = {
+      {  0.13572138f,   0.09140261f,   0.10667330f},
+      {  4.61539260f,   2.19418839f,  12.64194608f},
+      {-42.66032258f,   4.84296658f, -60.58204836f},
+      {132.13108234f, -14.18503333f, 110.36276771f},
+      {-152.94239396f,  4.27729857f, -89.90310912f},
+      { 59.28637943f,   2.82956604f,  27.34824973f}
+    };
+    for (int k = 0; k < 3; k++) {
+      float v = c[5][k];
+      for (int i = 4; i >= 0; i--)
+	v = v * t + c[i][k];
+      rgb[k] = v;
+    }
+    break;
+  }
+
+  case COLORMAP_DIVERGING: {
+    // blue, white, red (moreland's cool to warm end points)
+    static const float low[3]  = {0.230f, 0.299f, 0.754f};
+    static const float mid[3]  = {0.865f, 0.865f, 0.865f};
+    static const float high[3] = {0.706f, 0.016f, 0.150f};
+    for (int k = 0; k < 3; k++) {
+      if (t < 0.5f)
+	rgb[k] = low[k] + (mid[k] - low[k]) * (t * 2.0f);
+      else
+	rgb[k] = mid[k] + (high[k] - mid[k]) * (t * 2.0f - 1.0f);
+    }
+    break;
+  }
+
+  default:
+    rgb[0] = rgb[1] = rgb[2] = t;
+  }
+
+  for (int k = 0; k < 3; k++)
+    rgb[k] = std::clamp(rgb[k], 0.0f, 1.0f);
+}
+
+std::vector<unsigned char> colormap_table(int colormap, int size) {
+  std::vector<unsigned char> table(size * 3);
+  for (int i = 0; i < size; i++) {
+    float rgb[3];
+    colormap_sample(colormap, i / (float)(size - 1), rgb);
+    for (int k = 0; k < 3; k++)
+      table[i * 3 + k] = (unsigned char)std::lround(rgb[k] * 255.0f);
+  }
+  return table;
+}
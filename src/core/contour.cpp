@@ -0,0 +1,203 @@
+#include <contour.hpp>
+#include <parallel.hpp>
+#include <trace.hpp>
+#include <algorithm>
+#include <cmath>
+#include <climits>
+#include <mutex>
+
+namespace {
+
+// a piece of contour inside one triangle, from the edge the level
+// enters it by to the edge it leaves it by, and the triangle on the
+// other side of that edge
+struct segment {
+  int level;
+  int next_triangle; // -1 at the border of the grid
+  float start[3], end[3];
+};
+
+// the segments of a band of rows, in the order of their triangles
+// and, within a triangle, of their levels
+struct band {
+  int row_begin;
+  std::vector<segment> segments;
+};
+
+const int no_segments = INT_MIN;
+
+} // namespace
+
+std::vector<float> contour_levels(float min, float max, int count) {
+  std::vector<float> levels;
+  if (count <= 0 || !(max > min) || !std::isfinite(max - min))
+    return levels;
+  for (int k = 0; k < count; k++)
+    levels.push_back(min + (max - min) * (k + 1) / (count + 1));
+  return levels;
+}
+
+void extract_contours(const float* vertices, int rows, int columns, const std::vector<float>& levels,
+		      contour_lines& lines) {
+
+  trace_scope scope("contours");
+  lines.positions.clear();
+  lines.indices.clear();
+  int n = columns;
+  if (rows < 2 || n < 2 || levels.empty())
+    return;
+
+  // ------------------------------------------------------------
+  // segments
+  // ------------------------------------------------------------
+
+  // triangle 2 q and 2 q + 1 split quad q = i (n - 1) + j. `first`
+  // holds the index of the segment of a triangle at level 0, were
+  // there one: the segment at level l is first + l. it is no_segments
+  // where a corner is not finite.
+  int quad_rows = rows - 1, quads = n - 1;
+  std::vector<int> first((size_t)quad_rows * quads * 2, no_segments);
+  std::vector<band> bands;
+  std::mutex bands_mutex;
+
+  parallel_for(0, quad_rows, [&](int row_begin, int row_end) {
+    band local;
+    local.row_begin = row_begin;
+    auto height = [&](int v) { return vertices[(size_t)v * floats_per_vertex + 1]; };
+    auto finite = [&](int v) {
+      const float* p = vertices + (size_t)v * floats_per_vertex;
+      return std::isfinite(p[0]) && std::isfinite(p[1]) && std::isfinite(p[2]);
+    };
+    // the crossing on the edge between vertices a and b, always
+    // interpolated from the lower index so both triangles along the
+    // edge agree on it
+    auto crossing = [&](int a, int b, float level, float out[3]) {
+      if (a > b)
+	std::swap(a, b);
+      const float* p = vertices + (size_t)a * floats_per_vertex;
+      const float* q = vertices + (size_t)b * floats_per_vertex;
+      float s = (level - p[1]) / (q[1] - p[1]);
+      for (int k = 0; k < 3; k++)
+	out[k] = p[k] + s * (q[k] - p[k]);
+    };
+    // corners in the winding of the grid triangles and the triangles
+    // across the edge from each corner to the next one. the segment
+    // runs with the corners above the level on its right.
+    auto triangle = [&](int id, const int corner[3], const int across[3]) {
+      float h[3] = {height(corner[0]), height(corner[1]), height(corner[2])};
+      float low = std::min(h[0], std::min(h[1], h[2]));
+      float high = std::max(h[0], std::max(h[1], h[2]));
+      // the levels with corners above and corners at or below them
+      auto level_begin = std::lower_bound(levels.begin(), levels.end(), low);
+      auto level_end = std::lower_bound(level_begin, levels.end(), high);
+      first[id] = (int)local.segments.size() - (int)(level_begin - levels.begin());
+      for (auto level = level_begin; level < level_end; ++level) {
+	segment s;
+	s.level = level - levels.begin();
+	for (int k = 0; k < 3; k++) {
+	  int k1 = k == 2 ? 0 : k + 1;
+	  bool above = h[k] > *level, above1 = h[k1] > *level;
+	  if (above == above1)
+	    continue;
+	  if (above) {
+	    s.next_triangle = across[k];
+	    crossing(corner[k], corner[k1], *level, s.end);
+	  } else
+	    crossing(corner[k], corner[k1], *level, s.start);
+	}
+	local.segments.push_back(s);
+      }
+    };
+    for (int i = row_begin; i < row_end; i++) {
+      for (int j = 0; j < quads; j++) {
+	int v = i * n + j, below = v + n;
+	int q = i * quads + j;
+	bool corners[4] = {finite(v), finite(below), finite(v + 1), finite(below + 1)};
+	if (corners[0] && corners[1] && corners[2]) {
+	  int corner[3] = {v, below, v + 1};
+	  int across[3] = {j > 0 ? 2 * (q - 1) + 1 : -1, 2 * q + 1, i > 0 ? 2 * (q - quads) + 1 : -1};
+	  triangle(2 * q, corner, across);
+	}
+	if (corners[1] && corners[2] && corners[3]) {
+	  int corner[3] = {v + 1, below, below + 1};
+	  int across[3] = {2 * q, i < quad_rows - 1 ? 2 * (q + quads) : -1, j < quads - 1 ? 2 * (q + 1) : -1};
+	  triangle(2 * q + 1, corner, across);
+	}
+      }
+    }
+    std::lock_guard<std::mutex> lock(bands_mutex);
+    bands.push_back(std::move(local));
+  }, 16);
+
+  // the bands back in the order of their rows, and `first` moved from
+  // the start of a band to the start of all segments
+  std::sort(bands.begin(), bands.end(), [](const band& a, const band& b) {
+    return a.row_begin < b.row_begin;
+  });
+  std::vector<segment> segments;
+  for (size_t b = 0; b < bands.size(); b++) {
+    int offset = segments.size();
+    int row_end = b + 1 < bands.size() ? bands[b + 1].row_begin : quad_rows;
+    segments.insert(segments.end(), bands[b].segments.begin(), bands[b].segments.end());
+    std::vector<segment>().swap(bands[b].segments);
+    if (offset == 0)
+      continue;
+    parallel_for((size_t)bands[b].row_begin * quads * 2, (size_t)row_end * quads * 2, [&](int begin, int end) {
+      for (int t = begin; t < end; t++)
+	if (first[t] != no_segments)
+	  first[t] += offset;
+    }, 1 << 16);
+  }
+
+  // ------------------------------------------------------------
+  // polylines
+  // ------------------------------------------------------------
+
+  // a segment leaves its triangle by the edge the segment at the same
+  // level in the next triangle enters by
+  int count = segments.size();
+  std::vector<int> next(count, -1);
+  std::vector<char> followed(count, 0);
+  parallel_for(0, count, [&](int begin, int end) {
+    for (int s = begin; s < end; s++) {
+      int t = segments[s].next_triangle;
+      if (t >= 0 && first[t] != no_segments)
+	next[s] = first[t] + segments[s].level;
+    }
+  }, 1 << 16);
+  std::vector<int>().swap(first);
+  for (int s = 0; s < count; s++)
+    if (next[s] >= 0)
+      followed[next[s]] = 1;
+
+  std::vector<char> visited(count, 0);
+  auto emit = [&](const float p[3]) {
+    lines.indices.push_back(lines.positions.size() / 3);
+    lines.positions.insert(lines.positions.end(), p, p + 3);
+  };
+  auto walk = [&](int s) {
+    int head = s, last = s;
+    for (; s >= 0 && !visited[s]; s = next[s]) {
+      visited[s] = 1;
+      emit(segments[s].start);
+      last = s;
+    }
+    // a loop closes on its first point, a polyline ends on the far
+    // side of its last segment
+    if (s == head)
+      emit(segments[head].start);
+    else
+      emit(segments[last].end);
+    lines.indices.push_back(contour_restart);
+  };
+
+  lines.positions.reserve((size_t)count * 3 + 3);
+  lines.indices.reserve((size_t)count + count / 4 + 2);
+  // open polylines from their first segment, then the loops
+  for (int s = 0; s < count; s++)
+    if (!followed[s])
+      walk(s);
+  for (int s = 0; s < count; s++)
+    if (!visited[s])
+      walk(s);
+}
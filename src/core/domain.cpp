@@ -0,0 +1,176 @@
+#include <domain.hpp>
+#include <mesh.hpp>
+#include <parser.hpp>
+#include <algorithm>
+#include <cctype>
+
+namespace {
+
+std::string trim(const std::string& s) {
+  size_t begin = 0, end = s.size();
+  while (begin < end && std::isspace((unsigned char)s[begin]))
+    begin++;
+  while (end > begin && std::isspace((unsigned char)s[end - 1]))
+    end--;
+  return s.substr(begin, end - begin);
+}
+
+// the pieces of `s` between the commas outside parentheses
+std::vector<std::string> split_commas(const std::string& s) {
+  std::vector<std::string> parts(1);
+  int depth = 0;
+  for (char c : s) {
+    if (c == '(')
+      depth++;
+    else if (c == ')')
+      depth--;
+    if (c == ',' && depth == 0)
+      parts.emplace_back();
+    else
+      parts.back() += c;
+  }
+  return parts;
+}
+
+enum comparisons { LESS, LESS_EQUAL, GREATER, GREATER_EQUAL };
+
+// a chain a < b <= c into its operands and the comparisons between
+// them
+void split_comparisons(const std::string& s, std::vector<std::string>& operands, std::vector<int>& ops) {
+  operands.assign(1, "");
+  ops.clear();
+  int depth = 0;
+  for (size_t k = 0; k < s.size(); k++) {
+    char c = s[k];
+    if (c == '(')
+      depth++;
+    else if (c == ')')
+      depth--;
+    if (depth != 0 || (c != '<' && c != '>')) {
+      operands.back() += c;
+      continue;
+    }
+    bool equal = k + 1 < s.size() && s[k + 1] == '=';
+    ops.push_back(c == '<' ? (equal ? LESS_EQUAL : LESS) : (equal ? GREATER_EQUAL : GREATER));
+    if (equal)
+      k++;
+    operands.emplace_back();
+  }
+}
+
+// the value of an expression without variables
+bool constant(const std::string& expr, float& value) {
+  parser p;
+  program prog;
+  if (!p.compile(expr.c_str(), prog) || prog.parametric() || !prog.params.empty() ||
+      prog.uses(OP_X) || prog.uses(OP_Y) || prog.uses(OP_Z) || prog.uses(OP_T))
+    return false;
+  value = (float)prog.eval(0.0, 0.0);
+  return std::isfinite(value);
+}
+
+} // namespace
+
+bool parse_domain(const std::string& text, domain& d, std::string& error) {
+
+  d = domain();
+  domain result;
+  if (trim(text).empty())
+    return true;
+
+  for (const std::string& part : split_commas(text)) {
+    std::vector<std::string> operands;
+    std::vector<int> ops;
+    split_comparisons(part, operands, ops);
+    if (ops.empty()) {
+      error = "\"" + trim(part) + "\" is not a comparison";
+      return false;
+    }
+    for (size_t k = 0; k < ops.size(); k++) {
+      // lhs < rhs, or lhs <= rhs
+      bool less = ops[k] == LESS || ops[k] == LESS_EQUAL;
+      std::string lhs = trim(operands[less ? k : k + 1]);
+      std::string rhs = trim(operands[less ? k + 1 : k]);
+      bool strict = ops[k] == LESS || ops[k] == GREATER;
+      if (lhs.empty() || rhs.empty()) {
+	error = "\"" + trim(part) + "\" misses a side";
+	return false;
+      }
+      // repeated bounds intersect. an unset bound is nan, which
+      // std::min and std::max pass over when it is their second operand
+      float value;
+      if ((lhs == "x" || lhs == "y") && constant(rhs, value)) {
+	float& bound = lhs == "x" ? result.x_max : result.y_max;
+	bound = std::min(value, bound);
+	continue;
+      }
+      if ((rhs == "x" || rhs == "y") && constant(lhs, value)) {
+	float& bound = rhs == "x" ? result.x_min : result.y_min;
+	bound = std::max(value, bound);
+	continue;
+      }
+      mask_term term;
+      term.strict = strict;
+      parser p;
+      std::string difference = "(" + rhs + ")-(" + lhs + ")";
+      if (!p.compile(difference.c_str(), term.prog)) {
+	error = "\"" + lhs + "\" or \"" + rhs + "\" is not an expression";
+	return false;
+      }
+      if (!term.prog.params.empty() || term.prog.uses(OP_Z) || term.prog.uses(OP_T)) {
+	error = "\"" + trim(part) + "\" reads something other than x and y";
+	return false;
+      }
+      result.mask.push_back(term);
+    }
+  }
+
+  if (result.x_min >= result.x_max || result.y_min >= result.y_max) {
+    error = "the domain is empty";
+    return false;
+  }
+  d = result;
+  return true;
+}
+
+bool domain_fits(const domain& d, float size, std::string& error) {
+  grid g;
+  g.size = size;
+  g.vertices_per_axis = 2;
+  g.region = &d;
+  if (g.x_begin() < g.x_end() && g.y_begin() < g.y_end())
+    return true;
+  error = "the domain is outside the grid";
+  return false;
+}
+
+void domain_mask(const domain& d, const double* x, const double* y, int count, unsigned char* inside) {
+  std::fill(inside, inside + count, 1);
+  std::vector<double> values(count);
+  for (const mask_term& term : d.mask) {
+    term.prog.eval_batch(x, y, 0.0, values.data(), count);
+    for (int k = 0; k < count; k++)
+      inside[k] &= term.strict ? values[k] > 0.0 : values[k] >= 0.0;
+  }
+}
+
+void domain_mask_row(const domain& d, double x, const double* y, int count, unsigned char* inside) {
+  std::fill(inside, inside + count, 1);
+  std::vector<double> xs(program::batch_size, x), values(program::batch_size);
+  for (int begin = 0; begin < count; begin += program::batch_size) {
+    int n = std::min(program::batch_size, count - begin);
+    unsigned char* block = inside + begin;
+    for (const mask_term& term : d.mask) {
+      interval bounds = term.prog.eval_interval(interval(x), interval(y[begin], y[begin + n - 1]), 0.0);
+      if (!bounds.singular && (term.strict ? bounds.lo > 0.0 : bounds.lo >= 0.0))
+	continue;
+      if (!bounds.singular && (term.strict ? bounds.hi <= 0.0 : bounds.hi < 0.0)) {
+	std::fill(block, block + n, 0);
+	break;
+      }
+      term.prog.eval_batch(xs.data(), y + begin, 0.0, values.data(), n);
+      for (int k = 0; k < n; k++)
+	block[k] &= term.strict ? values[k] > 0.0 : values[k] >= 0.0;
+    }
+  }
+}
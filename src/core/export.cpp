@@ -0,0 +1,515 @@
+#include <export.hpp>
+#include <implicit.hpp>
+#include <trace.hpp>
+#include <algorithm>
+#include <cfloat>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+const char* export_format_names[] = {"stl", "ply", "obj", "raw"};
+
+// ------------------------------------------------------------
+// buffered writer
+// ------------------------------------------------------------
+
+buffered_writer::buffered_writer(size_t capacity)
+  : buffer(capacity) { }
+
+buffered_writer::~buffered_writer() {
+  close();
+}
+
+bool buffered_writer::open(const char* path) {
+  close();
+  file = std::fopen(path, "wb");
+  used = 0;
+  bytes = 0;
+  ok = file != nullptr;
+  return ok;
+}
+
+bool buffered_writer::close() {
+  if (!file)
+    return false;
+  flush();
+  ok = std::fclose(file) == 0 && ok;
+  file = nullptr;
+  return ok;
+}
+
+void buffered_writer::flush() {
+  if (used && file) {
+    trace_scope scope("write");
+    ok = std::fwrite(buffer.data(), 1, used, file) == used && ok;
+  }
+  used = 0;
+}
+
+void buffered_writer::write(const void* data, size_t size) {
+  bytes += size;
+  if (used + size > buffer.size()) {
+    flush();
+    if (size > buffer.size()) {
+      ok = file && std::fwrite(data, 1, size, file) == size && ok;
+      return;
+    }
+  }
+  std::memcpy(buffer.data() + used, data, size);
+  used += size;
+}
+
+void buffered_writer::write(const char* text) {
+  write(text, std::strlen(text));
+}
+
+void buffered_writer::put(char c) {
+  if (used == buffer.size())
+    flush();
+  buffer[used++] = c;
+  bytes++;
+}
+
+void buffered_writer::write(float value) {
+  char text[32];
+  auto result = std::to_chars(text, text + sizeof(text), value);
+  write(text, result.ptr - text);
+}
+
+void buffered_writer::write(unsigned long long value) {
+  char text[24];
+  auto result = std::to_chars(text, text + sizeof(text), value);
+  write(text, result.ptr - text);
+}
+
+long buffered_writer::tell() {
+  return (long)bytes;
+}
+
+bool buffered_writer::seek_write(long offset, const void* data, size_t size) {
+
+  // patches bytes that were already written, like the counts in the
+  // headers. the position is restored afterwards.
+
+  flush();
+  if (!file)
+    return false;
+  long end = std::ftell(file);
+  ok = std::fseek(file, offset, SEEK_SET) == 0 && ok;
+  ok = std::fwrite(data, 1, size, file) == size && ok;
+  ok = std::fseek(file, end, SEEK_SET) == 0 && ok;
+  return ok;
+}
+
+// ------------------------------------------------------------
+// formats
+// ------------------------------------------------------------
+
+int export_format_from_name(const std::string& name) {
+  for (int i = EXPORT_STL; i <= EXPORT_RAW; i++)
+    if (name == export_format_names[i])
+      return i;
+  return -1;
+}
+
+int export_format_from_path(const std::string& path) {
+  size_t dot = path.find_last_of('.');
+  if (dot == std::string::npos)
+    return EXPORT_RAW;
+  std::string extension = path.substr(dot + 1);
+  for (char& c : extension)
+    c = std::tolower((unsigned char)c);
+  int format = export_format_from_name(extension);
+  return format < 0 ? EXPORT_RAW : format;
+}
+
+namespace {
+
+// the pole test of grid_compact_indices for a grid that is never
+// held whole: the spread comes from a sample of evenly spaced rows.
+// infinity, no test, for a parametric surface or a height field whose
+// bounds over the grid are finite and defined everywhere.
+
+float export_jump(const program& prog, const grid& g) {
+  if (!prog.valid() || prog.parametric())
+    return INFINITY;
+  interval bounds = bound_grid(prog, g, 0);
+  if (!bounds.singular && bounds.lo >= -FLT_MAX && bounds.hi <= FLT_MAX)
+    return INFINITY;
+  int n = g.columns(), total = g.rows();
+  int rows = std::min(total, 64);
+  int stride = std::max(1, n * rows / 65536);
+  std::vector<float> heights(n), sample;
+  for (int k = 0; k < rows; k++) {
+    int row = (int)((long long)k * (total - 1) / std::max(1, rows - 1));
+    evaluate_heights(prog, g, row, row + 1, heights.data());
+    for (int j = 0; j < n; j += stride)
+      sample.push_back(heights[j]);
+  }
+  return grid_jump(sample);
+}
+
+// the rows of the grid in bands, keeping the last row of the previous
+// band so the triangles between two bands can be emitted.
+
+struct band_reader {
+  const program& prog;
+  const grid& g;
+  int n; // vertices per row, grid::columns
+  int total; // rows of the grid
+  int band;
+  int row = 0; // first row of `positions`
+  int rows = 0; // rows in `positions`
+  std::vector<float> positions; // xyz, z up
+  std::vector<float> previous; // row `row - 1`
+  float jump; // see export_jump
+
+  band_reader(const program& prog, const grid& g)
+    : band_reader(prog, g, export_jump(prog, g)) {}
+
+  band_reader(const program& prog, const grid& g, float jump)
+    : prog(prog), g(g), n(g.columns()), total(g.rows()), jump(jump) {
+    band = std::max(1, (1 << 20) / n);
+    positions.resize((size_t)band * n * 3);
+    previous.resize((size_t)n * 3);
+  }
+
+  bool next() {
+    if (rows > 0)
+      std::copy_n(positions.begin() + (size_t)(rows - 1) * n * 3, n * 3, previous.begin());
+    row += rows;
+    if (row >= total)
+      return false;
+    rows = std::min(band, total - row);
+    trace_scope scope("evaluate");
+    evaluate_positions(prog, g, row, row + rows, positions.data());
+    return true;
+  }
+
+  // position of vertex (i, j), i being in this band or the row before
+  const float* position(int i, int j) const {
+    if (i < row)
+      return &previous[(size_t)j * 3];
+    return &positions[((size_t)(i - row) * n + j) * 3];
+  }
+};
+
+// calls fn(a, b, c) with the vertex (i, j) pairs of every triangle
+// between row i - 1 and row i, in the winding of grid_indices
+
+template <typename F>
+void row_triangles(const band_reader& reader, int i, F fn) {
+  for (int j = 0; j < reader.n - 1; j++) {
+    int i0 = i - 1;
+    fn(i0, j, i, j, i0, j + 1);
+    fn(i0, j + 1, i, j, i, j + 1);
+  }
+}
+
+bool vertex_finite(const band_reader& r, int i, int j) {
+  const float* p = r.position(i, j);
+  return std::isfinite(p[0]) && std::isfinite(p[1]) && std::isfinite(p[2]);
+}
+
+// a triangle with three finite vertices that does not cross a pole,
+// as grid_compact_indices tells them
+
+bool triangle_kept(const band_reader& r, int i0, int j0, int i1, int j1, int i2, int j2) {
+  if (!vertex_finite(r, i0, j0) || !vertex_finite(r, i1, j1) || !vertex_finite(r, i2, j2))
+    return false;
+  float h[3] = {r.position(i0, j0)[2], r.position(i1, j1)[2], r.position(i2, j2)[2]};
+  float span = std::max(h[0], std::max(h[1], h[2])) - std::min(h[0], std::min(h[1], h[2]));
+  return !(span > r.jump) || !grid_quad_singular(r.prog, r.g, std::min(i0, i1), std::min(j0, std::min(j1, j2)));
+}
+
+float finite_or_zero(float value) {
+  return std::isfinite(value) ? value : 0.0f;
+}
+
+void write_raw(band_reader& reader, buffered_writer& out, export_stats& stats) {
+
+  // the heights of a height field, x, y and z of a parametric surface
+
+  bool parametric = reader.prog.parametric();
+  std::vector<float> heights;
+  while (reader.next()) {
+    size_t count = (size_t)reader.rows * reader.n;
+    if (parametric) {
+      out.write(reader.positions.data(), count * 3 * sizeof(float));
+    } else {
+      heights.resize(count);
+      for (size_t v = 0; v < count; v++)
+	heights[v] = reader.positions[v * 3 + 2];
+      out.write(heights.data(), count * sizeof(float));
+    }
+    stats.vertices += count;
+  }
+}
+
+// binary stl: 80 byte header, triangle count, then the normal, three
+// vertices and a 16 bit attribute per triangle. returns the offset of
+// the count.
+
+long write_stl_header(buffered_writer& out, uint32_t count) {
+  char header[80] = {};
+  std::strncpy(header, "plotter3d binary stl", sizeof(header));
+  out.write(header, sizeof(header));
+  long count_offset = out.tell();
+  out.write(&count, sizeof(count));
+  return count_offset;
+}
+
+void write_stl_triangle(buffered_writer& out, const float v[3][3]) {
+  float e1[3] = {v[1][0] - v[0][0], v[1][1] - v[0][1], v[1][2] - v[0][2]};
+  float e2[3] = {v[2][0] - v[0][0], v[2][1] - v[0][1], v[2][2] - v[0][2]};
+  float normal[3] = {e1[1] * e2[2] - e1[2] * e2[1],
+		     e1[2] * e2[0] - e1[0] * e2[2],
+		     e1[0] * e2[1] - e1[1] * e2[0]};
+  float length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+  if (length > 0.0f)
+    for (float& c : normal)
+      c /= length;
+  char record[50];
+  std::memcpy(record, normal, 12);
+  std::memcpy(record + 12, v, 36);
+  std::memset(record + 48, 0, 2);
+  out.write(record, sizeof(record));
+}
+
+void write_stl(band_reader& reader, buffered_writer& out, export_stats& stats) {
+
+  // the count is patched at the end
+
+  long count_offset = write_stl_header(out, 0);
+  uint32_t count = 0;
+
+  while (reader.next()) {
+    for (int i = std::max(1, reader.row); i < reader.row + reader.rows; i++) {
+      row_triangles(reader, i, [&](int i0, int j0, int i1, int j1, int i2, int j2) {
+	if (!triangle_kept(reader, i0, j0, i1, j1, i2, j2))
+	  return;
+	float v[3][3];
+	std::memcpy(v[0], reader.position(i0, j0), sizeof(v[0]));
+	std::memcpy(v[1], reader.position(i1, j1), sizeof(v[1]));
+	std::memcpy(v[2], reader.position(i2, j2), sizeof(v[2]));
+	write_stl_triangle(out, v);
+	count++;
+      });
+    }
+  }
+
+  stats.vertices = (unsigned long long)count * 3;
+  stats.triangles = count;
+  out.seek_write(count_offset, &count, sizeof(count));
+}
+
+void write_ply(band_reader& reader, buffered_writer& out, export_stats& stats) {
+
+  // vertices first, then the faces. the faces need to know which
+  // vertices are finite, so the grid is evaluated a second time
+  // instead of remembering every height. the face count is written
+  // padded and patched at the end.
+
+  unsigned long long vertices = (unsigned long long)reader.total * reader.n;
+  out.write("ply\nformat binary_little_endian 1.0\ncomment plotter3d\nelement vertex ");
+  out.write(vertices);
+  out.write("\nproperty float x\nproperty float y\nproperty float z\nelement face ");
+  long count_offset = out.tell();
+  out.write("          \nproperty list uchar uint vertex_indices\nend_header\n");
+
+  while (reader.next()) {
+    for (int i = reader.row; i < reader.row + reader.rows; i++)
+      for (int j = 0; j < reader.n; j++) {
+	const float* p = reader.position(i, j);
+	float v[3] = {finite_or_zero(p[0]), finite_or_zero(p[1]), finite_or_zero(p[2])};
+	out.write(v, sizeof(v));
+      }
+  }
+
+  band_reader faces(reader.prog, reader.g, reader.jump);
+  unsigned long long count = 0;
+  while (faces.next()) {
+    for (int i = std::max(1, faces.row); i < faces.row + faces.rows; i++) {
+      row_triangles(faces, i, [&](int i0, int j0, int i1, int j1, int i2, int j2) {
+	if (!triangle_kept(faces, i0, j0, i1, j1, i2, j2))
+	  return;
+	char record[13];
+	uint32_t ind[3] = {(uint32_t)(i0 * faces.n + j0), (uint32_t)(i1 * faces.n + j1), (uint32_t)(i2 * faces.n + j2)};
+	record[0] = 3;
+	std::memcpy(record + 1, ind, sizeof(ind));
+	out.write(record, sizeof(record));
+	count++;
+      });
+    }
+  }
+
+  char text[11];
+  std::snprintf(text, sizeof(text), "%-10llu", count);
+  out.seek_write(count_offset, text, 10);
+  stats.vertices = vertices;
+  stats.triangles = count;
+}
+
+void write_obj(band_reader& reader, buffered_writer& out, export_stats& stats) {
+
+  // obj allows faces anywhere after their vertices, so the vertices
+  // of each band are followed by the faces that end in it.
+
+  out.write("# plotter3d\n");
+  unsigned long long count = 0;
+  while (reader.next()) {
+    for (int i = reader.row; i < reader.row + reader.rows; i++)
+      for (int j = 0; j < reader.n; j++) {
+	const float* p = reader.position(i, j);
+	out.write("v ");
+	out.write(finite_or_zero(p[0]));
+	out.put(' ');
+	out.write(finite_or_zero(p[1]));
+	out.put(' ');
+	out.write(finite_or_zero(p[2]));
+	out.put('\n');
+      }
+    for (int i = std::max(1, reader.row); i < reader.row + reader.rows; i++) {
+      row_triangles(reader, i, [&](int i0, int j0, int i1, int j1, int i2, int j2) {
+	if (!triangle_kept(reader, i0, j0, i1, j1, i2, j2))
+	  return;
+	// obj indices start at 1
+	out.write("f ");
+	out.write((unsigned long long)i0 * reader.n + j0 + 1);
+	out.put(' ');
+	out.write((unsigned long long)i1 * reader.n + j1 + 1);
+	out.put(' ');
+	out.write((unsigned long long)i2 * reader.n + j2 + 1);
+	out.put('\n');
+	count++;
+      });
+    }
+  }
+  stats.vertices = (unsigned long long)reader.total * reader.n;
+  stats.triangles = count;
+}
+
+// ------------------------------------------------------------
+// indexed meshes
+// ------------------------------------------------------------
+
+// the mesh of an implicit surface is extracted as a whole, its
+// vertices are in the format of mesh.hpp with z as the second
+// coordinate. raw writes x y z triples of the vertices.
+
+void write_mesh(const std::vector<float>& vertices, const std::vector<unsigned int>& indices,
+		int format, buffered_writer& out, export_stats& stats) {
+
+  size_t count = vertices.size() / floats_per_vertex;
+  auto position = [&](unsigned int v, float p[3]) {
+    const float* scene = &vertices[(size_t)v * floats_per_vertex];
+    p[0] = scene[0];
+    p[1] = scene[2];
+    p[2] = scene[1];
+  };
+  uint32_t triangles = (uint32_t)(indices.size() / 3);
+
+  switch (format) {
+  case EXPORT_STL: {
+    write_stl_header(out, triangles);
+    for (size_t t = 0; t < indices.size(); t += 3) {
+      float v[3][3];
+      for (int k = 0; k < 3; k++)
+	position(indices[t + k], v[k]);
+      write_stl_triangle(out, v);
+    }
+    stats.vertices = (unsigned long long)triangles * 3;
+    stats.triangles = triangles;
+    return;
+  }
+  case EXPORT_PLY: {
+    out.write("ply\nformat binary_little_endian 1.0\ncomment plotter3d\nelement vertex ");
+    out.write((unsigned long long)count);
+    out.write("\nproperty float x\nproperty float y\nproperty float z\nelement face ");
+    out.write((unsigned long long)triangles);
+    out.write("\nproperty list uchar uint vertex_indices\nend_header\n");
+    for (size_t v = 0; v < count; v++) {
+      float p[3];
+      position((unsigned int)v, p);
+      out.write(p, sizeof(p));
+    }
+    for (size_t t = 0; t < indices.size(); t += 3) {
+      char record[13];
+      record[0] = 3;
+      std::memcpy(record + 1, &indices[t], 12);
+      out.write(record, sizeof(record));
+    }
+    break;
+  }
+  case EXPORT_OBJ: {
+    out.write("# plotter3d\n");
+    for (size_t v = 0; v < count; v++) {
+      float p[3];
+      position((unsigned int)v, p);
+      out.write("v ");
+      out.write(p[0]);
+      out.put(' ');
+      out.write(p[1]);
+      out.put(' ');
+      out.write(p[2]);
+      out.put('\n');
+    }
+    // obj indices start at 1
+    for (size_t t = 0; t < indices.size(); t += 3) {
+      out.write("f ");
+      out.write((unsigned long long)indices[t] + 1);
+      out.put(' ');
+      out.write((unsigned long long)indices[t + 1] + 1);
+      out.put(' ');
+      out.write((unsigned long long)indices[t + 2] + 1);
+      out.put('\n');
+    }
+    break;
+  }
+  default:
+    for (size_t v = 0; v < count; v++) {
+      float p[3];
+      position((unsigned int)v, p);
+      out.write(p, sizeof(p));
+    }
+    break;
+  }
+  stats.vertices = count;
+  stats.triangles = format == EXPORT_RAW ? 0 : triangles;
+}
+
+} // namespace
+
+bool export_grid(const program& prog, const grid& g, int format, const char* path,
+		 export_stats* stats) {
+
+  if (g.vertices_per_axis < 2)
+    return false;
+
+  buffered_writer out;
+  if (!out.open(path))
+    return false;
+
+  export_stats result;
+  if (prog.uses(OP_Z)) {
+    std::vector<float> vertices;
+    std::vector<unsigned int> indices;
+    extract_implicit(prog, g, vertices, indices);
+    write_mesh(vertices, indices, format, out, result);
+  } else {
+    band_reader reader(prog, g);
+    switch (format) {
+    case EXPORT_STL: write_stl(reader, out, result); break;
+    case EXPORT_PLY: write_ply(reader, out, result); break;
+    case EXPORT_OBJ: write_obj(reader, out, result); break;
+    default:         write_raw(reader, out, result); break;
+    }
+  }
+
+  result.bytes = out.written();
+  bool ok = out.close();
+  if (stats)
+    *stats = result;
+  return ok;
+}
@@ -0,0 +1,349 @@
+#include <height_field.hpp>
+#include <parallel.hpp>
+#include <trace.hpp>
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+
+namespace {
+
+// rows and cols are kept as int
+bool check_shape(long long rows, long long cols, std::string& error) {
+  if (rows <= INT_MAX && cols <= INT_MAX)
+    return true;
+  error = "more than " + std::to_string(INT_MAX) + " rows or columns";
+  return false;
+}
+
+// ------------------------------------------------------------
+// .npy
+// ------------------------------------------------------------
+
+// magic, version, header length, then a python dict literal such as
+// {'descr': '<f4', 'fortran_order': False, 'shape': (512, 1024), }
+
+bool open_npy(height_field& field, std::string& error) {
+  const unsigned char* p = field.file->data();
+  size_t size = field.file->size();
+  if (size < 10 || std::memcmp(p, "\x93NUMPY", 6) != 0) {
+    error = "not a .npy file";
+    return false;
+  }
+  size_t header_length, header_begin;
+  if (p[6] == 1) {
+    header_length = p[8] | (p[9] << 8);
+    header_begin = 10;
+  } else if (size >= 12) {
+    header_length = p[8] | (p[9] << 8) | (p[10] << 16) | ((size_t)p[11] << 24);
+    header_begin = 12;
+  } else {
+    error = "truncated .npy header";
+    return false;
+  }
+  if (header_begin + header_length > size) {
+    error = "truncated .npy header";
+    return false;
+  }
+  std::string header((const char*)p + header_begin, header_length);
+
+  auto value_of = [&](const char* key) -> std::string {
+    size_t at = header.find(key);
+    if (at == std::string::npos) return "";
+    at = header.find(':', at);
+    if (at == std::string::npos) return "";
+    // a key without a value is left to the checks below
+    size_t begin = header.find_first_not_of(" ", at + 1);
+    if (begin == std::string::npos) return "";
+    bool tuple = header[begin] == '(';
+    size_t end = tuple ? header.find(')', begin) : header.find_first_of(",}", begin);
+    if (end == std::string::npos) return "";
+    return header.substr(begin, end + tuple - begin);
+  };
+
+  std::string descr = value_of("'descr'");
+  if (descr == "'<f4'" || descr == "'=f4'")
+    field.type = HEIGHT_FLOAT32;
+  else if (descr == "'<f8'" || descr == "'=f8'")
+    field.type = HEIGHT_FLOAT64;
+  else {
+    error = "only little endian float32 and float64 arrays are supported, not " + descr;
+    return false;
+  }
+  if (value_of("'fortran_order'") != "False") {
+    error = "fortran ordered arrays are not supported";
+    return false;
+  }
+
+  long long rows = 0, cols = 0;
+  std::string shape = value_of("'shape'");
+  if (std::sscanf(shape.c_str(), "(%lld, %lld)", &rows, &cols) != 2 || rows < 2 || cols < 2) {
+    error = "expected a two dimensional array, the shape is " + shape;
+    return false;
+  }
+  if (!check_shape(rows, cols, error))
+    return false;
+
+  size_t element = field.type == HEIGHT_FLOAT64 ? sizeof(double) : sizeof(float);
+  size_t data_begin = header_begin + header_length;
+  if ((size - data_begin) / element / cols < (size_t)rows) {
+    error = "the file is shorter than its shape";
+    return false;
+  }
+  field.rows = rows;
+  field.cols = cols;
+  field.values = p + data_begin;
+  field.row_stride = cols * element;
+  return true;
+}
+
+// ------------------------------------------------------------
+// raw float32
+// ------------------------------------------------------------
+
+bool open_raw(height_field& field, const std::string& path, std::string& error) {
+  size_t count = field.file->size() / sizeof(float);
+  long long rows = 0, cols = 0;
+
+  // `name_<cols>x<rows>.ext`, otherwise square
+  size_t underscore = path.find_last_of('_');
+  if (underscore == std::string::npos ||
+      std::sscanf(path.c_str() + underscore + 1, "%lldx%lld", &cols, &rows) != 2) {
+    cols = rows = std::llround(std::sqrt((double)count));
+  }
+  if (rows < 2 || cols < 2 || rows > (long long)count || cols > (long long)count ||
+      (size_t)(rows * cols) != count) {
+    error = "a raw float32 file must be square or named like name_<cols>x<rows>";
+    return false;
+  }
+  field.rows = rows;
+  field.cols = cols;
+  field.type = HEIGHT_FLOAT32;
+  field.values = field.file->data();
+  field.row_stride = cols * sizeof(float);
+  return true;
+}
+
+// ------------------------------------------------------------
+// csv
+// ------------------------------------------------------------
+
+// the file is split into one chunk per thread at line boundaries. a
+// first pass counts the lines of every chunk, which gives each chunk
+// the row it starts at, and the second pass parses the values in
+// place with std::from_chars. nothing is allocated per line or per
+// value.
+
+bool is_separator(char c) {
+  return c == ',' || c == ';' || c == ' ' || c == '\t' || c == '\r';
+}
+
+bool is_blank_line(const char* begin, const char* end) {
+  for (const char* p = begin; p < end; p++)
+    if (!is_separator(*p))
+      return false;
+  return true;
+}
+
+// parses the values of one line into `out`, at most `cols` of them.
+// returns the number of fields on the line.
+int parse_line(const char* p, const char* end, float* out, int cols) {
+  int count = 0;
+  while (p < end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+      p++;
+    if (p >= end)
+      break;
+    const char* field_end = p;
+    while (field_end < end && !is_separator(*field_end))
+      field_end++;
+    // an empty field or one that is not a number is nan
+    float value = NAN;
+    const char* number = p < field_end && *p == '+' ? p + 1 : p;
+    auto result = std::from_chars(number, field_end, value);
+    if (result.ec != std::errc() || result.ptr != field_end)
+      value = NAN;
+    if (out && count < cols)
+      out[count] = value;
+    count++;
+    p = field_end;
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+      p++;
+    if (p < end && (*p == ',' || *p == ';'))
+      p++;
+  }
+  return count;
+}
+
+bool open_csv(height_field& field, std::string& error) {
+  const char* begin = (const char*)field.file->data();
+  const char* end = begin + field.file->size();
+  field.file->sequential();
+
+  // the first line that is not blank gives the number of columns. if
+  // it has no number at all it is a header and skipped.
+  const char* first = begin;
+  int cols = 0;
+  while (first < end) {
+    const char* line_end = std::find(first, end, '\n');
+    if (!is_blank_line(first, line_end)) {
+      std::vector<float> values(parse_line(first, line_end, nullptr, 0));
+      cols = parse_line(first, line_end, values.data(), values.size());
+      bool header = std::all_of(values.begin(), values.end(), [](float v) { return std::isnan(v); });
+      if (!header)
+	break;
+      cols = 0;
+    }
+    first = line_end + (line_end < end);
+  }
+  if (cols < 2) {
+    error = "no rows of numbers found";
+    return false;
+  }
+
+  int threads = std::max(1, (int)std::thread::hardware_concurrency());
+  size_t length = end - first;
+  threads = (int)std::max<size_t>(1, std::min<size_t>(threads, length / (1 << 16)));
+  std::vector<const char*> chunks(threads + 1);
+  chunks[0] = first;
+  chunks[threads] = end;
+  for (int i = 1; i < threads; i++) {
+    const char* at = first + length * i / threads;
+    at = std::max(at, chunks[i - 1]);
+    const char* line_end = std::find(at, end, '\n');
+    chunks[i] = line_end + (line_end < end);
+  }
+
+  // pass one, lines per chunk
+  std::vector<long long> lines(threads + 1, 0);
+  parallel_for(0, threads, [&](int chunk_begin, int chunk_end) {
+    for (int c = chunk_begin; c < chunk_end; c++) {
+      long long count = 0;
+      for (const char* p = chunks[c]; p < chunks[c + 1];) {
+	const char* line_end = std::find(p, chunks[c + 1], '\n');
+	if (!is_blank_line(p, line_end))
+	  count++;
+	p = line_end + 1;
+      }
+      lines[c + 1] = count;
+    }
+  });
+  for (int c = 0; c < threads; c++)
+    lines[c + 1] += lines[c];
+
+  long long rows = lines[threads];
+  if (rows < 2) {
+    error = "at least two rows are needed";
+    return false;
+  }
+  if (!check_shape(rows, cols, error))
+    return false;
+  field.storage.assign((size_t)rows * cols, NAN);
+
+  // pass two, values in place
+  std::atomic<long long> ragged(0);
+  parallel_for(0, threads, [&](int chunk_begin, int chunk_end) {
+    for (int c = chunk_begin; c < chunk_end; c++) {
+      long long row = lines[c];
+      for (const char* p = chunks[c]; p < chunks[c + 1];) {
+	const char* line_end = std::find(p, chunks[c + 1], '\n');
+	if (!is_blank_line(p, line_end)) {
+	  if (parse_line(p, line_end, field.storage.data() + row * cols, cols) != cols)
+	    ragged++;
+	  row++;
+	}
+	p = line_end + 1;
+      }
+    }
+  });
+  if (ragged)
+    field.warning = std::to_string(ragged.load()) + " of " + std::to_string(rows) + " rows do not have " +
+      std::to_string(cols) + " values, the missing ones are nan";
+
+  field.rows = rows;
+  field.cols = cols;
+  field.type = HEIGHT_FLOAT32;
+  field.values = (const unsigned char*)field.storage.data();
+  field.row_stride = cols * sizeof(float);
+  // the parsed values do not need the file anymore
+  field.file.reset();
+  return true;
+}
+
+} // namespace
+
+std::string file_extension(const std::string& path) {
+  size_t dot = path.find_last_of('.');
+  size_t slash = path.find_last_of("/\\");
+  if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+    return "";
+  std::string extension = path.substr(dot + 1);
+  for (char& c : extension)
+    c = std::tolower((unsigned char)c);
+  return extension;
+}
+
+bool height_field_open(const char* path, height_field& field, std::string& error) {
+  field = height_field();
+  field.file = std::make_shared<mapped_file>();
+  if (!field.file->open(path)) {
+    error = "cannot open the file";
+    return false;
+  }
+  std::string extension = file_extension(path);
+  if (extension == "npy")
+    return open_npy(field, error);
+  if (extension == "csv" || extension == "txt")
+    return open_csv(field, error);
+  return open_raw(field, path, error);
+}
+
+height_range sample_height_field(const height_field& field, const grid& g, std::vector<float>& vertices) {
+
+  // the field covers the whole grid. rows of the field run along x
+  // like the rows of the grid.
+
+  trace_scope scope("evaluate");
+  int n = g.vertices_per_axis;
+  float start = -g.size / 2.0f;
+  double step = g.size / (double)(n - 1);
+
+  float z_min = INFINITY, z_max = -INFINITY;
+  std::mutex mutex_range;
+
+  parallel_for(0, n, [&](int row_begin, int row_end) {
+    float chunk_min = INFINITY, chunk_max = -INFINITY;
+    for (int i = row_begin; i < row_end; ++i) {
+      float x = start + i * step;
+      size_t row = (size_t)std::llround((double)i * (field.rows - 1) / (n - 1));
+      for (int j = 0; j < n; ++j) {
+	size_t col = (size_t)std::llround((double)j * (field.cols - 1) / (n - 1));
+	float z = static_cast<float>(field.value(row, col));
+	int index = (i * n + j) * floats_per_vertex;
+	vertices[index] = x;
+	vertices[index + 1] = z;
+	vertices[index + 2] = start + j * step;
+	if (std::isfinite(z)) {
+	  chunk_min = std::min(chunk_min, z);
+	  chunk_max = std::max(chunk_max, z);
+	}
+      }
+    }
+    std::lock_guard<std::mutex> lock(mutex_range);
+    z_min = std::min(z_min, chunk_min);
+    z_max = std::max(z_max, chunk_max);
+  }, 16);
+
+  height_range range;
+  if (z_min <= z_max) {
+    range.min = z_min;
+    range.max = z_max;
+  }
+  if (g.normals)
+    grid_normals(g, vertices);
+  return range;
+}
@@ -0,0 +1,389 @@
+#include <implicit.hpp>
+#include <parallel.hpp>
+#include <normal_packing.hpp>
+#include <trace.hpp>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+
+namespace {
+
+// corners of a cell by bit: 1 is +x, 2 is +y, 4 is +z. every
+// tetrahedron walks from corner 0 to corner 7 along the three axes in
+// one of their six orders.
+const int tetrahedra[6][4] = {
+  {0, 1, 3, 7}, {0, 1, 5, 7}, {0, 2, 3, 7},
+  {0, 2, 6, 7}, {0, 4, 5, 7}, {0, 4, 6, 7}
+};
+
+// the edges of a corner of the lattice by the corner bits they add.
+// 1, 2 and 3 lie in the layer of the corner, 4 to 7 reach the next one.
+const int plane_edges = 3;
+const int cross_edges = 4;
+const unsigned int no_vertex = ~0u;
+
+// cells along the side of a block, the unit in which empty space is
+// skipped. an active block is marked singular_block when F is not
+// defined everywhere in it.
+const int block_cells = 8;
+const unsigned char singular_block = 2;
+
+struct slab {
+  std::vector<float> positions; // xyz per vertex
+  std::vector<unsigned int> indices;
+  // vertices on the edges within the first and last corner layer of
+  // the slab, which the slabs around it share
+  std::vector<unsigned int> first, last;
+};
+
+} // namespace
+
+height_range extract_implicit(const program& prog, const grid& g, std::vector<float>& vertices,
+			      std::vector<unsigned int>& indices) {
+
+  trace_scope scope("evaluate");
+  vertices.clear();
+  indices.clear();
+  height_range range;
+  int cells = g.vertices_per_axis - 1;
+  if (cells < 1 || !prog.valid())
+    return range;
+
+  int c = cells + 1; // corners per axis
+  float start = -g.size / 2.0f;
+  double step = g.size / (double)cells;
+  auto coord = [&](int i) { return (float)(start + i * step); };
+  auto corner = [&](int i, int j, int k) { return (uint64_t)i + (uint64_t)c * ((uint64_t)j + (uint64_t)c * k); };
+
+  // ------------------------------------------------------------
+  // blocks
+  // ------------------------------------------------------------
+
+  // the cells are grouped into blocks of block_cells^3. F is bounded
+  // over boxes of blocks (see interval.hpp), starting with the whole
+  // cube, and a box whose bounds leave out 0 holds no surface: none
+  // of its corners is sampled and none of its cells triangulated.
+  // other boxes are split in eight down to single blocks.
+
+  int blocks = (cells + block_cells - 1) / block_cells;
+  std::vector<unsigned char> active((size_t)blocks * blocks * blocks, 0);
+  auto block_side = [&](int lo, int hi) {
+    return interval(coord(lo * block_cells), coord(std::min(hi * block_cells, cells)));
+  };
+
+  struct box { int lo[3], hi[3]; };
+  std::vector<box> boxes = {{{0, 0, 0}, {blocks, blocks, blocks}}};
+  while (!boxes.empty()) {
+    box b = boxes.back();
+    boxes.pop_back();
+    interval bounds = prog.eval_interval(block_side(b.lo[0], b.hi[0]), block_side(b.lo[1], b.hi[1]), g.t,
+					 block_side(b.lo[2], b.hi[2]));
+    // negative values that round to -0 as floats count as outside
+    if (!bounds.singular && (bounds.lo > 0.0 || bounds.hi < -FLT_MIN))
+      continue;
+    int mid[3], split = 0;
+    for (int a = 0; a < 3; a++) {
+      mid[a] = (b.lo[a] + b.hi[a]) / 2;
+      split |= (b.hi[a] - b.lo[a] > 1) << a;
+    }
+    if (!split) {
+      active[((size_t)b.lo[2] * blocks + b.lo[1]) * blocks + b.lo[0]] = bounds.singular ? singular_block : 1;
+      continue;
+    }
+    for (int child = 0; child < 8; child++) {
+      if (child & ~split)
+	continue;
+      box part = b;
+      for (int a = 0; a < 3; a++)
+	if (split >> a & 1)
+	  (child >> a & 1 ? part.lo[a] : part.hi[a]) = mid[a];
+      boxes.push_back(part);
+    }
+  }
+
+  // the blocks of the cells around a row of corners along x
+  auto row_blocks = [&](int j, int k, std::vector<unsigned char>& mask) {
+    std::fill(mask.begin(), mask.end(), 0);
+    for (int bk = std::max(0, k - 1) / block_cells; bk <= std::min(k, cells - 1) / block_cells; bk++)
+      for (int bj = std::max(0, j - 1) / block_cells; bj <= std::min(j, cells - 1) / block_cells; bj++)
+	for (int bi = 0; bi < blocks; bi++)
+	  mask[bi] |= active[((size_t)bk * blocks + bj) * blocks + bi];
+  };
+
+  // ------------------------------------------------------------
+  // samples
+  // ------------------------------------------------------------
+
+  std::vector<float> field((size_t)c * c * c);
+  std::vector<double> xs(c);
+  for (int i = 0; i < c; i++)
+    xs[i] = coord(i);
+
+  parallel_for(0, c, [&](int k_begin, int k_end) {
+    std::vector<double> ys(c), zs(c), out(c);
+    std::vector<unsigned char> mask(blocks);
+    double* outs[1] = {out.data()};
+    for (int k = k_begin; k < k_end; k++) {
+      std::fill(zs.begin(), zs.end(), (double)coord(k));
+      for (int j = 0; j < c; j++) {
+	row_blocks(j, k, mask);
+	// runs of neighbouring active blocks, corners shared by two
+	// blocks are sampled once
+	for (int first = 0; first < blocks; first++) {
+	  if (!mask[first])
+	    continue;
+	  int last = first;
+	  while (last + 1 < blocks && mask[last + 1])
+	    last++;
+	  int i_begin = first * block_cells, i_end = std::min((last + 1) * block_cells, cells) + 1;
+	  int n = i_end - i_begin;
+	  std::fill(ys.begin(), ys.begin() + n, (double)coord(j));
+	  prog.eval_outputs(&xs[i_begin], ys.data(), g.t, n, {prog.result}, outs, nullptr, zs.data());
+	  float* row = &field[corner(i_begin, j, k)];
+	  for (int i = 0; i < n; i++)
+	    row[i] = static_cast<float>(out[i]);
+	  first = last;
+	}
+      }
+    }
+  });
+
+  // ------------------------------------------------------------
+  // triangles
+  // ------------------------------------------------------------
+
+  int slab_count = std::min(cells, std::max(1, (int)std::thread::hardware_concurrency()));
+  std::vector<slab> slabs(slab_count);
+  auto slab_begin = [&](int s) { return (int)((long long)cells * s / slab_count); };
+
+  // the vertices of the edges a layer of cells touches are kept in
+  // three tables indexed by corner and direction: the edges within the
+  // lower and the upper corner layer, and those between the two. the
+  // upper table becomes the lower one of the next layer of cells.
+
+  int plane = c * c;
+  int offset[8];
+  for (int b = 0; b < 8; b++)
+    offset[b] = (b & 1) + c * ((b >> 1 & 1) + c * (b >> 2 & 1));
+
+  parallel_for(0, slab_count, [&](int s_begin, int s_end) {
+    std::vector<unsigned int> lower, between, upper;
+    for (int s = s_begin; s < s_end; s++) {
+      slab& out = slabs[s];
+      lower.assign((size_t)plane * plane_edges, no_vertex);
+      upper.assign((size_t)plane * plane_edges, no_vertex);
+      between.resize((size_t)plane * cross_edges);
+
+      for (int k = slab_begin(s); k < slab_begin(s + 1); k++) {
+	std::fill(between.begin(), between.end(), no_vertex);
+	const float* layer = &field[(size_t)plane * k];
+
+	for (int j = 0; j < cells; j++) {
+	  const unsigned char* row_active = &active[((size_t)(k / block_cells) * blocks + j / block_cells) * blocks];
+	  for (int i = 0; i < cells; i++) {
+	    if (!row_active[i / block_cells]) {
+	      i = (i / block_cells + 1) * block_cells - 1;
+	      continue;
+	    }
+	    int base = i + c * j;
+	    float f[8];
+	    int inside = 0;
+	    for (int b = 0; b < 8; b++) {
+	      f[b] = layer[base + offset[b]];
+	      inside |= (f[b] < 0.0f) << b;
+	    }
+	    if (inside == 0 || inside == 0xFF)
+	      continue;
+	    bool finite = true;
+	    for (int b = 0; b < 8; b++)
+	      finite = finite && std::isfinite(f[b]);
+	    if (!finite)
+	      continue;
+	    // F may change sign through a pole instead of a zero, like
+	    // 1/(x^2+y^2+z^2-4) on its sphere. in a block that is not
+	    // defined everywhere, a cell whose bounds are not either is
+	    // left empty, as the grid leaves out the triangles across a
+	    // pole (see grid_compact_indices).
+	    if (row_active[i / block_cells] == singular_block &&
+		prog.eval_interval(interval(coord(i), coord(i + 1)), interval(coord(j), coord(j + 1)), g.t,
+				   interval(coord(k), coord(k + 1))).singular)
+	      continue;
+
+	    float p[8][3];
+	    for (int b = 0; b < 8; b++) {
+	      p[b][0] = coord(i + (b & 1));
+	      p[b][1] = coord(j + (b >> 1 & 1));
+	      p[b][2] = coord(k + (b >> 2 & 1));
+	    }
+
+	    // the corners of a tetrahedron are ordered by their bits, so
+	    // the lower corner of an edge is a subset of the other and the
+	    // edge adds the bits low ^ high to it
+	    auto cut = [&](int from, int to) -> unsigned int {
+	      int low = std::min(from, to), high = std::max(from, to), direction = low ^ high;
+	      int at = base + (low & 1) + c * (low >> 1 & 1);
+	      unsigned int& slot = direction >= 4 ? between[(size_t)at * cross_edges + direction - 4]
+		: (low & 4 ? upper : lower)[(size_t)at * plane_edges + direction - 1];
+	      if (slot != no_vertex)
+		return slot;
+	      // f[low] and f[high] differ in sign, the denominator is never 0
+	      float t = f[low] / (f[low] - f[high]);
+	      slot = (unsigned int)(out.positions.size() / 3);
+	      for (int a = 0; a < 3; a++)
+		out.positions.push_back(p[low][a] + t * (p[high][a] - p[low][a]));
+	      return slot;
+	    };
+
+	    for (const int* tet : tetrahedra) {
+	      int in[4], outside[4], n_in = 0, n_out = 0;
+	      for (int v = 0; v < 4; v++) {
+		if (inside >> tet[v] & 1)
+		  in[n_in++] = tet[v];
+		else
+		  outside[n_out++] = tet[v];
+	      }
+	      if (n_in == 0 || n_out == 0)
+		continue;
+
+	      unsigned int polygon[4];
+	      int corners = 0;
+	      if (n_in == 1 || n_out == 1) {
+		int lone = n_in == 1 ? in[0] : outside[0];
+		const int* others = n_in == 1 ? outside : in;
+		for (int v = 0; v < 3; v++)
+		  polygon[corners++] = cut(lone, others[v]);
+	      } else {
+		polygon[corners++] = cut(in[0], outside[0]);
+		polygon[corners++] = cut(in[0], outside[1]);
+		polygon[corners++] = cut(in[1], outside[1]);
+		polygon[corners++] = cut(in[1], outside[0]);
+	      }
+
+	      // wind every triangle so it faces the side where F is positive
+	      float inner[3] = {}, outer[3] = {};
+	      for (int a = 0; a < 3; a++) {
+		for (int v = 0; v < n_in; v++) inner[a] += p[in[v]][a] / n_in;
+		for (int v = 0; v < n_out; v++) outer[a] += p[outside[v]][a] / n_out;
+	      }
+	      for (int first = 1; first + 1 < corners; first++) {
+		unsigned int tri[3] = {polygon[0], polygon[first], polygon[first + 1]};
+		const float* q[3] = {&out.positions[tri[0] * 3], &out.positions[tri[1] * 3], &out.positions[tri[2] * 3]};
+		float e1[3], e2[3];
+		for (int a = 0; a < 3; a++) {
+		  e1[a] = q[1][a] - q[0][a];
+		  e2[a] = q[2][a] - q[0][a];
+		}
+		float normal[3] = {e1[1] * e2[2] - e1[2] * e2[1],
+				   e1[2] * e2[0] - e1[0] * e2[2],
+				   e1[0] * e2[1] - e1[1] * e2[0]};
+		float facing = 0.0f;
+		for (int a = 0; a < 3; a++)
+		  facing += normal[a] * (outer[a] - inner[a]);
+		if (facing < 0.0f)
+		  std::swap(tri[1], tri[2]);
+		out.indices.insert(out.indices.end(), tri, tri + 3);
+	      }
+	    }
+	  }
+	}
+
+	if (k == slab_begin(s))
+	  out.first = lower;
+	lower.swap(upper);
+	std::fill(upper.begin(), upper.end(), no_vertex);
+      }
+      out.last = lower;
+    }
+  });
+
+  // ------------------------------------------------------------
+  // welding
+  // ------------------------------------------------------------
+
+  // the edges in the first corner layer of a slab were also cut by
+  // the slab before it. those vertices take the index the earlier slab
+  // gave them, every other vertex gets the next free one.
+
+  std::vector<std::vector<unsigned int>> remap(slab_count);
+  unsigned int total = 0;
+  for (int s = 0; s < slab_count; s++) {
+    slab& current = slabs[s];
+    remap[s].assign(current.positions.size() / 3, no_vertex);
+    if (s > 0)
+      for (size_t e = 0; e < current.first.size(); e++)
+	if (current.first[e] != no_vertex && slabs[s - 1].last[e] != no_vertex)
+	  remap[s][current.first[e]] = remap[s - 1][slabs[s - 1].last[e]];
+    for (unsigned int& index : remap[s])
+      if (index == no_vertex)
+	index = total++;
+  }
+
+  // ------------------------------------------------------------
+  // vertex buffer
+  // ------------------------------------------------------------
+
+  vertices.assign((size_t)total * floats_per_vertex, 0.0f);
+  size_t index_count = 0;
+  for (const slab& current : slabs)
+    index_count += current.indices.size();
+  indices.reserve(index_count);
+  for (int s = 0; s < slab_count; s++)
+    for (unsigned int index : slabs[s].indices)
+      indices.push_back(remap[s][index]);
+
+  float z_min = INFINITY, z_max = -INFINITY;
+  for (int s = 0; s < slab_count; s++) {
+    const slab& current = slabs[s];
+    for (size_t v = 0; v < current.positions.size() / 3; v++) {
+      const float* position = &current.positions[v * 3];
+      float* out = &vertices[(size_t)remap[s][v] * floats_per_vertex];
+      // z is the vertical axis of the scene
+      out[0] = position[0];
+      out[1] = position[2];
+      out[2] = position[1];
+      z_min = std::min(z_min, position[2]);
+      z_max = std::max(z_max, position[2]);
+    }
+  }
+  if (z_min <= z_max) {
+    range.min = z_min;
+    range.max = z_max;
+  }
+  slabs.clear();
+
+  // ------------------------------------------------------------
+  // normals
+  // ------------------------------------------------------------
+
+  if (g.normals) {
+    float h = (float)step / 2.0f;
+    parallel_for(0, (int)total, [&](int v_begin, int v_end) {
+      const int batch = 256;
+      std::vector<double> px(batch * 6), py(batch * 6), pz(batch * 6), f(batch * 6);
+      double* outs[1] = {f.data()};
+      for (int first = v_begin; first < v_end; first += batch) {
+	int m = std::min(batch, v_end - first);
+	for (int v = 0; v < m; v++) {
+	  const float* scene = &vertices[(size_t)(first + v) * floats_per_vertex];
+	  for (int a = 0; a < 6; a++) {
+	    int lane = v * 6 + a;
+	    px[lane] = scene[0] + (a == 0 ? h : a == 1 ? -h : 0.0f);
+	    py[lane] = scene[2] + (a == 2 ? h : a == 3 ? -h : 0.0f);
+	    pz[lane] = scene[1] + (a == 4 ? h : a == 5 ? -h : 0.0f);
+	  }
+	}
+	prog.eval_outputs(px.data(), py.data(), g.t, m * 6, {prog.result}, outs, nullptr, pz.data());
+	for (int v = 0; v < m; v++) {
+	  const double* d = &f[v * 6];
+	  uint32_t normal = pack_normal((float)(d[0] - d[1]), (float)(d[4] - d[5]), (float)(d[2] - d[3]));
+	  std::memcpy(&vertices[(size_t)(first + v) * floats_per_vertex + 6], &normal, sizeof(normal));
+	}
+      }
+    }, 1024);
+  }
+
+  return range;
+}
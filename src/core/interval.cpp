@@ -0,0 +1,196 @@
+#include <interval.hpp>
+#include <program.hpp>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace {
+
+// moves both bounds out by `ulps` units in the last place, relative
+// to their magnitude. denormal results move by the smallest one. a
+// rounded result has the sign of the exact one, -0 for a negative
+// one that underflows, so a bound never crosses 0: sqrt(x^2) stays
+// defined at x = 0.
+interval widen(interval r, double ulps) {
+  double lo = r.lo - (std::fabs(r.lo) * ulps * DBL_EPSILON + DBL_TRUE_MIN);
+  double hi = r.hi + (std::fabs(r.hi) * ulps * DBL_EPSILON + DBL_TRUE_MIN);
+  r.lo = r.lo >= 0.0 && !std::signbit(r.lo) ? std::max(lo, 0.0) : lo;
+  r.hi = r.hi <= 0.0 && std::signbit(r.hi) ? std::min(hi, -0.0) : hi;
+  return r;
+}
+
+interval monotonic(const interval& a, double (*f)(double), double ulps) {
+  return widen(interval(f(a.lo), f(a.hi)), ulps);
+}
+
+// products with an infinite bound, where 0 * inf is 0
+double times(double a, double b) {
+  return a == 0.0 || b == 0.0 ? 0.0 : a * b;
+}
+
+interval multiply(const interval& a, const interval& b) {
+  double p[4] = {times(a.lo, b.lo), times(a.lo, b.hi), times(a.hi, b.lo), times(a.hi, b.hi)};
+  return widen(interval(*std::min_element(p, p + 4), *std::max_element(p, p + 4)), 1);
+}
+
+// x^k by k - 1 multiplications, like program::apply, for k >= 2
+double power(double x, int k) {
+  double r = x;
+  for (int t = k - 1; t > 0; t--)
+    r = r * x;
+  return r;
+}
+
+interval power(const interval& a, int k) {
+  if (k % 2 == 1)
+    return widen(interval(power(a.lo, k), power(a.hi, k)), k);
+  double low = std::fabs(a.lo), high = std::fabs(a.hi);
+  if (a.contains(0.0))
+    return widen(interval(0.0, power(std::max(low, high), k)), k);
+  return widen(interval(power(std::min(low, high), k), power(std::max(low, high), k)), k);
+}
+
+// is `point` + `period` * n inside a for some n. the test is loose by
+// a relative tolerance, answering yes near the bounds only costs the
+// result some tightness.
+bool reaches(const interval& a, double point, double period) {
+  double tolerance = 1e-9 * std::max(1.0, std::max(std::fabs(a.lo), std::fabs(a.hi)));
+  double n = std::ceil((a.lo - tolerance - point) / period);
+  return point + n * period <= a.hi + tolerance;
+}
+
+// sin and cos rise monotonically between their minima and maxima,
+// which lie at `peak` + 2 pi n and `peak` + pi + 2 pi n
+interval periodic(const interval& a, double (*f)(double), double peak) {
+  if (!(a.width() < 2.0 * M_PI))
+    return interval(-1.0, 1.0);
+  double y0 = f(a.lo), y1 = f(a.hi);
+  interval r = widen(interval(std::min(y0, y1), std::max(y0, y1)), 2);
+  if (reaches(a, peak, 2.0 * M_PI))
+    r.hi = 1.0;
+  if (reaches(a, peak + M_PI, 2.0 * M_PI))
+    r.lo = -1.0;
+  r.lo = std::max(r.lo, -1.0);
+  r.hi = std::min(r.hi, 1.0);
+  return r;
+}
+
+// arcsin, arccos, sqrt and the logarithms are only defined over
+// [lo, hi]; their argument is cut to it. going past a limit by the
+// rounding of the bounds alone does not count, or x/5 would leave the
+// domain of arcsin at x = 5.
+interval restrict(const interval& a, double lo, double hi, bool& singular) {
+  double slack = 4.0 * DBL_EPSILON;
+  singular = a.lo < lo - std::fabs(lo) * slack || a.hi > hi + std::fabs(hi) * slack;
+  return interval(std::max(a.lo, lo), std::min(a.hi, hi));
+}
+
+} // namespace
+
+interval interval_entire(bool singular) {
+  interval r(-INFINITY, INFINITY);
+  r.singular = singular;
+  return r;
+}
+
+interval interval_hull(const interval& a, const interval& b) {
+  interval r(std::min(a.lo, b.lo), std::max(a.hi, b.hi));
+  r.singular = a.singular || b.singular;
+  return r;
+}
+
+interval interval_apply(int op, const interval& a, const interval& b) {
+
+  bool singular = false;
+  interval r;
+
+  switch (op) {
+  case OP_ADD:
+    r = widen(interval(a.lo + b.lo, a.hi + b.hi), 1);
+    break;
+  case OP_SUB:
+    r = widen(interval(a.lo - b.hi, a.hi - b.lo), 1);
+    break;
+  case OP_MUL:
+    r = multiply(a, b);
+    break;
+  case OP_DIV:
+    if (b.contains(0.0))
+      return interval_entire(true);
+    r = multiply(a, widen(interval(1.0 / b.hi, 1.0 / b.lo), 1));
+    break;
+  case OP_POW: {
+    // integer exponents only, see program::apply: 0 gives 1, anything
+    // that truncates to 1 or less gives the base
+    int k_lo = (int)std::max(-1e9, std::min(1e9, b.lo));
+    int k_hi = (int)std::max(-1e9, std::min(1e9, b.hi));
+    if (std::isnan(b.lo) || std::isnan(b.hi) || k_hi - std::max(k_lo, 2) > 64)
+      return interval_entire(a.singular || b.singular);
+    bool first = true;
+    auto add = [&](const interval& part) {
+      r = first ? part : interval_hull(r, part);
+      first = false;
+    };
+    if (b.contains(0.0))
+      add(interval(1.0));
+    if (k_lo <= 1 && !(b.lo == 0.0 && b.hi == 0.0))
+      add(interval(a.lo, a.hi));
+    for (int k = std::max(k_lo, 2); k <= k_hi; k++)
+      add(power(a, k));
+    break;
+  }
+  case OP_NEG:
+    r = interval(-a.hi, -a.lo);
+    break;
+  case OP_SIN:
+    r = periodic(a, sin, M_PI / 2.0);
+    break;
+  case OP_COS:
+    r = periodic(a, cos, 0.0);
+    break;
+  case OP_TAN:
+    if (!(a.width() < M_PI) || reaches(a, M_PI / 2.0, M_PI))
+      return interval_entire(true);
+    r = monotonic(a, tan, 2);
+    break;
+  case OP_ASIN:
+  case OP_ACOS: {
+    interval d = restrict(a, -1.0, 1.0, singular);
+    if (d.lo > d.hi)
+      return interval_entire(true);
+    r = op == OP_ASIN ? monotonic(d, asin, 2) : widen(interval(acos(d.hi), acos(d.lo)), 2);
+    break;
+  }
+  case OP_ATAN:
+    r = monotonic(a, atan, 2);
+    break;
+  case OP_RAD:
+    r = widen(interval(a.lo * M_PI / 180, a.hi * M_PI / 180), 2);
+    break;
+  case OP_DEG:
+    r = widen(interval(a.lo * 180 / M_PI, a.hi * 180 / M_PI), 2);
+    break;
+  case OP_SQRT:
+  case OP_LN:
+  case OP_LOG10: {
+    interval d = restrict(a, 0.0, INFINITY, singular);
+    if (d.lo > d.hi)
+      return interval_entire(true);
+    r = monotonic(d, op == OP_SQRT ? (double (*)(double))sqrt : op == OP_LN ? (double (*)(double))log : log10, 2);
+    // the logarithms are not defined at 0 either
+    singular = singular || (op != OP_SQRT && d.lo == 0.0);
+    break;
+  }
+  case OP_EXP:
+    r = monotonic(a, exp, 2);
+    break;
+  default:
+    return interval_entire(a.singular || b.singular);
+  }
+
+  // inf - inf and the like leave nothing to bound
+  if (std::isnan(r.lo) || std::isnan(r.hi))
+    r = interval_entire(false);
+  r.singular = singular || a.singular || b.singular;
+  return r;
+}
@@ -0,0 +1,183 @@
+#include <mapped_file.hpp>
+#include <algorithm>
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+mapped_file::~mapped_file() {
+  close();
+}
+
+#ifdef _WIN32
+
+bool mapped_file::open(const char* path) {
+  close();
+  file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+		     FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    file = nullptr;
+    return false;
+  }
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+    close();
+    return false;
+  }
+  mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (!mapping) {
+    close();
+    return false;
+  }
+  bytes = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  if (!bytes) {
+    close();
+    return false;
+  }
+  length = (size_t)size.QuadPart;
+  return true;
+}
+
+void mapped_file::close() {
+  if (bytes) UnmapViewOfFile(bytes);
+  if (mapping) CloseHandle(mapping);
+  if (file) CloseHandle(file);
+  bytes = nullptr;
+  mapping = nullptr;
+  file = nullptr;
+  length = 0;
+}
+
+void mapped_file::will_need(size_t offset, size_t size) const { }
+void mapped_file::sequential() const { }
+
+#else
+
+bool mapped_file::open(const char* path) {
+  close();
+  int fd = ::open(path, O_RDONLY);
+  if (fd < 0)
+    return false;
+  struct stat info;
+  if (fstat(fd, &info) != 0 || info.st_size == 0) {
+    ::close(fd);
+    return false;
+  }
+  void* address = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  // the mapping keeps its own reference to the file
+  ::close(fd);
+  if (address == MAP_FAILED)
+    return false;
+  bytes = (const unsigned char*)address;
+  length = info.st_size;
+  return true;
+}
+
+void mapped_file::close() {
+  if (bytes)
+    munmap((void*)bytes, length);
+  bytes = nullptr;
+  length = 0;
+}
+
+void mapped_file::will_need(size_t offset, size_t size) const {
+  if (!bytes || offset >= length)
+    return;
+  // madvise wants a page aligned address
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t begin = offset / page * page;
+  size = std::min(size + (offset - begin), length - begin);
+  madvise((void*)(bytes + begin), size, MADV_WILLNEED);
+}
+
+void mapped_file::sequential() const {
+  if (bytes)
+    madvise((void*)bytes, length, MADV_SEQUENTIAL);
+}
+
+#endif
+
+// ------------------------------------------------------------
+// checksum
+// ------------------------------------------------------------
+
+namespace {
+
+const uint64_t prime1 = 0x9e3779b185ebca87ull;
+const uint64_t prime2 = 0xc2b2ae3d27d4eb4full;
+const uint64_t prime3 = 0x165667b19e3779f9ull;
+const uint64_t prime4 = 0x85ebca77c2b2ae63ull;
+const uint64_t prime5 = 0x27d4eb2f165667c5ull;
+
+inline uint64_t rotl(uint64_t x, int r) {
+  return (x << r) | (x >> (64 - r));
+}
+
+inline uint64_t read64(const unsigned char* p) {
+  uint64_t v;
+  std::memcpy(&v, p, 8);
+  return v;
+}
+
+inline uint64_t round64(uint64_t acc, uint64_t input) {
+  return rotl(acc + input * prime2, 31) * prime1;
+}
+
+inline uint64_t merge64(uint64_t acc, uint64_t lane) {
+  return (acc ^ round64(0, lane)) * prime1 + prime4;
+}
+
+}
+
+uint64_t checksum64(const void* data, size_t size) {
+
+  // xxh64 with seed 0: four independent lanes of 8 byte words, so
+  // the multiplications overlap, then the tail and a final avalanche
+
+  const unsigned char* p = (const unsigned char*)data;
+  const unsigned char* end = p + size;
+  uint64_t hash;
+
+  if (size >= 32) {
+    uint64_t v1 = prime1 + prime2, v2 = prime2, v3 = 0, v4 = 0 - prime1;
+    for (; end - p >= 32; p += 32) {
+      v1 = round64(v1, read64(p));
+      v2 = round64(v2, read64(p + 8));
+      v3 = round64(v3, read64(p + 16));
+      v4 = round64(v4, read64(p + 24));
+    }
+    hash = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+    hash = merge64(hash, v1);
+    hash = merge64(hash, v2);
+    hash = merge64(hash, v3);
+    hash = merge64(hash, v4);
+  } else
+    hash = prime5;
+  hash += size;
+
+  for (; end - p >= 8; p += 8)
+    hash = rotl(hash ^ round64(0, read64(p)), 27) * prime1 + prime4;
+  if (end - p >= 4) {
+    uint32_t word;
+    std::memcpy(&word, p, 4);
+    hash = rotl(hash ^ (word * prime1), 23) * prime2 + prime3;
+    p += 4;
+  }
+  for (; p < end; p++)
+    hash = rotl(hash ^ (*p * prime5), 11) * prime1;
+
+  hash ^= hash >> 33;
+  hash *= prime2;
+  hash ^= hash >> 29;
+  hash *= prime3;
+  hash ^= hash >> 32;
+  return hash;
+}
@@ -0,0 +1,664 @@
+#include <mesh.hpp>
+#include <parallel.hpp>
+#include <normal_packing.hpp>
+#include <trace.hpp>
+#include <cstring>
+#include <cfloat>
+#include <cmath>
+#include <algorithm>
+#include <mutex>
+
+// ------------------------------------------------------------
+// shape of the grid
+// ------------------------------------------------------------
+
+namespace {
+
+// an axis of the region from `lo` to `hi`, nan for a side left open
+// at the edge of the square. a side set alone is intersected with the
+// square, the axis is empty when it lies outside.
+
+float axis_begin(float lo, float hi, float size) {
+  if (std::isnan(lo))
+    return -size / 2.0f;
+  return std::isnan(hi) ? std::max(lo, -size / 2.0f) : lo;
+}
+
+float axis_end(float lo, float hi, float size) {
+  if (std::isnan(hi))
+    return size / 2.0f;
+  return std::isnan(lo) ? std::min(hi, size / 2.0f) : hi;
+}
+
+} // namespace
+
+float grid::x_begin() const {
+  return region ? axis_begin(region->x_min, region->x_max, size) : -size / 2.0f;
+}
+
+float grid::x_end() const {
+  return region ? axis_end(region->x_min, region->x_max, size) : size / 2.0f;
+}
+
+float grid::y_begin() const {
+  return region ? axis_begin(region->y_min, region->y_max, size) : -size / 2.0f;
+}
+
+float grid::y_end() const {
+  return region ? axis_end(region->y_min, region->y_max, size) : size / 2.0f;
+}
+
+int grid::rows() const {
+  double width = x_end() - x_begin(), height = y_end() - y_begin();
+  if (!region || vertices_per_axis < 2 || width >= height)
+    return vertices_per_axis;
+  return std::max(2, (int)std::lround((vertices_per_axis - 1) * width / height) + 1);
+}
+
+int grid::columns() const {
+  double width = x_end() - x_begin(), height = y_end() - y_begin();
+  if (!region || vertices_per_axis < 2 || height >= width)
+    return vertices_per_axis;
+  return std::max(2, (int)std::lround((vertices_per_axis - 1) * height / width) + 1);
+}
+
+std::vector<unsigned int> grid_indices(int vertices_per_axis) {
+  return grid_indices(vertices_per_axis, vertices_per_axis);
+}
+
+std::vector<unsigned int> grid_indices(int rows, int columns) {
+
+  std::vector<unsigned int> ind;
+  if (rows < 2 || columns < 2)
+    return ind;
+  ind.reserve((size_t)(rows - 1) * (columns - 1) * 6);
+
+  // indices
+  for (int i = 0; i < rows - 1; i++) {
+    for (int j = 0; j < columns - 1; j++) {
+      int row1 = i * columns;
+      int row2 = (i + 1) * columns;
+      // first quad
+      ind.push_back(row1 + j);
+      ind.push_back(row2 + j);
+      ind.push_back(row1 + j + 1);
+      // second quad
+      ind.push_back(row1 + j + 1);
+      ind.push_back(row2 + j);
+      ind.push_back(row2 + j + 1);
+    }
+  }
+  return ind;
+}
+
+void grid_fill_colors(std::vector<float>& vertices, const float rgb[3]) {
+
+  // only the color values. since the format is xyzrgbn, we need to
+  // skip every seven indices.
+
+  for (size_t i = 3; i < vertices.size(); i += floats_per_vertex) {
+    vertices[i] = rgb[0];
+    vertices[i+1] = rgb[1];
+    vertices[i+2] = rgb[2];
+  }
+}
+
+namespace {
+
+// calls `evaluate(begin, end)` for the runs of vertices of a row that
+// lie inside the mask of the region, all of them without one.
+// inside[j] is 0 for the vertices left out.
+template <typename F>
+void inside_runs(const grid& g, const double* xs, const double* ys, int n,
+		 std::vector<unsigned char>& inside, F evaluate) {
+  if (!g.masked()) {
+    evaluate(0, n);
+    return;
+  }
+  domain_mask_row(*g.region, xs[0], ys, n, inside.data());
+  for (int j = 0; j < n; ) {
+    if (!inside[j]) {
+      j++;
+      continue;
+    }
+    int end = j;
+    while (end < n && inside[end])
+      end++;
+    evaluate(j, end);
+    j = end;
+  }
+}
+
+void parametric_normals(const grid& g, std::vector<float>& vertices, const float* tangents) {
+
+  // the cross product of the derivatives along u and v, or of the
+  // differences to the neighbouring vertices where a derivative is
+  // not finite. both are in scene coordinates. where the surface
+  // pinches to a point (the poles of a sphere) the derivative along u
+  // vanishes and is taken from the next ring of vertices instead.
+
+  int n = g.vertices_per_axis;
+  parallel_for(0, n, [&](int row_begin, int row_end) {
+    auto position = [&](int i, int j, int k) {
+      return vertices[(i * n + j) * floats_per_vertex + k];
+    };
+    auto cross = [](const float a[3], const float b[3], float c[3]) {
+      c[0] = a[1] * b[2] - a[2] * b[1];
+      c[1] = a[2] * b[0] - a[0] * b[2];
+      c[2] = a[0] * b[1] - a[1] * b[0];
+      return std::isfinite(c[0] + c[1] + c[2]) && (c[0] != 0.0f || c[1] != 0.0f || c[2] != 0.0f);
+    };
+    for (int i = row_begin; i < row_end; ++i) {
+      int i0 = std::max(0, i - 1), i1 = std::min(n - 1, i + 1);
+      for (int j = 0; j < n; ++j) {
+	int vertex = i * n + j;
+	float du[3], dv[3], normal[3];
+	bool found = false;
+	if (tangents) {
+	  for (int k = 0; k < 3; k++) {
+	    du[k] = tangents[vertex * 6 + k];
+	    dv[k] = tangents[vertex * 6 + 3 + k];
+	  }
+	  found = cross(du, dv, normal);
+	}
+	if (!found) {
+	  int j0 = std::max(0, j - 1), j1 = std::min(n - 1, j + 1);
+	  int ring = j == 0 ? 1 : j == n - 1 ? n - 2 : j;
+	  for (int k = 0; k < 3; k++) {
+	    du[k] = position(i1, j, k) - position(i0, j, k);
+	    dv[k] = position(i, j1, k) - position(i, j0, k);
+	  }
+	  if (!cross(du, dv, normal)) {
+	    for (int k = 0; k < 3; k++)
+	      du[k] = position(i1, ring, k) - position(i0, ring, k);
+	    cross(du, dv, normal);
+	  }
+	}
+	uint32_t packed = pack_normal(normal[0], normal[1], normal[2]);
+	std::memcpy(&vertices[vertex * floats_per_vertex + 6], &packed, sizeof(packed));
+      }
+    }
+  }, 16);
+}
+
+height_range evaluate_parametric(const program& prog, const grid& g, std::vector<float>& vertices,
+				 const std::vector<int>& stored,
+				 std::vector<std::vector<double>>& stores,
+				 const std::vector<std::vector<double>>& loads) {
+
+  // one pass over the program yields x, y and z of a vertex, and with
+  // normals also their derivatives along u and v
+
+  int n = g.vertices_per_axis;
+  double step = parametric_range / (double)(n - 1);
+
+  std::vector<double> vs(n);
+  for (int j = 0; j < n; ++j)
+    vs[j] = j * step;
+
+  std::vector<int> outputs = prog.coordinates;
+  outputs.insert(outputs.end(), stored.begin(), stored.end());
+
+  bool lighting = g.normals;
+  bool gradient = lighting && stored.empty() && loads.empty();
+  std::vector<float> tangents;
+  if (lighting)
+    tangents.assign((size_t)n * n * 6, NAN);
+
+  float z_min = INFINITY, z_max = -INFINITY;
+  std::mutex mutex_range;
+
+  parallel_for(0, n, [&](int row_begin, int row_end) {
+    float chunk_min = INFINITY, chunk_max = -INFINITY;
+    std::vector<double> us(n);
+    std::vector<double> values(3 * n), du(gradient ? 3 * n : 0), dv(gradient ? 3 * n : 0);
+    std::vector<double*> out(outputs.size());
+    double* out_du[3];
+    double* out_dv[3];
+    std::vector<const double*> in(loads.size());
+    for (int k = 0; k < 3; k++) {
+      out[k] = values.data() + k * n;
+      out_du[k] = gradient ? du.data() + k * n : nullptr;
+      out_dv[k] = gradient ? dv.data() + k * n : nullptr;
+    }
+
+    for (int i = row_begin; i < row_end; ++i) {
+      std::fill(us.begin(), us.end(), i * step);
+      int row = i * n;
+      for (size_t k = 0; k < stored.size(); k++)
+	out[k + 3] = stores[k].data() + row;
+      for (size_t k = 0; k < loads.size(); k++)
+	in[k] = loads[k].data() + row;
+      if (gradient)
+	prog.eval_gradient(us.data(), vs.data(), g.t, n, prog.coordinates, out.data(), out_du, out_dv);
+      else
+	prog.eval_outputs(us.data(), vs.data(), g.t, n, outputs, out.data(), in.data());
+
+      for (int j = 0; j < n; ++j) {
+	// z is the vertical axis of the scene
+	static const int axis[3] = {0, 2, 1};
+	int index = (row + j) * floats_per_vertex;
+	for (int k = 0; k < 3; k++)
+	  vertices[index + axis[k]] = static_cast<float>(values[k * n + j]);
+	if (gradient)
+	  for (int k = 0; k < 3; k++) {
+	    tangents[(size_t)(row + j) * 6 + axis[k]] = static_cast<float>(du[k * n + j]);
+	    tangents[(size_t)(row + j) * 6 + 3 + axis[k]] = static_cast<float>(dv[k * n + j]);
+	  }
+	float z = vertices[index + 1];
+	if (std::isfinite(z)) {
+	  chunk_min = std::min(chunk_min, z);
+	  chunk_max = std::max(chunk_max, z);
+	}
+      }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_range);
+    z_min = std::min(z_min, chunk_min);
+    z_max = std::max(z_max, chunk_max);
+  }, 16);
+
+  height_range range;
+  if (z_min <= z_max) {
+    range.min = z_min;
+    range.max = z_max;
+  }
+
+  if (lighting)
+    parametric_normals(g, vertices, tangents.data());
+  return range;
+}
+
+} // namespace
+
+height_range evaluate_grid(const program& prog, const grid& g, std::vector<float>& vertices) {
+  std::vector<std::vector<double>> none;
+  return evaluate_grid(prog, g, vertices, {}, none, none);
+}
+
+void evaluate_heights(const program& prog, const grid& g, int row_begin, int row_end, float* heights) {
+
+  // same coordinates as evaluate_grid, so both produce the same values
+
+  if (prog.parametric()) {
+    std::vector<float> positions((size_t)(row_end - row_begin) * g.vertices_per_axis * 3);
+    evaluate_positions(prog, g, row_begin, row_end, positions.data());
+    for (size_t i = 0; i < positions.size() / 3; i++)
+      heights[i] = positions[i * 3 + 2];
+    return;
+  }
+
+  int n = g.columns();
+  float x_start = g.x_begin(), y_start = g.y_begin();
+  double x_step = (g.x_end() - x_start) / (double)(g.rows() - 1);
+  double y_step = (g.y_end() - y_start) / (double)(n - 1);
+
+  std::vector<double> ys(n);
+  for (int j = 0; j < n; ++j) {
+    float y = y_start + j * y_step;
+    ys[j] = static_cast<double>(y);
+  }
+
+  parallel_for(row_begin, row_end, [&](int begin, int end) {
+    std::vector<double> xs(n);
+    std::vector<double> zs(n, 0.0);
+    std::vector<unsigned char> inside(n, 1);
+    for (int i = begin; i < end; ++i) {
+      float x = x_start + i * x_step;
+      std::fill(xs.begin(), xs.end(), static_cast<double>(x));
+      inside_runs(g, xs.data(), ys.data(), n, inside, [&](int run_begin, int run_end) {
+	prog.eval_batch(xs.data() + run_begin, ys.data() + run_begin, g.t, zs.data() + run_begin,
+			run_end - run_begin);
+      });
+      float* row = heights + (size_t)(i - row_begin) * n;
+      for (int j = 0; j < n; ++j)
+	row[j] = inside[j] ? static_cast<float>(zs[j]) : NAN;
+    }
+  }, 16);
+}
+
+void evaluate_positions(const program& prog, const grid& g, int row_begin, int row_end, float* positions) {
+
+  if (!prog.parametric()) {
+    int n = g.columns();
+    size_t count = (size_t)(row_end - row_begin) * n;
+    std::vector<float> heights(count);
+    evaluate_heights(prog, g, row_begin, row_end, heights.data());
+    float x_start = g.x_begin(), y_start = g.y_begin();
+    double x_step = (g.x_end() - x_start) / (double)(g.rows() - 1);
+    double y_step = (g.y_end() - y_start) / (double)(n - 1);
+    for (size_t v = 0; v < count; v++) {
+      positions[v * 3] = x_start + (row_begin + v / n) * x_step;
+      positions[v * 3 + 1] = y_start + (v % n) * y_step;
+      positions[v * 3 + 2] = heights[v];
+    }
+    return;
+  }
+
+  int n = g.vertices_per_axis;
+  double step = parametric_range / (double)(n - 1);
+  std::vector<double> vs(n);
+  for (int j = 0; j < n; ++j)
+    vs[j] = j * step;
+
+  parallel_for(row_begin, row_end, [&](int begin, int end) {
+    std::vector<double> us(n);
+    std::vector<double> values(3 * n);
+    double* out[3] = {values.data(), values.data() + n, values.data() + 2 * n};
+    for (int i = begin; i < end; ++i) {
+      std::fill(us.begin(), us.end(), i * step);
+      prog.eval_outputs(us.data(), vs.data(), g.t, n, prog.coordinates, out);
+      float* row = positions + (size_t)(i - row_begin) * n * 3;
+      for (int j = 0; j < n; ++j)
+	for (int k = 0; k < 3; k++)
+	  row[j * 3 + k] = static_cast<float>(values[k * n + j]);
+    }
+  }, 16);
+}
+
+height_range evaluate_grid(const program& prog, const grid& g, std::vector<float>& vertices,
+			   const std::vector<int>& stored,
+			   std::vector<std::vector<double>>& stores,
+			   const std::vector<std::vector<double>>& loads) {
+
+  // rows are split between threads. every row evaluates the compiled
+  // program for all of its vertices in one batch, or for every run of
+  // vertices inside the mask.
+
+  trace_scope scope("evaluate");
+  if (prog.parametric())
+    return evaluate_parametric(prog, g, vertices, stored, stores, loads);
+
+  int rows = g.rows(), columns = g.columns();
+  double t = g.t;
+
+  float x_start = g.x_begin(), y_start = g.y_begin();
+  double x_step = (g.x_end() - x_start) / (double)(rows - 1);
+  double y_step = (g.y_end() - y_start) / (double)(columns - 1);
+
+  std::vector<double> ys(columns);
+  for (int j = 0; j < columns; ++j) {
+    float y = y_start + j * y_step;
+    ys[j] = static_cast<double>(y);
+  }
+
+  std::vector<int> outputs = {prog.result};
+  outputs.insert(outputs.end(), stored.begin(), stored.end());
+
+  // with normals, the gradient of every vertex is evaluated together
+  // with its height. the residual of an incremental update and the
+  // passes that store subexpressions have no derivatives, they leave
+  // nan and the normals fall back to finite differences.
+  bool lighting = g.normals;
+  bool gradient = lighting && prog.valid() && stored.empty() && loads.empty();
+  std::vector<float> gradients;
+  if (lighting)
+    gradients.assign((size_t)rows * columns * 2, NAN);
+
+  // finite height range, reduced per chunk and merged under the lock
+  float z_min = INFINITY, z_max = -INFINITY;
+  std::mutex mutex_range;
+
+  parallel_for(0, rows, [&](int row_begin, int row_end) {
+    float chunk_min = INFINITY, chunk_max = -INFINITY;
+    std::vector<double> xs(columns);
+    std::vector<double> zs(columns, 0.0);
+    std::vector<double> dxs(gradient ? columns : 0);
+    std::vector<double> dys(gradient ? columns : 0);
+    std::vector<unsigned char> inside(columns, 1);
+    std::vector<double*> out(outputs.size());
+    std::vector<const double*> in(loads.size());
+
+    for (int i = row_begin; i < row_end; ++i) {
+      float x = x_start + i * x_step;
+      std::fill(xs.begin(), xs.end(), static_cast<double>(x));
+
+      int row = i * columns;
+      inside_runs(g, xs.data(), ys.data(), columns, inside, [&](int begin, int end) {
+	int n = end - begin;
+	out[0] = zs.data() + begin;
+	for (size_t k = 0; k < stored.size(); k++)
+	  out[k + 1] = stores[k].data() + row + begin;
+	for (size_t k = 0; k < loads.size(); k++)
+	  in[k] = loads[k].data() + row + begin;
+	if (gradient)
+	  prog.eval_gradient(xs.data() + begin, ys.data() + begin, t, n, zs.data() + begin,
+			     dxs.data() + begin, dys.data() + begin);
+	else if (prog.valid())
+	  prog.eval_outputs(xs.data() + begin, ys.data() + begin, t, n, outputs, out.data(), in.data());
+      });
+
+      for (int j = 0; j < columns; ++j) {
+	int index = (row + j) * floats_per_vertex;
+	vertices[index] = x;
+	vertices[index + 1] = inside[j] ? static_cast<float>(zs[j]) : NAN;
+	vertices[index + 2] = static_cast<float>(ys[j]);
+	if (gradient && inside[j]) {
+	  gradients[(row + j) * 2] = static_cast<float>(dxs[j]);
+	  gradients[(row + j) * 2 + 1] = static_cast<float>(dys[j]);
+	}
+	float z = vertices[index + 1];
+	if (std::isfinite(z)) {
+	  chunk_min = std::min(chunk_min, z);
+	  chunk_max = std::max(chunk_max, z);
+	}
+      }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_range);
+    z_min = std::min(z_min, chunk_min);
+    z_max = std::max(z_max, chunk_max);
+  }, 16);
+
+  height_range range;
+  if (z_min <= z_max) {
+    range.min = z_min;
+    range.max = z_max;
+  }
+
+  if (lighting)
+    grid_normals(g, vertices, gradients.data());
+  return range;
+}
+
+void grid_normals(const grid& g, std::vector<float>& vertices, const float* gradients) {
+
+  // a second pass after the heights, it needs the neighbouring rows
+
+  int rows = g.rows(), columns = g.columns();
+  double x_step = (g.x_end() - g.x_begin()) / (double)(rows - 1);
+  double y_step = (g.y_end() - g.y_begin()) / (double)(columns - 1);
+
+  parallel_for(0, rows, [&](int row_begin, int row_end) {
+    auto height = [&](int i, int j) {
+      return vertices[(i * columns + j) * floats_per_vertex + 1];
+    };
+    for (int i = row_begin; i < row_end; ++i) {
+      for (int j = 0; j < columns; ++j) {
+	int vertex = i * columns + j;
+	float dzdx = gradients ? gradients[vertex * 2] : NAN;
+	float dzdy = gradients ? gradients[vertex * 2 + 1] : NAN;
+	if (!std::isfinite(dzdx) || !std::isfinite(dzdy)) {
+	  // central differences, one sided on the border and next to a
+	  // vertex without a height
+	  int i0 = std::max(0, i - 1), i1 = std::min(rows - 1, i + 1);
+	  int j0 = std::max(0, j - 1), j1 = std::min(columns - 1, j + 1);
+	  if (!std::isfinite(height(i0, j)))
+	    i0 = i;
+	  if (!std::isfinite(height(i1, j)))
+	    i1 = i;
+	  if (!std::isfinite(height(i, j0)))
+	    j0 = j;
+	  if (!std::isfinite(height(i, j1)))
+	    j1 = j;
+	  dzdx = i1 > i0 ? (height(i1, j) - height(i0, j)) / ((i1 - i0) * x_step) : 0.0f;
+	  dzdy = j1 > j0 ? (height(i, j1) - height(i, j0)) / ((j1 - j0) * y_step) : 0.0f;
+	}
+	// the function value is drawn along the y axis
+	uint32_t normal = pack_normal(-dzdx, 1.0f, -dzdy);
+	std::memcpy(&vertices[vertex * floats_per_vertex + 6], &normal, sizeof(normal));
+      }
+    }
+  }, 16);
+}
+
+interval bound_grid(const program& prog, const grid& g, int depth) {
+
+  if (!prog.valid())
+    return interval();
+
+  bool cube = prog.uses(OP_Z) && !prog.parametric();
+  double lo = prog.parametric() ? 0.0 : -g.size / 2.0;
+  double hi = prog.parametric() ? parametric_range : g.size / 2.0;
+  interval x(lo, hi), y(lo, hi);
+  if (g.region && !prog.parametric() && !cube) {
+    x = interval(g.x_begin(), g.x_end());
+    y = interval(g.y_begin(), g.y_end());
+  }
+
+  struct box { interval side[3]; int level; };
+  std::vector<box> boxes = {{{x, y, cube ? interval(lo, hi) : interval()}, 0}};
+  interval bounds;
+  bool first = true;
+  while (!boxes.empty()) {
+    box b = boxes.back();
+    boxes.pop_back();
+    interval part = prog.eval_interval(b.side[0], b.side[1], g.t, b.side[2]);
+    if (!part.singular || b.level == depth) {
+      bounds = first ? part : interval_hull(bounds, part);
+      first = false;
+      continue;
+    }
+    int axes = cube ? 3 : 2;
+    for (int child = 0; child < 1 << axes; child++) {
+      box c = b;
+      c.level++;
+      for (int a = 0; a < axes; a++) {
+	double mid = (b.side[a].lo + b.side[a].hi) / 2.0;
+	c.side[a] = child >> a & 1 ? interval(mid, b.side[a].hi) : interval(b.side[a].lo, mid);
+      }
+      boxes.push_back(c);
+    }
+  }
+  return bounds;
+}
+
+float grid_jump(std::vector<float>& sample) {
+  sample.erase(std::remove_if(sample.begin(), sample.end(), [](float h) { return !std::isfinite(h); }),
+	       sample.end());
+  if (sample.empty())
+    return INFINITY;
+  size_t low = sample.size() / 100, high = sample.size() - 1 - low;
+  std::nth_element(sample.begin(), sample.begin() + low, sample.end());
+  float spread = -sample[low];
+  std::nth_element(sample.begin(), sample.begin() + high, sample.end());
+  spread += sample[high];
+  return spread * jump_fraction;
+}
+
+bool grid_quad_singular(const program& prog, const grid& g, int i, int j) {
+  // the same coordinates the vertices were evaluated at
+  float x_start = g.x_begin(), y_start = g.y_begin();
+  double x_step = (g.x_end() - x_start) / (double)(g.rows() - 1);
+  double y_step = (g.y_end() - y_start) / (double)(g.columns() - 1);
+  interval x((float)(x_start + i * x_step), (float)(x_start + (i + 1) * x_step));
+  interval y((float)(y_start + j * y_step), (float)(y_start + (j + 1) * y_step));
+  return prog.eval_interval(x, y, g.t).singular;
+}
+
+bool grid_compact_indices(const program& prog, const grid& g, const float* vertices,
+			  std::vector<unsigned int>& indices) {
+
+  trace_scope scope("index");
+  indices.clear();
+  int n = g.columns();
+  int quad_rows = g.rows() - 1, quads = n - 1;
+  if (quad_rows < 1 || quads < 1)
+    return false;
+
+  // a height field whose bounds over the whole grid are finite and
+  // defined everywhere has nothing to leave out, which one interval
+  // evaluation tells. the heights are floats, so the bounds have to
+  // fit in one. the holes a mask leaves are not in the bounds.
+  bool height_field = prog.valid() && !prog.parametric();
+  if (height_field && !g.masked()) {
+    interval bounds = bound_grid(prog, g, 0);
+    if (!bounds.singular && bounds.lo >= -FLT_MAX && bounds.hi <= FLT_MAX)
+      return false;
+  }
+
+  // a triangle whose heights span more than jump_fraction of the
+  // spread of the heights is checked for a pole inside its quad
+  std::vector<float> sample;
+  size_t count = (size_t)g.rows() * n;
+  size_t stride = std::max<size_t>(1, count / 65536);
+  for (size_t v = 0; v < count; v += stride)
+    sample.push_back(vertices[v * floats_per_vertex + 1]);
+  float jump = grid_jump(sample);
+
+  // bit 0 and 1 keep the first and the second triangle of a quad
+  std::vector<unsigned char> keep((size_t)quad_rows * quads);
+  std::vector<long long> row_kept(quad_rows);
+
+  parallel_for(0, quad_rows, [&](int row_begin, int row_end) {
+    auto finite = [&](int v) {
+      const float* p = vertices + (size_t)v * floats_per_vertex;
+      return std::isfinite(p[0]) && std::isfinite(p[1]) && std::isfinite(p[2]);
+    };
+    auto height = [&](int v) { return vertices[(size_t)v * floats_per_vertex + 1]; };
+    auto span = [&](int a, int b, int c) {
+      float h[3] = {height(a), height(b), height(c)};
+      return std::max(h[0], std::max(h[1], h[2])) - std::min(h[0], std::min(h[1], h[2]));
+    };
+    for (int i = row_begin; i < row_end; i++) {
+      long long kept = 0;
+      for (int j = 0; j < quads; j++) {
+	int v = i * n + j, below = v + n;
+	bool corners[4] = {finite(v), finite(below), finite(v + 1), finite(below + 1)};
+	bool first = corners[0] && corners[1] && corners[2];
+	bool second = corners[1] && corners[2] && corners[3];
+	bool steep_first = first && span(v, below, v + 1) > jump;
+	bool steep_second = second && span(v + 1, below, below + 1) > jump;
+	if (height_field && (steep_first || steep_second) && grid_quad_singular(prog, g, i, j)) {
+	  first = first && !steep_first;
+	  second = second && !steep_second;
+	}
+	keep[(size_t)i * quads + j] = first | second << 1;
+	kept += first + second;
+      }
+      row_kept[i] = kept;
+    }
+  }, 16);
+
+  long long total = 0;
+  for (int i = 0; i < quad_rows; i++) {
+    long long kept = row_kept[i];
+    row_kept[i] = total;
+    total += kept;
+  }
+  if (total == (long long)quad_rows * quads * 2)
+    return false;
+
+  // the kept triangles in the order of grid_indices
+  indices.resize(total * 3);
+  parallel_for(0, quad_rows, [&](int row_begin, int row_end) {
+    unsigned int* out = indices.data() + row_kept[row_begin] * 3;
+    for (int i = row_begin; i < row_end; i++) {
+      for (int j = 0; j < quads; j++) {
+	unsigned char k = keep[(size_t)i * quads + j];
+	unsigned int v = i * n + j, below = v + n;
+	if (k & 1) {
+	  *out++ = v;
+	  *out++ = below;
+	  *out++ = v + 1;
+	}
+	if (k & 2) {
+	  *out++ = v + 1;
+	  *out++ = below;
+	  *out++ = below + 1;
+	}
+      }
+    }
+  }, 16);
+  return true;
+}
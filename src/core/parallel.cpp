@@ -0,0 +1,82 @@
+#include <parallel.hpp>
+
+// ------------------------------------------------------------
+// workers
+// ------------------------------------------------------------
+
+thread_pool& thread_pool::shared() {
+  static thread_pool pool;
+  return pool;
+}
+
+thread_pool::thread_pool() {
+  int threads = std::max(1, (int)std::thread::hardware_concurrency());
+  for (int i = 1; i < threads; i++)
+    workers.emplace_back(&thread_pool::work, this);
+}
+
+thread_pool::~thread_pool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  wake.notify_all();
+  for (std::thread& worker : workers)
+    worker.join();
+}
+
+void thread_pool::work() {
+  std::unique_lock<std::mutex> lock(mutex);
+  for (;;) {
+    wake.wait(lock, [&] { return stopping || !jobs.empty(); });
+    if (jobs.empty())
+      return;
+    job& j = *jobs.front();
+    int i = claim(j);
+    lock.unlock();
+    (*j.task)(i);
+    complete(j);
+    lock.lock();
+  }
+}
+
+// ------------------------------------------------------------
+// jobs
+// ------------------------------------------------------------
+
+int thread_pool::claim(job& j) {
+  // called with the mutex held, the job leaves the queue with its
+  // last task
+  int i = j.next++;
+  if (j.next == j.count)
+    jobs.erase(std::find(jobs.begin(), jobs.end(), &j));
+  return i;
+}
+
+void thread_pool::complete(job& j) {
+  // the last access of a worker to the job, the caller may return
+  // as soon as the mutex is released
+  std::lock_guard<std::mutex> lock(mutex);
+  if (++j.done == j.count)
+    finished.notify_all();
+}
+
+void thread_pool::run(int count, const std::function<void(int)>& task) {
+  if (count <= 0)
+    return;
+  job j;
+  j.task = &task;
+  j.count = count;
+
+  std::unique_lock<std::mutex> lock(mutex);
+  jobs.push_back(&j);
+  wake.notify_all();
+  while (j.next < j.count) {
+    int i = claim(j);
+    lock.unlock();
+    task(i);
+    complete(j);
+    lock.lock();
+  }
+  finished.wait(lock, [&] { return j.done == j.count; });
+}
@@ -0,0 +1,439 @@
+// modified parser from C++: Complete Reference
+
+#include <parser.hpp>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace {
+
+const char* function_names[] = {
+  "sin", "cos", "tan", "arcsin", "arccos", "arctan", "rad", "deg", "sqrt", "exp", "ln", "log10"
+};
+
+}
+
+parser::parser()
+  : expr_ptr(NULL),
+    x(0.0),
+    y(0.0),
+    z(0.0),
+    t(0.0),
+    failed(false),
+    parametric(false),
+    prog(NULL) { }
+
+double parser::eval_expr(char* expr) {
+  double result;
+  expr_ptr = expr;
+  get_token();
+  if (!*token) {
+    serror(2);
+    return 0.0;
+  }
+  eval_AS(result);
+  if (*token)
+    serror(0);
+  return result;
+}
+
+void parser::eval_AS(double& result) {
+  char op;
+  double temp;
+
+  eval_MD(result);
+  while ((op = *token) == '+' || op == '-') {
+    get_token();
+    eval_MD(temp);
+    switch (op) {
+    case '+':
+      result = result + temp;
+      break;
+    case '-':
+      result = result - temp;
+      break;
+    }
+  }
+}
+
+void parser::eval_MD(double& result) {
+  char op;
+  double temp;
+
+  eval_E(result);
+  while ((op = *token) == '*' || op == '/') {
+    get_token();
+    eval_E(temp);
+    switch (op) {
+    case '*':
+      result = result * temp;
+      break;
+    case '/':
+      result = result / temp;
+      break;
+    }
+  }
+}
+
+void parser::eval_E(double& result) {
+  double temp, ex;
+
+  eval_unary(result);
+  if (*token == '^') {
+    get_token();
+    eval_E(temp);
+    ex = result;
+    if (temp == 0.0) {
+      result = 1.0;
+      return;
+    }
+    for (int t = (int)temp - 1; t > 0; t--)
+      result = result * (double)ex;
+  }
+}
+
+void parser::eval_unary(double& result) {
+  char op = 0;
+  if (token_type == DELIMITER && (*token == '+' || *token == '-')) {
+    op = *token;
+    get_token();
+  }
+  eval_P(result);
+  if (op == '-')
+    result = -result;
+}
+
+void parser::eval_P(double& result) {
+  if (*token == '(') {
+    get_token();
+    eval_AS(result);
+    if (*token != ')')
+      serror(1);
+    get_token();
+  }
+  else
+    atom(result);
+}
+
+void parser::eval_function(double& result, const char* token) {
+  if (strcmp(token, "sin") == 0)
+    result = sin(result);
+  else if (strcmp(token, "cos") == 0)
+    result = cos(result);
+  else if (strcmp(token, "tan") == 0)
+    result = tan(result);
+  else if (strcmp(token, "arcsin") == 0)
+    result = asin(result);
+  else if (strcmp(token, "arccos") == 0)
+    result = acos(result);
+  else if (strcmp(token, "arctan") == 0)
+    result = atan(result);
+  else if (strcmp(token, "rad") == 0)
+    result = result * M_PI / 180;
+  else if (strcmp(token, "deg") == 0)
+    result = result * 180 / M_PI;
+  else if (strcmp(token, "sqrt") == 0)
+    result = sqrt(result);
+  else if (strcmp(token, "exp") == 0)
+    result = exp(result);
+  else if (strcmp(token, "ln") == 0)
+    result = log(result);
+  else if (strcmp(token, "log10") == 0)
+    result = log10(result);
+}
+
+void parser::get_token() {
+  char* temp;
+  token_type = 0;
+  temp = token;
+  *temp = '\0';
+
+  if (!*expr_ptr) return;
+
+  while (isspace(*expr_ptr)) ++expr_ptr;
+
+  if (strchr("+-*/^(),", *expr_ptr)) {
+    token_type = DELIMITER;
+    *temp++ = *expr_ptr++;
+  }
+  else if (isalpha(*expr_ptr)) {
+    copy_token(temp);
+
+    if (std::any_of(std::begin(function_names), std::end(function_names),
+		    [&](const char* name) { return strcmp(token, name) == 0; })) {
+      token_type = FUNCTION;
+    } else {
+      token_type = VARIABLE;
+    }
+  }
+  else if (isdigit(*expr_ptr)) {
+    copy_token(temp);
+    token_type = NUMBER;
+  }
+  *temp = '\0';
+}
+
+void parser::copy_token(char*& temp) {
+
+  // an identifier or a number up to the next delimiter. one longer
+  // than the token is an error, the rest of it is skipped.
+
+  while (!isdelim(*expr_ptr)) {
+    if (temp < token + sizeof(token) - 1)
+      *temp++ = *expr_ptr;
+    else
+      serror(5);
+    ++expr_ptr;
+  }
+  *temp = '\0';
+}
+
+void parser::atom(double& result) {
+  switch (token_type) {
+  case FUNCTION:
+    char token_temp[sizeof(token)];
+    strcpy(token_temp, token);
+    get_token(); // skip function name
+    if (*token != '(') serror(1);
+    get_token(); // skip (
+    eval_AS(result);
+    eval_function(result, token_temp);
+    if (*token != ')') serror(1);
+    get_token();
+    break;
+  case VARIABLE:
+    if (*token == 'x')
+      result = x;
+    else if (*token == 'y')
+      result = y;
+    else if (*token == 'z')
+      result = z;
+    else if (*token == 't')
+      result = t;
+    else
+      serror(3);
+    get_token();
+    return;
+  case NUMBER:
+    result = atof(token);
+    get_token();
+    return;
+  default:
+    serror(0);
+  }
+}
+
+void parser::set_xy(double x_val, double y_val) {
+  x = x_val;
+  y = y_val;
+}
+
+void parser::set_z(double z_val) {
+  z = z_val;
+}
+
+void parser::set_t(double t_val) {
+  t = t_val;
+}
+
+bool parser::isdelim(char c) {
+  if (strchr(" +-*/^(),", c) || c == 9 || c == '\r' || c == 0) {
+    return true;
+  }
+  return false;
+}
+
+void parser::serror(int error) {
+  static const char* e[] = {
+    "SyntaxError",
+    "UnbalancedParentheses",
+    "NoExpression",
+    "InvalidVariable",
+    "UnknownIdentifier",
+    "TokenTooLong"
+  };
+  failed = true;
+  // std::cout << e[error] << std::endl;
+}
+
+// ------------------------------------------------------------
+// compilation
+// ------------------------------------------------------------
+
+// same grammar as the eval_* functions above, but every rule emits
+// an instruction into `prog` and returns its register instead of a
+// value. the program can then be evaluated for many points without
+// parsing the string again.
+//
+// three expressions separated by commas are a parametric surface,
+// x(u,v), y(u,v), z(u,v). they are compiled into the same program,
+// so the three share every equal subexpression.
+
+bool parser::compile(const char* expr, program& prog) {
+  int reg = -1;
+  this->prog = &prog;
+  prog.clear();
+  failed = false;
+  parametric = strchr(expr, ',') != NULL;
+  expr_ptr = expr;
+  get_token();
+  if (!*token) {
+    serror(2);
+    return false;
+  }
+  compile_AS(reg);
+  if (parametric) {
+    std::vector<int> coordinates = {reg};
+    while (*token == ',' && coordinates.size() < 3) {
+      get_token();
+      compile_AS(reg);
+      coordinates.push_back(reg);
+    }
+    if (coordinates.size() != 3)
+      serror(0);
+    prog.coordinates = coordinates;
+  }
+  if (*token)
+    serror(0);
+  if (failed || reg < 0 || std::count(prog.coordinates.begin(), prog.coordinates.end(), -1) > 0) {
+    prog.clear();
+    return false;
+  }
+  prog.result = reg;
+  return true;
+}
+
+void parser::compile_AS(int& reg) {
+  char op;
+  int temp = -1;
+
+  compile_MD(reg);
+  while ((op = *token) == '+' || op == '-') {
+    get_token();
+    compile_MD(temp);
+    reg = prog->emit(op == '+' ? OP_ADD : OP_SUB, reg, temp);
+  }
+}
+
+void parser::compile_MD(int& reg) {
+  char op;
+  int temp = -1;
+
+  compile_E(reg);
+  while ((op = *token) == '*' || op == '/') {
+    get_token();
+    compile_E(temp);
+    reg = prog->emit(op == '*' ? OP_MUL : OP_DIV, reg, temp);
+  }
+}
+
+void parser::compile_E(int& reg) {
+  int temp = -1;
+
+  compile_unary(reg);
+  if (*token == '^') {
+    get_token();
+    compile_E(temp);
+    reg = prog->emit(OP_POW, reg, temp);
+  }
+}
+
+void parser::compile_unary(int& reg) {
+  char op = 0;
+  if (token_type == DELIMITER && (*token == '+' || *token == '-')) {
+    op = *token;
+    get_token();
+  }
+  compile_P(reg);
+  if (op == '-')
+    reg = prog->emit(OP_NEG, reg);
+}
+
+void parser::compile_P(int& reg) {
+  if (*token == '(') {
+    get_token();
+    compile_AS(reg);
+    if (*token != ')')
+      serror(1);
+    get_token();
+  }
+  else
+    compile_atom(reg);
+}
+
+void parser::compile_atom(int& reg) {
+  switch (token_type) {
+  case FUNCTION:
+    char token_temp[sizeof(token)];
+    strcpy(token_temp, token);
+    get_token(); // skip function name
+    if (*token != '(') serror(1);
+    get_token(); // skip (
+    compile_AS(reg);
+    reg = prog->emit(function_opcode(token_temp), reg);
+    if (*token != ')') serror(1);
+    get_token();
+    break;
+  case VARIABLE:
+    // any other name is a parameter of the program. x, y and z are
+    // the results of a parametric surface, not its variables. z makes
+    // any other expression an implicit surface.
+    if (strcmp(token, parametric ? "u" : "x") == 0)
+      reg = prog->emit(OP_X);
+    else if (strcmp(token, parametric ? "v" : "y") == 0)
+      reg = prog->emit(OP_Y);
+    else if (strcmp(token, "z") == 0 && !parametric)
+      reg = prog->emit(OP_Z);
+    else if (parametric && (strcmp(token, "x") == 0 || strcmp(token, "y") == 0 || strcmp(token, "z") == 0))
+      serror(3);
+    else if (strcmp(token, "t") == 0)
+      reg = prog->emit(OP_T);
+    else if (!parameter_name(token))
+      serror(4);
+    else
+      reg = prog->emit(OP_PARAM, prog->param_index(token));
+    get_token();
+    return;
+  case NUMBER:
+    reg = prog->emit(OP_CONST, -1, -1, atof(token));
+    get_token();
+    return;
+  default:
+    serror(0);
+  }
+}
+
+bool parser::parameter_name(const char* name) const {
+
+  // variables written without an operator, alone or after a
+  // function, such as xy or sinx, are not parameters: they would
+  // silently evaluate as one of value 1. radius or degree are. x, y
+  // and z count as variables of a parametric surface too, they are an
+  // error there.
+
+  const char* variables = parametric ? "uvtxyz" : "xyzt";
+  size_t length = strlen(name);
+  if (strspn(name, variables) == length)
+    return false;
+  for (const char* function : function_names) {
+    size_t prefix = strlen(function);
+    if (strncmp(name, function, prefix) == 0 && strspn(name + prefix, variables) == length - prefix)
+      return false;
+  }
+  return true;
+}
+
+int parser::function_opcode(const char* token) {
+  if (strcmp(token, "sin") == 0)    return OP_SIN;
+  if (strcmp(token, "cos") == 0)    return OP_COS;
+  if (strcmp(token, "tan") == 0)    return OP_TAN;
+  if (strcmp(token, "arcsin") == 0) return OP_ASIN;
+  if (strcmp(token, "arccos") == 0) return OP_ACOS;
+  if (strcmp(token, "arctan") == 0) return OP_ATAN;
+  if (strcmp(token, "rad") == 0)    return OP_RAD;
+  if (strcmp(token, "deg") == 0)    return OP_DEG;
+  if (strcmp(token, "sqrt") == 0)   return OP_SQRT;
+  if (strcmp(token, "exp") == 0)    return OP_EXP;
+  if (strcmp(token, "ln") == 0)     return OP_LN;
+  return OP_LOG10;
+}
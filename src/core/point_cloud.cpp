@@ -0,0 +1,276 @@
+#include <point_cloud.hpp>
+#include <parallel.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <mutex>
+
+namespace {
+
+const int max_depth = 21; // bits per axis of the morton code
+const uint32_t unowned = 0xFFFFFFFFu;
+
+struct keyed_point {
+  uint64_t code;
+  uint32_t index; // row of the table
+};
+
+// spreads the lower 21 bits of v over every third bit
+uint64_t spread_bits(uint64_t v) {
+  v &= 0x1FFFFF;
+  v = (v | v << 32) & 0x1F00000000FFFFull;
+  v = (v | v << 16) & 0x1F0000FF0000FFull;
+  v = (v | v << 8) & 0x100F00F00F00F00Full;
+  v = (v | v << 4) & 0x10C30C30C30C30C3ull;
+  v = (v | v << 2) & 0x1249249249249249ull;
+  return v;
+}
+
+// scene position of a row: the file's z is the vertical axis
+inline void row_position(const height_field& table, size_t row, float p[3]) {
+  p[0] = static_cast<float>(table.value(row, 0));
+  p[1] = static_cast<float>(table.value(row, 2));
+  p[2] = static_cast<float>(table.value(row, 1));
+}
+
+} // namespace
+
+bool point_cloud_open(const char* path, point_cloud& cloud, std::string& error) {
+
+  // tables with a header go through the height data readers, raw
+  // triples are used straight from the mapping
+
+  height_field table;
+  std::string extension = file_extension(path);
+  if (extension == "npy" || extension == "csv" || extension == "txt") {
+    if (!height_field_open(path, table, error))
+      return false;
+  } else {
+    table.file = std::make_shared<mapped_file>();
+    if (!table.file->open(path)) {
+      error = "cannot open the file";
+      return false;
+    }
+    size_t size = table.file->size();
+    if (size % (3 * sizeof(float)) != 0) {
+      error = "a raw point file holds float32 x, y, z triples";
+      return false;
+    }
+    table.rows = size / (3 * sizeof(float));
+    table.cols = 3;
+    table.type = HEIGHT_FLOAT32;
+    table.values = table.file->data();
+    table.row_stride = 3 * sizeof(float);
+    table.file->sequential();
+  }
+  return point_cloud_build(table, cloud, error);
+}
+
+bool point_cloud_build(const height_field& table, point_cloud& cloud, std::string& error) {
+
+  cloud = point_cloud();
+  if (table.cols < 3) {
+    error = "expected the columns x, y, z and an optional value";
+    return false;
+  }
+  if ((size_t)table.rows >= unowned) {
+    error = "too many points";
+    return false;
+  }
+  cloud.has_values = table.cols >= 4;
+  int rows = table.rows;
+
+  // ------------------------------------------------------------
+  // bounds
+  // ------------------------------------------------------------
+
+  float lo[4] = {INFINITY, INFINITY, INFINITY, INFINITY};
+  float hi[4] = {-INFINITY, -INFINITY, -INFINITY, -INFINITY};
+  std::mutex mutex_bounds;
+  parallel_for(0, rows, [&](int row_begin, int row_end) {
+    float chunk_lo[4] = {INFINITY, INFINITY, INFINITY, INFINITY};
+    float chunk_hi[4] = {-INFINITY, -INFINITY, -INFINITY, -INFINITY};
+    for (int i = row_begin; i < row_end; i++) {
+      float p[4];
+      row_position(table, i, p);
+      if (!std::isfinite(p[0]) || !std::isfinite(p[1]) || !std::isfinite(p[2]))
+	continue;
+      p[3] = cloud.has_values ? static_cast<float>(table.value(i, 3)) : p[1];
+      for (int k = 0; k < 4; k++) {
+	if (!std::isfinite(p[k])) continue;
+	chunk_lo[k] = std::min(chunk_lo[k], p[k]);
+	chunk_hi[k] = std::max(chunk_hi[k], p[k]);
+      }
+    }
+    std::lock_guard<std::mutex> lock(mutex_bounds);
+    for (int k = 0; k < 4; k++) {
+      lo[k] = std::min(lo[k], chunk_lo[k]);
+      hi[k] = std::max(hi[k], chunk_hi[k]);
+    }
+  }, 1 << 14);
+
+  if (!(lo[0] <= hi[0])) {
+    error = "no point with finite coordinates";
+    return false;
+  }
+  for (int k = 0; k < 3; k++) {
+    cloud.min[k] = lo[k];
+    cloud.max[k] = hi[k];
+  }
+  cloud.value_min = lo[3] <= hi[3] ? lo[3] : 0.0f;
+  cloud.value_max = lo[3] <= hi[3] ? hi[3] : 0.0f;
+
+  // the root is the bounding cube, a little larger so that the
+  // largest coordinate still falls inside
+  float root_size = std::max({hi[0] - lo[0], hi[1] - lo[1], hi[2] - lo[2]});
+  root_size = root_size > 0.0f ? root_size * (1.0f + 1e-6f) : 1.0f;
+
+  // ------------------------------------------------------------
+  // morton order
+  // ------------------------------------------------------------
+
+  // points that are not finite get the largest code and are cut off
+  // after sorting
+  std::vector<keyed_point> keys(rows);
+  double scale = (double)(1 << max_depth) / root_size;
+  parallel_for(0, rows, [&](int row_begin, int row_end) {
+    for (int i = row_begin; i < row_end; i++) {
+      float p[3];
+      row_position(table, i, p);
+      keys[i].index = i;
+      if (!std::isfinite(p[0]) || !std::isfinite(p[1]) || !std::isfinite(p[2])) {
+	keys[i].code = ~0ull;
+	continue;
+      }
+      uint64_t q[3];
+      for (int k = 0; k < 3; k++)
+	q[k] = std::min<uint64_t>((1 << max_depth) - 1, (uint64_t)((p[k] - lo[k]) * scale));
+      keys[i].code = spread_bits(q[0]) << 2 | spread_bits(q[1]) << 1 | spread_bits(q[2]);
+    }
+  }, 1 << 14);
+  parallel_sort(keys.begin(), keys.end(), [](const keyed_point& a, const keyed_point& b) {
+    return a.code < b.code;
+  });
+  size_t count = std::lower_bound(keys.begin(), keys.end(), ~0ull, [](const keyed_point& a, uint64_t code) {
+    return a.code < code;
+  }) - keys.begin();
+  cloud.count = count;
+
+  // ------------------------------------------------------------
+  // octree
+  // ------------------------------------------------------------
+
+  // nodes are appended while the vector is walked, which numbers them
+  // breadth first. `ranges` holds the sorted points under each node.
+  std::vector<std::pair<size_t, size_t>> ranges;
+  point_node root;
+  for (int k = 0; k < 3; k++)
+    root.min[k] = lo[k];
+  root.size = root_size;
+  std::fill(root.children, root.children + 8, -1);
+  cloud.nodes.push_back(root);
+  ranges.emplace_back(0, count);
+
+  for (size_t n = 0; n < cloud.nodes.size(); n++) {
+    size_t begin = ranges[n].first, end = ranges[n].second;
+    int depth = cloud.nodes[n].depth;
+    if (end - begin <= (size_t)point_cloud::node_samples || depth == max_depth)
+      continue;
+    int shift = 3 * (max_depth - depth - 1);
+    uint64_t prefix = keys[begin].code & ~((8ull << shift) - 1);
+    size_t child_begin = begin;
+    for (int octant = 0; octant < 8; octant++) {
+      size_t child_end = end;
+      if (octant < 7) {
+	uint64_t next = prefix | (uint64_t)(octant + 1) << shift;
+	child_end = std::lower_bound(keys.begin() + child_begin, keys.begin() + end, next,
+				     [](const keyed_point& a, uint64_t code) { return a.code < code; }) - keys.begin();
+      }
+      if (child_end > child_begin) {
+	point_node child;
+	float half = cloud.nodes[n].size / 2.0f;
+	child.min[0] = cloud.nodes[n].min[0] + ((octant >> 2) & 1) * half;
+	child.min[1] = cloud.nodes[n].min[1] + ((octant >> 1) & 1) * half;
+	child.min[2] = cloud.nodes[n].min[2] + (octant & 1) * half;
+	child.size = half;
+	child.depth = depth + 1;
+	std::fill(child.children, child.children + 8, -1);
+	cloud.nodes[n].children[octant] = cloud.nodes.size();
+	cloud.nodes.push_back(child);
+	ranges.emplace_back(child_begin, child_end);
+      }
+      child_begin = child_end;
+    }
+  }
+
+  // ------------------------------------------------------------
+  // samples
+  // ------------------------------------------------------------
+
+  // a node takes every k-th point of its range that no ancestor took,
+  // a leaf everything that is left. the nodes of one depth have
+  // disjoint ranges and run in parallel, depth after depth.
+  std::vector<uint32_t> owner(count, unowned);
+  auto is_leaf = [&](const point_node& node) {
+    return std::all_of(node.children, node.children + 8, [](int c) { return c < 0; });
+  };
+  auto stride_of = [&](size_t n) -> size_t {
+    if (is_leaf(cloud.nodes[n]))
+      return 1;
+    size_t length = ranges[n].second - ranges[n].first;
+    return (length + point_cloud::node_samples - 1) / point_cloud::node_samples;
+  };
+
+  size_t depth_begin = 0;
+  while (depth_begin < cloud.nodes.size()) {
+    size_t depth_end = depth_begin;
+    while (depth_end < cloud.nodes.size() && cloud.nodes[depth_end].depth == cloud.nodes[depth_begin].depth)
+      depth_end++;
+    parallel_for((int)depth_begin, (int)depth_end, [&](int node_begin, int node_end) {
+      for (int n = node_begin; n < node_end; n++) {
+	size_t stride = stride_of(n);
+	uint32_t taken = 0;
+	for (size_t p = ranges[n].first; p < ranges[n].second; p += stride)
+	  if (owner[p] == unowned) {
+	    owner[p] = n;
+	    taken++;
+	  }
+	cloud.nodes[n].count = taken;
+      }
+    });
+    depth_begin = depth_end;
+  }
+
+  uint32_t first = 0;
+  for (point_node& node : cloud.nodes) {
+    node.first = first;
+    first += node.count;
+  }
+
+  // positions relative to the cube of the node, 16 bits per axis
+  cloud.points.resize(count * 4);
+  float value_span = cloud.value_max - cloud.value_min;
+  parallel_for(0, (int)cloud.nodes.size(), [&](int node_begin, int node_end) {
+    for (int n = node_begin; n < node_end; n++) {
+      const point_node& node = cloud.nodes[n];
+      size_t stride = stride_of(n);
+      uint16_t* out = &cloud.points[(size_t)node.first * 4];
+      float to_unit = 65535.0f / node.size;
+      for (size_t p = ranges[n].first; p < ranges[n].second; p += stride) {
+	if (owner[p] != (uint32_t)n)
+	  continue;
+	size_t row = keys[p].index;
+	float position[3];
+	row_position(table, row, position);
+	for (int k = 0; k < 3; k++)
+	  out[k] = (uint16_t)std::clamp(std::lround((position[k] - node.min[k]) * to_unit), 0l, 65535l);
+	float value = cloud.has_values ? static_cast<float>(table.value(row, 3)) : position[1];
+	float t = value_span > 0.0f && std::isfinite(value) ? (value - cloud.value_min) / value_span : 0.0f;
+	out[3] = (uint16_t)std::lround(std::clamp(t, 0.0f, 1.0f) * 65535.0f);
+	out += 4;
+      }
+    }
+  });
+  return true;
+}
@@ -0,0 +1,420 @@
+#include <program.hpp>
+#include <cmath>
+#include <bit>
+#include <algorithm>
+#include <functional>
+
+// ------------------------------------------------------------
+// building
+// ------------------------------------------------------------
+
+void program::clear() {
+  code.clear();
+  params.clear();
+  param_values.clear();
+  emitted.clear();
+  result = -1;
+  coordinates.clear();
+}
+
+int program::param_index(const std::string& name) {
+  for (size_t i = 0; i < params.size(); i++)
+    if (params[i] == name)
+      return (int)i;
+  params.push_back(name);
+  param_values.push_back(1.0);
+  return (int)params.size() - 1;
+}
+
+int program::emit(int op, int a, int b, double value) {
+
+  bool binary = op >= OP_ADD && op <= OP_POW;
+  bool unary  = op >= OP_NEG;
+
+  // missing operand, the parser already reported an error
+  if ((binary && (a < 0 || b < 0)) || (unary && a < 0))
+    return -1;
+
+  // fold operations whose operands are all constants
+  if ((binary || unary) && code[a].op == OP_CONST && (unary || code[b].op == OP_CONST)) {
+    value = apply(op, code[a].value, binary ? code[b].value : 0.0);
+    op = OP_CONST;
+    a = b = -1;
+  }
+
+  // reuse the register of an equal instruction. constants compare
+  // bit for bit: -0 is not 0 (1/-0 is -inf), and nan orders like any
+  // other value.
+  std::tuple<int, int, int, uint64_t> key(op, a, b, std::bit_cast<uint64_t>(value));
+  auto it = emitted.find(key);
+  if (it != emitted.end())
+    return it->second;
+
+  code.push_back({op, a, b, value});
+  emitted[key] = (int)code.size() - 1;
+  return (int)code.size() - 1;
+}
+
+bool program::uses(int op) const {
+  for (const instruction& in : code)
+    if (in.op == op)
+      return true;
+  return false;
+}
+
+// ------------------------------------------------------------
+// evaluation
+// ------------------------------------------------------------
+
+double program::apply(int op, double a, double b) {
+
+  // same semantics as the interpreting parser
+
+  switch (op) {
+  case OP_ADD:   return a + b;
+  case OP_SUB:   return a - b;
+  case OP_MUL:   return a * b;
+  case OP_DIV:   return a / b;
+  case OP_POW: {
+    // integer exponents only, see parser::eval_E
+    if (b == 0.0) return 1.0;
+    double r = a;
+    for (int t = (int)b - 1; t > 0; t--)
+      r = r * a;
+    return r;
+  }
+  case OP_NEG:   return -a;
+  case OP_SIN:   return sin(a);
+  case OP_COS:   return cos(a);
+  case OP_TAN:   return tan(a);
+  case OP_ASIN:  return asin(a);
+  case OP_ACOS:  return acos(a);
+  case OP_ATAN:  return atan(a);
+  case OP_RAD:   return a * M_PI / 180;
+  case OP_DEG:   return a * 180 / M_PI;
+  case OP_SQRT:  return sqrt(a);
+  case OP_EXP:   return exp(a);
+  case OP_LN:    return log(a);
+  case OP_LOG10: return log10(a);
+  }
+  return 0.0;
+}
+
+double program::eval(double x, double y, double t) const {
+  if (!valid()) return 0.0;
+  double out;
+  eval_batch(&x, &y, t, &out, 1);
+  return out;
+}
+
+void program::eval_batch(const double* x, const double* y, double t, double* out, int n) const {
+  if (!valid()) {
+    std::fill(out, out + n, 0.0);
+    return;
+  }
+  eval_outputs(x, y, t, n, {result}, &out);
+}
+
+void program::eval_instruction(size_t i, double* regs, int first, int m, const double* x,
+				const double* y, double t, const double* const* loads, const double* z) const {
+
+  // instruction `i` for the lanes [0, m) of the batch of points from
+  // `first`, the registers are batch_size values apart
+
+  const instruction& in = code[i];
+  double* r = &regs[i * batch_size];
+  const double* ra = in.a >= 0 ? &regs[in.a * batch_size] : nullptr;
+  const double* rb = in.b >= 0 ? &regs[in.b * batch_size] : nullptr;
+  const double* xs = x + first;
+  const double* ys = y + first;
+
+  switch (in.op) {
+  case OP_CONST:
+    for (int k = 0; k < m; k++) r[k] = in.value;
+    break;
+  case OP_X:
+    for (int k = 0; k < m; k++) r[k] = xs[k];
+    break;
+  case OP_Y:
+    for (int k = 0; k < m; k++) r[k] = ys[k];
+    break;
+  case OP_Z:
+    for (int k = 0; k < m; k++) r[k] = z ? z[first + k] : 0.0;
+    break;
+  case OP_T:
+    for (int k = 0; k < m; k++) r[k] = t;
+    break;
+  case OP_PARAM:
+    for (int k = 0; k < m; k++) r[k] = param_values[in.a];
+    break;
+  case OP_LOAD:
+    // none while differentiating, see eval_gradient
+    for (int k = 0; k < m; k++) r[k] = loads ? loads[in.a][first + k] : 0.0;
+    break;
+  case OP_ADD:
+    for (int k = 0; k < m; k++) r[k] = ra[k] + rb[k];
+    break;
+  case OP_SUB:
+    for (int k = 0; k < m; k++) r[k] = ra[k] - rb[k];
+    break;
+  case OP_MUL:
+    for (int k = 0; k < m; k++) r[k] = ra[k] * rb[k];
+    break;
+  case OP_DIV:
+    for (int k = 0; k < m; k++) r[k] = ra[k] / rb[k];
+    break;
+  case OP_NEG:
+    for (int k = 0; k < m; k++) r[k] = -ra[k];
+    break;
+  case OP_SIN:
+    for (int k = 0; k < m; k++) r[k] = sin(ra[k]);
+    break;
+  case OP_COS:
+    for (int k = 0; k < m; k++) r[k] = cos(ra[k]);
+    break;
+  case OP_SQRT:
+    for (int k = 0; k < m; k++) r[k] = sqrt(ra[k]);
+    break;
+  case OP_EXP:
+    for (int k = 0; k < m; k++) r[k] = exp(ra[k]);
+    break;
+  default:
+    for (int k = 0; k < m; k++) r[k] = apply(in.op, ra[k], rb ? rb[k] : 0.0);
+    break;
+  }
+}
+
+void program::eval_outputs(const double* x, const double* y, double t, int n,
+			   const std::vector<int>& outputs, double* const* out,
+			   const double* const* loads, const double* z) const {
+
+  // evaluates `batch_size` points per instruction. every case is a
+  // plain loop over the lanes so the compiler can vectorize it. the
+  // registers listed in `outputs` are copied to the matching `out`
+  // array, so one pass can produce several values per point. `z` is
+  // only read by implicit surfaces.
+
+  thread_local std::vector<double> regs;
+  regs.resize(code.size() * batch_size);
+
+  for (int first = 0; first < n; first += batch_size) {
+    int m = std::min(batch_size, n - first);
+    for (size_t i = 0; i < code.size(); i++)
+      eval_instruction(i, regs.data(), first, m, x, y, t, loads, z);
+
+    for (size_t o = 0; o < outputs.size(); o++) {
+      const double* r = &regs[outputs[o] * batch_size];
+      std::copy(r, r + m, out[o] + first);
+    }
+  }
+}
+
+// ------------------------------------------------------------
+// derivatives
+// ------------------------------------------------------------
+
+void program::derivative(int op, double a, double b, double r, double& da, double& db) {
+
+  // partial derivatives of r = op(a, b). the exponent of OP_POW is
+  // truncated to an integer, so its derivative is zero.
+
+  da = 0.0;
+  db = 0.0;
+  switch (op) {
+  case OP_ADD:   da = 1.0; db = 1.0; break;
+  case OP_SUB:   da = 1.0; db = -1.0; break;
+  case OP_MUL:   da = b; db = a; break;
+  case OP_DIV:   da = 1.0 / b; db = -a / (b * b); break;
+  case OP_POW: {
+    int n = (int)b;
+    if (b == 0.0) break;
+    if (n <= 1) { da = 1.0; break; }
+    double p = 1.0;
+    for (int t = n - 1; t > 0; t--)
+      p = p * a;
+    da = n * p;
+    break;
+  }
+  case OP_NEG:   da = -1.0; break;
+  case OP_SIN:   da = cos(a); break;
+  case OP_COS:   da = -sin(a); break;
+  case OP_TAN:   da = 1.0 / (cos(a) * cos(a)); break;
+  case OP_ASIN:  da = 1.0 / sqrt(1.0 - a * a); break;
+  case OP_ACOS:  da = -1.0 / sqrt(1.0 - a * a); break;
+  case OP_ATAN:  da = 1.0 / (1.0 + a * a); break;
+  case OP_RAD:   da = M_PI / 180; break;
+  case OP_DEG:   da = 180 / M_PI; break;
+  case OP_SQRT:  da = 0.5 / r; break;
+  case OP_EXP:   da = r; break;
+  case OP_LN:    da = 1.0 / a; break;
+  case OP_LOG10: da = 1.0 / (a * M_LN10); break;
+  }
+}
+
+void program::eval_gradient(const double* x, const double* y, double t, int n,
+			    double* out, double* dx, double* dy) const {
+  if (!valid()) {
+    std::fill(out, out + n, 0.0);
+    std::fill(dx, dx + n, 0.0);
+    std::fill(dy, dy + n, 0.0);
+    return;
+  }
+  eval_gradient(x, y, t, n, {result}, &out, &dx, &dy);
+}
+
+void program::eval_gradient(const double* x, const double* y, double t, int n,
+			    const std::vector<int>& outputs, double* const* out,
+			    double* const* dx, double* const* dy) const {
+
+  // every register carries its value and its derivatives with
+  // respect to x and y. the values come from eval_instruction like
+  // those of eval_outputs, the derivatives follow each instruction.
+  // registers read through OP_LOAD have no known derivative and count
+  // as constants.
+
+  thread_local std::vector<double> regs;
+  regs.resize(code.size() * batch_size * 3);
+  double* vals = regs.data();
+  double* dxs = vals + code.size() * batch_size;
+  double* dys = dxs + code.size() * batch_size;
+
+  for (int first = 0; first < n; first += batch_size) {
+    int m = std::min(batch_size, n - first);
+
+    for (size_t i = 0; i < code.size(); i++) {
+      const instruction& in = code[i];
+      eval_instruction(i, vals, first, m, x, y, t, nullptr, nullptr);
+      double* r = vals + i * batch_size;
+      double* rx = dxs + i * batch_size;
+      double* ry = dys + i * batch_size;
+
+      if (in.op < OP_ADD) {
+	std::fill(rx, rx + m, in.op == OP_X ? 1.0 : 0.0);
+	std::fill(ry, ry + m, in.op == OP_Y ? 1.0 : 0.0);
+	continue;
+      }
+
+      const double* ra = vals + in.a * batch_size;
+      const double* rax = dxs + in.a * batch_size;
+      const double* ray = dys + in.a * batch_size;
+      const double* rb = in.b >= 0 ? vals + in.b * batch_size : nullptr;
+      const double* rbx = in.b >= 0 ? dxs + in.b * batch_size : nullptr;
+      const double* rby = in.b >= 0 ? dys + in.b * batch_size : nullptr;
+
+      for (int k = 0; k < m; k++) {
+	double da, db;
+	derivative(in.op, ra[k], rb ? rb[k] : 0.0, r[k], da, db);
+	// a zero tangent contributes nothing, even if the factor is
+	// infinite (sqrt(y) has no x derivative anywhere)
+	rx[k] = (rax[k] != 0.0 ? da * rax[k] : 0.0) + (rb && rbx[k] != 0.0 ? db * rbx[k] : 0.0);
+	ry[k] = (ray[k] != 0.0 ? da * ray[k] : 0.0) + (rb && rby[k] != 0.0 ? db * rby[k] : 0.0);
+      }
+    }
+
+    for (size_t o = 0; o < outputs.size(); o++) {
+      size_t r = outputs[o] * batch_size;
+      std::copy(vals + r, vals + r + m, out[o] + first);
+      std::copy(dxs + r, dxs + r + m, dx[o] + first);
+      std::copy(dys + r, dys + r + m, dy[o] + first);
+    }
+  }
+}
+
+// ------------------------------------------------------------
+// interval evaluation
+// ------------------------------------------------------------
+
+interval program::eval_interval(const interval& x, const interval& y, double t,
+				const interval& z) const {
+
+  // one pass over `code` like eval_outputs, with an interval per
+  // register. loads are not known, they can be anything.
+
+  if (!valid()) return interval();
+
+  thread_local std::vector<interval> regs;
+  regs.resize(code.size());
+
+  for (size_t i = 0; i < code.size(); i++) {
+    const instruction& in = code[i];
+    switch (in.op) {
+    case OP_CONST: regs[i] = interval(in.value); break;
+    case OP_X:     regs[i] = x; break;
+    case OP_Y:     regs[i] = y; break;
+    case OP_Z:     regs[i] = z; break;
+    case OP_T:     regs[i] = interval(t); break;
+    case OP_PARAM: regs[i] = interval(param_values[in.a]); break;
+    case OP_LOAD:  regs[i] = interval_entire(false); break;
+    default:
+      regs[i] = interval_apply(in.op, regs[in.a], in.b >= 0 ? regs[in.b] : interval());
+      break;
+    }
+  }
+  return regs[result];
+}
+
+// ------------------------------------------------------------
+// incremental evaluation
+// ------------------------------------------------------------
+
+void program::split(int param, program& residual, std::vector<int>& cut) const {
+
+  // a register has to be recomputed when `param` changes only if it
+  // depends on it. registers that vary per point but do not depend on
+  // `param` and feed a dependent one are "cut": their values are
+  // stored once per point, and the residual program reads them back
+  // with OP_LOAD instead of computing them again. for `a*sin(b*x)`
+  // and param `a`, sin(b*x) is cut and the residual is a single
+  // multiplication.
+
+  std::vector<bool> depends(code.size(), false);
+  std::vector<bool> varies(code.size(), false);
+  for (size_t i = 0; i < code.size(); i++) {
+    const instruction& in = code[i];
+    switch (in.op) {
+    case OP_CONST:
+      break;
+    case OP_PARAM:
+      depends[i] = in.a == param;
+      break;
+    case OP_X:
+    case OP_Y:
+    case OP_Z:
+    case OP_T:
+    case OP_LOAD:
+      varies[i] = true;
+      break;
+    default:
+      depends[i] = depends[in.a] || (in.b >= 0 && depends[in.b]);
+      varies[i] = varies[in.a] || (in.b >= 0 && varies[in.b]);
+    }
+  }
+
+  residual.clear();
+  residual.params = params;
+  residual.param_values = param_values;
+  cut.clear();
+  if (!valid())
+    return;
+
+  std::vector<int> mapped(code.size(), -1);
+  std::function<int(int)> copy = [&](int i) -> int {
+    if (mapped[i] >= 0)
+      return mapped[i];
+    const instruction& in = code[i];
+    if (varies[i] && !depends[i] && in.op >= OP_ADD) {
+      cut.push_back(i);
+      mapped[i] = residual.emit(OP_LOAD, (int)cut.size() - 1);
+    } else if (in.op < OP_ADD) {
+      mapped[i] = residual.emit(in.op, in.a, in.b, in.value);
+    } else {
+      int a = copy(in.a);
+      int b = in.b >= 0 ? copy(in.b) : -1;
+      mapped[i] = residual.emit(in.op, a, b);
+    }
+    return mapped[i];
+  };
+  residual.result = copy(result);
+  for (int coordinate : coordinates)
+    residual.coordinates.push_back(copy(coordinate));
+}
@@ -0,0 +1,269 @@
+#include <scene_cache.hpp>
+#include <mesh.hpp>
+#include <parallel.hpp>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+
+namespace {
+
+const char magic[8] = {'P', '3', 'D', 'S', 'C', 'E', 'N', 'E'};
+const uint32_t version = 4;
+const size_t alignment = 4096;
+
+struct header {
+  char magic[8];
+  uint32_t version;
+  uint32_t floats_per_vertex;
+  uint64_t table_offset;
+  uint64_t table_size;
+  uint64_t table_checksum;
+};
+
+size_t align(size_t offset) {
+  return (offset + alignment - 1) / alignment * alignment;
+}
+
+// ------------------------------------------------------------
+// table serialization
+// ------------------------------------------------------------
+
+struct table_writer {
+  std::vector<unsigned char> bytes;
+  template <typename T> void put(T value) {
+    size_t at = bytes.size();
+    bytes.resize(at + sizeof(T));
+    std::memcpy(bytes.data() + at, &value, sizeof(T));
+  }
+  void put_string(const std::string& s) {
+    put<uint32_t>(s.size());
+    bytes.insert(bytes.end(), s.begin(), s.end());
+  }
+};
+
+// every read is bounds checked, a truncated or damaged table only
+// clears `ok`
+struct table_reader {
+  const unsigned char* p;
+  const unsigned char* end;
+  bool ok = true;
+  template <typename T> T get() {
+    T value{};
+    if (end - p < (ptrdiff_t)sizeof(T)) {
+      ok = false;
+      return value;
+    }
+    std::memcpy(&value, p, sizeof(T));
+    p += sizeof(T);
+    return value;
+  }
+  std::string get_string() {
+    uint32_t size = get<uint32_t>();
+    if (!ok || end - p < (ptrdiff_t)size) {
+      ok = false;
+      return {};
+    }
+    std::string s((const char*)p, size);
+    p += size;
+    return s;
+  }
+};
+
+void put_table(table_writer& t, const Properties& props, const std::vector<cached_surface>& surfaces,
+	       const std::vector<uint64_t>& offsets, const std::vector<uint64_t>& checksums) {
+  t.put<int32_t>(props.grid_size);
+  t.put<float>(props.divisions);
+  t.put<uint8_t>(props.perspective);
+  t.put<uint8_t>(props.show_axes);
+  t.put<uint8_t>(props.show_mesh);
+  t.put<uint8_t>(props.lighting);
+  t.put<double>(props.time);
+  t.put<int32_t>(props.contours);
+  t.put<uint8_t>(props.contour_map);
+  t.put<uint32_t>(surfaces.size());
+  for (size_t i = 0; i < surfaces.size(); i++) {
+    const cached_surface& s = surfaces[i];
+    t.put_string(s.function);
+    t.put<int32_t>(s.source);
+    for (float c : s.rgb)
+      t.put<float>(c);
+    t.put<uint8_t>(s.show);
+    t.put<int32_t>(s.colormap);
+    t.put<uint8_t>(s.range_auto);
+    t.put<float>(s.range_min);
+    t.put<float>(s.range_max);
+    t.put<float>(s.z_min);
+    t.put<float>(s.z_max);
+    t.put<uint32_t>(s.params.size());
+    for (const auto& param : s.params) {
+      t.put_string(param.first);
+      t.put<double>(param.second);
+    }
+    t.put_string(s.domain);
+    t.put<int32_t>(s.rows);
+    t.put<int32_t>(s.columns);
+    t.put<uint64_t>(offsets[i]);
+    t.put<uint64_t>(s.vertices ? s.vertices_count * sizeof(float) : 0);
+    t.put<uint64_t>(checksums[i]);
+  }
+}
+
+} // namespace
+
+// ------------------------------------------------------------
+// write
+// ------------------------------------------------------------
+
+bool scene_cache_write(const char* path, const Properties& props, const std::vector<cached_surface>& surfaces) {
+
+  // the table goes right after the header. its size does not depend
+  // on the offsets it stores, so it is built once to measure it and
+  // again with the real offsets.
+
+  std::vector<uint64_t> offsets(surfaces.size(), 0), checksums(surfaces.size(), 0);
+  table_writer measure;
+  put_table(measure, props, surfaces, offsets, checksums);
+
+  size_t offset = align(sizeof(header) + measure.bytes.size());
+  for (size_t i = 0; i < surfaces.size(); i++) {
+    offsets[i] = offset;
+    if (surfaces[i].vertices)
+      offset = align(offset + surfaces[i].vertices_count * sizeof(float));
+  }
+
+  parallel_for(0, (int)surfaces.size(), [&](int begin, int end) {
+    for (int i = begin; i < end; i++)
+      if (surfaces[i].vertices)
+	checksums[i] = checksum64(surfaces[i].vertices, surfaces[i].vertices_count * sizeof(float));
+  });
+
+  table_writer table;
+  put_table(table, props, surfaces, offsets, checksums);
+
+  header h = {};
+  std::memcpy(h.magic, magic, sizeof(magic));
+  h.version = version;
+  h.floats_per_vertex = floats_per_vertex;
+  h.table_offset = sizeof(header);
+  h.table_size = table.bytes.size();
+  h.table_checksum = checksum64(table.bytes.data(), table.bytes.size());
+
+  // written next to the file and renamed over it. the vertices may
+  // point into a mapping of the file being replaced, which must not
+  // be truncated under them: the mapping keeps the old contents.
+  std::string temporary = std::string(path) + ".tmp";
+  FILE* file = std::fopen(temporary.c_str(), "wb");
+  if (!file)
+    return false;
+  bool ok = std::fwrite(&h, sizeof(h), 1, file) == 1;
+  ok = ok && std::fwrite(table.bytes.data(), 1, table.bytes.size(), file) == table.bytes.size();
+  size_t position = sizeof(h) + table.bytes.size();
+  static const char zeros[alignment] = {};
+  for (size_t i = 0; ok && i < surfaces.size(); i++) {
+    if (!surfaces[i].vertices)
+      continue;
+    ok = std::fwrite(zeros, 1, offsets[i] - position, file) == offsets[i] - position;
+    size_t size = surfaces[i].vertices_count * sizeof(float);
+    ok = ok && std::fwrite(surfaces[i].vertices, 1, size, file) == size;
+    position = offsets[i] + size;
+  }
+  ok = std::fclose(file) == 0 && ok;
+
+  std::error_code code;
+  if (ok)
+    std::filesystem::rename(temporary, path, code);
+  if (!ok || code) {
+    std::remove(temporary.c_str());
+    return false;
+  }
+  return true;
+}
+
+// ------------------------------------------------------------
+// read
+// ------------------------------------------------------------
+
+bool scene_cache_read(const char* path, scene_cache& cache) {
+
+  std::shared_ptr<mapped_file> file = std::make_shared<mapped_file>();
+  if (!file->open(path) || file->size() < sizeof(header))
+    return false;
+
+  header h;
+  std::memcpy(&h, file->data(), sizeof(h));
+  if (std::memcmp(h.magic, magic, sizeof(magic)) != 0 || h.version != version ||
+      h.floats_per_vertex != (uint32_t)floats_per_vertex ||
+      h.table_offset > file->size() || h.table_size > file->size() - h.table_offset)
+    return false;
+
+  const unsigned char* table = file->data() + h.table_offset;
+  if (checksum64(table, h.table_size) != h.table_checksum)
+    return false;
+
+  table_reader t = {table, table + h.table_size};
+  scene_cache result;
+  result.props.grid_size = t.get<int32_t>();
+  result.props.divisions = t.get<float>();
+  result.props.perspective = t.get<uint8_t>();
+  result.props.show_axes = t.get<uint8_t>();
+  result.props.show_mesh = t.get<uint8_t>();
+  result.props.lighting = t.get<uint8_t>();
+  result.props.time = t.get<double>();
+  result.props.contours = t.get<int32_t>();
+  result.props.contour_map = t.get<uint8_t>();
+
+  uint32_t count = t.get<uint32_t>();
+  std::vector<uint64_t> offsets, sizes, checksums;
+  for (uint32_t i = 0; t.ok && i < count; i++) {
+    cached_surface s;
+    s.function = t.get_string();
+    s.source = t.get<int32_t>();
+    for (float& c : s.rgb)
+      c = t.get<float>();
+    s.show = t.get<uint8_t>();
+    s.colormap = t.get<int32_t>();
+    s.range_auto = t.get<uint8_t>();
+    s.range_min = t.get<float>();
+    s.range_max = t.get<float>();
+    s.z_min = t.get<float>();
+    s.z_max = t.get<float>();
+    uint32_t params = t.get<uint32_t>();
+    for (uint32_t k = 0; t.ok && k < params; k++) {
+      std::string name = t.get_string();
+      s.params.emplace_back(name, t.get<double>());
+    }
+    s.domain = t.get_string();
+    s.rows = t.get<int32_t>();
+    s.columns = t.get<int32_t>();
+    offsets.push_back(t.get<uint64_t>());
+    sizes.push_back(t.get<uint64_t>());
+    checksums.push_back(t.get<uint64_t>());
+    result.surfaces.push_back(s);
+  }
+  if (!t.ok)
+    return false;
+
+  // the blocks are verified in parallel, which also reads the pages
+  // in. a block that does not match is dropped and the surface is
+  // evaluated again.
+
+  file->sequential();
+  parallel_for(0, (int)result.surfaces.size(), [&](int begin, int end) {
+    for (int i = begin; i < end; i++) {
+      cached_surface& s = result.surfaces[i];
+      uint64_t expected = (uint64_t)s.rows * s.columns * floats_per_vertex * sizeof(float);
+      if (sizes[i] == 0 || sizes[i] != expected || offsets[i] > file->size() ||
+	  sizes[i] > file->size() - offsets[i])
+	continue;
+      const unsigned char* block = file->data() + offsets[i];
+      if (checksum64(block, sizes[i]) != checksums[i])
+	continue;
+      s.vertices = (const float*)block;
+      s.vertices_count = sizes[i] / sizeof(float);
+    }
+  });
+
+  result.file = file;
+  cache = std::move(result);
+  return true;
+}
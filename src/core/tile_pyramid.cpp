@@ -0,0 +1,445 @@
+#include <tile_pyramid.hpp>
+#include <export.hpp>
+#include <normal_packing.hpp>
+#include <parallel.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+
+namespace {
+
+const char magic[8] = {'P', '3', 'D', 'T', 'I', 'L', 'E', 'S'};
+const uint32_t version = 2; // 2: xxh64 checksums
+const size_t alignment = 4096;
+
+struct header {
+  char magic[8];
+  uint32_t version;
+  int32_t tile_size;
+  int32_t rows;
+  int32_t cols;
+  uint64_t stamp;
+  uint64_t table_offset;
+  uint64_t table_count;
+  uint64_t table_checksum;
+};
+
+struct stored_tile {
+  uint64_t offset;
+  float min;
+  float max;
+  float error;
+  uint32_t unused;
+};
+
+size_t align(size_t offset) {
+  return (offset + alignment - 1) / alignment * alignment;
+}
+
+// value of sample (r, c) of a level, rows and columns past the end of
+// the field repeat the last one
+inline float level_value(const height_field& field, int level, size_t r, size_t c) {
+  return static_cast<float>(field.value(std::min(r << level, (size_t)field.rows - 1),
+					std::min(c << level, (size_t)field.cols - 1)));
+}
+
+} // namespace
+
+// ------------------------------------------------------------
+// layout
+// ------------------------------------------------------------
+
+void tile_pyramid_levels(int rows, int cols, int tile_size, std::vector<tile_level>& levels) {
+  levels.clear();
+  size_t first = 0;
+  tile_level level;
+  level.rows = rows;
+  level.cols = cols;
+  while (true) {
+    level.tile_rows = std::max(1, (level.rows - 1 + tile_size - 1) / tile_size);
+    level.tile_cols = std::max(1, (level.cols - 1 + tile_size - 1) / tile_size);
+    level.first = first;
+    levels.push_back(level);
+    first += (size_t)level.tile_rows * level.tile_cols;
+    if (level.tile_rows == 1 && level.tile_cols == 1)
+      break;
+    // every second sample, the last one is kept: ceil((rows - 1) / 2) + 1
+    level.rows = level.rows / 2 + 1;
+    level.cols = level.cols / 2 + 1;
+  }
+}
+
+bool tile_pyramid::exists(const tile_id& id) const {
+  if (id.level < 0 || id.level >= (int)levels.size())
+    return false;
+  const tile_level& level = levels[id.level];
+  return id.row >= 0 && id.row < level.tile_rows && id.col >= 0 && id.col < level.tile_cols;
+}
+
+const tile_info& tile_pyramid::info(const tile_id& id) const {
+  const tile_level& level = levels[id.level];
+  return tiles[level.first + (size_t)id.row * level.tile_cols + id.col];
+}
+
+size_t tile_pyramid::field_row(const tile_id& id, int i) const {
+  size_t r = std::min((size_t)id.row * tile_size + i, (size_t)levels[id.level].rows - 1);
+  return std::min(r << id.level, (size_t)rows - 1);
+}
+
+size_t tile_pyramid::field_col(const tile_id& id, int j) const {
+  size_t c = std::min((size_t)id.col * tile_size + j, (size_t)levels[id.level].cols - 1);
+  return std::min(c << id.level, (size_t)cols - 1);
+}
+
+void tile_pyramid::bounds(const tile_id& id, float size, float box_min[3], float box_max[3]) const {
+  const tile_info& tile = info(id);
+  float start = -size / 2.0f;
+  double step_x = size / (double)(rows - 1);
+  double step_z = size / (double)(cols - 1);
+  box_min[0] = start + field_row(id, 0) * step_x;
+  box_max[0] = start + field_row(id, tile_size) * step_x;
+  box_min[1] = tile.min;
+  box_max[1] = tile.max;
+  box_min[2] = start + field_col(id, 0) * step_z;
+  box_max[2] = start + field_col(id, tile_size) * step_z;
+}
+
+uint64_t tile_source_stamp(const char* path) {
+  std::error_code code;
+  uint64_t size = std::filesystem::file_size(path, code);
+  if (code) return 0;
+  auto time = std::filesystem::last_write_time(path, code);
+  if (code) return 0;
+  return size * 0x9E3779B97F4A7C15ull ^ (uint64_t)time.time_since_epoch().count();
+}
+
+// ------------------------------------------------------------
+// reading
+// ------------------------------------------------------------
+
+bool tile_pyramid::open(const char* path, std::string& error) {
+
+  // the table is verified, the tiles are not: they are only read when
+  // they are drawn
+
+  levels.clear();
+  tiles.clear();
+  if (!file.open(path)) {
+    error = "cannot open file";
+    return false;
+  }
+  const unsigned char* data = file.data();
+  size_t size = file.size();
+
+  header h;
+  if (size < sizeof(h)) {
+    error = "not a tile pyramid";
+    return false;
+  }
+  std::memcpy(&h, data, sizeof(h));
+  if (std::memcmp(h.magic, magic, sizeof(magic)) != 0) {
+    error = "not a tile pyramid";
+    return false;
+  }
+  if (h.version != version) {
+    error = "unsupported tile pyramid version";
+    return false;
+  }
+  if (h.tile_size < 1 || h.rows < 2 || h.cols < 2) {
+    error = "damaged tile pyramid header";
+    return false;
+  }
+
+  tile_size = h.tile_size;
+  rows = h.rows;
+  cols = h.cols;
+  stamp = h.stamp;
+  tile_pyramid_levels(rows, cols, tile_size, levels);
+  size_t count = levels.back().first + 1;
+  size_t tile_bytes = (size_t)(tile_size + 1) * (tile_size + 1) * sizeof(float);
+
+  if (h.table_count != count || h.table_offset > size
+      || (size - h.table_offset) / sizeof(stored_tile) < count) {
+    error = "damaged tile table";
+    levels.clear();
+    return false;
+  }
+  if (checksum64(data + h.table_offset, count * sizeof(stored_tile)) != h.table_checksum) {
+    error = "tile table checksum mismatch";
+    levels.clear();
+    return false;
+  }
+
+  tiles.resize(count);
+  for (size_t i = 0; i < count; i++) {
+    stored_tile stored;
+    std::memcpy(&stored, data + h.table_offset + i * sizeof(stored), sizeof(stored));
+    if (stored.offset > size || size - stored.offset < tile_bytes) {
+      error = "damaged tile table";
+      levels.clear();
+      tiles.clear();
+      return false;
+    }
+    tiles[i].offset = stored.offset;
+    tiles[i].min = stored.min;
+    tiles[i].max = stored.max;
+    tiles[i].error = stored.error;
+  }
+  return true;
+}
+
+void tile_pyramid::read(const tile_id& id, float* heights) const {
+  size_t count = (size_t)(tile_size + 1) * (tile_size + 1);
+  std::memcpy(heights, file.data() + info(id).offset, count * sizeof(float));
+}
+
+// ------------------------------------------------------------
+// building
+// ------------------------------------------------------------
+
+bool tile_pyramid_build(const height_field& field, const char* path, int tile_size,
+			uint64_t stamp, std::string& error) {
+
+  // levels are written from the finest up, so the error of a tile can
+  // add the largest error of its children
+
+  if (field.rows < 2 || field.cols < 2 || tile_size < 1) {
+    error = "the field is too small";
+    return false;
+  }
+
+  std::vector<tile_level> levels;
+  tile_pyramid_levels(field.rows, field.cols, tile_size, levels);
+  std::vector<tile_info> tiles(levels.back().first + 1);
+
+  buffered_writer out(4 << 20);
+  if (!out.open(path)) {
+    error = "cannot write file";
+    return false;
+  }
+  std::vector<char> padding(alignment, 0);
+  out.write(padding.data(), align(sizeof(header)));
+
+  int n = tile_size + 1;
+  size_t tile_values = (size_t)n * n;
+  size_t tile_bytes = tile_values * sizeof(float);
+  size_t tile_stride = align(tile_bytes);
+
+  for (int k = 0; k < (int)levels.size(); k++) {
+    const tile_level& level = levels[k];
+    int tile_cols = level.tile_cols;
+    std::vector<float> band((size_t)tile_cols * tile_values);
+    // one entry per row of a tile
+    std::vector<float> row_min((size_t)tile_cols * n), row_max((size_t)tile_cols * n);
+    std::vector<float> row_error((size_t)tile_cols * n);
+
+    for (int tr = 0; tr < level.tile_rows; tr++) {
+
+      parallel_for(0, tile_cols * n, [&](int item_begin, int item_end) {
+	for (int item = item_begin; item < item_end; item++) {
+	  int tc = item / n, i = item % n;
+	  size_t r = std::min((size_t)tr * tile_size + i, (size_t)level.rows - 1);
+	  float* heights = &band[(size_t)tc * tile_values + (size_t)i * n];
+	  float lo = INFINITY, hi = -INFINITY, deviation = 0.0f;
+	  for (int j = 0; j < n; j++) {
+	    size_t c = std::min((size_t)tc * tile_size + j, (size_t)level.cols - 1);
+	    float z = level_value(field, k, r, c);
+	    heights[j] = z;
+	    if (std::isfinite(z)) {
+	      lo = std::min(lo, z);
+	      hi = std::max(hi, z);
+	    }
+	  }
+
+	  // the samples of the level below that this row of quads leaves
+	  // out, against the interpolation of the quad corners
+	  if (k > 0 && i < tile_size && r + 1 < (size_t)level.rows) {
+	    for (int j = 0; j < tile_size; j++) {
+	      size_t c = (size_t)tc * tile_size + j;
+	      if (c + 1 >= (size_t)level.cols)
+		break;
+	      float h00 = heights[j], h01 = heights[j + 1];
+	      float h10 = level_value(field, k, r + 1, c);
+	      float h11 = level_value(field, k, r + 1, c + 1);
+	      float m10 = level_value(field, k - 1, 2 * r + 1, 2 * c);
+	      float m01 = level_value(field, k - 1, 2 * r, 2 * c + 1);
+	      float m11 = level_value(field, k - 1, 2 * r + 1, 2 * c + 1);
+	      float d = std::max({std::fabs(m10 - (h00 + h10) * 0.5f),
+				  std::fabs(m01 - (h00 + h01) * 0.5f),
+				  std::fabs(m11 - (h00 + h01 + h10 + h11) * 0.25f)});
+	      if (std::isfinite(d))
+		deviation = std::max(deviation, d);
+	    }
+	  }
+	  row_min[item] = lo;
+	  row_max[item] = hi;
+	  row_error[item] = deviation;
+	}
+      }, 4);
+
+      for (int tc = 0; tc < tile_cols; tc++) {
+	tile_info& tile = tiles[level.first + (size_t)tr * tile_cols + tc];
+	float lo = INFINITY, hi = -INFINITY, deviation = 0.0f;
+	for (int i = 0; i < n; i++) {
+	  lo = std::min(lo, row_min[(size_t)tc * n + i]);
+	  hi = std::max(hi, row_max[(size_t)tc * n + i]);
+	  deviation = std::max(deviation, row_error[(size_t)tc * n + i]);
+	}
+	float children = 0.0f;
+	if (k > 0) {
+	  const tile_level& below = levels[k - 1];
+	  for (int cr = 2 * tr; cr <= 2 * tr + 1 && cr < below.tile_rows; cr++)
+	    for (int cc = 2 * tc; cc <= 2 * tc + 1 && cc < below.tile_cols; cc++)
+	      children = std::max(children, tiles[below.first + (size_t)cr * below.tile_cols + cc].error);
+	}
+	tile.offset = out.tell();
+	tile.min = lo <= hi ? lo : 0.0f;
+	tile.max = lo <= hi ? hi : -1.0f;
+	tile.error = deviation + children;
+	out.write(&band[(size_t)tc * tile_values], tile_bytes);
+	out.write(padding.data(), tile_stride - tile_bytes);
+      }
+    }
+  }
+
+  std::vector<stored_tile> table(tiles.size());
+  for (size_t i = 0; i < tiles.size(); i++)
+    table[i] = {tiles[i].offset, tiles[i].min, tiles[i].max, tiles[i].error, 0};
+
+  header h = {};
+  std::memcpy(h.magic, magic, sizeof(magic));
+  h.version = version;
+  h.tile_size = tile_size;
+  h.rows = field.rows;
+  h.cols = field.cols;
+  h.stamp = stamp;
+  h.table_offset = out.tell();
+  h.table_count = table.size();
+  h.table_checksum = checksum64(table.data(), table.size() * sizeof(stored_tile));
+  out.write(table.data(), table.size() * sizeof(stored_tile));
+
+  out.seek_write(0, &h, sizeof(h));
+  if (!out.close()) {
+    error = "cannot write file";
+    std::remove(path);
+    return false;
+  }
+  return true;
+}
+
+// ------------------------------------------------------------
+// vertices
+// ------------------------------------------------------------
+
+void tile_vertices(const tile_pyramid& pyramid, const tile_id& id, float size, const float rgb[3],
+		   std::vector<float>& vertices) {
+
+  // the rows and columns that repeat the border of the field have no
+  // extent, their normals come from the other neighbour only
+
+  int n = pyramid.tile_size + 1;
+  std::vector<float> heights((size_t)n * n);
+  pyramid.read(id, heights.data());
+
+  float start = -size / 2.0f;
+  double step_x = size / (double)(pyramid.rows - 1);
+  double step_z = size / (double)(pyramid.cols - 1);
+  std::vector<float> xs(n), zs(n);
+  for (int i = 0; i < n; i++) {
+    xs[i] = start + pyramid.field_row(id, i) * step_x;
+    zs[i] = start + pyramid.field_col(id, i) * step_z;
+  }
+
+  vertices.resize((size_t)n * n * floats_per_vertex);
+  auto height = [&](int i, int j) { return heights[(size_t)i * n + j]; };
+  for (int i = 0; i < n; i++) {
+    int i0 = std::max(0, i - 1), i1 = std::min(n - 1, i + 1);
+    for (int j = 0; j < n; j++) {
+      int j0 = std::max(0, j - 1), j1 = std::min(n - 1, j + 1);
+      float* v = &vertices[((size_t)i * n + j) * floats_per_vertex];
+      v[0] = xs[i];
+      v[1] = height(i, j);
+      v[2] = zs[j];
+      v[3] = rgb[0];
+      v[4] = rgb[1];
+      v[5] = rgb[2];
+      float dx = xs[i1] - xs[i0], dz = zs[j1] - zs[j0];
+      float dzdx = dx > 0.0f ? (height(i1, j) - height(i0, j)) / dx : 0.0f;
+      float dzdy = dz > 0.0f ? (height(i, j1) - height(i, j0)) / dz : 0.0f;
+      uint32_t normal = pack_normal(-dzdx, 1.0f, -dzdy);
+      std::memcpy(&v[6], &normal, sizeof(normal));
+    }
+  }
+}
+
+// ------------------------------------------------------------
+// loader thread
+// ------------------------------------------------------------
+
+tile_loader::tile_loader(std::shared_ptr<const tile_pyramid> pyramid, float size, const float rgb[3])
+  : pyramid(pyramid),
+    size(size),
+    rgb{rgb[0], rgb[1], rgb[2]},
+    thread(&tile_loader::run, this) { }
+
+tile_loader::~tile_loader() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    quit = true;
+  }
+  wake.notify_one();
+  thread.join();
+}
+
+void tile_loader::request(const std::vector<tile_id>& wanted) {
+  std::lock_guard<std::mutex> lock(mutex);
+  queue.clear();
+  for (const tile_id& id : wanted) {
+    uint64_t key = id.key();
+    if (loading && key == loading_key)
+      continue;
+    if (std::any_of(done.begin(), done.end(), [&](const loaded_tile& t) { return t.id.key() == key; }))
+      continue;
+    queue.push_back(id);
+  }
+  if (!queue.empty())
+    wake.notify_one();
+}
+
+bool tile_loader::pop(loaded_tile& tile) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (done.empty())
+    return false;
+  tile = std::move(done.front());
+  done.pop_front();
+  return true;
+}
+
+bool tile_loader::idle() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return queue.empty() && done.empty() && !loading;
+}
+
+void tile_loader::run() {
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true) {
+    wake.wait(lock, [&] { return quit || !queue.empty(); });
+    if (quit)
+      return;
+    tile_id id = queue.front();
+    queue.pop_front();
+    loading = true;
+    loading_key = id.key();
+    lock.unlock();
+
+    loaded_tile tile;
+    tile.id = id;
+    tile_vertices(*pyramid, id, size, rgb, tile.vertices);
+
+    lock.lock();
+    loading = false;
+    done.push_back(std::move(tile));
+  }
+}
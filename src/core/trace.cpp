@@ -0,0 +1,170 @@
+#include <trace.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// a complete event ('X') of a scope, or a counter ('C')
+struct trace_event {
+  const char* name;
+  char phase;
+  unsigned thread;
+  double ts_us;
+  double value; // duration in microseconds, or the counter
+};
+
+// distinct names of scopes whose last time is kept
+const int name_capacity = 64;
+
+struct trace_state {
+  std::mutex mutex;
+  std::atomic<bool> recording{false};
+  std::vector<trace_event> events; // a ring once full
+  size_t next = 0;
+  // the names seen so far, compared by their text since a literal may
+  // have a copy per translation unit, and the last time of each
+  const char* names[name_capacity] = {};
+  int name_count = 0;
+  std::atomic<double> last_ms[name_capacity] = {};
+};
+
+trace_state& state() {
+  static trace_state s;
+  return s;
+}
+
+double now_us() {
+  using clock = std::chrono::steady_clock;
+  static const clock::time_point start = clock::now();
+  return std::chrono::duration<double, std::micro>(clock::now() - start).count();
+}
+
+// small numbers in the order threads first trace something
+unsigned thread_number() {
+  static std::atomic<unsigned> count{0};
+  thread_local unsigned number = count++;
+  return number;
+}
+
+// the slot of `name` in the table, -1 once it is full. called with
+// the lock held.
+int find_name(trace_state& s, const char* name, bool insert) {
+  for (int k = 0; k < s.name_count; k++)
+    if (std::strcmp(s.names[k], name) == 0)
+      return k;
+  if (!insert || s.name_count == name_capacity)
+    return -1;
+  s.names[s.name_count] = name;
+  return s.name_count++;
+}
+
+// the same without the lock for a pointer the thread has seen before,
+// which is every scope but the first of each name
+int name_slot(trace_state& s, const char* name) {
+  thread_local std::vector<std::pair<const char*, int>> seen;
+  for (const auto& p : seen)
+    if (p.first == name)
+      return p.second;
+  int slot;
+  {
+    std::lock_guard<std::mutex> lock(s.mutex);
+    slot = find_name(s, name, true);
+  }
+  seen.push_back({name, slot});
+  return slot;
+}
+
+void add(trace_state& s, const trace_event& e) {
+  if (s.events.size() < trace_capacity)
+    s.events.push_back(e);
+  else
+    s.events[s.next] = e;
+  s.next = (s.next + 1) % trace_capacity;
+}
+
+} // namespace
+
+void trace_record(bool on) {
+  state().recording = on;
+}
+
+bool trace_recording() {
+  return state().recording;
+}
+
+void trace_clear() {
+  trace_state& s = state();
+  std::lock_guard<std::mutex> lock(s.mutex);
+  std::vector<trace_event>().swap(s.events);
+  s.next = 0;
+}
+
+double trace_last_ms(const char* name) {
+  trace_state& s = state();
+  std::lock_guard<std::mutex> lock(s.mutex);
+  int slot = find_name(s, name, false);
+  return slot >= 0 ? s.last_ms[slot].load(std::memory_order_relaxed) : 0.0;
+}
+
+void trace_counter(const char* name, double value) {
+  trace_state& s = state();
+  if (!s.recording)
+    return;
+  trace_event e = {name, 'C', thread_number(), now_us(), value};
+  std::lock_guard<std::mutex> lock(s.mutex);
+  add(s, e);
+}
+
+bool trace_write(const char* path, std::string& error) {
+
+  trace_state& s = state();
+  std::FILE* file = std::fopen(path, "w");
+  if (!file) {
+    error = "cannot write the file";
+    return false;
+  }
+
+  // oldest first: the ring starts at `next` once it is full
+  std::lock_guard<std::mutex> lock(s.mutex);
+  size_t count = s.events.size();
+  size_t first = count < trace_capacity ? 0 : s.next;
+  std::fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+  for (size_t k = 0; k < count; k++) {
+    const trace_event& e = s.events[(first + k) % count];
+    if (e.phase == 'X')
+      std::fprintf(file, "{\"name\":\"%s\",\"cat\":\"plotter3d\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,"
+		   "\"ts\":%.3f,\"dur\":%.3f}", e.name, e.thread, e.ts_us, e.value);
+    else
+      std::fprintf(file, "{\"name\":\"%s\",\"cat\":\"plotter3d\",\"ph\":\"C\",\"pid\":1,\"tid\":%u,"
+		   "\"ts\":%.3f,\"args\":{\"value\":%g}}", e.name, e.thread, e.ts_us, e.value);
+    std::fprintf(file, k + 1 < count ? ",\n" : "\n");
+  }
+  std::fprintf(file, "]}\n");
+  if (std::fclose(file) != 0) {
+    error = "cannot write the file";
+    return false;
+  }
+  return true;
+}
+
+trace_scope::trace_scope(const char* name)
+  : name(name),
+    begin_us(now_us()) { }
+
+trace_scope::~trace_scope() {
+  double end_us = now_us();
+  trace_state& s = state();
+  int slot = name_slot(s, name);
+  if (slot >= 0)
+    s.last_ms[slot].store((end_us - begin_us) / 1000.0, std::memory_order_relaxed);
+  if (!s.recording.load(std::memory_order_relaxed))
+    return;
+  trace_event e = {name, 'X', thread_number(), begin_us, end_us - begin_us};
+  std::lock_guard<std::mutex> lock(s.mutex);
+  add(s, e);
+}
@@ -4,7 +4,11 @@
 #include <window_surface_config.hpp>
 #include <data_properties.hpp>
 #include <data_surfaces.hpp>
+#include <scene_cache.hpp>
+#include <trace.hpp>
+#include <wx/filedlg.h>
 #include <map>
+#include <vector>
 
 // ------------------------------------------------------------
 // frame plotter constructor
@@ -27,7 +31,8 @@ FramePlotter::FramePlotter(wxFrame* parent)
      .perspective = true,
      .show_axes = true,
      .show_mesh = true,
-     // .lighting = true
+     .lighting = false,
+     .time = 0.0
   };
 
    /* ----------- initialize map ----------- */
@@ -78,16 +83,20 @@ FramePlotter::FramePlotter(wxFrame* parent)
   wxGridBagSizer* panel_staticbox_sizer = new wxGridBagSizer();
   panel_staticbox_properties->SetSizer(panel_staticbox_sizer);
 
-  wxString combobox_projection_choices[2] = {"Perspective", "Orthographic"};
+  wxString combobox_projection_choices[3] = {"Perspective", "Orthographic", "Contour map"};
 
   textctrl_gridsize   = new wxTextCtrl(panel_staticbox_properties, wxID_ANY, "");
   textctrl_divisions  = new wxTextCtrl(panel_staticbox_properties, wxID_ANY, "");
   checkbox_axes       = new wxCheckBox(panel_staticbox_properties, wxID_ANY, "Show axes");
   checkbox_mesh       = new wxCheckBox(panel_staticbox_properties, wxID_ANY, "Show mesh");
-  // checkbox_lighting   = new wxCheckBox(panel_staticbox_properties, wxID_ANY, "Lighting:");
+  checkbox_lighting   = new wxCheckBox(panel_staticbox_properties, wxID_ANY, "Lighting");
   combobox_projection = new wxComboBox(panel_staticbox_properties, wxID_ANY, "Perspective",
-				       wxDefaultPosition, wxDefaultSize, 2,
+				       wxDefaultPosition, wxDefaultSize, 3,
 				       combobox_projection_choices, wxCB_READONLY);
+  textctrl_contours   = new wxTextCtrl(panel_staticbox_properties, wxID_ANY, "");
+  statictext_time     = new wxStaticText(panel_staticbox_properties, wxID_ANY, "");
+  textctrl_speed      = new wxTextCtrl(panel_staticbox_properties, wxID_ANY, "");
+  button_play         = new wxButton(panel_staticbox_properties, wxID_ANY, "Play");
 
   /* --- set initial values to controls --- */
 
@@ -95,7 +104,10 @@ FramePlotter::FramePlotter(wxFrame* parent)
   textctrl_divisions->SetValue(wxString::Format(wxT("%.2f"), props.divisions));
   checkbox_axes     ->SetValue(props.show_axes);
   checkbox_mesh     ->SetValue(props.show_mesh);
-  // checkbox_lighting ->SetValue(props.lighting);
+  checkbox_lighting ->SetValue(props.lighting);
+  textctrl_contours ->SetValue(wxString::Format(wxT("%d"), props.contours));
+  statictext_time   ->SetLabel(wxString::Format(wxT("%.2f"), props.time));
+  textctrl_speed    ->SetValue(wxString::Format(wxT("%.2f"), timeline.speed));
 
   /* ------------ bind events ------------ */
 
@@ -103,8 +115,11 @@ FramePlotter::FramePlotter(wxFrame* parent)
   textctrl_divisions ->Bind(wxEVT_TEXT,     &FramePlotter::on_divisions, this);
   checkbox_axes      ->Bind(wxEVT_CHECKBOX, &FramePlotter::on_axes, this);
   checkbox_mesh      ->Bind(wxEVT_CHECKBOX, &FramePlotter::on_mesh, this);
-  // checkbox_lighting  ->Bind(wxEVT_CHECKBOX, &FramePlotter::on_lighting, this);
+  checkbox_lighting  ->Bind(wxEVT_CHECKBOX, &FramePlotter::on_lighting, this);
   combobox_projection->Bind(wxEVT_COMBOBOX, &FramePlotter::on_projection, this);
+  textctrl_contours  ->Bind(wxEVT_TEXT,     &FramePlotter::on_contours, this);
+  textctrl_speed     ->Bind(wxEVT_TEXT,     &FramePlotter::on_speed, this);
+  button_play        ->Bind(wxEVT_BUTTON,   &FramePlotter::on_play, this);
 
   /* ------------ add to sizer ------------ */
   
@@ -114,9 +129,16 @@ FramePlotter::FramePlotter(wxFrame* parent)
   panel_staticbox_sizer->Add(textctrl_gridsize,   wxGBPosition(0, 1), wxGBSpan(1, 1), wxALL|wxALIGN_LEFT, 5);
   panel_staticbox_sizer->Add(textctrl_divisions,  wxGBPosition(1, 1), wxGBSpan(1, 1), wxALL|wxALIGN_LEFT, 5);
   panel_staticbox_sizer->Add(combobox_projection, wxGBPosition(2, 1), wxGBSpan(1, 1), wxALL|wxALIGN_LEFT, 5);
-  panel_staticbox_sizer->Add(checkbox_axes,       wxGBPosition(3, 1), wxGBSpan(1, 1), wxEXPAND);
-  panel_staticbox_sizer->Add(checkbox_mesh,       wxGBPosition(4, 1), wxGBSpan(1, 1), wxEXPAND);
-  // panel_staticbox_sizer->Add(checkbox_lighting,   wxGBPosition(5, 1), wxGBSpan(1, 1), wxEXPAND);
+  panel_staticbox_sizer->Add(new wxStaticText(panel_staticbox_properties, wxID_ANY, "Contours:"), wxGBPosition(3, 0), wxGBSpan(1, 1), wxALIGN_RIGHT|wxALIGN_CENTER_VERTICAL);
+  panel_staticbox_sizer->Add(textctrl_contours,   wxGBPosition(3, 1), wxGBSpan(1, 1), wxALL|wxALIGN_LEFT, 5);
+  panel_staticbox_sizer->Add(checkbox_axes,       wxGBPosition(4, 1), wxGBSpan(1, 1), wxEXPAND);
+  panel_staticbox_sizer->Add(checkbox_mesh,       wxGBPosition(5, 1), wxGBSpan(1, 1), wxEXPAND);
+  panel_staticbox_sizer->Add(checkbox_lighting,   wxGBPosition(6, 1), wxGBSpan(1, 1), wxEXPAND);
+  panel_staticbox_sizer->Add(new wxStaticText(panel_staticbox_properties, wxID_ANY, "Time:"),  wxGBPosition(7, 0), wxGBSpan(1, 1), wxALIGN_RIGHT|wxALIGN_CENTER_VERTICAL);
+  panel_staticbox_sizer->Add(new wxStaticText(panel_staticbox_properties, wxID_ANY, "Speed:"), wxGBPosition(8, 0), wxGBSpan(1, 1), wxALIGN_RIGHT|wxALIGN_CENTER_VERTICAL);
+  panel_staticbox_sizer->Add(statictext_time,     wxGBPosition(7, 1), wxGBSpan(1, 1), wxALL|wxALIGN_LEFT, 5);
+  panel_staticbox_sizer->Add(textctrl_speed,      wxGBPosition(8, 1), wxGBSpan(1, 1), wxALL|wxALIGN_LEFT, 5);
+  panel_staticbox_sizer->Add(button_play,         wxGBPosition(9, 1), wxGBSpan(1, 1), wxALL|wxALIGN_LEFT, 5);
 
   panel_staticbox_sizer->AddGrowableCol(0, 1);
   panel_staticbox_sizer->AddGrowableCol(1, 1);
@@ -142,26 +164,64 @@ FramePlotter::FramePlotter(wxFrame* parent)
   // ------------------------------------------------------------
 
   wxMenu *menu_file = new wxMenu;
+  menu_file->Append(103, "&Open scene...\tCtrl-O",
+		   "Open a scene saved with its evaluated surfaces.");
+  menu_file->Append(104, "&Save scene...\tCtrl-S",
+		   "Save the scene with its evaluated surfaces.");
+  menu_file->AppendSeparator();
   menu_file->Append(101, "&Exit\tCtrl-Q",
 		   "Exit the program.");
   
   wxMenu *menu_surface = new wxMenu;
   menu_surface->Append(102, "&Add new surface...",
 		       "");
+
+  wxMenu *menu_view = new wxMenu;
+  menu_view->AppendCheckItem(105, "Performance &overlay\tF3",
+			     "Show frame and gpu times, what is drawn and the stages of the last mesh.");
+  menu_view->AppendCheckItem(106, "&Record trace",
+			     "Record the time of every stage until the trace is saved.");
+  menu_view->Append(107, "Save &trace...",
+		    "Save the recorded stages for chrome://tracing or Perfetto.");
  
   wxMenuBar *menuBar = new wxMenuBar;
   menuBar->Append(menu_file, "&File");
   menuBar->Append(menu_surface, "&Surfaces");
+  menuBar->Append(menu_view, "&View");
  
   SetMenuBar(menuBar);
  
-  CreateStatusBar();
+  CreateStatusBar(3);
   SetStatusText("Welcome to Plotter3D");
+  canvas_gl->report_frames = [this](const FrameReport& report) {
+    if (report.frames == 0)
+      return;
+    SetStatusText(wxString::Format(wxT("%.0f fps, frame %.1f ms (max %.1f), %d requests in %d frames"),
+				   report.fps, report.frame_ms, report.frame_ms_max,
+				   report.requests, report.frames), 1);
+    // the gpu time of every pass that drew
+    const RenderStats& stats = canvas_gl->render_stats();
+    wxString passes = wxString::Format(wxT("gpu %.2f ms"), stats.gpu_ms);
+    for (int pass = 0; pass < PASS_COUNT; pass++)
+      if (stats.pass_gpu_ms[pass] > 0.0)
+	passes += wxString::Format(wxT(", %s %.2f"), render_pass_names[pass], stats.pass_gpu_ms[pass]);
+    SetStatusText(passes, 2);
+  };
 
   /* -------- bind menubar events -------- */
 
   Bind(wxEVT_MENU, &FramePlotter::on_menu_exit, this, 101);
   Bind(wxEVT_MENU, &FramePlotter::on_menu_surface, this, 102);
+  Bind(wxEVT_MENU, &FramePlotter::on_menu_open, this, 103);
+  Bind(wxEVT_MENU, &FramePlotter::on_menu_save, this, 104);
+  Bind(wxEVT_MENU, &FramePlotter::on_menu_overlay, this, 105);
+  Bind(wxEVT_MENU, &FramePlotter::on_menu_record, this, 106);
+  Bind(wxEVT_MENU, &FramePlotter::on_menu_trace, this, 107);
+
+  /* ----------- animation timer ----------- */
+
+  timer.SetOwner(this);
+  Bind(wxEVT_TIMER, &FramePlotter::on_timer, this);
   
 }
 
@@ -175,16 +235,7 @@ void FramePlotter::on_gridsize(wxCommandEvent& event) {
   textctrl_gridsize->GetValue().ToLong(&value);
   if (value <= 0) return;
   props.grid_size = (int)value;
-  // update ebo
-  canvas_gl->ebo_update();
-  for (const auto& pair : surfaces_data) {
-    // realloc buffer, and update all
-    pair.second.window_surface_config->update_buffer_size();
-    pair.second.window_surface_config->vector_update_coords();
-    pair.second.window_surface_config->vector_update_colors();
-    pair.second.window_surface_config->vector_send_to_buffer();
-  }
-  canvas_gl->Refresh();
+  canvas_gl->defer(this, DEFER_SURFACES, [this]{ rebuild_surfaces(); });
 }
 
 void FramePlotter::on_divisions(wxCommandEvent& event) {
@@ -192,16 +243,18 @@ void FramePlotter::on_divisions(wxCommandEvent& event) {
   textctrl_divisions->GetValue().ToDouble(&value);
   if (value <= 1) return;
   props.divisions = (float)value;
+  canvas_gl->defer(this, DEFER_SURFACES, [this]{ rebuild_surfaces(); });
+}
+
+void FramePlotter::rebuild_surfaces() {
   // update ebo
   canvas_gl->ebo_update();
   for (const auto& pair : surfaces_data) {
     // realloc buffer, and update all
-    pair.second.window_surface_config->update_buffer_size();
+    pair.second.window_surface_config->set_divisions(props.divisions);
     pair.second.window_surface_config->vector_update_coords();
-    pair.second.window_surface_config->vector_update_colors();
     pair.second.window_surface_config->vector_send_to_buffer();
   }
-  canvas_gl->Refresh();
 }
 
 void FramePlotter::on_projection(wxCommandEvent& event) {
@@ -210,29 +263,198 @@ void FramePlotter::on_projection(wxCommandEvent& event) {
   } else {
     props.perspective = false;
   }
-  canvas_gl->Refresh();
+  // the map is orthographic, seen from above
+  props.contour_map = combobox_projection->GetValue() == wxString("Contour map");
+  canvas_gl->request_frame();
+}
+
+void FramePlotter::on_contours(wxCommandEvent& event) {
+  long value;
+  if (!textctrl_contours->GetValue().ToLong(&value) || value < 0) return;
+  props.contours = (int)std::min(value, 256L);
+  // only the contours are extracted again, the vertices stay
+  canvas_gl->defer(this, DEFER_CONTOURS, [this]{
+    for (auto& pair : surfaces_data) {
+      pair.second.window_surface_config->update_contours();
+      SceneRenderer::upload_contours(pair.second);
+    }
+  });
 }
 
 void FramePlotter::on_axes(wxCommandEvent& event) {
   props.show_axes = checkbox_axes->GetValue();
-  canvas_gl->Refresh();
+  canvas_gl->request_frame();
 }
 
 void FramePlotter::on_mesh(wxCommandEvent& event) {
   props.show_mesh = checkbox_mesh->GetValue();
-  canvas_gl->Refresh();
+  canvas_gl->request_frame();
+}
+
+void FramePlotter::on_lighting(wxCommandEvent& event) {
+  props.lighting = checkbox_lighting->GetValue();
+  // normals are only computed while lighting is enabled
+  canvas_gl->defer(this, DEFER_SURFACES, [this]{ rebuild_surfaces(); });
 }
 
-// void FramePlotter::on_lighting(wxCommandEvent& event) {
-//   props.lighting = checkbox_lighting->GetValue();
-//   canvas_gl->Refresh();
-// }
+// ------------------------------------------------------------
+// animation
+// ------------------------------------------------------------
+
+void FramePlotter::on_play(wxCommandEvent& event) {
+  timeline.playing = !timeline.playing;
+  if (timeline.playing) {
+    button_play->SetLabel("Pause");
+    time_last = stopwatch.Time();
+    timer.Start(16);
+  } else {
+    button_play->SetLabel("Play");
+    timer.Stop();
+    // paused surfaces are shown at full resolution again
+    scheduler.reset();
+    animate(props.divisions);
+  }
+}
+
+void FramePlotter::on_speed(wxCommandEvent& event) {
+  double value;
+  if (!textctrl_speed->GetValue().ToDouble(&value)) return;
+  timeline.speed = value;
+}
+
+void FramePlotter::on_timer(wxTimerEvent& event) {
+  long time_now = stopwatch.Time();
+  timeline.advance(props.time, (time_now - time_last) / 1000.0);
+  time_last = time_now;
+  statictext_time->SetLabel(wxString::Format(wxT("%.2f"), props.time));
+  animate(scheduler.divisions(props.divisions));
+}
+
+void FramePlotter::animate(float divisions) {
+
+  // re-evaluates every surface that depends on t. the time it takes
+  // decides the resolution the scheduler picks for the next tick.
+
+  wxStopWatch watch;
+  bool any_animated = false;
+
+  for (auto& pair : surfaces_data) {
+    if (!pair.second.animated || !pair.second.show)
+      continue;
+    WindowSurfaceConfig* window = pair.second.window_surface_config;
+    if (pair.second.divisions != divisions)
+      window->set_divisions(divisions);
+    window->vector_update_coords();
+    window->vector_send_to_buffer();
+    any_animated = true;
+  }
+
+  if (!any_animated) return;
+  scheduler.record(watch.Time(), props.divisions);
+  canvas_gl->request_frame();
+}
 
 void FramePlotter::on_menu_exit(wxCommandEvent &event) {
   Close(true);
 }
 
 void FramePlotter::on_menu_surface(wxCommandEvent& event) {
-  WindowSurfaceConfig* window_surface_config = this->panel_scrolled->create_surface_config_window();
-  window_surface_config->set_canvas_gl(canvas_gl);
+  this->panel_scrolled->create_surface_config_window();
+}
+
+// ------------------------------------------------------------
+// scene cache
+// ------------------------------------------------------------
+
+void FramePlotter::on_menu_open(wxCommandEvent& event) {
+
+  wxFileDialog dialog(this, "Open scene", "", "", "Plotter3D scenes (*.p3d)|*.p3d",
+		      wxFD_OPEN|wxFD_FILE_MUST_EXIST);
+  if (dialog.ShowModal() != wxID_OK) return;
+
+  wxStopWatch watch;
+  std::string path = std::string(dialog.GetPath().mb_str());
+  scene_cache cache;
+  if (!scene_cache_read(path.c_str(), cache)) {
+    wxMessageBox("The file is not a scene or it is damaged.", "Open scene", wxOK|wxICON_ERROR);
+    return;
+  }
+
+  // the current surfaces are replaced
+  std::vector<WindowSurfaceConfig*> windows;
+  for (const auto& pair : surfaces_data)
+    windows.push_back(pair.second.window_surface_config);
+  for (WindowSurfaceConfig* window : windows)
+    window->remove();
+
+  if (timeline.playing) {
+    wxCommandEvent pause;
+    on_play(pause);
+  }
+
+  props = cache.props;
+  textctrl_gridsize ->ChangeValue(wxString::Format(wxT("%d"), props.grid_size));
+  textctrl_divisions->ChangeValue(wxString::Format(wxT("%.2f"), props.divisions));
+  checkbox_axes     ->SetValue(props.show_axes);
+  checkbox_mesh     ->SetValue(props.show_mesh);
+  checkbox_lighting ->SetValue(props.lighting);
+  combobox_projection->SetValue(props.contour_map ? "Contour map" :
+			       props.perspective ? "Perspective" : "Orthographic");
+  textctrl_contours ->ChangeValue(wxString::Format(wxT("%d"), props.contours));
+  statictext_time   ->SetLabel(wxString::Format(wxT("%.2f"), props.time));
+  canvas_gl->ebo_update();
+
+  for (const cached_surface& cached : cache.surfaces) {
+    WindowSurfaceConfig* window_surface_config = this->panel_scrolled->create_surface_config_window();
+    window_surface_config->load_cached(cached, cache.file);
+  }
+
+  canvas_gl->request_frame();
+  SetStatusText(wxString::Format(wxT("Opened %zu surfaces in %ld ms"), cache.surfaces.size(), watch.Time()));
+}
+
+void FramePlotter::on_menu_save(wxCommandEvent& event) {
+
+  wxFileDialog dialog(this, "Save scene", "", "scene.p3d", "Plotter3D scenes (*.p3d)|*.p3d",
+		      wxFD_SAVE|wxFD_OVERWRITE_PROMPT);
+  if (dialog.ShowModal() != wxID_OK) return;
+
+  std::string path = std::string(dialog.GetPath().mb_str());
+  std::vector<cached_surface> surfaces;
+  for (const auto& pair : surfaces_data)
+    surfaces.push_back(pair.second.window_surface_config->to_cached());
+
+  if (!scene_cache_write(path.c_str(), props, surfaces))
+    wxMessageBox("The scene could not be written.", "Save scene", wxOK|wxICON_ERROR);
+  else
+    SetStatusText(wxString::Format(wxT("Saved %zu surfaces"), surfaces.size()));
+}
+
+// ------------------------------------------------------------
+// performance overlay and trace
+// ------------------------------------------------------------
+
+void FramePlotter::on_menu_overlay(wxCommandEvent& event) {
+  canvas_gl->show_overlay(event.IsChecked());
+}
+
+void FramePlotter::on_menu_record(wxCommandEvent& event) {
+  // a new recording starts empty
+  if (event.IsChecked())
+    trace_clear();
+  trace_record(event.IsChecked());
+}
+
+void FramePlotter::on_menu_trace(wxCommandEvent& event) {
+
+  wxFileDialog dialog(this, "Save trace", "", "trace.json", "Chrome traces (*.json)|*.json",
+		      wxFD_SAVE|wxFD_OVERWRITE_PROMPT);
+  if (dialog.ShowModal() != wxID_OK) return;
+
+  std::string path = std::string(dialog.GetPath().mb_str());
+  std::string error;
+  if (!trace_write(path.c_str(), error))
+    wxMessageBox(wxString(path + ": " + error), "Save trace", wxOK|wxICON_ERROR);
+  else
+    SetStatusText(wxString::Format(wxT("Saved the trace to %s"), dialog.GetPath()));
 }
@@ -0,0 +1,140 @@
+#include <height_array.hpp>
+#include <mesh.hpp>
+#include <algorithm>
+#include <cstring>
+
+// ------------------------------------------------------------
+// layers
+// ------------------------------------------------------------
+
+void HeightArrays::init() {
+  glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+  glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &max_layers);
+}
+
+bool HeightArrays::fits(int rows, int columns) {
+  return rows >= 2 && columns >= 2 && rows <= max_size && columns <= max_size && max_layers > 0;
+}
+
+height_layer HeightArrays::allocate(int rows, int columns) {
+
+  // the first free layer of an array of the resolution, or of one
+  // that can still grow
+
+  int index = 0;
+  for (; index < (int)arrays.size(); index++) {
+    array& a = arrays[index];
+    if (a.rows != rows || a.columns != columns)
+      continue;
+    if (std::find(a.used.begin(), a.used.end(), 0) != a.used.end() || a.capacity < max_layers)
+      break;
+  }
+
+  if (index == (int)arrays.size()) {
+    array a;
+    a.rows = rows;
+    a.columns = columns;
+    glGenVertexArrays(1, &a.vao);
+    glGenBuffers(1, &a.instances);
+    glBindVertexArray(a.vao);
+    glBindBuffer(GL_ARRAY_BUFFER, a.instances);
+    GLsizei stride = instance_floats * sizeof(float);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, stride, (void*)0);
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, stride, (void*)(4 * sizeof(float)));
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, stride, (void*)(8 * sizeof(float)));
+    for (GLuint k = 0; k < 3; k++) {
+      glEnableVertexAttribArray(k);
+      glVertexAttribDivisor(k, 1);
+    }
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    arrays.push_back(a);
+  }
+
+  array& a = arrays[index];
+  auto unused = std::find(a.used.begin(), a.used.end(), 0);
+  if (unused == a.used.end()) {
+    resize(a, std::min(std::max(a.capacity * 2, 1), (int)max_layers));
+    unused = std::find(a.used.begin(), a.used.end(), 0);
+  }
+  *unused = 1;
+  return {index, (int)(unused - a.used.begin())};
+}
+
+void HeightArrays::release(const height_layer& layer) {
+  // uploads to a texture are ordered with the draws, the layer can be
+  // reused right away
+  if (layer.array < 0)
+    return;
+  arrays[layer.array].used[layer.layer] = 0;
+}
+
+void HeightArrays::resize(array& a, int capacity) {
+
+  // a new texture, the layers of the old one are copied through a
+  // framebuffer since gl 3.3 has no glCopyImageSubData
+
+  GLuint texture;
+  glGenTextures(1, &texture);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+  glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RG32UI, a.columns, a.rows, capacity, 0, GL_RG_INTEGER,
+	       GL_UNSIGNED_INT, NULL);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+  if (a.texture) {
+    GLint framebuffer_previous = 0;
+    glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &framebuffer_previous);
+    GLuint framebuffer;
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+    for (int layer = 0; layer < a.capacity; layer++) {
+      if (!a.used[layer])
+	continue;
+      glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, a.texture, 0, layer);
+      glCopyTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, 0, 0, a.columns, a.rows);
+    }
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer_previous);
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteTextures(1, &a.texture);
+  }
+  glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+  a.texture = texture;
+  a.capacity = capacity;
+  a.used.resize(capacity, 0);
+}
+
+// ------------------------------------------------------------
+// upload
+// ------------------------------------------------------------
+
+size_t HeightArrays::upload(const height_layer& layer, const float* vertices) {
+
+  // the height and the packed normal of every vertex, bit for bit.
+  // an integer texture keeps the nan heights of holes as they are.
+
+  if (layer.array < 0)
+    return 0;
+  const array& a = arrays[layer.array];
+  size_t count = (size_t)a.rows * a.columns;
+  texels.resize(count * 2);
+  for (size_t v = 0; v < count; v++) {
+    std::memcpy(&texels[v * 2], &vertices[v * floats_per_vertex + 1], sizeof(float));
+    std::memcpy(&texels[v * 2 + 1], &vertices[v * floats_per_vertex + 6], sizeof(float));
+  }
+  glBindTexture(GL_TEXTURE_2D_ARRAY, a.texture);
+  glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer.layer, a.columns, a.rows, 1, GL_RG_INTEGER,
+		  GL_UNSIGNED_INT, texels.data());
+  glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+  return texels.size() * sizeof(unsigned int);
+}
+
+void HeightArrays::destroy() {
+  for (array& a : arrays) {
+    glDeleteTextures(1, &a.texture);
+    glDeleteVertexArrays(1, &a.vao);
+    glDeleteBuffers(1, &a.instances);
+  }
+  arrays.clear();
+}
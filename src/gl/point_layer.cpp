@@ -0,0 +1,141 @@
+#include <point_layer.hpp>
+#include <algorithm>
+#include <cmath>
+#include <queue>
+#include <utility>
+
+PointLayer::PointLayer(std::shared_ptr<const point_cloud> cloud)
+  : cloud(cloud) { }
+
+// ------------------------------------------------------------
+// gl objects
+// ------------------------------------------------------------
+
+void PointLayer::create() {
+
+  // the nodes are breadth first, so the nodes that fit into the
+  // budget are always the coarse ones
+
+  destroy();
+  const size_t point_bytes = 4 * sizeof(uint16_t);
+  size_t capacity = 0;
+  uploadable_nodes = 0;
+  while (uploadable_nodes < cloud->nodes.size()) {
+    size_t count = cloud->nodes[uploadable_nodes].count;
+    if ((capacity + count) * point_bytes > budget)
+      break;
+    capacity += count;
+    uploadable_nodes++;
+  }
+
+  glGenVertexArrays(1, &vao);
+  glGenBuffers(1, &vbo);
+  glBindVertexArray(vao);
+  glBindBuffer(GL_ARRAY_BUFFER, vbo);
+  glBufferData(GL_ARRAY_BUFFER, std::max<size_t>(capacity, 1) * point_bytes, NULL, GL_STATIC_DRAW);
+  // position within the cube of the node and value, all in [0, 1]
+  glVertexAttribPointer(0, 4, GL_UNSIGNED_SHORT, GL_TRUE, point_bytes, (void*)0);
+  glEnableVertexAttribArray(0);
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void PointLayer::destroy() {
+  if (vao) glDeleteVertexArrays(1, &vao);
+  if (vbo) glDeleteBuffers(1, &vbo);
+  vao = vbo = 0;
+  uploaded_nodes = 0;
+  uploadable_nodes = 0;
+  selection.clear();
+}
+
+// ------------------------------------------------------------
+// selection
+// ------------------------------------------------------------
+
+bool PointLayer::visible(const point_node& node) const {
+  float box_max[3] = {node.min[0] + node.size, node.min[1] + node.size, node.min[2] + node.size};
+  return view_frustum.intersects(node.min, box_max);
+}
+
+float PointLayer::distance(const point_node& node) const {
+  glm::vec3 closest(std::clamp(camera.x, node.min[0], node.min[0] + node.size),
+		    std::clamp(camera.y, node.min[1], node.min[1] + node.size),
+		    std::clamp(camera.z, node.min[2], node.min[2] + node.size));
+  return glm::length(camera - closest);
+}
+
+void PointLayer::update(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& camera_pos,
+			int viewport_height) {
+  if (!vao)
+    return;
+
+  // the next nodes of the stream, whole nodes only
+  if (uploaded_nodes < uploadable_nodes) {
+    const std::vector<point_node>& nodes = cloud->nodes;
+    size_t first = nodes[uploaded_nodes].first, count = 0;
+    size_t end = uploaded_nodes;
+    while (end < uploadable_nodes && (count == 0 || count + nodes[end].count <= uploads_per_frame))
+      count += nodes[end++].count;
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferSubData(GL_ARRAY_BUFFER, first * 4 * sizeof(uint16_t), count * 4 * sizeof(uint16_t),
+		    &cloud->points[first * 4]);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    uploaded_nodes = end;
+  }
+
+  view_frustum.set(projection * view);
+  orthographic = projection[3][3] == 1.0f;
+  pixels_per_unit = 0.5f * viewport_height * projection[1][1];
+  camera = camera_pos;
+
+  // largest on screen first
+  auto projected = [&](const point_node& node) {
+    if (orthographic)
+      return node.size * pixels_per_unit;
+    float d = distance(node);
+    return d < 1e-6f ? INFINITY : node.size * pixels_per_unit / d;
+  };
+
+  selection.clear();
+  std::priority_queue<std::pair<float, int>> queue;
+  if (uploaded_nodes > 0 && visible(cloud->nodes[0]))
+    queue.emplace(projected(cloud->nodes[0]), 0);
+  size_t points = 0;
+  while (!queue.empty()) {
+    int n = queue.top().second;
+    queue.pop();
+    const point_node& node = cloud->nodes[n];
+    if (points + node.count > point_budget)
+      break;
+    selection.push_back(n);
+    points += node.count;
+
+    // the points of a node are about `spacing` apart
+    float spacing = projected(node) * cloud->spacing(node) / node.size;
+    if (spacing <= point_size)
+      continue;
+    for (int child : node.children)
+      if (child >= 0 && (size_t)child < uploaded_nodes && visible(cloud->nodes[child]))
+	queue.emplace(projected(cloud->nodes[child]), child);
+  }
+}
+
+// ------------------------------------------------------------
+// draw
+// ------------------------------------------------------------
+
+unsigned long long PointLayer::draw(GLint location_node, int& draw_calls) const {
+  if (!vao || selection.empty())
+    return 0;
+  unsigned long long points = 0;
+  glBindVertexArray(vao);
+  for (int n : selection) {
+    const point_node& node = cloud->nodes[n];
+    glUniform4f(location_node, node.min[0], node.min[1], node.min[2], node.size);
+    glDrawArrays(GL_POINTS, node.first, node.count);
+    points += node.count;
+  }
+  draw_calls += selection.size();
+  return points;
+}
@@ -0,0 +1,1175 @@
+#include <scene_renderer.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <mesh.hpp>
+#include <trace.hpp>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+SceneRenderer::SceneRenderer(Properties& props, std::map<unsigned int, SurfaceData>& surfaces_data)
+  : props(props),
+    surfaces_data(surfaces_data) { }
+
+// ------------------------------------------------------------
+// gl objects
+// ------------------------------------------------------------
+
+// called once the context is current and glad has been loaded
+
+void SceneRenderer::init() {
+
+	// ------------------------------------------------------------
+	// vertex shader
+  	// ------------------------------------------------------------
+	const char *shader_source_vertex = R"(
+		#version 330 core
+		layout (location = 0) in vec3 aPos;
+		layout (location = 1) in vec3 aColor;
+		layout (location = 2) in vec2 aNormal;
+		uniform mat4 model;
+		uniform mat4 view;
+		uniform mat4 projection;
+		// the tables of the vertex pool, see vertex_pool.hpp
+		uniform bool pooled;
+		uniform isamplerBuffer pool_blocks;
+		uniform samplerBuffer pool_params;
+		uniform int block_vertices;
+		out vec4 input_color;
+		out vec3 input_normal;
+		out float input_height;
+		flat out vec4 input_params;
+		void main() {
+			gl_Position = projection * view * model * vec4(aPos, 1.0);
+			input_color = vec4(aColor, 1.0);
+			input_height = aPos.y;
+			input_params = vec4(-1.0, 0.0, 1.0, 0.0);
+			if (pooled)
+				input_params = texelFetch(pool_params, texelFetch(pool_blocks, gl_VertexID / block_vertices).r);
+			// octahedral decoding, see normal_packing.hpp
+			vec3 n = vec3(aNormal, 1.0 - abs(aNormal.x) - abs(aNormal.y));
+			if (n.z < 0.0)
+				n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+			input_normal = mat3(model) * normalize(n);
+		}
+	)";
+
+	// ------------------------------------------------------------
+	// fragment shaders
+	// ------------------------------------------------------------
+
+	const char *shader_source_fragment_surface = R"(
+		#version 330 core
+		in vec4 input_color;
+		in vec3 input_normal;
+		in float input_height;
+		flat in vec4 input_params;
+		uniform bool lighting;
+		uniform vec3 light_dir;
+		uniform bool pooled;
+		uniform sampler2D colormaps;
+		uniform float colormap_rows;
+		uniform bool use_colormap;
+		uniform sampler1D colormap;
+		uniform vec2 height_range;
+		out vec4 FragColor;
+		void main() {
+			// FragColor = vec4(1.0f, 1.0f, 1.0f, 1.0f);
+			vec4 color = input_color;
+			if (pooled) {
+				// colormap row and height range of the surface
+				if (input_params.x >= 0.0) {
+					float span = max(input_params.z - input_params.y, 1e-6);
+					vec2 uv = vec2((input_height - input_params.y) / span, (input_params.x + 0.5) / colormap_rows);
+					color = texture(colormaps, uv);
+				}
+			} else if (use_colormap) {
+				float span = max(height_range.y - height_range.x, 1e-6);
+				color = texture(colormap, (input_height - height_range.x) / span);
+			}
+			if (!lighting) {
+				FragColor = color;
+				return;
+			}
+			// headlight, both sides of the surface are lit
+			vec3 n = normalize(input_normal);
+			float diffuse = abs(dot(n, light_dir));
+			float specular = pow(diffuse, 32.0) * 0.3;
+			FragColor = vec4(color.rgb * (0.25 + 0.75 * diffuse) + specular, 1.0);
+		}
+	)";
+
+	const char *shader_source_fragment_mesh = R"(
+		#version 330 core
+		in vec4 input_color;
+		out vec4 FragColor;
+		void main() {
+			FragColor = vec4(0.0f, 0.0f, 0.0f, 1.0f);
+		}
+	)";
+
+	// ------------------------------------------------------------
+	// surface shader
+	// ------------------------------------------------------------
+
+	// glCreateShader用于创建一个新的着色器对象，失败了就返回0
+	// GL_VERTEX_SHADER类型的着色器是一种旨在在可编程顶点处理器上运行的着色器。
+	GLuint shader_vertex = glCreateShader(GL_VERTEX_SHADER);
+	// glShaderSource函数将着色器对象中的源代码设置为由string参数指定的字符串数组中的源代码。之前存储在着色器对象中的任何源代码会被完全替换。
+	// 数组中的字符串数量由count参数指定, 这里就一个字符串。
+	glShaderSource(shader_vertex, 1, &shader_source_vertex, NULL);
+	// 指出要被编译的着色器对象
+	glCompileShader(shader_vertex);
+
+	// 类型为GL_FRAGMENT_SHADER的着色器是一种专为在可编程片段处理器上运行而设计的着色器。
+	GLuint shader_fragment_surface = glCreateShader(GL_FRAGMENT_SHADER);
+	glShaderSource(shader_fragment_surface, 1, &shader_source_fragment_surface, NULL);
+	// 指出要被编译的着色器对象
+	glCompileShader(shader_fragment_surface);
+
+	// glCreateProgram函数创建一个空的程序对象，并返回一个非零值作为其引用标识符。程序对象是一个可以附加着色器对象的容器。
+	shader_surface = glCreateProgram();
+	// 附加着色器对象
+	glAttachShader(shader_surface, shader_vertex);
+	// 附加着色器对象
+	glAttachShader(shader_surface, shader_fragment_surface);
+	// 指明要被链接的程序对象句柄
+	glLinkProgram(shader_surface);
+
+	// ------------------------------------------------------------
+	// mesh shader
+	// ------------------------------------------------------------
+
+	// 类型为GL_FRAGMENT_SHADER的着色器是一种专为在可编程片段处理器上运行而设计的着色器
+	GLuint shader_fragment_mesh = glCreateShader(GL_FRAGMENT_SHADER);
+	// glShaderSource函数将着色器对象中的源代码设置为由string参数指定的字符串数组中的源代码。之前存储在着色器对象中的任何源代码会被完全替换。
+	// 数组中的字符串数量由count参数指定, 这里就一个字符串。
+	glShaderSource(shader_fragment_mesh, 1, &shader_source_fragment_mesh, NULL);
+	// 指出要被编译的着色器对象
+	glCompileShader(shader_fragment_mesh);
+
+	// glCreateProgram函数创建一个空的程序对象，并返回一个非零值作为其引用标识符。程序对象是一个可以附加着色器对象的容器。
+	shader_mesh = glCreateProgram();
+	// 附加着色器对象
+	glAttachShader(shader_mesh, shader_vertex);
+	// 附加着色器对象
+	glAttachShader(shader_mesh, shader_fragment_mesh);
+	// 指明要被链接的程序对象句柄
+	glLinkProgram(shader_mesh);
+
+	// ------------------------------------------------------------
+	// instanced shaders
+	// ------------------------------------------------------------
+
+	// a surface of a height array per instance, see height_array.hpp.
+	// the vertex is rebuilt from its row and column, the texel of its
+	// layer and the attributes of the instance, the fragment shaders
+	// are those of the surfaces and meshes.
+	const char *shader_source_vertex_instanced = R"(
+		#version 330 core
+		layout (location = 0) in vec4 aExtent;
+		layout (location = 1) in vec4 aParams;
+		layout (location = 2) in vec3 aColor;
+		uniform mat4 model;
+		uniform mat4 view;
+		uniform mat4 projection;
+		uniform usampler2DArray heights;
+		uniform int rows;
+		uniform int columns;
+		out vec4 input_color;
+		out vec3 input_normal;
+		out float input_height;
+		flat out vec4 input_params;
+		void main() {
+			int i = gl_VertexID / columns;
+			int j = gl_VertexID - i * columns;
+			uvec2 texel = texelFetch(heights, ivec3(j, i, int(aParams.w)), 0).rg;
+			float x = aExtent.x + float(i) * ((aExtent.y - aExtent.x) / float(rows - 1));
+			float z = aExtent.z + float(j) * ((aExtent.w - aExtent.z) / float(columns - 1));
+			float height = uintBitsToFloat(texel.r);
+			gl_Position = projection * view * model * vec4(x, height, z, 1.0);
+			input_color = vec4(aColor, 1.0);
+			input_height = height;
+			input_params = vec4(aParams.xyz, 0.0);
+			// the halves of the packed normal as a GL_SHORT vec2 reads them
+			vec2 halves = vec2(float(int(texel.g << 16u) >> 16), float(int(texel.g) >> 16));
+			halves = max(halves / 32767.0, -1.0);
+			vec3 n = vec3(halves, 1.0 - abs(halves.x) - abs(halves.y));
+			if (n.z < 0.0)
+				n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+			input_normal = mat3(model) * normalize(n);
+		}
+	)";
+
+	GLuint shader_vertex_instanced = glCreateShader(GL_VERTEX_SHADER);
+	glShaderSource(shader_vertex_instanced, 1, &shader_source_vertex_instanced, NULL);
+	glCompileShader(shader_vertex_instanced);
+	shader_instanced = glCreateProgram();
+	glAttachShader(shader_instanced, shader_vertex_instanced);
+	glAttachShader(shader_instanced, shader_fragment_surface);
+	glLinkProgram(shader_instanced);
+	shader_instanced_mesh = glCreateProgram();
+	glAttachShader(shader_instanced_mesh, shader_vertex_instanced);
+	glAttachShader(shader_instanced_mesh, shader_fragment_mesh);
+	glLinkProgram(shader_instanced_mesh);
+	glDeleteShader(shader_vertex_instanced);
+
+	// 着色器对象已附加到某个程序对象,则仅会将其标记为待删除，但不会立即删除。
+	// 只有当该着色器对象从所有程序对象中分离，且在所有渲染上下文中均未被使用时，才会真正被删除。
+	glDeleteShader(shader_vertex);
+	glDeleteShader(shader_fragment_surface);
+	glDeleteShader(shader_fragment_mesh);
+
+	// ------------------------------------------------------------
+	// point shader
+	// ------------------------------------------------------------
+
+	// one vertex per point, the position is relative to the cube of
+	// the node, see point_cloud.hpp
+	const char *shader_source_vertex_points = R"(
+		#version 330 core
+		layout (location = 0) in vec4 aPoint;
+		uniform mat4 view;
+		uniform mat4 projection;
+		uniform vec4 node;
+		uniform vec2 value_range;
+		uniform float point_size;
+		out float input_value;
+		void main() {
+			gl_Position = projection * view * vec4(node.xyz + aPoint.xyz * node.w, 1.0);
+			gl_PointSize = point_size;
+			input_value = mix(value_range.x, value_range.y, aPoint.w);
+		}
+	)";
+
+	const char *shader_source_fragment_points = R"(
+		#version 330 core
+		in float input_value;
+		uniform bool lighting;
+		uniform bool use_colormap;
+		uniform sampler1D colormap;
+		uniform vec2 height_range;
+		uniform vec3 color;
+		out vec4 FragColor;
+		void main() {
+			// round sprites, shaded like small spheres when lit
+			vec2 d = gl_PointCoord * 2.0 - 1.0;
+			float r2 = dot(d, d);
+			if (r2 > 1.0)
+				discard;
+			vec3 c = color;
+			if (use_colormap) {
+				float span = max(height_range.y - height_range.x, 1e-6);
+				c = texture(colormap, (input_value - height_range.x) / span).rgb;
+			}
+			if (lighting)
+				c *= 0.4 + 0.6 * sqrt(1.0 - r2);
+			FragColor = vec4(c, 1.0);
+		}
+	)";
+
+	GLuint shader_vertex_points = glCreateShader(GL_VERTEX_SHADER);
+	glShaderSource(shader_vertex_points, 1, &shader_source_vertex_points, NULL);
+	glCompileShader(shader_vertex_points);
+	GLuint shader_fragment_points = glCreateShader(GL_FRAGMENT_SHADER);
+	glShaderSource(shader_fragment_points, 1, &shader_source_fragment_points, NULL);
+	glCompileShader(shader_fragment_points);
+	shader_points = glCreateProgram();
+	glAttachShader(shader_points, shader_vertex_points);
+	glAttachShader(shader_points, shader_fragment_points);
+	glLinkProgram(shader_points);
+	glDeleteShader(shader_vertex_points);
+	glDeleteShader(shader_fragment_points);
+
+	// ------------------------------------------------------------
+	// contour shader
+	// ------------------------------------------------------------
+
+	// positions only, see contour.hpp. the lines lie on the drawn
+	// triangles and are pulled towards the camera by a little depth
+	// so the fill does not hide them.
+	const char *shader_source_vertex_lines = R"(
+		#version 330 core
+		layout (location = 0) in vec3 aPos;
+		uniform mat4 view;
+		uniform mat4 projection;
+		uniform float depth_offset;
+		out float input_height;
+		void main() {
+			gl_Position = projection * view * vec4(aPos, 1.0);
+			gl_Position.z -= depth_offset * gl_Position.w;
+			input_height = aPos.y;
+		}
+	)";
+
+	const char *shader_source_fragment_lines = R"(
+		#version 330 core
+		in float input_height;
+		uniform bool use_colormap;
+		uniform sampler1D colormap;
+		uniform vec2 height_range;
+		uniform vec3 color;
+		out vec4 FragColor;
+		void main() {
+			vec3 c = color;
+			if (use_colormap) {
+				float span = max(height_range.y - height_range.x, 1e-6);
+				c = texture(colormap, (input_height - height_range.x) / span).rgb;
+			}
+			FragColor = vec4(c, 1.0);
+		}
+	)";
+
+	GLuint shader_vertex_lines = glCreateShader(GL_VERTEX_SHADER);
+	glShaderSource(shader_vertex_lines, 1, &shader_source_vertex_lines, NULL);
+	glCompileShader(shader_vertex_lines);
+	GLuint shader_fragment_lines = glCreateShader(GL_FRAGMENT_SHADER);
+	glShaderSource(shader_fragment_lines, 1, &shader_source_fragment_lines, NULL);
+	glCompileShader(shader_fragment_lines);
+	shader_lines = glCreateProgram();
+	glAttachShader(shader_lines, shader_vertex_lines);
+	glAttachShader(shader_lines, shader_fragment_lines);
+	glLinkProgram(shader_lines);
+	glDeleteShader(shader_vertex_lines);
+	glDeleteShader(shader_fragment_lines);
+
+	// ------------------------------------------------------------
+	// overlay shader
+	// ------------------------------------------------------------
+
+	// a texture drawn over the plot in pixels, see draw_overlay. the
+	// corners of the quad come from the vertex id, there is no buffer.
+	const char *shader_source_vertex_overlay = R"(
+		#version 330 core
+		uniform vec4 rect;
+		out vec2 uv;
+		void main() {
+			uv = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+			gl_Position = vec4(mix(rect.xy, rect.zw, uv), 0.0, 1.0);
+		}
+	)";
+
+	const char *shader_source_fragment_overlay = R"(
+		#version 330 core
+		in vec2 uv;
+		uniform sampler2D overlay;
+		out vec4 FragColor;
+		void main() {
+			FragColor = texture(overlay, uv);
+		}
+	)";
+
+	GLuint shader_vertex_overlay = glCreateShader(GL_VERTEX_SHADER);
+	glShaderSource(shader_vertex_overlay, 1, &shader_source_vertex_overlay, NULL);
+	glCompileShader(shader_vertex_overlay);
+	GLuint shader_fragment_overlay = glCreateShader(GL_FRAGMENT_SHADER);
+	glShaderSource(shader_fragment_overlay, 1, &shader_source_fragment_overlay, NULL);
+	glCompileShader(shader_fragment_overlay);
+	shader_overlay = glCreateProgram();
+	glAttachShader(shader_overlay, shader_vertex_overlay);
+	glAttachShader(shader_overlay, shader_fragment_overlay);
+	glLinkProgram(shader_overlay);
+	glDeleteShader(shader_vertex_overlay);
+	glDeleteShader(shader_fragment_overlay);
+	glGenVertexArrays(1, &VAO_OVERLAY);
+	glGenTextures(1, &overlay_texture);
+
+	// ------------------------------------------------------------
+	// timer queries
+	// ------------------------------------------------------------
+
+	glGenQueries(2 * PASS_COUNT, &pass_queries[0][0]);
+
+	// ------------------------------------------------------------
+	// create axis
+	// ------------------------------------------------------------
+
+	// glGenVertexArrays返回一个顶点数组对象的名称，并存在了VAO_AXIS中
+	glGenVertexArrays(1, &VAO_AXIS);
+	// glGenBuffers函数会生成1个缓冲区对象标识符，并将这些标识符存储在VBO_AXIS中。
+	glGenBuffers(1, &VBO_AXIS);
+
+	// glBindVertexArray函数用于绑定指定名称的顶点数组对象（VAO）
+	glBindVertexArray(VAO_AXIS);
+	// glBindBuffer用于绑定一个已经命名的缓存区对象。GL_ARRAY_BUFFER代表顶点属性
+	glBindBuffer(GL_ARRAY_BUFFER, VBO_AXIS);
+	float s = 10.0f;
+	float axis[] = {
+		s, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,
+		-s, 0.0f, 0.0f, 0.2f, 0.0f, 0.0f,
+		0.0f, s, 0.0f, 0.0f, 0.0f, 1.0f,
+		0.0f, -s, 0.0f, 0.0f, 0.0f, 0.2f,
+		0.0f, 0.0f, s, 0.0f, 1.0f, 0.0f,
+		0.0f, 0.0f, -s, 0.0f, 0.2f, 0.0f
+	};
+	
+	// glBufferData是OpenGL中用于为缓冲区对象（Buffer Object）分配数据存储空间的函数
+	// GL_ARRAY_BUFFER表示当前绑定的缓冲区对象所关联的目标类型为顶点属性（位置、颜色、纹理坐标）
+	// 数组axis包含了用于指定要复制到缓冲区对象数据存储区的初始化数据
+	/* GL_STATIC_DRAW要分开看: STATIC表示数据会被修改一次，利用许多次；
+ 		DRAW表明数据内容被应用程序所修改，并且数据内容作为OpenGL绘图和图像规范命令的来源
+ 	*/
+	glBufferData(GL_ARRAY_BUFFER, sizeof(axis), axis, GL_STATIC_DRAW);
+
+	// 定义一个通用顶点属性数据的数组
+	/* 0表示需修改的通用顶点属性的索引
+ 	   3表示每个通用顶点属性的分量数目。
+     	   GL_FLOAT表示数组中每个分量的数据类型为单精度浮点型
+	   GL_FALSE表示当访问定点数据值时直接按原定点值转换
+           指定连续通用顶点属性之间的字节偏移量（步幅）为6 * sizeof(float)
+	*/
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
+	glEnableVertexAttribArray(1);
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindVertexArray(0);
+
+	// ------------------------------------------------------------
+	// states
+	// ------------------------------------------------------------
+
+	glLineWidth(2);
+	glPointSize(10);
+	glEnable(GL_PROGRAM_POINT_SIZE); // point layers set their own size
+	glEnable(GL_DEPTH_TEST);
+
+	// ------------------------------------------------------------
+	// colormaps
+	// ------------------------------------------------------------
+
+	// one 1d lookup texture per colormap, sampled by height in the
+	// surface fragment shader
+	glGenTextures(COLORMAP_COUNT, colormap_textures);
+	for (int i = COLORMAP_SOLID + 1; i < COLORMAP_COUNT; i++) {
+		std::vector<unsigned char> table = colormap_table(i, 256);
+		glBindTexture(GL_TEXTURE_1D, colormap_textures[i]);
+		glTexImage1D(GL_TEXTURE_1D, 0, GL_RGB8, 256, 0, GL_RGB, GL_UNSIGNED_BYTE, table.data());
+		glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	}
+	glBindTexture(GL_TEXTURE_1D, 0);
+
+	// the same tables as the rows of one texture, the pooled surfaces
+	// of a draw each pick theirs
+	std::vector<unsigned char> atlas(COLORMAP_COUNT * 256 * 3, 0);
+	for (int i = COLORMAP_SOLID + 1; i < COLORMAP_COUNT; i++) {
+		std::vector<unsigned char> table = colormap_table(i, 256);
+		std::copy(table.begin(), table.end(), atlas.begin() + i * 256 * 3);
+	}
+	glGenTextures(1, &colormap_atlas);
+	glBindTexture(GL_TEXTURE_2D, colormap_atlas);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, 256, COLORMAP_COUNT, 0, GL_RGB, GL_UNSIGNED_BYTE, atlas.data());
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	// ------------------------------------------------------------
+	// ebo
+	// ------------------------------------------------------------
+
+	// GLuint e;
+	glGenBuffers(1,&EBO);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+	heights.init();
+	ebo_update();
+}
+
+void SceneRenderer::destroy() {
+
+  // the surfaces release their own objects, see
+  // WindowSurfaceConfig::remove. those of the pool and the height
+  // arrays go here, with the context current.
+
+  pool.destroy();
+  heights.destroy();
+  for (GLuint shader : {shader_surface, shader_mesh, shader_points, shader_lines, shader_overlay,
+			shader_instanced, shader_instanced_mesh})
+    glDeleteProgram(shader);
+  glDeleteVertexArrays(1, &VAO_AXIS);
+  glDeleteBuffers(1, &VBO_AXIS);
+  glDeleteVertexArrays(1, &VAO_OVERLAY);
+  glDeleteTextures(1, &overlay_texture);
+  glDeleteQueries(2 * PASS_COUNT, &pass_queries[0][0]);
+  glDeleteTextures(COLORMAP_COUNT, colormap_textures);
+  glDeleteTextures(1, &colormap_atlas);
+  glDeleteBuffers(1, &EBO);
+  for (auto& level : ebo_levels)
+    glDeleteBuffers(1, &level.second.first);
+  ebo_levels.clear();
+  batches.clear();
+  batch_count = 0;
+}
+
+// ------------------------------------------------------------
+// draw passes
+// ------------------------------------------------------------
+
+void SceneRenderer::draw(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& camera_pos) {
+
+  trace_scope scope("draw");
+  stats = RenderStats();
+
+  read_pass_queries();
+  begin_pass(PASS_FILL);
+
+  glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+  glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
+
+  /* ----- model (not needed for now) ----- */
+
+  glm::mat4 model = glm::mat4(1.0f);
+  model = glm::translate(model, glm::vec3(0.0f, 0.0f, 0.0f));
+
+  // ------------------------------------------------------------
+  // draw surfaces
+  // ------------------------------------------------------------
+
+  glUseProgram(shader_surface);
+  glEnable(GL_DEPTH_TEST);
+
+  GLuint locView = glGetUniformLocation(shader_surface, "view");
+  glUniformMatrix4fv(locView, 1, GL_FALSE, glm::value_ptr(view));
+  GLuint locProjection = glGetUniformLocation(shader_surface, "projection");
+  glUniformMatrix4fv(locProjection, 1, GL_FALSE, glm::value_ptr(projection));
+  GLuint locModel = glGetUniformLocation(shader_surface, "model");
+  glUniformMatrix4fv(locModel, 1, GL_FALSE, glm::value_ptr(model));
+  glm::vec3 light_dir = glm::normalize(camera_pos);
+  glUniform1i(glGetUniformLocation(shader_surface, "lighting"), props.lighting);
+  glUniform3fv(glGetUniformLocation(shader_surface, "light_dir"), 1, glm::value_ptr(light_dir));
+  glUniform1i(glGetUniformLocation(shader_surface, "colormap"), 0);
+  GLint locUseColormap = glGetUniformLocation(shader_surface, "use_colormap");
+  GLint locHeightRange = glGetUniformLocation(shader_surface, "height_range");
+  GLint locPooled = glGetUniformLocation(shader_surface, "pooled");
+  glUniform1i(glGetUniformLocation(shader_surface, "colormaps"), 1);
+  glUniform1f(glGetUniformLocation(shader_surface, "colormap_rows"), (float)COLORMAP_COUNT);
+  glUniform1i(glGetUniformLocation(shader_surface, "pool_blocks"), 2);
+  glUniform1i(glGetUniformLocation(shader_surface, "pool_params"), 3);
+  glUniform1i(glGetUniformLocation(shader_surface, "block_vertices"), VertexPool::block_vertices);
+  glActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_2D, colormap_atlas);
+  glActiveTexture(GL_TEXTURE0);
+
+  // tiled surfaces and point layers pick and page their nodes for
+  // this camera first
+  GLint viewport[4];
+  glGetIntegerv(GL_VIEWPORT, viewport);
+  for (auto& pair : surfaces_data) {
+    if (!pair.second.show)
+      continue;
+    if (pair.second.tiles) {
+      pair.second.tiles->update(view, projection, camera_pos, viewport[3]);
+      stats.tiles += pair.second.tiles->selected();
+      stats.pending = stats.pending || pair.second.tiles->pending();
+    }
+    if (pair.second.points) {
+      pair.second.points->update(view, projection, camera_pos, viewport[3]);
+      stats.pending = stats.pending || pair.second.points->pending();
+    }
+  }
+
+  // the grid surfaces in a draw per chunk and index buffer, the tiles
+  // one by one. the contour map draws the contours alone.
+  collect_batches();
+  if (!props.contour_map) {
+    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+    glUniform1i(locPooled, true);
+    draw_batches(shader_surface);
+    glUniform1i(locPooled, false);
+
+    glUseProgram(shader_instanced);
+    glUniformMatrix4fv(glGetUniformLocation(shader_instanced, "view"), 1, GL_FALSE, glm::value_ptr(view));
+    glUniformMatrix4fv(glGetUniformLocation(shader_instanced, "projection"), 1, GL_FALSE,
+		       glm::value_ptr(projection));
+    glUniformMatrix4fv(glGetUniformLocation(shader_instanced, "model"), 1, GL_FALSE, glm::value_ptr(model));
+    glUniform1i(glGetUniformLocation(shader_instanced, "lighting"), props.lighting);
+    glUniform3fv(glGetUniformLocation(shader_instanced, "light_dir"), 1, glm::value_ptr(light_dir));
+    glUniform1i(glGetUniformLocation(shader_instanced, "pooled"), true);
+    glUniform1i(glGetUniformLocation(shader_instanced, "colormaps"), 1);
+    glUniform1f(glGetUniformLocation(shader_instanced, "colormap_rows"), (float)COLORMAP_COUNT);
+    glUniform1i(glGetUniformLocation(shader_instanced, "heights"), 4);
+    draw_instances(shader_instanced);
+    glUseProgram(shader_surface);
+  }
+  for (const auto& pair : surfaces_data) {
+    if (!pair.second.show || !pair.second.tiles || pair.second.points || props.contour_map)
+      continue;
+    // colormap and range are uniforms, changing them costs nothing
+    const SurfaceData& surface = pair.second;
+    bool use_colormap = surface.colormap != COLORMAP_SOLID;
+    glUniform1i(locUseColormap, use_colormap);
+    if (use_colormap) {
+      glBindTexture(GL_TEXTURE_1D, colormap_textures[surface.colormap]);
+      if (surface.range_auto)
+	glUniform2f(locHeightRange, surface.z_min, surface.z_max);
+      else
+	glUniform2f(locHeightRange, surface.range_min, surface.range_max);
+    }
+    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+    stats.triangles += surface.tiles->draw(stats.draw_calls);
+  }
+  end_pass(PASS_FILL);
+
+  // ------------------------------------------------------------
+  // draw meshes
+  // ------------------------------------------------------------
+
+  if (props.show_mesh && !props.contour_map) {
+    begin_pass(PASS_MESH);
+    glUseProgram(shader_mesh);
+    glEnable(GL_DEPTH_TEST);
+
+    locView = glGetUniformLocation(shader_mesh, "view");
+    glUniformMatrix4fv(locView, 1, GL_FALSE, glm::value_ptr(view));
+    locProjection = glGetUniformLocation(shader_mesh, "projection");
+    glUniformMatrix4fv(locProjection, 1, GL_FALSE, glm::value_ptr(projection));
+    locModel = glGetUniformLocation(shader_mesh, "model");
+    glUniformMatrix4fv(locModel, 1, GL_FALSE, glm::value_ptr(model));
+
+    glUniform1i(glGetUniformLocation(shader_mesh, "pooled"), false);
+
+    glLineWidth(2);
+    glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+    draw_batches(shader_mesh);
+    glUseProgram(shader_instanced_mesh);
+    glUniformMatrix4fv(glGetUniformLocation(shader_instanced_mesh, "view"), 1, GL_FALSE, glm::value_ptr(view));
+    glUniformMatrix4fv(glGetUniformLocation(shader_instanced_mesh, "projection"), 1, GL_FALSE,
+		       glm::value_ptr(projection));
+    glUniformMatrix4fv(glGetUniformLocation(shader_instanced_mesh, "model"), 1, GL_FALSE, glm::value_ptr(model));
+    glUniform1i(glGetUniformLocation(shader_instanced_mesh, "heights"), 4);
+    draw_instances(shader_instanced_mesh);
+    glUseProgram(shader_mesh);
+    for (const auto& pair : surfaces_data) {
+      if (!pair.second.show || !pair.second.tiles || pair.second.points)
+	continue;
+      pair.second.tiles->draw(stats.draw_calls);
+    }
+    end_pass(PASS_MESH);
+  }
+
+  // ------------------------------------------------------------
+  // draw contours
+  // ------------------------------------------------------------
+
+  // one strip draw per surface, the polylines are separated by the
+  // restart index. over the surfaces they are dark, on the map they
+  // take the color of the surface or of its colormap.
+
+  bool any_contours = false;
+  for (const auto& pair : surfaces_data) {
+    const SurfaceData& surface = pair.second;
+    if (!surface.show || surface.contour_size == 0)
+      continue;
+    if (!any_contours) {
+      any_contours = true;
+      begin_pass(PASS_CONTOURS);
+      glUseProgram(shader_lines);
+      glUniformMatrix4fv(glGetUniformLocation(shader_lines, "view"), 1, GL_FALSE, glm::value_ptr(view));
+      glUniformMatrix4fv(glGetUniformLocation(shader_lines, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+      glUniform1f(glGetUniformLocation(shader_lines, "depth_offset"), props.contour_map ? 0.0f : 1e-4f);
+      glUniform1i(glGetUniformLocation(shader_lines, "colormap"), 0);
+      if (props.contour_map)
+	glDisable(GL_DEPTH_TEST);
+      else
+	glEnable(GL_DEPTH_TEST);
+      glEnable(GL_PRIMITIVE_RESTART);
+      glPrimitiveRestartIndex(contour_restart);
+      glLineWidth(2);
+    }
+    bool use_colormap = props.contour_map && surface.colormap != COLORMAP_SOLID;
+    glUniform1i(glGetUniformLocation(shader_lines, "use_colormap"), use_colormap);
+    if (use_colormap) {
+      glBindTexture(GL_TEXTURE_1D, colormap_textures[surface.colormap]);
+      if (surface.range_auto)
+	glUniform2f(glGetUniformLocation(shader_lines, "height_range"), surface.z_min, surface.z_max);
+      else
+	glUniform2f(glGetUniformLocation(shader_lines, "height_range"), surface.range_min, surface.range_max);
+    }
+    if (props.contour_map)
+      glUniform3f(glGetUniformLocation(shader_lines, "color"), surface.rgb[0], surface.rgb[1], surface.rgb[2]);
+    else
+      glUniform3f(glGetUniformLocation(shader_lines, "color"), 0.05f, 0.05f, 0.05f);
+    glBindVertexArray(surface.contour_vao);
+    glDrawElements(GL_LINE_STRIP, surface.contour_size, GL_UNSIGNED_INT, 0);
+    stats.draw_calls++;
+  }
+  if (any_contours) {
+    glDisable(GL_PRIMITIVE_RESTART);
+    end_pass(PASS_CONTOURS);
+  }
+
+  // ------------------------------------------------------------
+  // draw point layers
+  // ------------------------------------------------------------
+
+  bool any_points = false;
+  for (const auto& pair : surfaces_data) {
+    if (!pair.second.show || !pair.second.points || props.contour_map)
+      continue;
+    const SurfaceData& surface = pair.second;
+    if (!any_points) {
+      any_points = true;
+      begin_pass(PASS_POINTS);
+      glUseProgram(shader_points);
+      glEnable(GL_DEPTH_TEST);
+      glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+      glUniformMatrix4fv(glGetUniformLocation(shader_points, "view"), 1, GL_FALSE, glm::value_ptr(view));
+      glUniformMatrix4fv(glGetUniformLocation(shader_points, "projection"), 1, GL_FALSE,
+			 glm::value_ptr(projection));
+      glUniform1i(glGetUniformLocation(shader_points, "lighting"), props.lighting);
+      glUniform1i(glGetUniformLocation(shader_points, "colormap"), 0);
+    }
+    const point_cloud& cloud = surface.points->data();
+    glUniform2f(glGetUniformLocation(shader_points, "value_range"), cloud.value_min, cloud.value_max);
+    glUniform1f(glGetUniformLocation(shader_points, "point_size"), surface.points->point_size);
+    glUniform3f(glGetUniformLocation(shader_points, "color"), surface.rgb[0], surface.rgb[1], surface.rgb[2]);
+    bool use_colormap = surface.colormap != COLORMAP_SOLID;
+    glUniform1i(glGetUniformLocation(shader_points, "use_colormap"), use_colormap);
+    if (use_colormap) {
+      glBindTexture(GL_TEXTURE_1D, colormap_textures[surface.colormap]);
+      if (surface.range_auto)
+	glUniform2f(glGetUniformLocation(shader_points, "height_range"), surface.z_min, surface.z_max);
+      else
+	glUniform2f(glGetUniformLocation(shader_points, "height_range"), surface.range_min, surface.range_max);
+    }
+    stats.points += surface.points->draw(glGetUniformLocation(shader_points, "node"), stats.draw_calls);
+  }
+  if (any_points)
+    end_pass(PASS_POINTS);
+
+  // ------------------------------------------------------------
+  // draw axes
+  // ------------------------------------------------------------
+
+  if (props.show_axes) {
+    begin_pass(PASS_AXES);
+    glUseProgram(shader_surface);
+    glUniform1i(glGetUniformLocation(shader_surface, "lighting"), false);
+    glUniform1i(locUseColormap, false);
+    glUniform1i(locPooled, false);
+    glDisable(GL_DEPTH_TEST);
+    glLineWidth(5);
+    glBindVertexArray(VAO_AXIS);
+    glDrawArrays(GL_LINES, 0, 6);
+    stats.draw_calls++;
+    end_pass(PASS_AXES);
+  }
+
+  frame_query = 1 - frame_query;
+  trace_counter("triangles", stats.triangles);
+  trace_counter("draw_calls", stats.draw_calls);
+
+  // ------------------------------------------------------------
+  // fence the regions read by this frame
+  // ------------------------------------------------------------
+
+  for (auto& pair : surfaces_data) {
+    if (!pair.second.show || pair.second.function.empty())
+      continue;
+    pair.second.vbo.fence();
+  }
+}
+
+// ------------------------------------------------------------
+// batches
+// ------------------------------------------------------------
+
+void SceneRenderer::collect_batches() {
+
+  // visible surfaces only: a hidden one is left out of the arrays. the
+  // colormap and range of every surface go to the params of its slot,
+  // or of its instance in a height array.
+
+  GLint vertex_size = floats_per_vertex * sizeof(float);
+  batch_count = 0;
+  for (HeightArrays::array& a : heights.arrays)
+    a.instance_data.clear();
+  for (auto& pair : surfaces_data) {
+    const SurfaceData& surface = pair.second;
+    if (!surface.show || surface.function.empty() || surface.points || surface.tiles || surface.ind_size == 0)
+      continue;
+    float colormap_row = surface.colormap == COLORMAP_SOLID ? -1.0f : (float)surface.colormap;
+    float range_min = surface.range_auto ? surface.z_min : surface.range_min;
+    float range_max = surface.range_auto ? surface.z_max : surface.range_max;
+
+    if (surface.heights.array >= 0) {
+      std::vector<float>& data = heights.arrays[surface.heights.array].instance_data;
+      data.insert(data.end(), surface.extent, surface.extent + 4);
+      data.insert(data.end(), {colormap_row, range_min, range_max, (float)surface.heights.layer});
+      data.insert(data.end(), surface.rgb.begin(), surface.rgb.begin() + 3);
+      continue;
+    }
+    if (surface.vbo.slice().chunk < 0)
+      continue;
+    const pool_slice& slice = surface.vbo.slice();
+    pool.set_params(slice, colormap_row, range_min, range_max);
+
+    size_t k = 0;
+    while (k < batch_count && (batches[k].chunk != slice.chunk || batches[k].ebo != surface.ebo))
+      k++;
+    if (k == batch_count) {
+      if (batch_count == batches.size())
+	batches.emplace_back();
+      draw_batch& batch = batches[batch_count++];
+      batch.chunk = slice.chunk;
+      batch.ebo = surface.ebo;
+      batch.counts.clear();
+      batch.offsets.clear();
+      batch.base_vertices.clear();
+    }
+    batches[k].counts.push_back(surface.ind_size);
+    batches[k].offsets.push_back(nullptr);
+    batches[k].base_vertices.push_back(surface.vbo.base_vertex(vertex_size));
+  }
+
+  for (HeightArrays::array& a : heights.arrays) {
+    if (a.instance_data.empty())
+      continue;
+    glBindBuffer(GL_ARRAY_BUFFER, a.instances);
+    glBufferData(GL_ARRAY_BUFFER, a.instance_data.size() * sizeof(float), a.instance_data.data(), GL_STREAM_DRAW);
+  }
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void SceneRenderer::draw_batches(GLuint shader) {
+  for (size_t k = 0; k < batch_count; k++) {
+    const draw_batch& batch = batches[k];
+    const VertexPool::chunk& c = pool.chunks[batch.chunk];
+    if (shader == shader_surface) {
+      pool.update_tables(batch.chunk);
+      glActiveTexture(GL_TEXTURE2);
+      glBindTexture(GL_TEXTURE_BUFFER, c.blocks_texture);
+      glActiveTexture(GL_TEXTURE3);
+      glBindTexture(GL_TEXTURE_BUFFER, c.params_texture);
+      glActiveTexture(GL_TEXTURE0);
+      for (GLsizei count : batch.counts)
+	stats.triangles += count / 3;
+    }
+    glBindVertexArray(c.vao);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, batch.ebo);
+    glMultiDrawElementsBaseVertex(GL_TRIANGLES, batch.counts.data(), GL_UNSIGNED_INT, batch.offsets.data(),
+				  (GLsizei)batch.counts.size(), const_cast<GLint*>(batch.base_vertices.data()));
+    stats.draw_calls++;
+  }
+  glBindVertexArray(0);
+}
+
+void SceneRenderer::draw_instances(GLuint shader) {
+
+  // every surface of a height array in one draw, over the index
+  // buffer of its resolution
+
+  GLint locRows = glGetUniformLocation(shader, "rows");
+  GLint locColumns = glGetUniformLocation(shader, "columns");
+  glActiveTexture(GL_TEXTURE4);
+  for (HeightArrays::array& a : heights.arrays) {
+    if (a.instance_data.empty())
+      continue;
+    GLsizei instances = a.instance_data.size() / HeightArrays::instance_floats;
+    unsigned int count;
+    GLuint ebo = grid_ebo(a.rows, a.columns, count);
+    glUniform1i(locRows, a.rows);
+    glUniform1i(locColumns, a.columns);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, a.texture);
+    glBindVertexArray(a.vao);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+    glDrawElementsInstanced(GL_TRIANGLES, count, GL_UNSIGNED_INT, 0, instances);
+    stats.draw_calls++;
+    if (shader == shader_instanced)
+      stats.triangles += (unsigned long long)count / 3 * instances;
+  }
+  glBindVertexArray(0);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+  glActiveTexture(GL_TEXTURE0);
+}
+
+// ------------------------------------------------------------
+// pass timers
+// ------------------------------------------------------------
+
+// the gpu time of every pass is read two frames after it was drawn,
+// when its query is done and reading it does not wait for the gpu. a
+// query still running keeps the time read before. the time elapsed
+// queries do not nest, so each pass has its own and the frame is
+// their sum.
+
+static const char* const pass_counters[PASS_COUNT] = {
+  "gpu fill ms", "gpu mesh ms", "gpu contours ms", "gpu points ms", "gpu axes ms"
+};
+
+void SceneRenderer::read_pass_queries() {
+  for (int pass = 0; pass < PASS_COUNT; pass++) {
+    if (!pass_issued[frame_query][pass]) {
+      pass_gpu_ms[pass] = 0.0;
+      continue;
+    }
+    pass_issued[frame_query][pass] = false;
+    GLuint query = pass_queries[frame_query][pass];
+    GLuint available = 0;
+    glGetQueryObjectuiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
+      continue;
+    GLuint64 elapsed = 0;
+    glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+    pass_gpu_ms[pass] = elapsed / 1e6;
+  }
+  for (int pass = 0; pass < PASS_COUNT; pass++) {
+    stats.pass_gpu_ms[pass] = pass_gpu_ms[pass];
+    stats.gpu_ms += pass_gpu_ms[pass];
+    trace_counter(pass_counters[pass], pass_gpu_ms[pass]);
+  }
+  trace_counter("gpu ms", stats.gpu_ms);
+}
+
+void SceneRenderer::begin_pass(int pass) {
+  glBeginQuery(GL_TIME_ELAPSED, pass_queries[frame_query][pass]);
+}
+
+void SceneRenderer::end_pass(int pass) {
+  glEndQuery(GL_TIME_ELAPSED);
+  pass_issued[frame_query][pass] = true;
+}
+
+// ------------------------------------------------------------
+// overlay
+// ------------------------------------------------------------
+
+void SceneRenderer::set_overlay(const unsigned char* rgba, int width, int height) {
+  glBindTexture(GL_TEXTURE_2D, overlay_texture);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, rgba);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  overlay_width = width;
+  overlay_height = height;
+}
+
+void SceneRenderer::draw_overlay(int x, int y) {
+
+  // the first row of the texture at the top, pixel for pixel, `x` and
+  // `y` from the top left corner of the viewport
+
+  if (overlay_width == 0)
+    return;
+  GLint viewport[4];
+  glGetIntegerv(GL_VIEWPORT, viewport);
+  float left = -1.0f + 2.0f * x / viewport[2];
+  float top = 1.0f - 2.0f * y / viewport[3];
+  glUseProgram(shader_overlay);
+  glUniform4f(glGetUniformLocation(shader_overlay, "rect"), left, top,
+	      left + 2.0f * overlay_width / viewport[2], top - 2.0f * overlay_height / viewport[3]);
+  glUniform1i(glGetUniformLocation(shader_overlay, "overlay"), 0);
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, overlay_texture);
+  glDisable(GL_DEPTH_TEST);
+  glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  glBindVertexArray(VAO_OVERLAY);
+  glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+  glBindVertexArray(0);
+  glDisable(GL_BLEND);
+  glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+// ------------------------------------------------------------
+// index buffers
+// ------------------------------------------------------------
+
+void SceneRenderer::ebo_update() {
+
+  // rebuilds the full resolution ebo and points every surface to the
+  // ebo that matches its own resolution.
+
+  std::vector<unsigned int> ind = grid_indices(props.divisions + 1);
+
+  this->ind_size = ind.size();
+
+  glBindVertexArray(0);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, ind.size() * sizeof(unsigned int), ind.data(), GL_STATIC_DRAW);
+
+  for (auto& pair : surfaces_data) {
+    if (pair.second.implicit || pair.second.compacted)
+      continue;
+    pair.second.ebo = grid_ebo(pair.second.rows, pair.second.columns, pair.second.ind_size);
+    glBindVertexArray(pair.second.vao);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, pair.second.ebo);
+  }
+  glBindVertexArray(0);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+GLuint SceneRenderer::grid_ebo(int rows, int columns, unsigned int& count) {
+
+  // lower resolutions used by animated surfaces are kept around, the
+  // scheduler only ever picks a handful of levels. so are the shapes
+  // of the rectangular domains, see domain.hpp.
+
+  int num_vertices_per_axis = props.divisions + 1;
+  if (rows == num_vertices_per_axis && columns == num_vertices_per_axis) {
+    count = ind_size;
+    return EBO;
+  }
+
+  auto it = ebo_levels.find(std::make_pair(rows, columns));
+  if (it == ebo_levels.end()) {
+    std::vector<unsigned int> ind = grid_indices(rows, columns);
+    GLuint ebo;
+    glGenBuffers(1, &ebo);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, ind.size() * sizeof(unsigned int), ind.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    it = ebo_levels.emplace(std::make_pair(rows, columns), std::make_pair(ebo, (unsigned int)ind.size())).first;
+  }
+  count = it->second.second;
+  return it->second.first;
+}
+
+// ------------------------------------------------------------
+// vertex buffers
+// ------------------------------------------------------------
+
+void SceneRenderer::create_vertex_buffer(SurfaceData& surface, size_t size) {
+
+  // the stream buffer takes a new slice of the pool, possibly in
+  // another chunk. the draws go through the vao of the chunk, the one
+  // of the surface is kept pointing to the same buffer for the code
+  // that binds it. `size` is in bytes and defaults to the vertices of
+  // the surface. a surface in a height array takes a slice again only
+  // once it leaves the array, see upload_vertices.
+  if (surface.heights.array >= 0) {
+    surface.vbo.destroy();
+    return;
+  }
+  surface.vbo.create(pool, size ? size : surface.vertices.size() * sizeof(float));
+
+  glBindVertexArray(surface.vao);
+  glBindBuffer(GL_ARRAY_BUFFER, surface.vbo.buffer());
+
+  // set location and data format
+  GLsizei stride = floats_per_vertex * sizeof(float);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)(3 * sizeof(float)));
+  glEnableVertexAttribArray(1);
+  glVertexAttribPointer(2, 2, GL_SHORT, GL_TRUE, stride, (void*)(6 * sizeof(float)));
+  glEnableVertexAttribArray(2);
+
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void SceneRenderer::upload_indices(SurfaceData& surface, size_t size) {
+
+  // the mesh of an implicit surface changes its size with every
+  // evaluation. the vertex buffer grows by half again whenever it is
+  // too small, in whole vertices so the base vertex stays exact, and
+  // the triangles go to an ebo of the surface itself. so do the
+  // triangles a compacted grid keeps, its vertices always fit.
+
+  if (size > surface.vbo.capacity() || surface.vbo.slice().chunk < 0) {
+    size_t vertex_size = floats_per_vertex * sizeof(float);
+    create_vertex_buffer(surface, (size + size / 2 + vertex_size - 1) / vertex_size * vertex_size);
+  }
+
+  if (!surface.mesh_ebo)
+    glGenBuffers(1, &surface.mesh_ebo);
+  surface.ebo = surface.mesh_ebo;
+  surface.ind_size = surface.indices.size();
+  glBindVertexArray(surface.vao);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, surface.ebo);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, surface.indices.size() * sizeof(unsigned int),
+	       surface.indices.data(), GL_STREAM_DRAW);
+  glBindVertexArray(0);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+void SceneRenderer::upload_contours(SurfaceData& surface) {
+
+  // the contours change size with every evaluation and are drawn from
+  // a plain buffer pair of their own, replaced as a whole
+
+  if (!surface.contour_vao) {
+    glGenVertexArrays(1, &surface.contour_vao);
+    glGenBuffers(1, &surface.contour_vbo);
+    glGenBuffers(1, &surface.contour_ebo);
+    glBindVertexArray(surface.contour_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, surface.contour_vbo);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, surface.contour_ebo);
+  }
+
+  const contour_lines& lines = surface.contours;
+  glBindVertexArray(surface.contour_vao);
+  glBindBuffer(GL_ARRAY_BUFFER, surface.contour_vbo);
+  glBufferData(GL_ARRAY_BUFFER, lines.positions.size() * sizeof(float), lines.positions.data(), GL_STREAM_DRAW);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, lines.indices.size() * sizeof(unsigned int), lines.indices.data(),
+	       GL_STREAM_DRAW);
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  surface.contour_size = lines.indices.size();
+  surface.contours_changed = false;
+}
+
+size_t SceneRenderer::upload_vertices(SurfaceData& surface) {
+
+  // write into the next region of the ring instead of replacing the
+  // data the gpu may still be reading. with a persistent mapping
+  // this is a plain copy into gpu visible memory.
+
+  trace_scope scope("upload");
+  // vertices of a scene cache go straight from the mapped pages
+  const float* vertices = surface.mapped_vertices ? surface.mapped_vertices : surface.vertices.data();
+  size_t count = surface.mapped_vertices ? surface.mapped_count : surface.vertices.size();
+  size_t size = count * sizeof(float);
+  if (surface.contours_changed)
+    upload_contours(surface);
+
+  // a height field on the grid is kept as the heights and normals of
+  // a layer of the array of its resolution
+  if (!surface.implicit && !surface.compacted && !surface.tiles && !surface.points &&
+      (surface.source == SOURCE_DATA || !surface.prog.parametric()) &&
+      count == (size_t)surface.rows * surface.columns * floats_per_vertex &&
+      heights.fits(surface.rows, surface.columns)) {
+    height_layer& layer = surface.heights;
+    if (layer.array >= 0 && (heights.arrays[layer.array].rows != surface.rows ||
+			     heights.arrays[layer.array].columns != surface.columns)) {
+      heights.release(layer);
+      layer = height_layer();
+    }
+    if (layer.array < 0)
+      layer = heights.allocate(surface.rows, surface.columns);
+    if (surface.vbo.slice().chunk >= 0)
+      surface.vbo.destroy();
+    surface.extent[0] = vertices[0];
+    surface.extent[1] = vertices[(size_t)(surface.rows - 1) * surface.columns * floats_per_vertex];
+    surface.extent[2] = vertices[2];
+    surface.extent[3] = vertices[(size_t)(surface.columns - 1) * floats_per_vertex + 2];
+    return heights.upload(layer, vertices);
+  }
+
+  // any other surface streams its vertices through the pool
+  if (surface.heights.array >= 0) {
+    heights.release(surface.heights);
+    surface.heights = height_layer();
+  }
+  if (surface.implicit || surface.compacted)
+    upload_indices(surface, size);
+  else if (surface.vbo.slice().chunk < 0)
+    create_vertex_buffer(surface, size);
+  void* region = surface.vbo.map_region();
+  if (!region) return 0;
+  std::memcpy(region, vertices, size);
+  surface.vbo.unmap_region();
+  return size;
+}
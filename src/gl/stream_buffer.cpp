@@ -0,0 +1,115 @@
+#include <stream_buffer.hpp>
+
+// ------------------------------------------------------------
+// allocation
+// ------------------------------------------------------------
+
+void StreamBuffer::create(VertexPool& pool, size_t region_size) {
+
+  // a new slice on every resize, the vertex array of the chunk needs
+  // no new attribute pointers
+
+  destroy();
+
+  this->pool = &pool;
+  this->region_size = region_size;
+  region_current = 0;
+  region_writing = -1;
+  pooled = pool.allocate(region_size * regions);
+}
+
+void StreamBuffer::destroy() {
+  for (int i = 0; i < regions; i++) {
+    if (fences[i]) {
+      glDeleteSync(fences[i]);
+      fences[i] = 0;
+    }
+  }
+  if (pool)
+    pool->release(pooled);
+  pooled = pool_slice();
+  region_writing = -1;
+}
+
+GLuint StreamBuffer::buffer() const {
+  return pooled.chunk < 0 ? 0 : pool->chunks[pooled.chunk].buffer;
+}
+
+bool StreamBuffer::is_persistent() const {
+  return pooled.chunk >= 0 && pool->chunks[pooled.chunk].persistent;
+}
+
+// ------------------------------------------------------------
+// writing
+// ------------------------------------------------------------
+
+void* StreamBuffer::map_region() {
+
+  // returns a pointer to the next region. the pointer may be filled
+  // from any thread, but unmap_region() must be called from the
+  // thread that owns the context.
+
+  if (pooled.chunk < 0 || region_writing != -1)
+    return nullptr;
+
+  int region_next = (region_current + 1) % regions;
+  wait(region_next);
+  const VertexPool::chunk& c = pool->chunks[pooled.chunk];
+  size_t offset = pooled.offset + region_next * region_size;
+
+  if (c.persistent) {
+    region_writing = region_next;
+    return static_cast<char*>(c.mapped) + offset;
+  }
+
+  // the fence has passed, nothing reads the region anymore
+  glBindBuffer(GL_ARRAY_BUFFER, c.buffer);
+  void* ptr = glMapBufferRange(GL_ARRAY_BUFFER, offset, region_size,
+			       GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  if (ptr)
+    region_writing = region_next;
+  return ptr;
+}
+
+void StreamBuffer::unmap_region() {
+  if (region_writing == -1)
+    return;
+  if (!is_persistent()) {
+    glBindBuffer(GL_ARRAY_BUFFER, buffer());
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+  }
+  region_current = region_writing;
+  region_writing = -1;
+}
+
+// ------------------------------------------------------------
+// synchronization
+// ------------------------------------------------------------
+
+void StreamBuffer::fence() {
+
+  // called after the draws that read the current region
+  if (pooled.chunk < 0)
+    return;
+  if (fences[region_current])
+    glDeleteSync(fences[region_current]);
+  fences[region_current] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void StreamBuffer::wait(int region) {
+  if (!fences[region])
+    return;
+  GLenum status;
+  do {
+    status = glClientWaitSync(fences[region], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+  } while (status == GL_TIMEOUT_EXPIRED);
+  glDeleteSync(fences[region]);
+  fences[region] = 0;
+}
+
+GLint StreamBuffer::base_vertex(size_t vertex_size) const {
+  return static_cast<GLint>((pooled.offset + region_current * region_size) / vertex_size);
+}
@@ -0,0 +1,239 @@
+#include <tiled_surface.hpp>
+#include <mesh.hpp>
+#include <algorithm>
+#include <cmath>
+#include <unordered_set>
+
+TiledSurface::TiledSurface(std::shared_ptr<const tile_pyramid> pyramid)
+  : pyramid(pyramid) { }
+
+// ------------------------------------------------------------
+// gl objects
+// ------------------------------------------------------------
+
+void TiledSurface::create(float size, const float rgb[3]) {
+
+  // also called to change the size or the color, the resident tiles
+  // were built with the old ones
+
+  destroy();
+  this->size = size;
+  loader = std::make_unique<tile_loader>(pyramid, size, rgb);
+
+  int n = pyramid->tile_size + 1;
+  vertices_per_tile = n * n;
+  size_t slot_bytes = (size_t)vertices_per_tile * floats_per_vertex * sizeof(float);
+  int count = std::max<size_t>(1, budget / slot_bytes);
+  slots.assign(count, slot());
+  lru.clear();
+  for (int i = 0; i < count; i++)
+    slots[i].position = lru.insert(lru.end(), i);
+
+  std::vector<unsigned int> indices = grid_indices(n);
+  index_count = indices.size();
+
+  glGenVertexArrays(1, &vao);
+  glGenBuffers(1, &vbo);
+  glGenBuffers(1, &ebo);
+  glBindVertexArray(vao);
+  glBindBuffer(GL_ARRAY_BUFFER, vbo);
+  glBufferData(GL_ARRAY_BUFFER, slot_bytes * count, NULL, GL_DYNAMIC_DRAW);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+
+  // same layout as SceneRenderer::create_vertex_buffer
+  GLsizei stride = floats_per_vertex * sizeof(float);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)(3 * sizeof(float)));
+  glEnableVertexAttribArray(1);
+  glVertexAttribPointer(2, 2, GL_SHORT, GL_TRUE, stride, (void*)(6 * sizeof(float)));
+  glEnableVertexAttribArray(2);
+
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void TiledSurface::destroy() {
+  // the loader thread stops before the slots go away
+  loader.reset();
+  if (vao) glDeleteVertexArrays(1, &vao);
+  if (vbo) glDeleteBuffers(1, &vbo);
+  if (ebo) glDeleteBuffers(1, &ebo);
+  vao = vbo = ebo = 0;
+  slots.clear();
+  lru.clear();
+  keys.clear();
+  selection.clear();
+  wanted.clear();
+  uploads = 0;
+}
+
+bool TiledSurface::pending() const {
+  // the tiles uploaded by the last update are drawn by the next one
+  return uploads > 0 || (loader && !loader->idle());
+}
+
+// ------------------------------------------------------------
+// residency
+// ------------------------------------------------------------
+
+int TiledSurface::find(const tile_id& id) const {
+  auto it = keys.find(id.key());
+  return it == keys.end() ? -1 : it->second;
+}
+
+void TiledSurface::touch(int index) {
+  slots[index].frame = frame;
+  lru.splice(lru.begin(), lru, slots[index].position);
+}
+
+void TiledSurface::upload(const loaded_tile& tile) {
+  if (find(tile.id) >= 0)
+    return;
+
+  // the least recently used slot, unless this frame walked through it
+  int index = lru.back();
+  slot& s = slots[index];
+  if (s.used && s.frame == frame)
+    return;
+  if (s.used)
+    keys.erase(s.id.key());
+
+  s.id = tile.id;
+  s.used = true;
+  keys[tile.id.key()] = index;
+  touch(index);
+
+  size_t slot_bytes = (size_t)vertices_per_tile * floats_per_vertex * sizeof(float);
+  glBindBuffer(GL_ARRAY_BUFFER, vbo);
+  glBufferSubData(GL_ARRAY_BUFFER, slot_bytes * index, slot_bytes, tile.vertices.data());
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// ------------------------------------------------------------
+// selection
+// ------------------------------------------------------------
+
+bool TiledSurface::visible(const float box_min[3], const float box_max[3]) const {
+  if (box_min[1] > box_max[1])
+    return false; // nothing finite in the tile
+  return view_frustum.intersects(box_min, box_max);
+}
+
+float TiledSurface::screen_error(const tile_id& id, const float box_min[3], const float box_max[3]) const {
+  float error = pyramid->info(id).error;
+  if (id.level == 0 || error <= 0.0f)
+    return 0.0f;
+  if (orthographic)
+    return error * pixels_per_unit;
+  // distance to the closest point of the box
+  glm::vec3 closest(std::clamp(camera.x, box_min[0], box_max[0]),
+		    std::clamp(camera.y, box_min[1], box_max[1]),
+		    std::clamp(camera.z, box_min[2], box_max[2]));
+  float distance = glm::length(camera - closest);
+  if (distance < 1e-6f)
+    return INFINITY;
+  return error * pixels_per_unit / distance;
+}
+
+void TiledSurface::walk(const tile_id& id) {
+  float box_min[3], box_max[3];
+  pyramid->bounds(id, size, box_min, box_max);
+  if (!visible(box_min, box_max))
+    return;
+
+  int index = find(id);
+  if (index >= 0)
+    touch(index);
+  float error = screen_error(id, box_min, box_max);
+
+  if (error > max_pixel_error) {
+    // split only once every visible child can be drawn
+    tile_id children[4];
+    int count = 0;
+    bool ready = true;
+    for (int r = 0; r < 2; r++)
+      for (int c = 0; c < 2; c++) {
+	tile_id child{id.level - 1, 2 * id.row + r, 2 * id.col + c};
+	if (!pyramid->exists(child))
+	  continue;
+	children[count++] = child;
+	float child_min[3], child_max[3];
+	pyramid->bounds(child, size, child_min, child_max);
+	if (visible(child_min, child_max) && find(child) < 0) {
+	  ready = false;
+	  wanted.push_back({child, error});
+	}
+      }
+    if (ready || index < 0) {
+      for (int i = 0; i < count; i++)
+	walk(children[i]);
+      if (index < 0)
+	wanted.push_back({id, error});
+      return;
+    }
+  }
+
+  if (index >= 0)
+    selection.push_back(index);
+  else
+    wanted.push_back({id, error});
+}
+
+void TiledSurface::update(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& camera_pos,
+			  int viewport_height) {
+  if (!loader)
+    return;
+  frame++;
+
+  view_frustum.set(projection * view);
+
+  // an error of one unit covers this many pixels at distance one
+  orthographic = projection[3][3] == 1.0f;
+  pixels_per_unit = 0.5f * viewport_height * projection[1][1];
+  camera = camera_pos;
+
+  selection.clear();
+  wanted.clear();
+  walk({pyramid->top(), 0, 0});
+
+  // finished tiles are drawn from the next frame on
+  loaded_tile tile;
+  uploads = 0;
+  while (uploads < uploads_per_frame && loader->pop(tile)) {
+    upload(tile);
+    uploads++;
+  }
+
+  // coarse tiles first, they stand in for everything below them. no
+  // more than the slots this frame does not need.
+  std::sort(wanted.begin(), wanted.end(), [](const wanted_tile& a, const wanted_tile& b) {
+    if (a.id.level != b.id.level)
+      return a.id.level > b.id.level;
+    return a.error > b.error;
+  });
+  size_t free_slots = 0;
+  for (auto it = lru.rbegin(); it != lru.rend() && slots[*it].frame != frame; ++it)
+    free_slots++;
+  std::vector<tile_id> requests;
+  std::unordered_set<uint64_t> requested;
+  for (size_t i = 0; i < wanted.size() && requests.size() < free_slots; i++)
+    if (requested.insert(wanted[i].id.key()).second)
+      requests.push_back(wanted[i].id);
+  loader->request(requests);
+}
+
+// ------------------------------------------------------------
+// draw
+// ------------------------------------------------------------
+
+unsigned long long TiledSurface::draw(int& draw_calls) const {
+  if (!vao || selection.empty())
+    return 0;
+  glBindVertexArray(vao);
+  for (int index : selection)
+    glDrawElementsBaseVertex(GL_TRIANGLES, index_count, GL_UNSIGNED_INT, 0, index * vertices_per_tile);
+  draw_calls += selection.size();
+  return (unsigned long long)selection.size() * (index_count / 3);
+}
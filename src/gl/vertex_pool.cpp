@@ -0,0 +1,217 @@
+#include <vertex_pool.hpp>
+#include <algorithm>
+
+// ------------------------------------------------------------
+// chunks
+// ------------------------------------------------------------
+
+int VertexPool::create_chunk(size_t size) {
+
+  // twice the last chunk up to chunk_max, or as large as the slice
+  // that does not fit into one
+
+  size_t last = chunks.empty() ? chunk_min / 2 : chunks.back().capacity;
+  size_t capacity = std::max(std::min(last * 2, chunk_max), size);
+  capacity = (capacity + block_size - 1) / block_size * block_size;
+
+  chunk c;
+  c.capacity = capacity;
+  c.persistent = GLAD_GL_ARB_buffer_storage != 0;
+  glGenBuffers(1, &c.buffer);
+  glBindBuffer(GL_ARRAY_BUFFER, c.buffer);
+  if (c.persistent) {
+    // write only: the surfaces keep their vertices in memory of their
+    // own for the indices, the contours and the scene cache, reading
+    // gpu visible memory back is slow on a discrete card
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glBufferStorage(GL_ARRAY_BUFFER, capacity, NULL, flags);
+    c.mapped = glMapBufferRange(GL_ARRAY_BUFFER, 0, capacity, flags);
+    // mapped range by range if the driver refuses the mapping
+    if (!c.mapped) {
+      c.persistent = false;
+      glDeleteBuffers(1, &c.buffer);
+      glGenBuffers(1, &c.buffer);
+      glBindBuffer(GL_ARRAY_BUFFER, c.buffer);
+    }
+  }
+  if (!c.persistent)
+    glBufferData(GL_ARRAY_BUFFER, capacity, NULL, GL_DYNAMIC_DRAW);
+
+  // same layout as SceneRenderer::create_vertex_buffer
+  glGenVertexArrays(1, &c.vao);
+  glBindVertexArray(c.vao);
+  GLsizei stride = vertex_size;
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)(3 * sizeof(float)));
+  glEnableVertexAttribArray(1);
+  glVertexAttribPointer(2, 2, GL_SHORT, GL_TRUE, stride, (void*)(6 * sizeof(float)));
+  glEnableVertexAttribArray(2);
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  c.free.push_back(std::make_pair((size_t)0, capacity));
+  c.blocks.assign(capacity / block_size, -1);
+  c.blocks_changed = true;
+  c.params_changed = true;
+  glGenBuffers(1, &c.blocks_buffer);
+  glGenTextures(1, &c.blocks_texture);
+  glGenBuffers(1, &c.params_buffer);
+  glGenTextures(1, &c.params_texture);
+  chunks.push_back(c);
+  return (int)chunks.size() - 1;
+}
+
+// ------------------------------------------------------------
+// slices
+// ------------------------------------------------------------
+
+bool VertexPool::fit(int index, size_t size, pool_slice& slice) {
+
+  // first fit, from the front of the free range
+
+  chunk& c = chunks[index];
+  auto it = std::find_if(c.free.begin(), c.free.end(), [&](const std::pair<size_t, size_t>& range) {
+    return range.second >= size;
+  });
+  if (it == c.free.end())
+    return false;
+
+  slice.chunk = index;
+  slice.offset = it->first;
+  slice.size = size;
+  it->first += size;
+  it->second -= size;
+  if (it->second == 0)
+    c.free.erase(it);
+
+  auto unused = std::find(c.slots_used.begin(), c.slots_used.end(), 0);
+  slice.slot = unused - c.slots_used.begin();
+  if (unused == c.slots_used.end()) {
+    c.slots_used.push_back(1);
+    c.params.resize(c.slots_used.size() * 4, 0.0f);
+  } else
+    *unused = 1;
+  c.params[slice.slot * 4] = -1.0f;
+  c.params_changed = true;
+
+  std::fill_n(c.blocks.begin() + slice.offset / block_size, slice.size / block_size, slice.slot);
+  c.blocks_changed = true;
+  return true;
+}
+
+pool_slice VertexPool::allocate(size_t size) {
+  reclaim();
+  size = std::max((size + block_size - 1) / block_size, (size_t)1) * block_size;
+  pool_slice slice;
+  for (int index = 0; index < (int)chunks.size(); index++)
+    if (fit(index, size, slice))
+      return slice;
+  fit(create_chunk(size), size, slice);
+  return slice;
+}
+
+void VertexPool::release(const pool_slice& slice) {
+  // the frames already submitted may still read the slice
+  if (slice.chunk < 0)
+    return;
+  retired.push_back({slice, glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0)});
+}
+
+void VertexPool::reclaim() {
+  auto done = [&](retired_slice& r) {
+    GLenum status = glClientWaitSync(r.fence, 0, 0);
+    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+      return false;
+    glDeleteSync(r.fence);
+    free_slice(r.slice);
+    return true;
+  };
+  retired.erase(std::remove_if(retired.begin(), retired.end(), done), retired.end());
+}
+
+void VertexPool::free_slice(const pool_slice& slice) {
+
+  // back into the sorted free list, merged with the ranges next to it
+
+  chunk& c = chunks[slice.chunk];
+  c.slots_used[slice.slot] = 0;
+  std::fill_n(c.blocks.begin() + slice.offset / block_size, slice.size / block_size, -1);
+  c.blocks_changed = true;
+
+  auto it = std::lower_bound(c.free.begin(), c.free.end(), std::make_pair(slice.offset, (size_t)0));
+  it = c.free.insert(it, std::make_pair(slice.offset, slice.size));
+  auto next = it + 1;
+  if (next != c.free.end() && it->first + it->second == next->first) {
+    it->second += next->second;
+    c.free.erase(next);
+  }
+  if (it != c.free.begin()) {
+    auto previous = it - 1;
+    if (previous->first + previous->second == it->first) {
+      previous->second += it->second;
+      c.free.erase(it);
+    }
+  }
+}
+
+// ------------------------------------------------------------
+// tables
+// ------------------------------------------------------------
+
+void VertexPool::set_params(const pool_slice& slice, float colormap_row, float range_min, float range_max) {
+  if (slice.chunk < 0)
+    return;
+  chunk& c = chunks[slice.chunk];
+  float* p = &c.params[slice.slot * 4];
+  if (p[0] == colormap_row && p[1] == range_min && p[2] == range_max)
+    return;
+  p[0] = colormap_row;
+  p[1] = range_min;
+  p[2] = range_max;
+  c.params_changed = true;
+}
+
+void VertexPool::update_tables(int index) {
+
+  // replaced as a whole, they are small: an int per block and a vec4
+  // per surface
+
+  chunk& c = chunks[index];
+  if (c.blocks_changed) {
+    glBindBuffer(GL_TEXTURE_BUFFER, c.blocks_buffer);
+    glBufferData(GL_TEXTURE_BUFFER, c.blocks.size() * sizeof(int), c.blocks.data(), GL_DYNAMIC_DRAW);
+    glBindTexture(GL_TEXTURE_BUFFER, c.blocks_texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_R32I, c.blocks_buffer);
+    c.blocks_changed = false;
+  }
+  if (c.params_changed && !c.params.empty()) {
+    glBindBuffer(GL_TEXTURE_BUFFER, c.params_buffer);
+    glBufferData(GL_TEXTURE_BUFFER, c.params.size() * sizeof(float), c.params.data(), GL_DYNAMIC_DRAW);
+    glBindTexture(GL_TEXTURE_BUFFER, c.params_texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, c.params_buffer);
+    c.params_changed = false;
+  }
+  glBindBuffer(GL_TEXTURE_BUFFER, 0);
+  glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+void VertexPool::destroy() {
+  for (retired_slice& r : retired)
+    glDeleteSync(r.fence);
+  retired.clear();
+  for (chunk& c : chunks) {
+    if (c.mapped) {
+      glBindBuffer(GL_ARRAY_BUFFER, c.buffer);
+      glUnmapBuffer(GL_ARRAY_BUFFER);
+      glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+    glDeleteBuffers(1, &c.buffer);
+    glDeleteVertexArrays(1, &c.vao);
+    glDeleteBuffers(1, &c.blocks_buffer);
+    glDeleteTextures(1, &c.blocks_texture);
+    glDeleteBuffers(1, &c.params_buffer);
+    glDeleteTextures(1, &c.params_texture);
+  }
+  chunks.clear();
+}
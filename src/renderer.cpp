@@ -4,10 +4,21 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <parser.hpp>
+#include <trace.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <vector>
 #include <wx/event.h>
+#include <wx/display.h>
+#include <wx/dcmemory.h>
 #include <window_surface_config.hpp>
 
+static double now_ms() {
+  using clock = std::chrono::steady_clock;
+  return std::chrono::duration<double, std::milli>(clock::now().time_since_epoch()).count();
+}
+
 // 构造函数
 /* 这里所用的wxGLCanvas类的构造函数应该是:
 	wxGLCanvas::wxGLCanvas(	
@@ -25,7 +36,8 @@
 CanvasGL::CanvasGL(wxPanel* parent, int* args, Properties& properties, std::map<unsigned int, SurfaceData>& surfaces_data)
   : wxGLCanvas(parent, wxID_ANY, args, wxDefaultPosition, wxDefaultSize, wxFULL_REPAINT_ON_RESIZE),
     props(properties),
-    surfaces_data(surfaces_data)
+    surfaces_data(surfaces_data),
+    scene(properties, surfaces_data)
 {
 	/* 
 	wxGLContext的实例既承载了OpenGL状态机的实时运行状态，
@@ -56,10 +68,21 @@ CanvasGL::CanvasGL(wxPanel* parent, int* args, Properties& properties, std::map<
 
 	// 松开鼠标右键
 	Bind(wxEVT_RIGHT_UP,   &CanvasGL::on_mouse_right_up, this);
+
+	// requested frames start from here when they have to wait
+	timer_frame.SetOwner(this);
+	Bind(wxEVT_TIMER, &CanvasGL::on_timer_frame, this);
 }
 
 // 析构函数: 销毁OpenGL上下文
-CanvasGL::~CanvasGL() { delete m_context; }
+CanvasGL::~CanvasGL() {
+  // the buffers of the renderer go with the context they live in
+  if (gl_has_been_init) {
+    SetCurrent(*m_context);
+    scene.destroy();
+  }
+  delete m_context;
+}
 
 // 初始化OpenGL
 void CanvasGL::init_gl(void) 
@@ -80,165 +103,16 @@ void CanvasGL::init_gl(void)
     	*/
 	SetBackgroundStyle(wxBG_STYLE_CUSTOM);
 
-	// ------------------------------------------------------------
-	// vertex shader
-  	// ------------------------------------------------------------
-	const char *shader_source_vertex = R"(
-		#version 330 core
-		layout (location = 0) in vec3 aPos;
-		layout (location = 1) in vec3 aColor;
-		uniform mat4 model;
-		uniform mat4 view;
-		uniform mat4 projection;
-		out vec4 input_color;
-		void main() {
-			gl_Position = projection * view * model * vec4(aPos, 1.0);
-			input_color = vec4(aColor, 1.0);
-		}
-	)";
-
-	// ------------------------------------------------------------
-	// fragment shaders
-	// ------------------------------------------------------------
-
-	const char *shader_source_fragment_surface = R"(
-		#version 330 core
-		in vec4 input_color;
-		out vec4 FragColor;
-		void main() {
-			// FragColor = vec4(1.0f, 1.0f, 1.0f, 1.0f);
-			FragColor = input_color;
-		}
-	)";
-
-	const char *shader_source_fragment_mesh = R"(
-		#version 330 core
-		in vec4 input_color;
-		out vec4 FragColor;
-		void main() {
-			FragColor = vec4(0.0f, 0.0f, 0.0f, 1.0f);
-		}
-	)";
-
-	// ------------------------------------------------------------
-	// surface shader
-	// ------------------------------------------------------------
-
-	// glCreateShader用于创建一个新的着色器对象，失败了就返回0
-	// GL_VERTEX_SHADER类型的着色器是一种旨在在可编程顶点处理器上运行的着色器。
-	GLuint shader_vertex = glCreateShader(GL_VERTEX_SHADER);
-	// glShaderSource函数将着色器对象中的源代码设置为由string参数指定的字符串数组中的源代码。之前存储在着色器对象中的任何源代码会被完全替换。
-	// 数组中的字符串数量由count参数指定, 这里就一个字符串。
-	glShaderSource(shader_vertex, 1, &shader_source_vertex, NULL);
-	// 指出要被编译的着色器对象
-	glCompileShader(shader_vertex);
-
-	// 类型为GL_FRAGMENT_SHADER的着色器是一种专为在可编程片段处理器上运行而设计的着色器。
-	GLuint shader_fragment_surface = glCreateShader(GL_FRAGMENT_SHADER);
-	glShaderSource(shader_fragment_surface, 1, &shader_source_fragment_surface, NULL);
-	// 指出要被编译的着色器对象
-	glCompileShader(shader_fragment_surface);
-
-	// glCreateProgram函数创建一个空的程序对象，并返回一个非零值作为其引用标识符。程序对象是一个可以附加着色器对象的容器。
-	shader_surface = glCreateProgram();
-	// 附加着色器对象
-	glAttachShader(shader_surface, shader_vertex);
-	// 附加着色器对象
-	glAttachShader(shader_surface, shader_fragment_surface);
-	// 指明要被链接的程序对象句柄
-	glLinkProgram(shader_surface);
-
-	// ------------------------------------------------------------
-	// mesh shader
-	// ------------------------------------------------------------
-
-	// 类型为GL_FRAGMENT_SHADER的着色器是一种专为在可编程片段处理器上运行而设计的着色器
-	GLuint shader_fragment_mesh = glCreateShader(GL_FRAGMENT_SHADER);
-	// glShaderSource函数将着色器对象中的源代码设置为由string参数指定的字符串数组中的源代码。之前存储在着色器对象中的任何源代码会被完全替换。
-	// 数组中的字符串数量由count参数指定, 这里就一个字符串。
-	glShaderSource(shader_fragment_mesh, 1, &shader_source_fragment_mesh, NULL);
-	// 指出要被编译的着色器对象
-	glCompileShader(shader_fragment_mesh);
-
-	// glCreateProgram函数创建一个空的程序对象，并返回一个非零值作为其引用标识符。程序对象是一个可以附加着色器对象的容器。
-	shader_mesh = glCreateProgram();
-	// 附加着色器对象
-	glAttachShader(shader_mesh, shader_vertex);
-	// 附加着色器对象
-	glAttachShader(shader_mesh, shader_fragment_mesh);
-	// 指明要被链接的程序对象句柄
-	glLinkProgram(shader_mesh);
-
-	// 着色器对象已附加到某个程序对象,则仅会将其标记为待删除，但不会立即删除。
-	// 只有当该着色器对象从所有程序对象中分离，且在所有渲染上下文中均未被使用时，才会真正被删除。
-	glDeleteShader(shader_vertex);
-	glDeleteShader(shader_fragment_surface);
-	glDeleteShader(shader_fragment_mesh);
-
-	// ------------------------------------------------------------
-	// create axis
-	// ------------------------------------------------------------
-
-	// glGenVertexArrays返回一个顶点数组对象的名称，并存在了VAO_AXIS中
-	glGenVertexArrays(1, &VAO_AXIS);
-	// glGenBuffers函数会生成1个缓冲区对象标识符，并将这些标识符存储在VBO_AXIS中。
-	glGenBuffers(1, &VBO_AXIS);
-
-	// glBindVertexArray函数用于绑定指定名称的顶点数组对象（VAO）
-	glBindVertexArray(VAO_AXIS);
-	// glBindBuffer用于绑定一个已经命名的缓存区对象。GL_ARRAY_BUFFER代表顶点属性
-	glBindBuffer(GL_ARRAY_BUFFER, VBO_AXIS);
-	float s = 10.0f;
-	float axis[] = {
-		s, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,
-		-s, 0.0f, 0.0f, 0.2f, 0.0f, 0.0f,
-		0.0f, s, 0.0f, 0.0f, 0.0f, 1.0f,
-		0.0f, -s, 0.0f, 0.0f, 0.0f, 0.2f,
-		0.0f, 0.0f, s, 0.0f, 1.0f, 0.0f,
-		0.0f, 0.0f, -s, 0.0f, 0.2f, 0.0f
-	};
-	
-	// glBufferData是OpenGL中用于为缓冲区对象（Buffer Object）分配数据存储空间的函数
-	// GL_ARRAY_BUFFER表示当前绑定的缓冲区对象所关联的目标类型为顶点属性（位置、颜色、纹理坐标）
-	// 数组axis包含了用于指定要复制到缓冲区对象数据存储区的初始化数据
-	/* GL_STATIC_DRAW要分开看: STATIC表示数据会被修改一次，利用许多次；
- 		DRAW表明数据内容被应用程序所修改，并且数据内容作为OpenGL绘图和图像规范命令的来源
- 	*/
-	glBufferData(GL_ARRAY_BUFFER, sizeof(axis), axis, GL_STATIC_DRAW);
-
-	// 定义一个通用顶点属性数据的数组
-	/* 0表示需修改的通用顶点属性的索引
- 	   3表示每个通用顶点属性的分量数目。
-     	   GL_FLOAT表示数组中每个分量的数据类型为单精度浮点型
-	   GL_FALSE表示当访问定点数据值时直接按原定点值转换
-           指定连续通用顶点属性之间的字节偏移量（步幅）为6 * sizeof(float)
-	*/
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
-	glEnableVertexAttribArray(1);
-
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindVertexArray(0);
-
-	// ------------------------------------------------------------
-	// states
-	// ------------------------------------------------------------
+	scene.init();
 
-	glLineWidth(2);
-	glPointSize(10);
-	glEnable(GL_DEPTH_TEST);
-
-	// ------------------------------------------------------------
-	// ebo
-	// ------------------------------------------------------------
-
-	// GLuint e;
-	glGenBuffers(1,&EBO);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-
-	ebo_update();
+	// frames are paced to the refresh rate of the display the canvas
+	// is on, 60 Hz when it does not tell
+	int display = wxDisplay::GetFromWindow(this);
+	if (display != wxNOT_FOUND) {
+	  int hz = wxDisplay(display).GetCurrentMode().GetRefreshFrequency();
+	  if (hz > 0)
+	    pacer.interval_ms = 1000.0 / hz;
+	}
 
 }
 
@@ -267,8 +141,20 @@ void CanvasGL::render(wxPaintEvent& event) {
 
   SetCurrent(*m_context);
   wxPaintDC dc(this);
-  glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-  glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
+
+  trace_scope scope("frame");
+
+  // the work deferred to this frame first. what it requests is folded
+  // into this frame.
+  double start = now_ms();
+  if (pacer.pending() & REDRAW_SCENE) {
+    trace_scope deferred_scope("deferred");
+    std::vector<deferred_work> work;
+    work.swap(deferred);
+    for (deferred_work& w : work)
+      w.work();
+  }
+  pacer.begin(start);
 
   // ------------------------------------------------------------
   // transformations
@@ -279,6 +165,14 @@ void CanvasGL::render(wxPaintEvent& event) {
   glm::mat4 view = glm::mat4(1.0f);
   view = glm::lookAt(camera_pos, glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f)); // dest, up
 
+  // the contour map looks along the vertical axis. the scene swaps y
+  // and z, so it looks up from below to put x to the right and y up.
+  glm::vec3 eye = camera_pos;
+  if (props.contour_map) {
+    eye = glm::vec3(0.0f, -far_plane / 2.0f, 0.0f);
+    view = glm::lookAt(eye, glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+  }
+
   /* --------- handle projection --------- */
 
   int width, height;
@@ -296,79 +190,148 @@ void CanvasGL::render(wxPaintEvent& event) {
     projection = glm::ortho<float>(left, right, bottom, top, near_plane, far_plane);
   }
 
-  /* ----- model (not needed for now) ----- */
-
-  glm::mat4 model = glm::mat4(1.0f);
-  model = glm::translate(model, glm::vec3(0.0f, 0.0f, 0.0f));
+  scene.draw(view, projection, eye);
+  if (overlay) {
+    if (overlay_stale)
+      update_overlay();
+    scene.draw_overlay(8, 8);
+  }
+  pacer.end(now_ms());
 
   // ------------------------------------------------------------
-  // draw surfaces
+  // display
   // ------------------------------------------------------------
 
-  glUseProgram(shader_surface);
-  glEnable(GL_DEPTH_TEST);
-
-  GLuint locView = glGetUniformLocation(shader_surface, "view");
-  glUniformMatrix4fv(locView, 1, GL_FALSE, glm::value_ptr(view));
-  GLuint locProjection = glGetUniformLocation(shader_surface, "projection");
-  glUniformMatrix4fv(locProjection, 1, GL_FALSE, glm::value_ptr(projection));
-  GLuint locModel = glGetUniformLocation(shader_surface, "model");
-  glUniformMatrix4fv(locModel, 1, GL_FALSE, glm::value_ptr(model));
-
-  for (const auto& pair : surfaces_data) {
-    if (!pair.second.show || pair.second.function.empty())
-      continue;
-    glBindVertexArray(pair.second.vao);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, pair.second.ebo);
-    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-    glDrawElements(GL_TRIANGLES, pair.second.ind_size, GL_UNSIGNED_INT, 0);
+  SwapBuffers();
+
+  // tiles and points arrive from the loader threads between frames
+  if (scene.stats.pending)
+    request_frame(REDRAW_CAMERA);
+
+  double now = now_ms();
+  if (report_last == 0.0)
+    report_last = now;
+  if (now - report_last >= 500.0) {
+    report_latest = pacer.report(now);
+    report_last = now;
+    overlay_stale = true;
+    if (report_frames)
+      report_frames(report_latest);
   }
+}
 
-  // ------------------------------------------------------------
-  // draw meshes
-  // ------------------------------------------------------------
+// ------------------------------------------------------------
+// frame requests
+// ------------------------------------------------------------
 
-  if (props.show_mesh) {
-    glUseProgram(shader_mesh);
-    glEnable(GL_DEPTH_TEST);
+void CanvasGL::request_frame(int reasons) {
 
-    locView = glGetUniformLocation(shader_mesh, "view");
-    glUniformMatrix4fv(locView, 1, GL_FALSE, glm::value_ptr(view));
-    locProjection = glGetUniformLocation(shader_mesh, "projection");
-    glUniformMatrix4fv(locProjection, 1, GL_FALSE, glm::value_ptr(projection));
-    locModel = glGetUniformLocation(shader_mesh, "model");
-    glUniformMatrix4fv(locModel, 1, GL_FALSE, glm::value_ptr(model));
+  // a frame already requested takes this one in. otherwise the frame
+  // starts right away, or once the refresh period since the last one
+  // is over.
 
-    glLineWidth(2);
-    
-    for (const auto& pair : surfaces_data) {
-      if (!pair.second.show || pair.second.function.empty())
-	continue;
-      glBindVertexArray(pair.second.vao);
-      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, pair.second.ebo);
-      glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-      glDrawElements(GL_TRIANGLES, pair.second.ind_size, GL_UNSIGNED_INT, 0);
-    }
-  }
+  if (!pacer.request(reasons) || timer_frame.IsRunning())
+    return;
+  double delay = pacer.delay(now_ms());
+  if (delay <= 0.0)
+    Refresh();
+  else
+    timer_frame.Start(std::max(1, (int)std::ceil(delay)), wxTIMER_ONE_SHOT);
+}
 
-  // ------------------------------------------------------------
-  // draw axes
-  // ------------------------------------------------------------
+void CanvasGL::on_timer_frame(wxTimerEvent& event) {
+  // a paint event of the window system may have drawn it already
+  if (pacer.pending())
+    Refresh();
+}
+
+// ------------------------------------------------------------
+// performance overlay
+// ------------------------------------------------------------
 
-  if (props.show_axes) {
-    glUseProgram(shader_surface);
-    glDisable(GL_DEPTH_TEST);
-    glLineWidth(5);
-    glBindVertexArray(VAO_AXIS);
-    glDrawArrays(GL_LINES, 0, 6);
+void CanvasGL::show_overlay(bool show) {
+  overlay = show;
+  overlay_stale = true;
+  request_frame(REDRAW_CAMERA);
+}
+
+void CanvasGL::update_overlay() {
+
+  // the frame, what the gpu took for it, what it drew, and the stages
+  // of the last mesh made (see trace.hpp), as light text on a dark
+  // box. the text only changes with a report, twice a second.
+
+  const RenderStats& stats = scene.stats;
+  std::vector<wxString> lines = {
+    wxString::Format(wxT("frame    %6.2f ms  max %6.2f ms  %4.0f fps"),
+		     report_latest.frame_ms, report_latest.frame_ms_max, report_latest.fps),
+    wxString::Format(wxT("gpu      %6.2f ms  fill %.2f  mesh %.2f  contours %.2f  points %.2f  axes %.2f"),
+		     stats.gpu_ms, stats.pass_gpu_ms[PASS_FILL], stats.pass_gpu_ms[PASS_MESH],
+		     stats.pass_gpu_ms[PASS_CONTOURS], stats.pass_gpu_ms[PASS_POINTS], stats.pass_gpu_ms[PASS_AXES]),
+    wxString::Format(wxT("drawn    %llu triangles  %d draw calls"), stats.triangles, stats.draw_calls),
+    wxString::Format(wxT("mesh     parse %.2f  evaluate %.2f  index %.2f  contours %.2f  upload %.2f ms"),
+		     trace_last_ms("parse"), trace_last_ms("evaluate"), trace_last_ms("index"),
+		     trace_last_ms("contours"), trace_last_ms("upload"))
+  };
+  overlay_stale = false;
+
+  wxFont font(9, wxFONTFAMILY_TELETYPE, wxFONTSTYLE_NORMAL, wxFONTWEIGHT_NORMAL);
+  wxBitmap measure(1, 1);
+  wxMemoryDC dc(measure);
+  dc.SetFont(font);
+  int width = 0, line_height = 0;
+  for (const wxString& line : lines) {
+    int w, h;
+    dc.GetTextExtent(line, &w, &h);
+    width = std::max(width, w);
+    line_height = std::max(line_height, h);
+  }
+  const int pad = 4;
+  width += 2 * pad;
+  int height = (int)lines.size() * line_height + 2 * pad;
+
+  wxBitmap bitmap(width, height, 24);
+  dc.SelectObject(bitmap);
+  dc.SetBackground(*wxBLACK_BRUSH);
+  dc.Clear();
+  dc.SetTextForeground(wxColour(230, 230, 230));
+  for (size_t k = 0; k < lines.size(); k++)
+    dc.DrawText(lines[k], pad, pad + (int)k * line_height);
+  dc.SelectObject(wxNullBitmap);
+
+  // the text opaque, the box behind it translucent
+  wxImage image = bitmap.ConvertToImage();
+  const unsigned char* rgb = image.GetData();
+  if (!rgb)
+    return;
+  std::vector<unsigned char> rgba((size_t)width * height * 4);
+  for (size_t p = 0; p < (size_t)width * height; p++) {
+    std::copy_n(rgb + p * 3, 3, &rgba[p * 4]);
+    rgba[p * 4 + 3] = std::max<unsigned char>(160, rgb[p * 3]);
   }
+  scene.set_overlay(rgba.data(), width, height);
+}
 
-  // ------------------------------------------------------------
-  // display
-  // ------------------------------------------------------------
+void CanvasGL::defer(const void* owner, int tag, std::function<void()> work) {
 
-  SwapBuffers();
+  // a handler that fires faster than frames are drawn, a slider or a
+  // text field being typed into, only does its work once per frame,
+  // with the latest values
+
+  auto it = std::find_if(deferred.begin(), deferred.end(), [&](const deferred_work& w) {
+    return w.owner == owner && w.tag == tag;
+  });
+  if (it != deferred.end())
+    it->work = std::move(work);
+  else
+    deferred.push_back({owner, tag, std::move(work)});
+  request_frame(REDRAW_SCENE);
+}
 
+void CanvasGL::cancel_deferred(const void* owner) {
+  deferred.erase(std::remove_if(deferred.begin(), deferred.end(), [&](const deferred_work& w) {
+    return w.owner == owner;
+  }), deferred.end());
 }
 
 // ------------------------------------------------------------
@@ -383,7 +346,7 @@ void CanvasGL::on_size(wxSizeEvent &event) {
     if (gl_has_been_init) {
       glViewport(0, 0, width, height);
     }
-    Refresh();
+    request_frame(REDRAW_CAMERA);
 }
 
 // ------------------------------------------------------------
@@ -401,6 +364,10 @@ void CanvasGL::on_mouse_motion(wxMouseEvent& event) {
   x_current = pos.x;
   y_current = pos.y;
 
+  // the same position again moves nothing
+  if (x_current == x_last && y_current == y_last)
+    return;
+
   if (left_is_down) {
 
     // calculate offset using coordinate differences
@@ -458,7 +425,7 @@ void CanvasGL::on_mouse_motion(wxMouseEvent& event) {
       
     }
   }
-  Refresh();
+  request_frame(REDRAW_CAMERA);
 }
 
 // ------------------------------------------------------------
@@ -500,39 +467,26 @@ void CanvasGL::on_mouse_right_up(wxMouseEvent& event) {
 }
 
 // ------------------------------------------------------------
-//
+// index buffers
 // ------------------------------------------------------------
 
 void CanvasGL::ebo_update() {
+  scene.ebo_update();
+}
 
-  std::vector<unsigned int> ind;
-  int num_vertices_per_axis = props.divisions + 1;
-    
-  // indices
-  for (int i = 0; i < props.divisions; i++) {
-    for (int j = 0; j < props.divisions; j++) {
-      int row1 = i * num_vertices_per_axis;
-      int row2 = (i + 1) * num_vertices_per_axis;
-      // first quad
-      ind.push_back(row1 + j);
-      ind.push_back(row2 + j);
-      ind.push_back(row1 + j + 1);
-      // second quad
-      ind.push_back(row1 + j + 1);
-      ind.push_back(row2 + j);
-      ind.push_back(row2 + j + 1);
-    }
-  }
+GLuint CanvasGL::grid_ebo(int rows, int columns, unsigned int& count) {
+  return scene.grid_ebo(rows, columns, count);
+}
 
-  this->ind_size = ind.size();
+void CanvasGL::create_vertex_buffer(SurfaceData& surface) {
+  scene.create_vertex_buffer(surface);
+}
 
-  for (auto& pair : surfaces_data) {
-    glBindVertexArray(pair.second.vao);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    // glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, ind.size() * sizeof(unsigned int), ind.data());
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, ind.size() * sizeof(unsigned int), ind.data(), GL_STATIC_DRAW);
-    pair.second.ebo = EBO;
-    pair.second.ind_size = ind.size();
-  }
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+size_t CanvasGL::upload_vertices(SurfaceData& surface) {
+  return scene.upload_vertices(surface);
+}
+
+void CanvasGL::release_heights(SurfaceData& surface) {
+  scene.height_arrays().release(surface.heights);
+  surface.heights = height_layer();
 }
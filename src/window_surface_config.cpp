@@ -1,9 +1,21 @@
 #include <wx/clrpicker.h>
 #include <wx/event.h>
 #include <wx/wx.h>
+#include <wx/filedlg.h>
 #include <window_surface_config.hpp>
 #include <renderer.hpp>
 #include <parser.hpp>
+#include <trace.hpp>
+#include <mesh.hpp>
+#include <implicit.hpp>
+#include <contour.hpp>
+#include <tile_pyramid.hpp>
+#include <cmath>
+#include <algorithm>
+
+const char* const domain_tooltip =
+  "comparisons separated by commas, e.g. -1 < x < 3, x^2 + y^2 < 4. bounds of x and y"
+  " set the rectangle of the grid, the other comparisons mask it. empty for the whole grid";
 
 WindowSurfaceConfig::WindowSurfaceConfig(wxPanel* parent, unsigned int id, Properties& props, std::map<unsigned int, SurfaceData>& surfaces_data)
   : wxPanel(parent, wxID_ANY, wxDefaultPosition, wxDefaultSize),
@@ -11,24 +23,70 @@ WindowSurfaceConfig::WindowSurfaceConfig(wxPanel* parent, unsigned int id, Prope
     props(props),
     surfaces_data(surfaces_data) {
 
+  wxBoxSizer* sizer_main = new wxBoxSizer(wxVERTICAL);
   wxBoxSizer* sizer = new wxBoxSizer(wxHORIZONTAL);
-  this->SetSizer(sizer);
+  sizer_params = new wxBoxSizer(wxVERTICAL);
+  wxBoxSizer* sizer_colormap = new wxBoxSizer(wxHORIZONTAL);
+  wxBoxSizer* sizer_domain = new wxBoxSizer(wxHORIZONTAL);
+  sizer_main->Add(sizer, 0, wxEXPAND);
+  sizer_main->Add(sizer_colormap, 0, wxEXPAND|wxLEFT, 20);
+  sizer_main->Add(sizer_domain, 0, wxEXPAND|wxLEFT, 20);
+  sizer_main->Add(sizer_params, 0, wxEXPAND|wxLEFT, 20);
+  this->SetSizer(sizer_main);
 
   checkbox_show = new wxCheckBox(this, wxID_ANY, "Show");
   textctrl_function = new wxTextCtrl(this, wxID_ANY, "");
   colour_picker = new wxColourPickerCtrl(this, wxID_ANY, wxColour(255, 0, 0));
+  button_data = new wxButton(this, wxID_ANY, "Data...");
+  button_points = new wxButton(this, wxID_ANY, "Points...");
   button_remove = new wxButton(this, wxID_ANY, "Remove");
 
   checkbox_show->SetValue(true);
+  textctrl_function->SetToolTip("f(x,y), F(x,y,z) for the implicit surface F = 0, or"
+				" x(u,v), y(u,v), z(u,v) separated by commas for a parametric"
+				" surface over u, v in [0, 2 pi]");
   
   sizer->Add(checkbox_show, 0, wxALL|wxEXPAND, 5);
   sizer->Add(new wxStaticText(this, wxID_ANY, "f(x,y) = "), 0, wxALL|wxALIGN_CENTER_VERTICAL, 5);
   sizer->Add(textctrl_function, 1, wxALL|wxEXPAND, 5);
   sizer->Add(colour_picker, 0, wxALL|wxEXPAND, 5);
+  sizer->Add(button_data, 0, wxALL|wxEXPAND, 5);
+  sizer->Add(button_points, 0, wxALL|wxEXPAND, 5);
   sizer->Add(button_remove, 0, wxALL|wxEXPAND, 5);
 
   sizer->Layout();
 
+  /* -------------- colormap -------------- */
+
+  wxString choice_colormap_choices[COLORMAP_COUNT];
+  for (int i = 0; i < COLORMAP_COUNT; i++)
+    choice_colormap_choices[i] = colormap_names[i];
+
+  choice_colormap = new wxChoice(this, wxID_ANY, wxDefaultPosition, wxDefaultSize,
+				 COLORMAP_COUNT, choice_colormap_choices);
+  checkbox_range_auto = new wxCheckBox(this, wxID_ANY, "Auto range");
+  textctrl_range_min = new wxTextCtrl(this, wxID_ANY, "");
+  textctrl_range_max = new wxTextCtrl(this, wxID_ANY, "");
+
+  choice_colormap->SetSelection(COLORMAP_SOLID);
+  checkbox_range_auto->SetValue(true);
+  textctrl_range_min->Enable(false);
+  textctrl_range_max->Enable(false);
+
+  sizer_colormap->Add(new wxStaticText(this, wxID_ANY, "Colormap:"), 0, wxALL|wxALIGN_CENTER_VERTICAL, 5);
+  sizer_colormap->Add(choice_colormap, 0, wxALL, 5);
+  sizer_colormap->Add(checkbox_range_auto, 0, wxALL|wxALIGN_CENTER_VERTICAL, 5);
+  sizer_colormap->Add(textctrl_range_min, 1, wxALL, 5);
+  sizer_colormap->Add(textctrl_range_max, 1, wxALL, 5);
+
+  /* -------------- domain -------------- */
+
+  textctrl_domain = new wxTextCtrl(this, wxID_ANY, "");
+  textctrl_domain->SetToolTip(domain_tooltip);
+
+  sizer_domain->Add(new wxStaticText(this, wxID_ANY, "Domain:"), 0, wxALL|wxALIGN_CENTER_VERTICAL, 5);
+  sizer_domain->Add(textctrl_domain, 1, wxALL, 5);
+
   // ------------------------------------------------------------
   // events
   // ------------------------------------------------------------
@@ -36,26 +94,255 @@ WindowSurfaceConfig::WindowSurfaceConfig(wxPanel* parent, unsigned int id, Prope
   textctrl_function->Bind(wxEVT_TEXT, &WindowSurfaceConfig::on_textctrl, this);
   checkbox_show->Bind(wxEVT_CHECKBOX, &WindowSurfaceConfig::on_checkbox, this);
   colour_picker->Bind(wxEVT_COLOURPICKER_CHANGED, &WindowSurfaceConfig::on_color, this);
+  button_data->Bind(wxEVT_BUTTON, &WindowSurfaceConfig::on_data, this);
+  button_points->Bind(wxEVT_BUTTON, &WindowSurfaceConfig::on_points, this);
   button_remove->Bind(wxEVT_BUTTON, &WindowSurfaceConfig::on_remove, this);
+  choice_colormap->Bind(wxEVT_CHOICE, &WindowSurfaceConfig::on_colormap, this);
+  checkbox_range_auto->Bind(wxEVT_CHECKBOX, &WindowSurfaceConfig::on_range, this);
+  textctrl_range_min->Bind(wxEVT_TEXT, &WindowSurfaceConfig::on_range, this);
+  textctrl_range_max->Bind(wxEVT_TEXT, &WindowSurfaceConfig::on_range, this);
+  textctrl_domain->Bind(wxEVT_TEXT, &WindowSurfaceConfig::on_domain, this);
 }
 
 void WindowSurfaceConfig::on_checkbox(wxCommandEvent& event) {
   surfaces_data[id].show = checkbox_show->GetValue();
   // refresh context
-  if (canvas_gl) canvas_gl->Refresh();
+  if (canvas_gl) canvas_gl->request_frame();
 }
 
 void WindowSurfaceConfig::on_textctrl(wxCommandEvent& event) {
-  // get function string
+  // get function string, typing replaces a data file
   surfaces_data[id].function = std::string(textctrl_function->GetValue().mb_str());
-  // update ebo?
-  canvas_gl->ebo_update();
-  // update only xyz values
+  surfaces_data[id].source = SOURCE_FUNCTION;
+  surfaces_data[id].data.reset();
+  this->release_tiles();
+  this->release_points();
+  // compile once, the program is evaluated for every vertex
+  {
+    trace_scope scope("parse");
+    parser p;
+    p.compile(surfaces_data[id].function.c_str(), surfaces_data[id].prog);
+  }
+  surfaces_data[id].animated = surfaces_data[id].prog.uses(OP_T);
+  this->set_implicit(surfaces_data[id].prog.uses(OP_Z));
+  // one slider per parameter
+  this->update_param_controls();
+  // static surfaces always use the full resolution
+  if (!surfaces_data[id].animated && surfaces_data[id].divisions != props.divisions)
+    this->set_divisions(props.divisions);
+  // evaluated once per frame while typing
+  this->defer_evaluate();
+}
+
+void WindowSurfaceConfig::on_data(wxCommandEvent& event) {
+  wxFileDialog dialog(this, "Open height data", "", "",
+		      "Height data (*.npy;*.csv;*.txt;*.f32;*.raw)|*.npy;*.csv;*.txt;*.f32;*.raw|All files|*",
+		      wxFD_OPEN|wxFD_FILE_MUST_EXIST);
+  if (dialog.ShowModal() != wxID_OK) return;
+  if (!this->open_data(std::string(dialog.GetPath().mb_str()))) return;
   this->vector_update_coords();
-  // update buffer
   this->vector_send_to_buffer();
-  // refresh context
-  if (canvas_gl) canvas_gl->Refresh();
+  if (canvas_gl) canvas_gl->request_frame();
+}
+
+bool WindowSurfaceConfig::open_data(const std::string& path) {
+
+  // the surface shows the file instead of a function. binary files
+  // stay mapped, every evaluation samples them at the resolution of
+  // the surface.
+
+  std::shared_ptr<height_field> data = std::make_shared<height_field>();
+  std::string error;
+  if (!height_field_open(path.c_str(), *data, error)) {
+    wxMessageBox(wxString(path + ": " + error), "Open height data", wxOK|wxICON_ERROR);
+    return false;
+  }
+  if (!data->warning.empty())
+    wxMessageBox(wxString(path + ": " + data->warning), "Open height data", wxOK|wxICON_WARNING);
+
+  this->release_tiles();
+  this->release_points();
+  SurfaceData& surface = surfaces_data[id];
+  surface.source = SOURCE_DATA;
+  surface.data = data;
+  surface.tiles = this->open_tiles(path, *data);
+  surface.function = path;
+  surface.prog.clear();
+  surface.animated = false;
+  this->set_implicit(false);
+  textctrl_function->ChangeValue(path);
+  this->update_param_controls();
+  if (surface.divisions != props.divisions)
+    this->set_divisions(props.divisions);
+  return true;
+}
+
+// ------------------------------------------------------------
+// point clouds
+// ------------------------------------------------------------
+
+void WindowSurfaceConfig::on_points(wxCommandEvent& event) {
+  wxFileDialog dialog(this, "Open point cloud", "", "",
+		      "Point clouds (*.npy;*.csv;*.txt;*.xyz;*.f32;*.raw)|*.npy;*.csv;*.txt;*.xyz;*.f32;*.raw|All files|*",
+		      wxFD_OPEN|wxFD_FILE_MUST_EXIST);
+  if (dialog.ShowModal() != wxID_OK) return;
+  if (!this->open_points(std::string(dialog.GetPath().mb_str()))) return;
+  if (canvas_gl) canvas_gl->request_frame();
+}
+
+bool WindowSurfaceConfig::open_points(const std::string& path) {
+
+  // the surface shows the points instead of a grid, the octree is
+  // built once and the points are uploaded over the next frames
+
+  std::shared_ptr<point_cloud> cloud = std::make_shared<point_cloud>();
+  std::string error;
+  {
+    wxBusyCursor busy;
+    if (!point_cloud_open(path.c_str(), *cloud, error)) {
+      wxMessageBox(wxString(path + ": " + error), "Open point cloud", wxOK|wxICON_ERROR);
+      return false;
+    }
+  }
+
+  this->release_tiles();
+  this->release_points();
+  SurfaceData& surface = surfaces_data[id];
+  surface.source = SOURCE_POINTS;
+  surface.data.reset();
+  surface.points = std::make_shared<PointLayer>(cloud);
+  surface.points->create();
+  surface.function = path;
+  surface.prog.clear();
+  surface.animated = false;
+  this->set_implicit(false);
+  surface.z_min = cloud->value_min;
+  surface.z_max = cloud->value_max;
+  textctrl_function->ChangeValue(path);
+  this->update_param_controls();
+  this->update_range_controls();
+  return true;
+}
+
+void WindowSurfaceConfig::release_points() {
+  SurfaceData& surface = surfaces_data[id];
+  if (!surface.points) return;
+  surface.points->destroy();
+  surface.points.reset();
+}
+
+// ------------------------------------------------------------
+// tiled data
+// ------------------------------------------------------------
+
+// fields with more values than this are drawn from a tile pyramid
+const size_t tiled_values = 4096 * 4096;
+const int tile_size = 256;
+
+std::shared_ptr<TiledSurface> WindowSurfaceConfig::open_tiles(const std::string& path, const height_field& field) {
+
+  // the pyramid is kept next to the file. it is built the first time
+  // the file is opened and again once the file has changed. the grid
+  // of the surface is still sampled for the height range and the scene
+  // cache, it is only not drawn.
+
+  if ((size_t)field.rows * field.cols <= tiled_values)
+    return nullptr;
+
+  std::string tiles_path = path + ".p3dt";
+  uint64_t stamp = tile_source_stamp(path.c_str());
+  std::shared_ptr<tile_pyramid> pyramid = std::make_shared<tile_pyramid>();
+  std::string error;
+  if (!pyramid->open(tiles_path.c_str(), error) || pyramid->stamp != stamp
+      || pyramid->rows != field.rows || pyramid->cols != field.cols) {
+    // unmapped before the file is written again
+    pyramid = std::make_shared<tile_pyramid>();
+    wxBusyCursor busy;
+    if (!tile_pyramid_build(field, tiles_path.c_str(), tile_size, stamp, error)
+	|| !pyramid->open(tiles_path.c_str(), error)) {
+      wxMessageBox(wxString(tiles_path + ": " + error + ", the surface is drawn at the grid resolution"),
+		   "Open height data", wxOK|wxICON_WARNING);
+      return nullptr;
+    }
+  }
+
+  std::shared_ptr<TiledSurface> tiles = std::make_shared<TiledSurface>(pyramid);
+  tiles->create(props.grid_size, surfaces_data[id].rgb.data());
+  return tiles;
+}
+
+void WindowSurfaceConfig::release_tiles() {
+  SurfaceData& surface = surfaces_data[id];
+  if (!surface.tiles) return;
+  surface.tiles->destroy();
+  surface.tiles.reset();
+}
+
+void WindowSurfaceConfig::on_slider(int param) {
+  program& prog = surfaces_data[id].prog;
+  double value = sliders_params[param]->GetValue() / 100.0;
+  prog.param_values[param] = value;
+  param_values[prog.params[param]] = value;
+  statictexts_params[param]->SetLabel(wxString::Format(wxT("%.2f"), value));
+  // only the part of the function that depends on this parameter,
+  // once per frame while the slider is dragged
+  if (!canvas_gl) return;
+  canvas_gl->defer(this, DEFER_PARAM + param, [this, param]{
+    // the function may have lost the parameter since
+    if (param >= (int)surfaces_data[id].prog.params.size()) return;
+    this->vector_update_param(param);
+    this->vector_send_to_buffer();
+  });
+}
+
+void WindowSurfaceConfig::update_param_controls() {
+
+  // restores the values of parameters that were already known and
+  // rebuilds the sliders only when the set of names changed.
+
+  program& prog = surfaces_data[id].prog;
+  for (size_t i = 0; i < prog.params.size(); i++) {
+    auto it = param_values.find(prog.params[i]);
+    if (it != param_values.end())
+      prog.param_values[i] = it->second;
+    else
+      param_values[prog.params[i]] = prog.param_values[i];
+  }
+
+  bool same = sliders_params.size() == prog.params.size();
+  for (size_t i = 0; same && i < prog.params.size(); i++)
+    same = sliders_params[i]->GetName() == wxString(prog.params[i]);
+  if (same) return;
+
+  sizer_params->Clear(true);
+  sliders_params.clear();
+  statictexts_params.clear();
+
+  for (size_t i = 0; i < prog.params.size(); i++) {
+    double value = prog.param_values[i];
+    int position = std::max(-1000, std::min(1000, (int)std::lround(value * 100.0)));
+
+    wxBoxSizer* sizer_row = new wxBoxSizer(wxHORIZONTAL);
+    wxSlider* slider = new wxSlider(this, wxID_ANY, position, -1000, 1000,
+				    wxDefaultPosition, wxDefaultSize, wxSL_HORIZONTAL,
+				    wxDefaultValidator, prog.params[i]);
+    wxStaticText* statictext_value = new wxStaticText(this, wxID_ANY, wxString::Format(wxT("%.2f"), value));
+
+    sizer_row->Add(new wxStaticText(this, wxID_ANY, prog.params[i] + " = "), 0, wxALL|wxALIGN_CENTER_VERTICAL, 5);
+    sizer_row->Add(slider, 1, wxALL|wxEXPAND, 5);
+    sizer_row->Add(statictext_value, 0, wxALL|wxALIGN_CENTER_VERTICAL, 5);
+    sizer_params->Add(sizer_row, 0, wxEXPAND);
+
+    int param = (int)i;
+    slider->Bind(wxEVT_SLIDER, [this, param](wxCommandEvent& event) { on_slider(param); });
+
+    sliders_params.push_back(slider);
+    statictexts_params.push_back(statictext_value);
+  }
+
+  this->Layout();
+  this->GetParent()->Layout();
+  this->GetParent()->FitInside();
 }
 
 void WindowSurfaceConfig::on_color(wxColourPickerEvent& event) {
@@ -67,16 +354,92 @@ void WindowSurfaceConfig::on_color(wxColourPickerEvent& event) {
   surfaces_data[id].rgb[2] = color.GetBlue() / 255.0f;
   // update only rgb values
   this->vector_update_colors();
+  // the tiles carry their color, they are loaded again
+  if (surfaces_data[id].tiles)
+    surfaces_data[id].tiles->create(props.grid_size, surfaces_data[id].rgb.data());
   // update buffer
   this->vector_send_to_buffer();
   // refresh context
-  if (canvas_gl) canvas_gl->Refresh();
+  if (canvas_gl) canvas_gl->request_frame();
+}
+
+void WindowSurfaceConfig::on_colormap(wxCommandEvent& event) {
+  // only a uniform and a texture binding change, no buffer work
+  surfaces_data[id].colormap = choice_colormap->GetSelection();
+  if (canvas_gl) canvas_gl->request_frame();
+}
+
+void WindowSurfaceConfig::on_range(wxCommandEvent& event) {
+  SurfaceData& surface = surfaces_data[id];
+  surface.range_auto = checkbox_range_auto->GetValue();
+  textctrl_range_min->Enable(!surface.range_auto);
+  textctrl_range_max->Enable(!surface.range_auto);
+  double value;
+  if (textctrl_range_min->GetValue().ToDouble(&value))
+    surface.range_min = (float)value;
+  if (textctrl_range_max->GetValue().ToDouble(&value))
+    surface.range_max = (float)value;
+  // the contour levels divide the range
+  if (props.contours > 0 && canvas_gl) {
+    this->update_contours();
+    SceneRenderer::upload_contours(surface);
+  }
+  if (canvas_gl) canvas_gl->request_frame();
+}
+
+void WindowSurfaceConfig::on_domain(wxCommandEvent& event) {
+  // a domain that does not parse or lies outside the grid is the
+  // whole grid, the tooltip tells what is wrong with it. the grid takes its new shape in
+  // evaluate_grid.
+  SurfaceData& surface = surfaces_data[id];
+  surface.domain_text = std::string(textctrl_domain->GetValue().mb_str());
+  std::string error;
+  bool ok = parse_domain(surface.domain_text, surface.region, error) &&
+    domain_fits(surface.region, props.grid_size, error);
+  textctrl_domain->SetToolTip(ok ? wxString(domain_tooltip) : wxString(error));
+  this->defer_evaluate();
+}
+
+void WindowSurfaceConfig::defer_evaluate() {
+  if (!canvas_gl) return;
+  canvas_gl->defer(this, DEFER_EVALUATE, [this]{
+    canvas_gl->ebo_update();
+    this->vector_update_coords();
+    this->vector_send_to_buffer();
+  });
+}
+
+void WindowSurfaceConfig::update_range_controls() {
+  // the fields follow the evaluated range until it is set by hand.
+  // ChangeValue does not send wxEVT_TEXT.
+  SurfaceData& surface = surfaces_data[id];
+  if (!surface.range_auto) return;
+  surface.range_min = surface.z_min;
+  surface.range_max = surface.z_max;
+  textctrl_range_min->ChangeValue(wxString::Format(wxT("%.3g"), surface.z_min));
+  textctrl_range_max->ChangeValue(wxString::Format(wxT("%.3g"), surface.z_max));
 }
 
 void WindowSurfaceConfig::on_remove(wxCommandEvent& event) {
+  this->remove();
+}
+
+void WindowSurfaceConfig::remove() {
+  // work left for the next frame would find the surface gone
+  if (canvas_gl) canvas_gl->cancel_deferred(this);
   // delete vao and vbo
   glDeleteVertexArrays(1, &surfaces_data[id].vao);
-  glDeleteBuffers(1, &surfaces_data[id].vbo);
+  surfaces_data[id].vbo.destroy();
+  if (canvas_gl) canvas_gl->release_heights(surfaces_data[id]);
+  if (surfaces_data[id].mesh_ebo)
+    glDeleteBuffers(1, &surfaces_data[id].mesh_ebo);
+  if (surfaces_data[id].contour_vao) {
+    glDeleteVertexArrays(1, &surfaces_data[id].contour_vao);
+    glDeleteBuffers(1, &surfaces_data[id].contour_vbo);
+    glDeleteBuffers(1, &surfaces_data[id].contour_ebo);
+  }
+  this->release_tiles();
+  this->release_points();
   // remove from map
   surfaces_data.erase(id);
   // remove window
@@ -90,75 +453,338 @@ void WindowSurfaceConfig::update_buffer_size() {
 
   // the vertices per axis (horizontal plane) are props.divisions +
   // 1. therefore, the total amount of vertices in the surface will be
-  // this value squared. except that we also save the color data in
-  // the array buffer, so we should multiply this by 6 (xyz + rgb per
-  // vertex)
-  unsigned int vertices_count = (props.divisions + 1) * (props.divisions + 1) * 6;
+  // this value squared, or rows by columns over a rectangular domain.
+  // except that we also save the color and the normal in the array
+  // buffer, so we should multiply this by floats_per_vertex (xyz +
+  // rgb + packed normal per vertex)
+  grid g = this->surface_grid();
+  surfaces_data[id].rows = g.rows();
+  surfaces_data[id].columns = g.columns();
+  unsigned int vertices_count = g.rows() * g.columns() * floats_per_vertex;
 
+  // the cached vertices are of the old size
+  surfaces_data[id].mapped.reset();
+  surfaces_data[id].mapped_vertices = nullptr;
   surfaces_data[id].vertices.resize(vertices_count);
   // surfaces_data[id].ind_size = vertices_count;
 
-  glBindVertexArray(surfaces_data[id].vao);
-  glBindBuffer(GL_ARRAY_BUFFER, surfaces_data[id].vbo);
-  glBufferData(GL_ARRAY_BUFFER, vertices_count * sizeof(float), NULL, GL_STATIC_DRAW);
+  if (canvas_gl) canvas_gl->create_vertex_buffer(surfaces_data[id]);
+}
+
+void WindowSurfaceConfig::set_implicit(bool implicit) {
 
-  // glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+  // an implicit surface brings its own vertices and triangles, a
+  // function or data go back to the grid and its shared ebo
 
-  glBindBuffer(GL_ARRAY_BUFFER, 0);
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+  SurfaceData& surface = surfaces_data[id];
+  if (surface.implicit == implicit) return;
+  surface.implicit = implicit;
+  surface.compacted = false;
+  surface.indices.clear();
+  this->update_buffer_size();
+  this->vector_update_colors();
+  if (!implicit && canvas_gl) {
+    surface.ebo = canvas_gl->grid_ebo(surface.rows, surface.columns, surface.ind_size);
+    glBindVertexArray(surface.vao);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, surface.ebo);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+  }
+}
+
+void WindowSurfaceConfig::set_divisions(float divisions) {
+
+  // changes the resolution of this surface only. the vertices have
+  // to be recalculated afterwards.
+
+  surfaces_data[id].divisions = divisions;
+  this->update_buffer_size();
+  this->vector_update_colors();
+
+  // the evaluation that follows compacts the triangles again
+  surfaces_data[id].compacted = false;
+  if (canvas_gl && !surfaces_data[id].implicit) {
+    surfaces_data[id].ebo = canvas_gl->grid_ebo(surfaces_data[id].rows, surfaces_data[id].columns,
+						surfaces_data[id].ind_size);
+    glBindVertexArray(surfaces_data[id].vao);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, surfaces_data[id].ebo);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+  }
 }
 
 void WindowSurfaceConfig::vector_update_coords() {
 
   // recalculates xyz in vector
 
-  parser p;
-  char* expression = new char[surfaces_data[id].function.size() + 1];
-  std::strcpy(expression, surfaces_data[id].function.c_str());
+  std::vector<std::vector<double>> none;
+  incremental_param = -1;
+  evaluate_grid(surfaces_data[id].prog, {}, none, none);
+}
+
+void WindowSurfaceConfig::vector_update_param(int param) {
 
-  float start = -props.grid_size / 2.0f;
-  int num_vertices_per_axis = props.divisions + 1;
-  double step = props.grid_size / props.divisions;
+  // recalculates xyz after `param` changed. the first call stores the
+  // subexpressions that do not depend on it, the following ones only
+  // run the residual program.
 
-  for (int i = 0; i < num_vertices_per_axis; ++i) {
-    for (int j = 0; j < num_vertices_per_axis; ++j) {
-      float x = start + i * step;
-      float y = start + j * step;
+  this->unmap_vertices();
+  SurfaceData& surface = surfaces_data[id];
 
-      p.set_xy(static_cast<double>(x), static_cast<double>(y));
-      double z = p.eval_expr(expression);
+  // t changes between calls, nothing can be kept
+  if (surface.animated) {
+    this->vector_update_coords();
+    return;
+  }
 
-      int index = (i * num_vertices_per_axis + j) * 6;      
-      surfaces_data[id].vertices[index] = x;
-      surfaces_data[id].vertices[index + 1] = static_cast<float>(z);
-      surfaces_data[id].vertices[index + 2] = y;
-    }
-  }  
+  if (incremental_param != param) {
+    surface.prog.split(param, residual, cut);
+    cut_values.assign(cut.size(), std::vector<double>(surface.vertices.size() / floats_per_vertex));
+    evaluate_grid(surface.prog, cut, cut_values, {});
+    incremental_param = param;
+    return;
+  }
+
+  std::vector<std::vector<double>> none;
+  residual.param_values = surface.prog.param_values;
+  evaluate_grid(residual, {}, none, cut_values);
+}
+
+grid WindowSurfaceConfig::surface_grid() const {
+
+  // the grid the surface is evaluated over. only the heights of a
+  // function are restricted to its domain, data and the other kinds
+  // of surfaces cover the square.
+
+  const SurfaceData& surface = surfaces_data.at(id);
+  grid g;
+  g.size = props.grid_size;
+  g.vertices_per_axis = surface.divisions + 1;
+  g.t = props.time;
+  g.normals = props.lighting;
+  if (surface.source == SOURCE_FUNCTION && !surface.implicit && !surface.prog.parametric() &&
+      !surface.region.empty())
+    g.region = &surface.region;
+  // a domain a new grid size leaves outside is the whole square too,
+  // like one that does not parse
+  std::string error;
+  if (g.region && !domain_fits(*g.region, g.size, error))
+    g.region = nullptr;
+  return g;
+}
+
+void WindowSurfaceConfig::evaluate_grid(const program& prog, const std::vector<int>& stored,
+					std::vector<std::vector<double>>& stores,
+					const std::vector<std::vector<double>>& loads) {
+
+  // the grid itself is generated by the core library, see mesh.hpp
+
+  this->unmap_vertices();
+
+  SurfaceData& surface = surfaces_data[id];
+  // the grid of a point cloud is never drawn, its range is the values
+  if (surface.source == SOURCE_POINTS) {
+    this->update_contours();
+    return;
+  }
+
+  // a new function or domain can change the shape of the grid
+  grid g = this->surface_grid();
+  if (!surface.implicit && (g.rows() != surface.rows || g.columns() != surface.columns))
+    this->set_divisions(surface.divisions);
+
+  // a new grid size moves every tile
+  if (surface.tiles && surface.tiles->grid_size() != g.size)
+    surface.tiles->create(g.size, surface.rgb.data());
+
+  height_range range;
+  if (surface.source == SOURCE_DATA && surface.data)
+    range = sample_height_field(*surface.data, g, surface.vertices);
+  else if (surface.implicit) {
+    // a new mesh every time, the indices are uploaded with it
+    range = extract_implicit(prog, g, surface.vertices, surface.indices);
+    grid_fill_colors(surface.vertices, surface.rgb.data());
+  }
+  else
+    range = ::evaluate_grid(prog, g, surface.vertices, stored, stores, loads);
+  surface.z_min = range.min;
+  surface.z_max = range.max;
+  this->update_range_controls();
+  this->update_indices();
+  this->update_contours();
+}
+
+void WindowSurfaceConfig::update_indices() {
+
+  // leaves the triangles over holes and poles of the grid out, see
+  // grid_compact_indices. the indices are uploaded with the vertices,
+  // a surface without holes goes back to the shared ebo.
+
+  SurfaceData& surface = surfaces_data[id];
+  if (surface.implicit)
+    return;
+
+  grid g = this->surface_grid();
+  const float* vertices = surface.mapped_vertices ? surface.mapped_vertices : surface.vertices.data();
+  size_t count = surface.mapped_vertices ? surface.mapped_count : surface.vertices.size();
+  bool compacted = surface.compacted;
+  surface.compacted = !surface.tiles && surface.source != SOURCE_POINTS &&
+    count >= (size_t)g.rows() * g.columns() * floats_per_vertex &&
+    grid_compact_indices(surface.prog, g, vertices, surface.indices);
+  if (compacted && !surface.compacted && canvas_gl)
+    surface.ebo = canvas_gl->grid_ebo(surface.rows, surface.columns, surface.ind_size);
+}
+
+void WindowSurfaceConfig::update_contours() {
+
+  // the contours of the grid at props.contours levels over the range
+  // of the colormap, see contour.hpp. they are uploaded with the
+  // vertices, drawing them later costs one draw call.
+
+  SurfaceData& surface = surfaces_data[id];
+  bool had_contours = !surface.contours.indices.empty();
+  if (props.contours <= 0 || surface.source == SOURCE_POINTS || surface.implicit || surface.tiles) {
+    surface.contours = contour_lines();
+    surface.contours_changed = had_contours;
+    return;
+  }
+
+  const float* vertices = surface.mapped_vertices ? surface.mapped_vertices : surface.vertices.data();
+  size_t count = surface.mapped_vertices ? surface.mapped_count : surface.vertices.size();
+  if (count < (size_t)surface.rows * surface.columns * floats_per_vertex)
+    return;
+  std::vector<float> levels = surface.range_auto ?
+    contour_levels(surface.z_min, surface.z_max, props.contours) :
+    contour_levels(surface.range_min, surface.range_max, props.contours);
+  extract_contours(vertices, surface.rows, surface.columns, levels, surface.contours);
+  surface.contours_changed = had_contours || !surface.contours.indices.empty();
 }
 
 void WindowSurfaceConfig::vector_update_colors() {
 
   // recalculates rgb in vector
 
-  // only update color values in the vertices data vector. since the
-  // current format is xyzrgb, we need to skip every six indices.
+  this->unmap_vertices();
+  grid_fill_colors(surfaces_data[id].vertices, surfaces_data[id].rgb.data());
+}
+
+void WindowSurfaceConfig::vector_send_to_buffer() {
+  if (canvas_gl) canvas_gl->upload_vertices(surfaces_data[id]);
+}
+
+void WindowSurfaceConfig::unmap_vertices() {
+
+  // copies the vertices of a scene cache out of the mapping, only
+  // done once the surface is changed
+
+  SurfaceData& surface = surfaces_data[id];
+  if (!surface.mapped_vertices) return;
+  surface.vertices.assign(surface.mapped_vertices, surface.mapped_vertices + surface.mapped_count);
+  surface.mapped_vertices = nullptr;
+  surface.mapped.reset();
+}
+
+// ------------------------------------------------------------
+// scene cache
+// ------------------------------------------------------------
+
+void WindowSurfaceConfig::load_cached(const cached_surface& cached, std::shared_ptr<mapped_file> file) {
+
+  // restores the controls without sending their events, then uses the
+  // cached vertices when they match the resolution of the surface
+
+  SurfaceData& surface = surfaces_data[id];
+
+  for (const auto& param : cached.params)
+    param_values[param.first] = param.second;
 
-  for (int i=3; i<surfaces_data[id].vertices.size(); i=i+6) {
-    surfaces_data[id].vertices[i] = surfaces_data[id].rgb[0];
-    surfaces_data[id].vertices[i+1] = surfaces_data[id].rgb[1];
-    surfaces_data[id].vertices[i+2] = surfaces_data[id].rgb[2];
+  surface.function = cached.function;
+  surface.source = SOURCE_FUNCTION;
+  surface.show = cached.show;
+  surface.rgb = {cached.rgb[0], cached.rgb[1], cached.rgb[2]};
+  surface.colormap = std::max(0, std::min(COLORMAP_COUNT - 1, cached.colormap));
+  surface.range_auto = cached.range_auto;
+  surface.range_min = cached.range_min;
+  surface.range_max = cached.range_max;
+  surface.z_min = cached.z_min;
+  surface.z_max = cached.z_max;
+  surface.domain_text = cached.domain;
+  std::string error;
+  parse_domain(surface.domain_text, surface.region, error);
+
+  textctrl_function->ChangeValue(surface.function);
+  textctrl_domain->ChangeValue(surface.domain_text);
+  checkbox_show->SetValue(surface.show);
+  colour_picker->SetColour(wxColour(std::lround(cached.rgb[0] * 255.0f),
+				    std::lround(cached.rgb[1] * 255.0f),
+				    std::lround(cached.rgb[2] * 255.0f)));
+  choice_colormap->SetSelection(surface.colormap);
+  checkbox_range_auto->SetValue(surface.range_auto);
+  textctrl_range_min->Enable(!surface.range_auto);
+  textctrl_range_max->Enable(!surface.range_auto);
+  textctrl_range_min->ChangeValue(wxString::Format(wxT("%.3g"), surface.range_min));
+  textctrl_range_max->ChangeValue(wxString::Format(wxT("%.3g"), surface.range_max));
+
+  if (cached.source == SOURCE_DATA) {
+    // without its file the surface is flat
+    if (!this->open_data(cached.function))
+      surface.prog.clear();
+  } else if (cached.source == SOURCE_POINTS) {
+    if (!this->open_points(cached.function))
+      surface.prog.clear();
+  } else {
+    parser p;
+    p.compile(surface.function.c_str(), surface.prog);
+    surface.animated = surface.prog.uses(OP_T);
+    this->set_implicit(surface.prog.uses(OP_Z));
+    this->update_param_controls();
+  }
+
+  // the shape of the grid follows the function and the domain
+  grid g = this->surface_grid();
+  if (!surface.implicit && (g.rows() != surface.rows || g.columns() != surface.columns))
+    this->set_divisions(surface.divisions);
+
+  if (cached.vertices && cached.rows == surface.rows && cached.columns == surface.columns && !surface.implicit) {
+    surface.mapped = file;
+    surface.mapped_vertices = cached.vertices;
+    surface.mapped_count = cached.vertices_count;
+    // nothing is evaluated, the zeros from update_buffer_size go away
+    std::vector<float>().swap(surface.vertices);
+    this->update_indices();
+    this->update_contours();
+  } else {
+    this->vector_update_colors();
+    this->vector_update_coords();
   }
+  this->vector_send_to_buffer();
 }
 
-void WindowSurfaceConfig::vector_send_to_buffer() {
-  
-  glBindVertexArray(surfaces_data[id].vao);
-  glBindBuffer(GL_ARRAY_BUFFER, surfaces_data[id].vbo);
-  // replace old data
-  glBufferSubData(GL_ARRAY_BUFFER, 0, surfaces_data[id].vertices.size() * sizeof(float), surfaces_data[id].vertices.data());
-  // glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-  glBindBuffer(GL_ARRAY_BUFFER, 0);
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);  
+cached_surface WindowSurfaceConfig::to_cached() const {
+  const SurfaceData& surface = surfaces_data.at(id);
+  cached_surface cached;
+  cached.function = surface.function;
+  cached.source = surface.source;
+  for (int k = 0; k < 3; k++)
+    cached.rgb[k] = surface.rgb[k];
+  cached.show = surface.show;
+  cached.colormap = surface.colormap;
+  cached.range_auto = surface.range_auto;
+  cached.range_min = surface.range_min;
+  cached.range_max = surface.range_max;
+  cached.z_min = surface.z_min;
+  cached.z_max = surface.z_max;
+  for (size_t i = 0; i < surface.prog.params.size(); i++)
+    cached.params.emplace_back(surface.prog.params[i], surface.prog.param_values[i]);
+  cached.domain = surface.domain_text;
+  cached.rows = surface.rows;
+  cached.columns = surface.columns;
+  // the cache holds grids, an implicit surface is extracted again
+  if (surface.implicit)
+    return cached;
+  cached.vertices = surface.mapped_vertices ? surface.mapped_vertices : surface.vertices.data();
+  cached.vertices_count = surface.mapped_vertices ? surface.mapped_count : surface.vertices.size();
+  return cached;
 }
 
 void WindowSurfaceConfig::set_canvas_gl(CanvasGL* canvas_gl) {
@@ -0,0 +1,80 @@
+// regression tests of the height data readers, run by ctest
+
+#include <height_field.hpp>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// ------------------------------------------------------------
+// harness
+// ------------------------------------------------------------
+
+static int failures = 0;
+
+#define CHECK(condition)						\
+  do {									\
+    if (!(condition)) {							\
+      std::fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #condition); \
+      failures++;							\
+    }									\
+  } while (0)
+
+// a version 1 .npy file with `header` and `data_bytes` zero bytes of
+// data after it
+static void write_npy(const char* path, const std::string& header, size_t data_bytes) {
+  std::FILE* file = std::fopen(path, "wb");
+  if (!file)
+    return;
+  unsigned char preamble[10] = {0x93, 'N', 'U', 'M', 'P', 'Y', 1, 0,
+				(unsigned char)(header.size() & 0xff), (unsigned char)(header.size() >> 8)};
+  std::fwrite(preamble, 1, sizeof(preamble), file);
+  std::fwrite(header.data(), 1, header.size(), file);
+  std::vector<char> data(data_bytes);
+  std::fwrite(data.data(), 1, data.size(), file);
+  std::fclose(file);
+}
+
+// ------------------------------------------------------------
+// tests
+// ------------------------------------------------------------
+
+static void test_npy(const char* path) {
+  write_npy(path, "{'descr': '<f4', 'fortran_order': False, 'shape': (3, 4), }\n", 3 * 4 * sizeof(float));
+  height_field field;
+  std::string error;
+  CHECK(height_field_open(path, field, error));
+  CHECK(field.rows == 3 && field.cols == 4 && field.type == HEIGHT_FLOAT32);
+}
+
+static void test_npy_malformed(const char* path) {
+
+  // keys without values or with an unterminated shape are errors, not
+  // crashes
+
+  const char* headers[] = {
+    "{'descr':",
+    "{'descr':   ",
+    "{'descr': '<f4'",
+    "{'descr': '<f4', 'fortran_order':",
+    "{'descr': '<f4', 'fortran_order': False, 'shape':",
+    "{'descr': '<f4', 'fortran_order': False, 'shape': (3, 4",
+  };
+  for (const char* header : headers) {
+    write_npy(path, header, 64);
+    height_field field;
+    std::string error;
+    CHECK(!height_field_open(path, field, error));
+    CHECK(!error.empty());
+  }
+}
+
+int main() {
+  const char* path = "height_field_test.npy";
+  test_npy(path);
+  test_npy_malformed(path);
+  std::remove(path);
+  if (failures)
+    std::fprintf(stderr, "%d checks failed\n", failures);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,131 @@
+// regression tests of the scene cache, run by ctest
+
+#include <scene_cache.hpp>
+#include <mesh.hpp>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// ------------------------------------------------------------
+// harness
+// ------------------------------------------------------------
+
+static int failures = 0;
+
+#define CHECK(condition)						\
+  do {									\
+    if (!(condition)) {							\
+      std::fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #condition); \
+      failures++;							\
+    }									\
+  } while (0)
+
+static cached_surface make_surface(const std::string& function, int rows, int columns,
+				   std::vector<float>& vertices) {
+  vertices.resize((size_t)rows * columns * floats_per_vertex);
+  for (size_t i = 0; i < vertices.size(); i++)
+    vertices[i] = (float)i * 0.25f - 3.0f;
+  cached_surface s;
+  s.function = function;
+  s.params = {{"a", 2.0}};
+  s.rows = rows;
+  s.columns = columns;
+  s.vertices = vertices.data();
+  s.vertices_count = vertices.size();
+  return s;
+}
+
+static bool same_vertices(const cached_surface& s, const std::vector<float>& vertices) {
+  return s.vertices && s.vertices_count == vertices.size() &&
+    std::memcmp(s.vertices, vertices.data(), vertices.size() * sizeof(float)) == 0;
+}
+
+// ------------------------------------------------------------
+// tests
+// ------------------------------------------------------------
+
+static void test_round_trip(const char* path) {
+  Properties props = {};
+  props.grid_size = 12;
+  props.divisions = 40.0f;
+  props.contours = 7;
+  props.contour_map = true;
+  std::vector<float> first, second;
+  std::vector<cached_surface> surfaces = {make_surface("a*sin(x)", 41, 41, first),
+					  make_surface("x*y", 20, 41, second)};
+  CHECK(scene_cache_write(path, props, surfaces));
+
+  scene_cache cache;
+  CHECK(scene_cache_read(path, cache));
+  CHECK(cache.props.grid_size == 12);
+  CHECK(cache.props.contours == 7);
+  CHECK(cache.props.contour_map);
+  CHECK(cache.surfaces.size() == 2);
+  if (cache.surfaces.size() != 2)
+    return;
+  CHECK(cache.surfaces[0].function == "a*sin(x)");
+  CHECK(cache.surfaces[0].params.size() == 1 && cache.surfaces[0].params[0].second == 2.0);
+  CHECK(same_vertices(cache.surfaces[0], first));
+  CHECK(same_vertices(cache.surfaces[1], second));
+}
+
+static void test_save_over_open(const char* path) {
+
+  // the gui saves the vertices of a scene it opened straight from the
+  // mapping of that file. writing must not truncate the mapped pages.
+
+  Properties props = {};
+  std::vector<float> vertices;
+  std::vector<cached_surface> surfaces = {make_surface("x^2", 64, 64, vertices)};
+  CHECK(scene_cache_write(path, props, surfaces));
+
+  scene_cache opened;
+  CHECK(scene_cache_read(path, opened));
+  CHECK(opened.surfaces.size() == 1 && same_vertices(opened.surfaces[0], vertices));
+  if (opened.surfaces.size() != 1 || !opened.surfaces[0].vertices)
+    return;
+  CHECK(scene_cache_write(path, opened.props, opened.surfaces));
+  // still readable after the file was replaced
+  CHECK(same_vertices(opened.surfaces[0], vertices));
+
+  scene_cache reopened;
+  CHECK(scene_cache_read(path, reopened));
+  CHECK(reopened.surfaces.size() == 1 && same_vertices(reopened.surfaces[0], vertices));
+}
+
+static void test_damaged_block(const char* path) {
+
+  // a vertex block that does not match its checksum is dropped, the
+  // rest of the scene still opens
+
+  Properties props = {};
+  std::vector<float> vertices;
+  std::vector<cached_surface> surfaces = {make_surface("x", 16, 16, vertices)};
+  CHECK(scene_cache_write(path, props, surfaces));
+
+  FILE* file = std::fopen(path, "r+b");
+  CHECK(file);
+  if (!file)
+    return;
+  std::fseek(file, 4096 + 1000, SEEK_SET);
+  int byte = std::fgetc(file);
+  std::fseek(file, 4096 + 1000, SEEK_SET);
+  std::fputc(byte ^ 0x40, file);
+  std::fclose(file);
+
+  scene_cache cache;
+  CHECK(scene_cache_read(path, cache));
+  CHECK(cache.surfaces.size() == 1 && !cache.surfaces[0].vertices);
+}
+
+int main() {
+  const char* path = "scene_cache_test.p3d";
+  test_round_trip(path);
+  test_save_over_open(path);
+  test_damaged_block(path);
+  std::remove(path);
+  if (failures)
+    std::fprintf(stderr, "%d checks failed\n", failures);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,345 @@
+// batch evaluation and export of surfaces without the gui
+//
+//   plotter3d-cli -e "sin(x)*cos(y)" -s 10 -d 2000 -o surface.stl
+//   plotter3d-cli --jobs jobs.txt
+//   plotter3d-cli --tiles heights.npy
+//
+// every line of a job list is `output grid_size divisions expression`,
+// the expression being the rest of the line. empty lines and lines
+// starting with # are skipped. jobs run one after another and each of
+// them uses every core.
+//
+// --domain restricts every height field to a rectangle and a mask,
+// see domain.hpp. vertices outside the mask are not evaluated and
+// their triangles are not written.
+//
+// --tiles builds the tile pyramid the gui draws large height data
+// from, next to the data file, so opening it later does not wait.
+//
+// --trace saves the time every stage of every job took (parse, bound,
+// evaluate, write) for chrome://tracing or Perfetto, see trace.hpp.
+
+#include <parser.hpp>
+#include <program.hpp>
+#include <mesh.hpp>
+#include <domain.hpp>
+#include <export.hpp>
+#include <height_field.hpp>
+#include <tile_pyramid.hpp>
+#include <trace.hpp>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+struct job {
+  std::string output;
+  int grid_size = 10;
+  int divisions = 100;
+  std::string expression;
+};
+
+// ------------------------------------------------------------
+// output
+// ------------------------------------------------------------
+
+// the format follows the extension of the output (.stl, .ply, .obj,
+// anything else is raw float32 heights) unless --format is given.
+// export_grid streams the grid in bands of rows, so the memory used
+// does not depend on the size of the grid. `points` is the number of
+// points the job evaluated, a cube of them for an implicit surface.
+
+static bool run_job(const job& j, const std::map<std::string, double>& params, double t, int format,
+		    const domain& region, double& points) {
+
+  trace_scope scope("job");
+  program prog;
+  bool compiled;
+  {
+    trace_scope parse("parse");
+    compiled = parser().compile(j.expression.c_str(), prog);
+  }
+  if (!compiled) {
+    std::fprintf(stderr, "%s: cannot compile \"%s\"\n", j.output.c_str(), j.expression.c_str());
+    return false;
+  }
+  for (size_t i = 0; i < prog.params.size(); i++) {
+    auto it = params.find(prog.params[i]);
+    if (it != params.end())
+      prog.param_values[i] = it->second;
+  }
+
+  using clock = std::chrono::steady_clock;
+  auto begin = clock::now();
+
+  grid g;
+  g.size = j.grid_size;
+  g.vertices_per_axis = j.divisions + 1;
+  g.t = t;
+  if (!region.empty() && !prog.parametric() && !prog.uses(OP_Z))
+    g.region = &region;
+  std::string error;
+  if (g.region && !domain_fits(region, g.size, error)) {
+    std::fprintf(stderr, "%s: %s\n", j.output.c_str(), error.c_str());
+    return false;
+  }
+
+  // divisions by zero and the like, found by interval arithmetic.
+  // their vertices are not finite and are left out.
+  bool singular;
+  {
+    trace_scope bound("bound");
+    singular = bound_grid(prog, g).singular;
+  }
+  if (singular)
+    std::fprintf(stderr, "%s: \"%s\" is not defined everywhere in the grid\n",
+		 j.output.c_str(), j.expression.c_str());
+
+  if (format < 0)
+    format = export_format_from_path(j.output);
+  export_stats stats;
+  if (!export_grid(prog, g, format, j.output.c_str(), &stats)) {
+    std::fprintf(stderr, "%s: write failed\n", j.output.c_str());
+    return false;
+  }
+
+  double seconds = std::chrono::duration<double>(clock::now() - begin).count();
+  // an implicit surface samples a cube
+  int dimensions = prog.uses(OP_Z) ? 3 : 2;
+  points = dimensions == 3 ? std::pow((double)g.vertices_per_axis, 3) : (double)g.rows() * g.columns();
+  std::printf("%-24s %s %6d^%d %10.3f s %14.0f points/s %12llu triangles %10.1f MB/s\n",
+	      j.output.c_str(), export_format_names[format], g.vertices_per_axis, dimensions, seconds,
+	      points / seconds, stats.triangles, stats.bytes / seconds / 1e6);
+  return true;
+}
+
+// ------------------------------------------------------------
+// tile pyramids
+// ------------------------------------------------------------
+
+static bool build_tiles(const std::string& path, int tile_size) {
+  height_field field;
+  std::string error;
+  if (!height_field_open(path.c_str(), field, error)) {
+    std::fprintf(stderr, "%s: %s\n", path.c_str(), error.c_str());
+    return false;
+  }
+  if (!field.warning.empty())
+    std::fprintf(stderr, "%s: %s\n", path.c_str(), field.warning.c_str());
+
+  using clock = std::chrono::steady_clock;
+  auto begin = clock::now();
+  std::string output = path + ".p3dt";
+  if (!tile_pyramid_build(field, output.c_str(), tile_size, tile_source_stamp(path.c_str()), error)) {
+    std::fprintf(stderr, "%s: %s\n", output.c_str(), error.c_str());
+    return false;
+  }
+  double seconds = std::chrono::duration<double>(clock::now() - begin).count();
+
+  std::vector<tile_level> levels;
+  tile_pyramid_levels(field.rows, field.cols, tile_size, levels);
+  double values = (double)field.rows * field.cols;
+  std::printf("%-24s %6dx%-6d %2zu levels %8zu tiles %10.3f s %14.0f values/s\n",
+	      output.c_str(), field.rows, field.cols, levels.size(), levels.back().first + 1,
+	      seconds, values / seconds);
+  return true;
+}
+
+// ------------------------------------------------------------
+// job list
+// ------------------------------------------------------------
+
+static bool read_jobs(const char* path, std::vector<job>& jobs) {
+  std::ifstream in(path);
+  if (!in) {
+    std::fprintf(stderr, "cannot read %s\n", path);
+    return false;
+  }
+  std::string line;
+  int number = 0;
+  while (std::getline(in, line)) {
+    number++;
+    size_t first = line.find_first_not_of(" \t\r");
+    if (first == std::string::npos || line[first] == '#')
+      continue;
+    std::istringstream fields(line);
+    job j;
+    if (!(fields >> j.output >> j.grid_size >> j.divisions) || j.grid_size < 1 || j.divisions < 1) {
+      std::fprintf(stderr, "%s:%d: expected `output grid_size divisions expression`\n", path, number);
+      return false;
+    }
+    std::getline(fields, j.expression);
+    size_t begin = j.expression.find_first_not_of(" \t");
+    size_t end = j.expression.find_last_not_of(" \t\r");
+    if (begin == std::string::npos) {
+      std::fprintf(stderr, "%s:%d: missing expression\n", path, number);
+      return false;
+    }
+    j.expression = j.expression.substr(begin, end - begin + 1);
+    jobs.push_back(j);
+  }
+  return true;
+}
+
+// the whole of `text` as a number: a count above 0, or any finite
+// value
+
+static bool parse_count(const char* text, int& value) {
+  char* end;
+  errno = 0;
+  long parsed = std::strtol(text, &end, 10);
+  if (end == text || *end || errno == ERANGE || parsed < 1 || parsed > INT_MAX)
+    return false;
+  value = (int)parsed;
+  return true;
+}
+
+static bool parse_value(const char* text, double& value) {
+  char* end;
+  double parsed = std::strtod(text, &end);
+  if (end == text || *end || !std::isfinite(parsed))
+    return false;
+  value = parsed;
+  return true;
+}
+
+static void usage(const char* name) {
+  std::fprintf(stderr,
+	       "usage: %s [options]\n"
+	       "  -e, --expression f   function of x and y, or F(x, y, z) of an implicit surface\n"
+	       "  -s, --size n         grid size (default 10)\n"
+	       "  -d, --divisions n    divisions per axis (default 100)\n"
+	       "  -o, --output file    output file\n"
+	       "  -f, --format name    stl, ply, obj or raw (default: from the extension)\n"
+	       "  --jobs file          job list, one `output grid_size divisions expression` per line\n"
+	       "  --set name=value     value of a parameter, for every job (default 1)\n"
+	       "  -t value             value of t (default 0)\n"
+	       "  --domain text        region of every height field, e.g. \"0 < x < 4, x^2 + y^2 < 9\"\n"
+	       "  --tiles file         build the tile pyramid of height data (.npy, .csv, raw float32)\n"
+	       "  --tile-size n        quads along a tile (default 256)\n"
+	       "  --trace file         save the time of every stage as a chrome trace (.json)\n",
+	       name);
+}
+
+int main(int argc, char** argv) {
+
+  std::vector<job> jobs;
+  std::map<std::string, double> params;
+  double t = 0.0;
+  int format = -1;
+  job single;
+  std::vector<std::string> tiles;
+  int tile_size = 256;
+  domain region;
+  const char* trace = nullptr;
+
+  for (int i = 1; i < argc; i++) {
+    const char* arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if ((!std::strcmp(arg, "-e") || !std::strcmp(arg, "--expression")) && has_value)
+      single.expression = argv[++i];
+    else if ((!std::strcmp(arg, "-s") || !std::strcmp(arg, "--size")) && has_value) {
+      if (!parse_count(argv[++i], single.grid_size)) {
+	usage(argv[0]);
+	return 1;
+      }
+    } else if ((!std::strcmp(arg, "-d") || !std::strcmp(arg, "--divisions")) && has_value) {
+      if (!parse_count(argv[++i], single.divisions)) {
+	usage(argv[0]);
+	return 1;
+      }
+    } else if ((!std::strcmp(arg, "-o") || !std::strcmp(arg, "--output")) && has_value)
+      single.output = argv[++i];
+    else if ((!std::strcmp(arg, "-f") || !std::strcmp(arg, "--format")) && has_value) {
+      format = export_format_from_name(argv[++i]);
+      if (format < 0) {
+	usage(argv[0]);
+	return 1;
+      }
+    } else if (!std::strcmp(arg, "-t") && has_value) {
+      if (!parse_value(argv[++i], t)) {
+	usage(argv[0]);
+	return 1;
+      }
+    } else if (!std::strcmp(arg, "--domain") && has_value) {
+      std::string error;
+      if (!parse_domain(argv[++i], region, error)) {
+	std::fprintf(stderr, "--domain: %s\n", error.c_str());
+	return 1;
+      }
+    } else if (!std::strcmp(arg, "--tiles") && has_value)
+      tiles.push_back(argv[++i]);
+    else if (!std::strcmp(arg, "--trace") && has_value) {
+      trace = argv[++i];
+      trace_record(true);
+    } else if (!std::strcmp(arg, "--tile-size") && has_value) {
+      if (!parse_count(argv[++i], tile_size)) {
+	usage(argv[0]);
+	return 1;
+      }
+    } else if (!std::strcmp(arg, "--jobs") && has_value) {
+      if (!read_jobs(argv[++i], jobs))
+	return 1;
+    } else if (!std::strcmp(arg, "--set") && has_value) {
+      std::string assignment = argv[++i];
+      size_t equal = assignment.find('=');
+      double value;
+      if (equal == std::string::npos || !parse_value(assignment.c_str() + equal + 1, value)) {
+	usage(argv[0]);
+	return 1;
+      }
+      params[assignment.substr(0, equal)] = value;
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (!single.expression.empty()) {
+    if (single.output.empty()) {
+      std::fprintf(stderr, "missing --output\n");
+      return 1;
+    }
+    jobs.push_back(single);
+  }
+  if (jobs.empty() && tiles.empty()) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  int failed = 0;
+  for (const std::string& path : tiles)
+    if (!build_tiles(path, tile_size))
+      failed++;
+  if (jobs.empty())
+    return failed ? 1 : 0;
+
+  using clock = std::chrono::steady_clock;
+  auto begin = clock::now();
+  double points = 0.0;
+  for (const job& j : jobs) {
+    double job_points = 0.0;
+    if (run_job(j, params, t, format, region, job_points))
+      points += job_points;
+    else
+      failed++;
+  }
+  double seconds = std::chrono::duration<double>(clock::now() - begin).count();
+  std::printf("%zu jobs, %d failed, %.3f s, %.0f points/s\n", jobs.size(), failed, seconds, points / seconds);
+
+  std::string error;
+  if (trace && !trace_write(trace, error)) {
+    std::fprintf(stderr, "%s: %s\n", trace, error.c_str());
+    return 1;
+  }
+
+  return failed ? 1 : 0;
+}